@@ -8,34 +8,70 @@
 #include <vector>
 #include <cstdint>
 #include <fstream>
+#include <filesystem>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 #include "svo.h"
-#include "vss_prop.h"
+#include "svo_compact.h"
+#include "svo_dag.h"
+#include "vss_metrics.h"
 
-#define BSVO_VERSION 3
+#define BSVO_VERSION 6
+
+// 8 byte SvoNode, all 8 children of a parent are stored
+#define BSVO_NODES_CLASSIC 0
+// 4 byte SvoCompactNode, level offset table followed by existing children only
+#define BSVO_NODES_COMPACT 1
+// SvoNode layout like classic, child blocks may be shared between parents
+#define BSVO_NODES_DAG 2
 
 struct BsvoHeader {
     alignas(4) uint8_t version;
     alignas(4) uint8_t max_depth;
     alignas(4) uint32_t root_res;
     alignas(1) bool run_length_encoded;
+    alignas(1) uint8_t node_format;
+    alignas(1) bool lod;
+    // VOXEL_FORMAT_* of the leaf data, leaves hold VoxelTraits<T>::to_data of their voxel
+    alignas(1) uint8_t voxel_format;
 };
 
+static int check_bsvo_version(const BsvoHeader &header) {
+    if (header.version > BSVO_VERSION) {
+        VSS_EVENT("file version: " << static_cast<int>(header.version) << ", reader version: " << BSVO_VERSION);
+        throw std::runtime_error("newer bsvo reader version required for file.");
+    }
+    if (header.version < BSVO_VERSION) {
+        VSS_EVENT("file version: " << static_cast<int>(header.version) << ", reader version: " << BSVO_VERSION);
+        throw std::runtime_error("file version is outdated, use older bsvo reader.");
+    }
+
+    return EXIT_SUCCESS;
+}
+
 static int write_empty_bsvo(const std::string &filename, BsvoHeader header) {
     header.version = BSVO_VERSION;
 
-#ifdef DEBUG
-    std::cout << "writing empty bsvo file: " << filename
+    VSS_EVENT("writing empty bsvo file: " << filename
               << " | version: " << static_cast<int>(header.version) << " | max depth: "
               << static_cast<int>(header.max_depth) << " | root res: " << header.root_res << " | rle: "
-              << static_cast<int>(header.run_length_encoded) << std::endl;
-#endif
+              << static_cast<int>(header.run_length_encoded) << " | node format: "
+              << static_cast<int>(header.node_format) << " | lod: " << static_cast<int>(header.lod));
+
+    VSS_SPAN(SPAN_FILE_WRITE);
 
     std::ofstream ofs(filename, std::ios::out | std::ios::binary);
     if (!ofs.is_open())
         throw std::runtime_error("failed to open file.");
 
     ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    VSS_COUNT(METRIC_BYTES_WRITTEN, ofs.tellp());
 
     ofs.close();
     if (ofs.fail())
@@ -46,13 +82,16 @@ static int write_empty_bsvo(const std::string &filename, BsvoHeader header) {
 
 static int write_bsvo(const std::string &filename, const Svo &svo, BsvoHeader header) {
     header.version = BSVO_VERSION;
+    header.node_format = BSVO_NODES_CLASSIC;
+    header.lod = svo.lod_mats.size() == svo.nodes.size() && !svo.nodes.empty();
 
-#ifdef DEBUG
-    std::cout << "writing bsvo file: " << filename
+    VSS_EVENT("writing bsvo file: " << filename
               << " | version: " << static_cast<int>(header.version) << " | max depth: "
               << static_cast<int>(header.max_depth) << " | root res: " << header.root_res << " | rle: "
-              << static_cast<int>(header.run_length_encoded) << std::endl;
-#endif
+              << static_cast<int>(header.run_length_encoded) << " | node format: "
+              << static_cast<int>(header.node_format) << " | lod: " << static_cast<int>(header.lod));
+
+    VSS_SPAN(SPAN_FILE_WRITE);
 
     std::ofstream ofs(filename, std::ios::out | std::ios::binary);
     if (!ofs.is_open())
@@ -60,6 +99,75 @@ static int write_bsvo(const std::string &filename, const Svo &svo, BsvoHeader he
 
     ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
     ofs.write(reinterpret_cast<const char *>(svo.nodes.data()), sizeof(SvoNode) * svo.nodes.size());
+    if (header.lod)
+        ofs.write(reinterpret_cast<const char *>(svo.lod_mats.data()), sizeof(uint32_t) * svo.lod_mats.size());
+    VSS_COUNT(METRIC_BYTES_WRITTEN, ofs.tellp());
+
+    ofs.close();
+    if (ofs.fail())
+        throw std::runtime_error("failed to write to file.");
+
+    return EXIT_SUCCESS;
+}
+
+static int write_bsvo(const std::string &filename, const SvoDag &dag, BsvoHeader header) {
+    header.version = BSVO_VERSION;
+    header.node_format = BSVO_NODES_DAG;
+    header.lod = false;
+    header.max_depth = dag.max_depth;
+    header.root_res = dag.root_res;
+
+    VSS_EVENT("writing dag bsvo file: " << filename
+              << " | version: " << static_cast<int>(header.version) << " | max depth: "
+              << static_cast<int>(header.max_depth) << " | root res: " << header.root_res << " | rle: "
+              << static_cast<int>(header.run_length_encoded) << " | node format: "
+              << static_cast<int>(header.node_format) << " | lod: " << static_cast<int>(header.lod));
+
+    VSS_SPAN(SPAN_FILE_WRITE);
+
+    std::ofstream ofs(filename, std::ios::out | std::ios::binary);
+    if (!ofs.is_open())
+        throw std::runtime_error("failed to open file.");
+
+    ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    ofs.write(reinterpret_cast<const char *>(dag.nodes.data()), sizeof(SvoNode) * dag.nodes.size());
+    VSS_COUNT(METRIC_BYTES_WRITTEN, ofs.tellp());
+
+    ofs.close();
+    if (ofs.fail())
+        throw std::runtime_error("failed to write to file.");
+
+    return EXIT_SUCCESS;
+}
+
+// the level table and tree shape of a compact file are taken from the header
+static int write_bsvo(const std::string &filename, const SvoCompact &svo, BsvoHeader header) {
+    header.version = BSVO_VERSION;
+    header.node_format = BSVO_NODES_COMPACT;
+    header.lod = false;
+    header.max_depth = svo.max_depth;
+    header.root_res = svo.root_res;
+
+    VSS_EVENT("writing compact bsvo file: " << filename
+              << " | version: " << static_cast<int>(header.version) << " | max depth: "
+              << static_cast<int>(header.max_depth) << " | root res: " << header.root_res << " | rle: "
+              << static_cast<int>(header.run_length_encoded) << " | node format: "
+              << static_cast<int>(header.node_format) << " | lod: " << static_cast<int>(header.lod));
+
+    check_compact_voxel_format(header.voxel_format);
+    if (svo.level_offsets.size() != static_cast<size_t>(svo.max_depth) + 1)
+        throw std::runtime_error("level offsets do not match max depth.");
+
+    VSS_SPAN(SPAN_FILE_WRITE);
+
+    std::ofstream ofs(filename, std::ios::out | std::ios::binary);
+    if (!ofs.is_open())
+        throw std::runtime_error("failed to open file.");
+
+    ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    ofs.write(reinterpret_cast<const char *>(svo.level_offsets.data()), sizeof(uint32_t) * svo.level_offsets.size());
+    ofs.write(reinterpret_cast<const char *>(svo.nodes.data()), sizeof(SvoCompactNode) * svo.nodes.size());
+    VSS_COUNT(METRIC_BYTES_WRITTEN, ofs.tellp());
 
     ofs.close();
     if (ofs.fail())
@@ -68,48 +176,448 @@ static int write_bsvo(const std::string &filename, const Svo &svo, BsvoHeader he
     return EXIT_SUCCESS;
 }
 
+static int read_bsvo_header(std::istream &is, const std::string &filename, BsvoHeader *p_header) {
+    BsvoHeader header{};
+    if (!is.read(reinterpret_cast<char *>(&header), sizeof(header)))
+        throw std::runtime_error("file is too small for bsvo header.");
+    VSS_COUNT(METRIC_BYTES_READ, sizeof(header));
+
+    VSS_EVENT("reading bsvo file: " << filename
+              << " | version: " << static_cast<int>(header.version) << " | max depth: "
+              << static_cast<int>(header.max_depth) << " | root res: " << header.root_res << " | rle: "
+              << static_cast<int>(header.run_length_encoded) << " | node format: "
+              << static_cast<int>(header.node_format) << " | lod: " << static_cast<int>(header.lod));
+
+    check_bsvo_version(header);
+
+    if (header.node_format > BSVO_NODES_DAG)
+        throw std::runtime_error("unknown bsvo node format.");
+
+    if (p_header)
+        *p_header = header;
+
+    return EXIT_SUCCESS;
+}
+
+// read the rest of the file into a node array with a single read
+template<typename Node>
+static std::vector<Node> read_bsvo_nodes(std::istream &is, const size_t payload_size) {
+    std::vector<Node> nodes(payload_size / sizeof(Node));
+    is.read(reinterpret_cast<char *>(nodes.data()), static_cast<std::streamsize>(sizeof(Node) * nodes.size()));
+    if (!is)
+        throw std::runtime_error("failed to read nodes from file.");
+    VSS_COUNT(METRIC_BYTES_READ, sizeof(Node) * nodes.size());
+
+    return nodes;
+}
+
+// bytes of svo nodes in a classic payload, the lod materials follow the nodes
+static size_t bsvo_node_bytes(const BsvoHeader &header, const size_t payload_size) {
+    if (!header.lod)
+        return payload_size;
+
+    return payload_size / (sizeof(SvoNode) + sizeof(uint32_t)) * sizeof(SvoNode);
+}
+
+static SvoCompact read_bsvo_compact_payload(std::istream &is, const BsvoHeader &header, size_t payload_size) {
+    SvoCompact svo;
+    svo.max_depth = header.max_depth;
+    svo.root_res = header.root_res;
+
+    const size_t table_size = sizeof(uint32_t) * (static_cast<size_t>(header.max_depth) + 1);
+    if (payload_size < table_size)
+        throw std::runtime_error("file is too small for level offsets.");
+
+    svo.level_offsets.resize(header.max_depth + 1);
+    if (!is.read(reinterpret_cast<char *>(svo.level_offsets.data()), static_cast<std::streamsize>(table_size)))
+        throw std::runtime_error("failed to read level offsets from file.");
+    VSS_COUNT(METRIC_BYTES_READ, table_size);
+
+    svo.nodes = read_bsvo_nodes<SvoCompactNode>(is, payload_size - table_size);
+
+    return svo;
+}
+
+// compact and dag files are expanded to the classic layout
 static int read_bsvo(const std::string &filename, Svo *p_svo, BsvoHeader *p_header) {
+    VSS_SPAN(SPAN_FILE_READ);
+
     std::ifstream ifs(filename, std::ios::binary);
     if (!ifs.is_open())
         throw std::runtime_error("failed to open file.");
 
     BsvoHeader header{};
-    ifs.read(reinterpret_cast<char *>(&header), sizeof(header));
+    read_bsvo_header(ifs, filename, &header);
 
-#ifdef DEBUG
-    std::cout << "reading bsvo file: " << filename
-              << " | version: " << static_cast<int>(header.version) << " | max depth: "
-              << static_cast<int>(header.max_depth) << " | root res: " << header.root_res << " | rle: "
-              << static_cast<int>(header.run_length_encoded) << std::endl;
-#endif
+    const size_t payload_size = std::filesystem::file_size(filename) - sizeof(BsvoHeader);
 
-    if (header.version > BSVO_VERSION) {
-        std::cout << "file version: " << header.version << ", reader version: " << BSVO_VERSION << std::endl;
-        throw std::runtime_error("newer bsvo reader version required for file.");
+    Svo svo;
+    if (header.node_format == BSVO_NODES_COMPACT) {
+        svo = expand_svo(read_bsvo_compact_payload(ifs, header, payload_size));
+    } else if (header.node_format == BSVO_NODES_DAG) {
+        svo = expand_dag(read_bsvo_nodes<SvoNode>(ifs, payload_size), header.root_res, header.max_depth);
+    } else {
+        svo.nodes = read_bsvo_nodes<SvoNode>(ifs, bsvo_node_bytes(header, payload_size));
+        svo.max_depth = header.max_depth;
+        svo.root_res = header.root_res;
+
+        if (header.lod)
+            svo.lod_mats = read_bsvo_nodes<uint32_t>(ifs, sizeof(uint32_t) * svo.nodes.size());
     }
-    if (header.version < BSVO_VERSION) {
-        std::cout << "file version: " << header.version << ", reader version: " << BSVO_VERSION << std::endl;
-        throw std::runtime_error("file version is outdated, use older bsvo reader.");
+
+    ifs.close();
+
+    if (p_svo)
+        *p_svo = std::move(svo);
+
+    if (p_header)
+        *p_header = header;
+
+    return EXIT_SUCCESS;
+}
+
+// classic files are converted to the compact layout
+static int read_bsvo(const std::string &filename, SvoCompact *p_svo, BsvoHeader *p_header) {
+    VSS_SPAN(SPAN_FILE_READ);
+
+    std::ifstream ifs(filename, std::ios::binary);
+    if (!ifs.is_open())
+        throw std::runtime_error("failed to open file.");
+
+    BsvoHeader header{};
+    read_bsvo_header(ifs, filename, &header);
+    check_compact_voxel_format(header.voxel_format);
+
+    const size_t payload_size = std::filesystem::file_size(filename) - sizeof(BsvoHeader);
+
+    SvoCompact svo;
+    if (header.node_format == BSVO_NODES_COMPACT) {
+        svo = read_bsvo_compact_payload(ifs, header, payload_size);
+    } else if (header.node_format == BSVO_NODES_DAG) {
+        svo = compact_svo(expand_dag(read_bsvo_nodes<SvoNode>(ifs, payload_size), header.root_res, header.max_depth));
+    } else {
+        Svo classic;
+        classic.nodes = read_bsvo_nodes<SvoNode>(ifs, bsvo_node_bytes(header, payload_size));
+        classic.max_depth = header.max_depth;
+        classic.root_res = header.root_res;
+        svo = compact_svo(classic);
     }
 
-    // read rest of file into nodes array of svo
-    std::vector<SvoNode> nodes;
-    SvoNode node;
-    while (ifs.read(reinterpret_cast<char *>(&node), sizeof(SvoNode)))
-        nodes.push_back(node);
+    ifs.close();
+
+    if (p_svo)
+        *p_svo = std::move(svo);
+
+    if (p_header)
+        *p_header = header;
+
+    return EXIT_SUCCESS;
+}
+
+// tree files are reduced on load
+static int read_bsvo(const std::string &filename, SvoDag *p_dag, BsvoHeader *p_header) {
+    VSS_SPAN(SPAN_FILE_READ);
+
+    std::ifstream ifs(filename, std::ios::binary);
+    if (!ifs.is_open())
+        throw std::runtime_error("failed to open file.");
+
+    BsvoHeader header{};
+    read_bsvo_header(ifs, filename, &header);
+
+    const size_t payload_size = std::filesystem::file_size(filename) - sizeof(BsvoHeader);
+
+    SvoDag dag;
+    if (header.node_format == BSVO_NODES_DAG) {
+        dag.nodes = read_bsvo_nodes<SvoNode>(ifs, payload_size);
+        dag.max_depth = header.max_depth;
+        dag.root_res = header.root_res;
+    } else if (header.node_format == BSVO_NODES_COMPACT) {
+        dag.reduce(expand_svo(read_bsvo_compact_payload(ifs, header, payload_size)));
+    } else {
+        Svo classic;
+        classic.nodes = read_bsvo_nodes<SvoNode>(ifs, bsvo_node_bytes(header, payload_size));
+        classic.max_depth = header.max_depth;
+        classic.root_res = header.root_res;
+        dag.reduce(classic);
+    }
 
     ifs.close();
 
-    if (p_svo) {
-        p_svo->nodes = std::move(nodes);
-        p_svo->max_depth = header.max_depth;
-        p_svo->root_res = header.root_res;
+    if (p_dag)
+        *p_dag = std::move(dag);
+
+    if (p_header)
+        *p_header = header;
+
+    return EXIT_SUCCESS;
+}
+
+// read only the first level_count levels of a breadth first classic file written with lod, parents on the last
+// level become leaves holding their lod material. coarse levels form a prefix of the node array, so only
+// that prefix and the matching lod materials are read.
+static int read_bsvo_levels(const std::string &filename, const uint8_t level_count, Svo *p_svo,
+                            BsvoHeader *p_header) {
+    if (level_count == 0)
+        throw std::runtime_error("at least one bsvo level has to be read.");
+
+    VSS_SPAN(SPAN_FILE_READ);
+
+    std::ifstream ifs(filename, std::ios::binary);
+    if (!ifs.is_open())
+        throw std::runtime_error("failed to open file.");
+
+    BsvoHeader header{};
+    read_bsvo_header(ifs, filename, &header);
+
+    if (header.node_format != BSVO_NODES_CLASSIC)
+        throw std::runtime_error("partial bsvo loading requires classic nodes.");
+    if (!header.lod)
+        throw std::runtime_error("partial bsvo loading requires lod materials.");
+
+    const size_t payload_size = std::filesystem::file_size(filename) - sizeof(BsvoHeader);
+    const size_t node_count = bsvo_node_bytes(header, payload_size) / sizeof(SvoNode);
+
+    Svo svo;
+    svo.root_res = header.root_res;
+    svo.max_depth = std::min(static_cast<uint8_t>(level_count - 1), header.max_depth);
+
+    // every level starts right after the previous one and holds the child blocks of its parents in order
+    std::vector<size_t> level_starts;
+    size_t level_start = 0;
+    size_t level_size = std::min<size_t>(1, node_count);
+    for (uint8_t depth = 0; level_size > 0; depth++) {
+        level_starts.push_back(level_start);
+        if (level_start + level_size > node_count)
+            throw std::runtime_error("bsvo levels exceed the node array.");
+
+        svo.nodes.resize(level_start + level_size);
+        if (!ifs.read(reinterpret_cast<char *>(svo.nodes.data() + level_start),
+                      static_cast<std::streamsize>(sizeof(SvoNode) * level_size)))
+            throw std::runtime_error("failed to read nodes from file.");
+        VSS_COUNT(METRIC_BYTES_READ, sizeof(SvoNode) * level_size);
+
+        if (depth == svo.max_depth)
+            break;
+
+        size_t next_size = 0;
+        for (size_t i = level_start; i < level_start + level_size; i++) {
+            if (!svo.nodes[i].is_parent())
+                continue;
+
+            if (svo.nodes[i].data != level_start + level_size + next_size)
+                throw std::runtime_error("bsvo nodes are not in breadth first order.");
+            next_size += CHILD_COUNT;
+        }
+
+        level_start += level_size;
+        level_size = next_size;
     }
 
+    ifs.seekg(static_cast<std::streamoff>(sizeof(BsvoHeader) + sizeof(SvoNode) * node_count));
+    svo.lod_mats = read_bsvo_nodes<uint32_t>(ifs, sizeof(uint32_t) * svo.nodes.size());
+
+    for (size_t i = level_start; i < svo.nodes.size(); i++) {
+        if (svo.nodes[i].is_parent())
+            svo.nodes[i] = SvoNode{svo.lod_mats[i], 0};
+    }
+
+    // parents collapsed to an empty lod material are dropped from their parent like any empty child, a parent
+    // left without children becomes empty itself
+    for (size_t level = level_starts.size(); level > 1; level--) {
+        for (size_t i = level_starts[level - 2]; i < level_starts[level - 1]; i++) {
+            SvoNode &parent = svo.nodes[i];
+            if (!parent.is_parent())
+                continue;
+
+            for (uint8_t c = 0; c < CHILD_COUNT; c++) {
+                const SvoNode &child = svo.nodes[parent.data + c];
+                if (parent.exists_child(c) && child.is_leaf() && child.data == 0)
+                    parent.reset_child(c);
+            }
+            if (!parent.is_parent())
+                parent = SvoNode{0, 0};
+        }
+    }
+
+    ifs.close();
+
+    VSS_EVENT("read " << svo.nodes.size() << " of " << node_count << " bsvo nodes for "
+              << static_cast<int>(svo.max_depth) + 1 << " levels");
+
+    if (p_svo)
+        *p_svo = std::move(svo);
+
     if (p_header)
         *p_header = header;
 
     return EXIT_SUCCESS;
 }
 
+//
+// memory mapped reading
+//
+
+// read only view of a classic or dag bsvo file, nodes are used in place and paged in lazily by the os
+class SvoView {
+public:
+    BsvoHeader header{};
+    const SvoNode *nodes = nullptr;
+    size_t node_count = 0;
+    // lod material of every node, only set for files written with lod
+    const uint32_t *lod_mats = nullptr;
+
+    SvoView() {
+    }
+
+    explicit SvoView(const std::string &filename) {
+        open(filename);
+    }
+
+    SvoView(const SvoView &) = delete;
+
+    SvoView &operator=(const SvoView &) = delete;
+
+    SvoView(SvoView &&other) noexcept {
+        *this = std::move(other);
+    }
+
+    SvoView &operator=(SvoView &&other) noexcept {
+        if (this != &other) {
+            close();
+            header = other.header;
+            nodes = other.nodes;
+            node_count = other.node_count;
+            lod_mats = other.lod_mats;
+            mapping = other.mapping;
+            mapping_size = other.mapping_size;
+            buffer = std::move(other.buffer);
+
+            other.nodes = nullptr;
+            other.node_count = 0;
+            other.lod_mats = nullptr;
+            other.mapping = nullptr;
+            other.mapping_size = 0;
+        }
+        return *this;
+    }
+
+    ~SvoView() {
+        close();
+    }
+
+    int open(const std::string &filename) {
+        close();
+
+#ifdef _WIN32
+        // no mapping support here, fall back to one bulk read
+        std::ifstream ifs(filename, std::ios::binary);
+        if (!ifs.is_open())
+            throw std::runtime_error("failed to open file.");
+
+        buffer.resize(std::filesystem::file_size(filename));
+        ifs.read(reinterpret_cast<char *>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+        if (!ifs)
+            throw std::runtime_error("failed to read file.");
+
+        const uint8_t *data = buffer.data();
+        const size_t size = buffer.size();
+        if (size < sizeof(BsvoHeader)) {
+            close();
+            throw std::runtime_error("file is too small for bsvo header.");
+        }
+#else
+        const int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("failed to open file.");
+
+        struct stat st{};
+        if (fstat(fd, &st) != 0) {
+            ::close(fd);
+            throw std::runtime_error("failed to stat file.");
+        }
+
+        const size_t size = static_cast<size_t>(st.st_size);
+        if (size < sizeof(BsvoHeader)) {
+            ::close(fd);
+            throw std::runtime_error("file is too small for bsvo header.");
+        }
+
+        void *addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (addr == MAP_FAILED)
+            throw std::runtime_error("failed to map file.");
+
+        mapping = addr;
+        mapping_size = size;
+
+        const uint8_t *data = static_cast<const uint8_t *>(addr);
+#endif
+
+        std::memcpy(&header, data, sizeof(BsvoHeader));
+
+        VSS_EVENT("mapping bsvo file: " << filename
+                  << " | version: " << static_cast<int>(header.version) << " | max depth: "
+                  << static_cast<int>(header.max_depth) << " | root res: " << header.root_res << " | rle: "
+                  << static_cast<int>(header.run_length_encoded) << " | node format: "
+                  << static_cast<int>(header.node_format) << " | lod: " << static_cast<int>(header.lod));
+
+        try {
+            check_bsvo_version(header);
+            if (header.node_format > BSVO_NODES_DAG)
+                throw std::runtime_error("unknown bsvo node format.");
+            if (header.node_format == BSVO_NODES_COMPACT)
+                throw std::runtime_error("bsvo view does not support compact nodes.");
+        } catch (...) {
+            close();
+            throw;
+        }
+
+        nodes = reinterpret_cast<const SvoNode *>(data + sizeof(BsvoHeader));
+        node_count = bsvo_node_bytes(header, size - sizeof(BsvoHeader)) / sizeof(SvoNode);
+        if (header.lod)
+            lod_mats = reinterpret_cast<const uint32_t *>(nodes + node_count);
+
+        return EXIT_SUCCESS;
+    }
+
+    void close() {
+#ifndef _WIN32
+        if (mapping)
+            munmap(mapping, mapping_size);
+#endif
+        mapping = nullptr;
+        mapping_size = 0;
+        buffer.clear();
+        nodes = nullptr;
+        node_count = 0;
+        lod_mats = nullptr;
+    }
+
+    bool is_open() const {
+        return nodes != nullptr;
+    }
+
+    size_t size() const {
+        return node_count;
+    }
+
+    const SvoNode &operator[](const size_t index) const {
+        return nodes[index];
+    }
+
+    uint32_t root_res() const {
+        return header.root_res;
+    }
+
+    uint8_t max_depth() const {
+        return header.max_depth;
+    }
+
+private:
+    void *mapping = nullptr;
+    size_t mapping_size = 0;
+    std::vector<uint8_t> buffer;
+};
+
 #endif //BSVO_H
@@ -7,13 +7,18 @@
 
 #include <vector>
 #include <cstdint>
+#include <cstring>
 #include <fstream>
+#include <filesystem>
 
-#include "vss_prop.h"
+#include "rle.h"
+#include "vox.h"
+#include "vox_bits.h"
+#include "vox_types.h"
+#include "vss_metrics.h"
+#include "vss_thread.h"
 
-#define BVOX_VERSION 2
-#define CHUNK_SEPARATOR UINT8_MAX
-#define RLE_MAX (UINT8_MAX - 1)
+#define BVOX_VERSION 6
 
 struct BvoxHeader {
     alignas(4) uint8_t version;
@@ -22,75 +27,117 @@ struct BvoxHeader {
     alignas(1) bool run_length_encoded;
 
     alignas(1) bool morton_encoded;
+    // RLE_FORMAT_PAIRS or RLE_FORMAT_VARINT, only used with run_length_encoded
+    alignas(1) uint8_t rle_format;
+    // one bit per cell in 64 bit words (see vox_bits.h), filled cells are read back as 1
+    alignas(1) bool bit_packed;
+
+    // chunk index, written after the chunk data
+    alignas(4) uint32_t chunk_count;
+    // VOXEL_FORMAT_*, chunks of every format but u8 hold u16 palette indices
+    alignas(1) uint8_t voxel_format;
+    alignas(8) uint64_t index_offset;
+
+    // u32 voxel data of every palette index, written after the chunk index. empty for u8 voxels.
+    alignas(4) uint32_t palette_count;
+    alignas(8) uint64_t palette_offset;
+};
+
+// position of one encoded chunk in the file
+struct BvoxChunkEntry {
+    uint64_t offset;
+    uint64_t size;
 };
 
 //
-// encoding / decoding
+// writing
 //
 
-static std::vector<uint8_t> run_length_encode(const std::vector<uint8_t> &data) {
-    std::vector<uint8_t> encoded;
-    uint8_t current = data[0];
-    uint8_t count = 1;
-
-    for (size_t i = 1; i < data.size(); i++) {
-        if (data[i] == current) {
-            if (count == RLE_MAX) {
-                encoded.push_back(current);
-                encoded.push_back(count);
-                count = 0;
-            }
-            count++;
-        } else {
-            encoded.push_back(current);
-            encoded.push_back(count);
-            current = data[i];
-            count = 1;
-        }
+static int check_bvox_version(const BvoxHeader &header) {
+    if (header.version > BVOX_VERSION) {
+        VSS_EVENT("file version: " << static_cast<int>(header.version) << ", reader version: " << BVOX_VERSION);
+        throw std::runtime_error("newer bvox reader version required for file.");
     }
 
-    encoded.push_back(current);
-    encoded.push_back(count);
+    if (header.version < BVOX_VERSION) {
+        VSS_EVENT("file version: " << static_cast<int>(header.version) << ", reader version: " << BVOX_VERSION);
+        throw std::runtime_error("file version is outdated, use older bvox reader.");
+    }
 
-    return encoded;
+    return EXIT_SUCCESS;
 }
 
-static std::vector<uint8_t> run_length_decode(const std::vector<uint8_t> &data) {
-    std::vector<uint8_t> decoded;
+static void check_bvox_voxel_format(const BvoxHeader &header, const uint8_t format) {
+    if (header.voxel_format != format)
+        throw std::runtime_error("bvox voxel format does not match voxel type.");
+}
 
-    if (data.size() % 2 != 0)
-        throw std::runtime_error("invalid encoded vector size.");
+// encode a chunk as it is stored in the file, safe to call from several threads
+static std::vector<uint8_t> encode_bvox_chunk(const std::vector<uint8_t> &chunk, const BvoxHeader &header) {
+    VSS_SPAN(SPAN_CHUNK_ENCODE);
 
+    check_bvox_voxel_format(header, VOXEL_FORMAT_U8);
+    if (chunk.size() != header.chunk_size)
+        throw std::runtime_error("chunk is not the given size.");
 
-    for (size_t i = 0; i < data.size(); i += 2) {
-        const uint8_t value = data[i];
-        const uint8_t count = data[i + 1];
+    // packed words are stored as little endian bytes
+    std::vector<uint8_t> packed;
+    if (header.bit_packed) {
+        check_occupancy_cell_count(chunk.size());
+        packed.resize(chunk.size() / 8);
 
-        decoded.insert(decoded.end(), count, value);
+        std::vector<uint64_t> words = pack_occupancy(chunk);
+        std::memcpy(packed.data(), words.data(), packed.size());
     }
+    const std::vector<uint8_t> &payload = header.bit_packed ? packed : chunk;
+
+    std::vector<uint8_t> encoded = header.run_length_encoded ? run_length_encode(payload, header.rle_format) : payload;
+
+    VSS_COUNT(METRIC_CHUNKS_ENCODED, 1);
+    VSS_COUNT(METRIC_ENCODE_INPUT_BYTES, chunk.size());
+    VSS_COUNT(METRIC_ENCODE_OUTPUT_BYTES, encoded.size());
+
+    return encoded;
+}
+
+// write an encoded chunk at the current position of the stream and return its index entry
+static BvoxChunkEntry write_bvox_encoded_chunk(std::ostream &os, const std::vector<uint8_t> &encoded) {
+    BvoxChunkEntry entry{};
+    entry.offset = static_cast<uint64_t>(os.tellp());
+    entry.size = encoded.size();
 
-    return decoded;
+    os.write(reinterpret_cast<const char *>(encoded.data()), static_cast<std::streamsize>(encoded.size()));
+
+    return entry;
+}
+
+// write chunk at the current position of the stream and return its index entry
+static BvoxChunkEntry write_bvox_chunk(std::ostream &os, const std::vector<uint8_t> &chunk, const BvoxHeader &header) {
+    return write_bvox_encoded_chunk(os, encode_bvox_chunk(chunk, header));
 }
 
-//
-// writing
-//
 static int write_empty_bvox(const std::string &filename, BvoxHeader header) {
     header.version = BVOX_VERSION;
+    header.chunk_count = 0;
+    header.index_offset = sizeof(BvoxHeader);
+    header.palette_count = 0;
+    header.palette_offset = sizeof(BvoxHeader);
 
-#ifdef DEBUG
-    std::cout << "writing empty bvox file: " << filename << " | version: " << static_cast<int>(header.version) << " | chunk_res: "
+    VSS_EVENT("writing empty bvox file: " << filename << " | version: " << static_cast<int>(header.version) << " | chunk_res: "
               << header.chunk_res << " | chunk_size: " << header.chunk_size << " | rle: "
               << static_cast<int>(header.run_length_encoded) << " | morton_encoded: "
-              << static_cast<int>(header.morton_encoded) << std::endl;
-#endif
+              << static_cast<int>(header.morton_encoded) << " | rle_format: "
+              << static_cast<int>(header.rle_format) << " | bit_packed: " << static_cast<int>(header.bit_packed));
 
 
+    VSS_SPAN(SPAN_FILE_WRITE);
+
     std::ofstream ofs(filename, std::ios::out | std::ios::binary);
     if (!ofs.is_open())
         throw std::runtime_error("failed to open file.");
 
     ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    VSS_COUNT(METRIC_BYTES_WRITTEN, sizeof(header));
 
     ofs.close();
     if (ofs.fail())
@@ -99,42 +146,50 @@ static int write_empty_bvox(const std::string &filename, BvoxHeader header) {
     return EXIT_SUCCESS;
 }
 
-static int write_bvox(const std::string &filename, const std::vector<std::vector<uint8_t> > &chunk_data,
-                      BvoxHeader header) {
+// write_chunks(write) hands every encoded chunk to write in chunk order, the index, the palette and the final
+// header follow the last one. typed chunks need the palette they were encoded with.
+template<typename WriteChunks>
+static int write_bvox_stream(const std::string &filename, const size_t chunk_count, BvoxHeader header,
+                             const std::vector<uint32_t> &palette, WriteChunks &&write_chunks) {
+    if ((header.voxel_format == VOXEL_FORMAT_U8) != palette.empty())
+        throw std::runtime_error("only typed bvox files have a palette.");
+
     header.version = BVOX_VERSION;
+    header.chunk_count = static_cast<uint32_t>(chunk_count);
+    header.palette_count = static_cast<uint32_t>(palette.size());
 
-#ifdef DEBUG
-    std::cout << "writing bvox file: " << filename << " | version: " << static_cast<int>(header.version) << " | chunk_res: "
+    VSS_EVENT("writing bvox file: " << filename << " | version: " << static_cast<int>(header.version) << " | chunk_res: "
               << header.chunk_res << " | chunk_size: " << header.chunk_size << " | rle: "
               << static_cast<int>(header.run_length_encoded) << " | morton_encoded: "
-              << static_cast<int>(header.morton_encoded) << std::endl;
-#endif
+              << static_cast<int>(header.morton_encoded) << " | rle_format: "
+              << static_cast<int>(header.rle_format) << " | bit_packed: " << static_cast<int>(header.bit_packed));
+
+    VSS_SPAN(SPAN_FILE_WRITE);
 
     std::ofstream ofs(filename, std::ios::out | std::ios::binary);
     if (!ofs.is_open())
         throw std::runtime_error("failed to open file.");
 
+    // header is written again once the index offset is known
     ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
 
-    constexpr uint8_t separator = CHUNK_SEPARATOR;
-    for (const std::vector<uint8_t> &chunk: chunk_data) {
-        if (chunk.size() != header.chunk_size)
-            throw std::runtime_error("chunk is not the given size.");
-
-        if (header.run_length_encoded) {
-            size_t before = chunk.size();
+    std::vector<BvoxChunkEntry> index;
+    index.reserve(chunk_count);
+    write_chunks([&](const std::vector<uint8_t> &encoded) {
+        index.push_back(write_bvox_encoded_chunk(ofs, encoded));
+    });
+    if (index.size() != chunk_count)
+        throw std::runtime_error("bvox chunk count does not match.");
 
-            std::vector<uint8_t> encoded = run_length_encode(chunk);
-            ofs.write(reinterpret_cast<const char *>(encoded.data()), static_cast<std::streamsize>(encoded.size()));
+    header.index_offset = static_cast<uint64_t>(ofs.tellp());
+    ofs.write(reinterpret_cast<const char *>(index.data()), static_cast<std::streamsize>(sizeof(BvoxChunkEntry) * index.size()));
 
-            size_t after = encoded.size();
-            std::cout << "size before: " << before << " | size after: " << after << " | compression: " << (float) after / (float) before << std::endl;
-        } else {
-            ofs.write(reinterpret_cast<const char *>(chunk.data()), static_cast<std::streamsize>(chunk.size()));
-        }
+    header.palette_offset = static_cast<uint64_t>(ofs.tellp());
+    ofs.write(reinterpret_cast<const char *>(palette.data()), static_cast<std::streamsize>(sizeof(uint32_t) * palette.size()));
+    VSS_COUNT(METRIC_BYTES_WRITTEN, ofs.tellp());
 
-        ofs.write(reinterpret_cast<const char *>(&separator), sizeof(separator));
-    }
+    ofs.seekp(0);
+    ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
 
     ofs.close();
     if (ofs.fail())
@@ -143,25 +198,67 @@ static int write_bvox(const std::string &filename, const std::vector<std::vector
     return EXIT_SUCCESS;
 }
 
-static int get_bvox_header(const std::string &filename, BvoxHeader *p_header) {
-    std::ifstream ifs(filename, std::ios::binary);
-    if (!ifs.is_open())
-        throw std::runtime_error("failed to open file.");
+// write chunks that were already encoded with encode_bvox_chunk for the same header
+static int write_bvox_encoded(const std::string &filename, const std::vector<std::vector<uint8_t> > &encoded_data,
+                              const BvoxHeader &header, const std::vector<uint32_t> &palette = {}) {
+    return write_bvox_stream(filename, encoded_data.size(), header, palette, [&](auto &&write) {
+        for (const std::vector<uint8_t> &encoded: encoded_data)
+            write(encoded);
+    });
+}
 
-    BvoxHeader header{};
-    ifs.read(reinterpret_cast<char *>(&header), sizeof(header));
+// chunks are encoded in parallel and streamed to the file in order, only a window of encoded chunks is held at
+// once. the file is identical for every thread count, 0 uses all hardware threads.
+static int write_bvox(const std::string &filename, const std::vector<std::vector<uint8_t> > &chunk_data,
+                      const BvoxHeader &header, const uint32_t thread_count = 0) {
+    return write_bvox_stream(filename, chunk_data.size(), header, {}, [&](auto &&write) {
+        parallel_ordered<std::vector<uint8_t> >(chunk_data.size(), [&](const size_t i) {
+            return encode_bvox_chunk(chunk_data[i], header);
+        }, [&](size_t, std::vector<uint8_t> &&encoded) {
+            write(encoded);
+        }, thread_count);
+    });
+}
 
-    if (header.version > BVOX_VERSION) {
-        std::cout << "file version: " << header.version << ", reader version: " << BVOX_VERSION << std::endl;
-        throw std::runtime_error("newer bvox reader version required for file.");
+// file of one lod level next to the full resolution file, chunks.bvox -> chunks_lod1.bvox
+static std::string bvox_lod_filename(const std::string &filename, const uint8_t lod) {
+    const std::filesystem::path path(filename);
+    const std::string name = path.stem().string() + "_lod" + std::to_string(lod) + path.extension().string();
+    return (path.parent_path() / name).string();
+}
+
+// write lod levels 1 to lod_count of morton encoded chunks, one file per level. every chunk is downsampled
+// in a single pass over its full resolution cells.
+static int write_bvox_lods(const std::string &filename, const std::vector<std::vector<uint8_t> > &chunk_data,
+                           const BvoxHeader &header, const uint8_t lod_count, const uint8_t mode = LOD_MAJORITY) {
+    if (!header.morton_encoded)
+        throw std::runtime_error("lod generation requires morton encoded chunks.");
+
+    std::vector<std::vector<std::vector<uint8_t> > > levels(lod_count);
+    for (const std::vector<uint8_t> &chunk: chunk_data) {
+        std::vector<std::vector<uint8_t> > lods =
+                morton_downsample_3d_grid(chunk.data(), header.chunk_res, chunk.size(), lod_count, mode);
+
+        for (uint8_t l = 0; l < lod_count; l++)
+            levels[l].push_back(std::move(lods[l]));
     }
 
-    if (header.version < BVOX_VERSION) {
-        std::cout << "file version: " << header.version << ", reader version: " << BVOX_VERSION << std::endl;
-        throw std::runtime_error("file version is outdated, use older bvox reader.");
+    for (uint8_t l = 0; l < lod_count; l++) {
+        BvoxHeader lod_header = header;
+        lod_header.chunk_res = header.chunk_res >> (l + 1);
+        lod_header.chunk_size = lod_header.chunk_res * lod_header.chunk_res * lod_header.chunk_res;
+        write_bvox(bvox_lod_filename(filename, l + 1), levels[l], lod_header);
     }
 
-    ifs.close();
+    return EXIT_SUCCESS;
+}
+
+static int read_bvox_header(std::istream &is, BvoxHeader *p_header) {
+    BvoxHeader header{};
+    if (!is.read(reinterpret_cast<char *>(&header), sizeof(header)))
+        throw std::runtime_error("failed to read bvox header.");
+
+    check_bvox_version(header);
 
     if (p_header)
         *p_header = header;
@@ -169,41 +266,97 @@ static int get_bvox_header(const std::string &filename, BvoxHeader *p_header) {
     return EXIT_SUCCESS;
 }
 
+// size of the file behind is, the read position is kept
+static uint64_t bvox_stream_size(std::istream &is) {
+    const std::streampos position = is.tellg();
+    is.seekg(0, std::ios::end);
+    const std::streamoff size = is.tellg();
+    is.seekg(position);
+    if (size < 0)
+        throw std::runtime_error("failed to read file size.");
+
+    return static_cast<uint64_t>(size);
+}
+
+// offsets and counts of a file are checked against its size before anything is allocated from them. compared by
+// subtraction, sums of crafted offsets could wrap around.
+static void check_bvox_index(const BvoxHeader &header, const uint64_t file_size) {
+    if (header.index_offset > file_size ||
+        header.chunk_count > (file_size - header.index_offset) / sizeof(BvoxChunkEntry))
+        throw std::runtime_error("bvox chunk index exceeds file size.");
+}
+
+static void check_bvox_entry(const BvoxChunkEntry &entry, const uint64_t file_size) {
+    if (entry.offset > file_size || entry.size > file_size - entry.offset)
+        throw std::runtime_error("bvox chunk exceeds file size.");
+}
+
+static int read_bvox_index(std::istream &is, const BvoxHeader &header, std::vector<BvoxChunkEntry> *p_index) {
+    check_bvox_index(header, bvox_stream_size(is));
+    std::vector<BvoxChunkEntry> index(header.chunk_count);
+
+    is.seekg(static_cast<std::streamoff>(header.index_offset));
+    is.read(reinterpret_cast<char *>(index.data()), static_cast<std::streamsize>(sizeof(BvoxChunkEntry) * index.size()));
+    if (!is)
+        throw std::runtime_error("failed to read bvox chunk index.");
+
+    if (p_index)
+        *p_index = std::move(index);
+
+    return EXIT_SUCCESS;
+}
+
+static int get_bvox_header(const std::string &filename, BvoxHeader *p_header) {
+    std::ifstream ifs(filename, std::ios::binary);
+    if (!ifs.is_open())
+        throw std::runtime_error("failed to open file.");
+
+    read_bvox_header(ifs, p_header);
+
+    ifs.close();
+
+    return EXIT_SUCCESS;
+}
+
+// chunk data overwrites the old index, the updated index is written behind it
 static int append_to_bvox(const std::string &filename, const std::vector<uint8_t> &chunk) {
+    VSS_SPAN(SPAN_FILE_WRITE);
+
+    std::fstream fs(filename, std::ios::in | std::ios::out | std::ios::binary);
+    if (!fs.is_open())
+        throw std::runtime_error("failed to open file.");
+
     BvoxHeader header{};
-    get_bvox_header(filename, &header);
+    read_bvox_header(fs, &header);
+
+    // typed chunks would need the palette rewritten behind the new index
+    if (header.voxel_format != VOXEL_FORMAT_U8)
+        throw std::runtime_error("append only supports u8 bvox files.");
 
-#ifdef DEBUG
-    std::cout << "appending to bvox file: " << filename << " | version: " << static_cast<int>(header.version) << " | chunk_res: "
+    VSS_EVENT("appending to bvox file: " << filename << " | version: " << static_cast<int>(header.version) << " | chunk_res: "
               << header.chunk_res << " | chunk_size: " << header.chunk_size << " | rle: "
               << static_cast<int>(header.run_length_encoded) << " | morton_encoded: "
-              << static_cast<int>(header.morton_encoded) << std::endl;
-#endif
+              << static_cast<int>(header.morton_encoded) << " | rle_format: "
+              << static_cast<int>(header.rle_format) << " | bit_packed: " << static_cast<int>(header.bit_packed));
 
-    std::ofstream ofs(filename, std::ios::out | std::ios::binary | std::ios::app);
-    if (!ofs.is_open())
-        throw std::runtime_error("failed to open file.");
+    std::vector<BvoxChunkEntry> index;
+    read_bvox_index(fs, header, &index);
 
-    constexpr uint8_t separator = CHUNK_SEPARATOR;
-    if (chunk.size() != header.chunk_size)
-        throw std::runtime_error("chunk is not the given size.");
-
-    if (header.run_length_encoded) {
-        size_t before = chunk.size();
+    const uint64_t old_index_offset = header.index_offset;
+    fs.seekp(static_cast<std::streamoff>(header.index_offset));
+    index.push_back(write_bvox_chunk(fs, chunk, header));
 
-        std::vector<uint8_t> encoded = run_length_encode(chunk);
-        ofs.write(reinterpret_cast<const char *>(encoded.data()), static_cast<std::streamsize>(encoded.size()));
+    header.chunk_count = static_cast<uint32_t>(index.size());
+    header.index_offset = static_cast<uint64_t>(fs.tellp());
+    fs.write(reinterpret_cast<const char *>(index.data()), static_cast<std::streamsize>(sizeof(BvoxChunkEntry) * index.size()));
+    header.palette_offset = static_cast<uint64_t>(fs.tellp());
+    VSS_COUNT(METRIC_BYTES_WRITTEN, static_cast<uint64_t>(fs.tellp()) - old_index_offset + sizeof(header));
 
-        size_t after = encoded.size();
-        std::cout << "size before: " << before << " | size after: " << after << " | compression: " << (float) after / (float) before << std::endl;
-    } else {
-        ofs.write(reinterpret_cast<const char *>(chunk.data()), static_cast<std::streamsize>(chunk.size()));
-    }
+    fs.seekp(0);
+    fs.write(reinterpret_cast<const char *>(&header), sizeof(header));
 
-    ofs.write(reinterpret_cast<const char *>(&separator), sizeof(separator));
-
-    ofs.close();
-    if (ofs.fail())
+    fs.close();
+    if (fs.fail())
         throw std::runtime_error("failed to write to file.");
 
     return EXIT_SUCCESS;
@@ -213,48 +366,446 @@ static int append_to_bvox(const std::string &filename, const std::vector<uint8_t
 // reading
 //
 
+// words of a bit packed chunk, without expanding them to one byte per cell
+static int decode_bvox_chunk_bits(const uint8_t *data, const size_t size, const BvoxHeader &header,
+                                  std::vector<uint64_t> &words) {
+    if (!header.bit_packed)
+        throw std::runtime_error("bvox chunks are not bit packed.");
+    check_occupancy_cell_count(header.chunk_size);
+
+    VSS_SPAN(SPAN_CHUNK_DECODE);
+    VSS_COUNT(METRIC_CHUNKS_DECODED, 1);
+
+    words.resize(header.chunk_size / OCCUPANCY_WORD_CELLS);
+    uint8_t *bytes = reinterpret_cast<uint8_t *>(words.data());
+    const size_t byte_count = header.chunk_size / 8;
+
+    size_t decoded_size = size;
+    if (header.run_length_encoded)
+        decoded_size = run_length_decode(data, size, bytes, byte_count, header.rle_format);
+    else if (size == byte_count)
+        std::memcpy(bytes, data, size);
+
+    if (decoded_size != byte_count)
+        throw std::runtime_error("chunk is not the given size.");
+
+    return EXIT_SUCCESS;
+}
+
+// decode one encoded chunk into a chunk_size buffer
+static int decode_bvox_chunk(const uint8_t *data, const size_t size, const BvoxHeader &header,
+                             std::vector<uint8_t> &chunk) {
+    check_bvox_voxel_format(header, VOXEL_FORMAT_U8);
+    chunk.resize(header.chunk_size);
+
+    if (header.bit_packed) {
+        std::vector<uint64_t> words;
+        decode_bvox_chunk_bits(data, size, header, words);
+        unpack_occupancy(words.data(), chunk.size(), chunk.data());
+        return EXIT_SUCCESS;
+    }
+
+    VSS_SPAN(SPAN_CHUNK_DECODE);
+    VSS_COUNT(METRIC_CHUNKS_DECODED, 1);
+
+    size_t decoded_size = size;
+    if (header.run_length_encoded)
+        decoded_size = run_length_decode(data, size, chunk.data(), chunk.size(), header.rle_format);
+    else if (size == chunk.size())
+        std::memcpy(chunk.data(), data, size);
+
+    if (decoded_size != header.chunk_size)
+        throw std::runtime_error("chunk is not the given size.");
+
+    return EXIT_SUCCESS;
+}
+
+// index entry of one chunk, the index is checked against the file size first
+static BvoxChunkEntry read_bvox_index_entry(std::istream &is, const BvoxHeader &header, const uint32_t index) {
+    if (index >= header.chunk_count)
+        throw std::runtime_error("chunk index out of bounds.");
+    check_bvox_index(header, bvox_stream_size(is));
+
+    BvoxChunkEntry entry{};
+    is.seekg(static_cast<std::streamoff>(header.index_offset + sizeof(BvoxChunkEntry) * index));
+    if (!is.read(reinterpret_cast<char *>(&entry), sizeof(entry)))
+        throw std::runtime_error("failed to read bvox chunk index.");
+
+    return entry;
+}
+
+// still encoded bytes of the chunk described by entry, the entry is checked against the file size first
+static std::vector<uint8_t> read_bvox_entry(std::istream &is, const BvoxChunkEntry &entry) {
+    check_bvox_entry(entry, bvox_stream_size(is));
+    std::vector<uint8_t> encoded(entry.size);
+
+    is.seekg(static_cast<std::streamoff>(entry.offset));
+    is.read(reinterpret_cast<char *>(encoded.data()), static_cast<std::streamsize>(encoded.size()));
+    if (!is)
+        throw std::runtime_error("failed to read chunk from file.");
+    VSS_COUNT(METRIC_BYTES_READ, encoded.size());
+
+    return encoded;
+}
+
+// read and decode the chunk described by entry
+static int read_bvox_chunk(std::istream &is, const BvoxHeader &header, const BvoxChunkEntry &entry,
+                           std::vector<uint8_t> *p_chunk) {
+    const std::vector<uint8_t> encoded = read_bvox_entry(is, entry);
+
+    std::vector<uint8_t> chunk;
+    decode_bvox_chunk(encoded.data(), encoded.size(), header, chunk);
+
+    if (p_chunk)
+        *p_chunk = std::move(chunk);
+
+    return EXIT_SUCCESS;
+}
+
+// random access to a single chunk through the chunk index
+static int read_bvox_chunk(const std::string &filename, const uint32_t index, std::vector<uint8_t> *p_chunk,
+                           BvoxHeader *p_header = nullptr) {
+    std::ifstream ifs(filename, std::ios::binary);
+    if (!ifs.is_open())
+        throw std::runtime_error("failed to open file.");
+
+    BvoxHeader header{};
+    read_bvox_header(ifs, &header);
+
+    const BvoxChunkEntry entry = read_bvox_index_entry(ifs, header, index);
+    read_bvox_chunk(ifs, header, entry, p_chunk);
+
+    ifs.close();
+
+    if (p_header)
+        *p_header = header;
+
+    return EXIT_SUCCESS;
+}
+
+// read the still encoded bytes of a single chunk, decoding is left to the caller. lets io and decoding run on
+// different threads.
+static int read_bvox_chunk_encoded(const std::string &filename, const uint32_t index,
+                                   std::vector<uint8_t> *p_encoded, BvoxHeader *p_header = nullptr) {
+    VSS_SPAN(SPAN_FILE_READ);
+
+    std::ifstream ifs(filename, std::ios::binary);
+    if (!ifs.is_open())
+        throw std::runtime_error("failed to open file.");
+
+    BvoxHeader header{};
+    read_bvox_header(ifs, &header);
+
+    const BvoxChunkEntry entry = read_bvox_index_entry(ifs, header, index);
+    std::vector<uint8_t> encoded = read_bvox_entry(ifs, entry);
+
+    ifs.close();
+
+    if (p_encoded)
+        *p_encoded = std::move(encoded);
+    if (p_header)
+        *p_header = header;
+
+    return EXIT_SUCCESS;
+}
+
+// read the words of the bit packed chunk described by entry
+static int read_bvox_chunk_bits(std::istream &is, const BvoxHeader &header, const BvoxChunkEntry &entry,
+                                std::vector<uint64_t> *p_words) {
+    const std::vector<uint8_t> encoded = read_bvox_entry(is, entry);
+
+    std::vector<uint64_t> words;
+    decode_bvox_chunk_bits(encoded.data(), encoded.size(), header, words);
+
+    if (p_words)
+        *p_words = std::move(words);
+
+    return EXIT_SUCCESS;
+}
+
+// random access to the words of a single bit packed chunk
+static int read_bvox_chunk_bits(const std::string &filename, const uint32_t index, std::vector<uint64_t> *p_words,
+                                BvoxHeader *p_header = nullptr) {
+    std::ifstream ifs(filename, std::ios::binary);
+    if (!ifs.is_open())
+        throw std::runtime_error("failed to open file.");
+
+    BvoxHeader header{};
+    read_bvox_header(ifs, &header);
+
+    const BvoxChunkEntry entry = read_bvox_index_entry(ifs, header, index);
+    read_bvox_chunk_bits(ifs, header, entry, p_words);
+
+    ifs.close();
+
+    if (p_header)
+        *p_header = header;
+
+    return EXIT_SUCCESS;
+}
+
+// the whole file is read at once and every chunk is decoded straight into its final buffer
 static int
 read_bvox(const std::string &filename, std::vector<std::vector<uint8_t> > *p_chunk_data, BvoxHeader *p_header) {
     std::ifstream ifs(filename, std::ios::binary);
     if (!ifs.is_open())
         throw std::runtime_error("failed to open file.");
 
+    std::vector<uint8_t> file(std::filesystem::file_size(filename));
+    {
+        VSS_SPAN(SPAN_FILE_READ);
+        ifs.read(reinterpret_cast<char *>(file.data()), static_cast<std::streamsize>(file.size()));
+        if (!ifs)
+            throw std::runtime_error("failed to read file.");
+        VSS_COUNT(METRIC_BYTES_READ, file.size());
+    }
+
+    ifs.close();
+
+    if (file.size() < sizeof(BvoxHeader))
+        throw std::runtime_error("file is too small for bvox header.");
+
     BvoxHeader header{};
-    ifs.read(reinterpret_cast<char *>(&header), sizeof(header));
+    std::memcpy(&header, file.data(), sizeof(header));
 
-#ifdef DEBUG
-    std::cout << "reading bvox file: " << filename << " | version: " << static_cast<int>(header.version) << " | chunk_res: "
+    VSS_EVENT("reading bvox file: " << filename << " | version: " << static_cast<int>(header.version) << " | chunk_res: "
               << header.chunk_res << " | chunk_size: " << header.chunk_size << " | rle: "
               << static_cast<int>(header.run_length_encoded) << " | morton_encoded: "
-              << static_cast<int>(header.morton_encoded) << std::endl;
-#endif
+              << static_cast<int>(header.morton_encoded) << " | rle_format: "
+              << static_cast<int>(header.rle_format) << " | bit_packed: " << static_cast<int>(header.bit_packed));
 
-    if (header.version > BVOX_VERSION) {
-        std::cout << "file version: " << header.version << ", reader version: " << BVOX_VERSION << std::endl;
-        throw std::runtime_error("newer bvox reader version required for file.");
+    check_bvox_version(header);
+
+    check_bvox_index(header, file.size());
+
+    std::vector<BvoxChunkEntry> index(header.chunk_count);
+    std::memcpy(index.data(), file.data() + header.index_offset, sizeof(BvoxChunkEntry) * index.size());
+
+    if (p_chunk_data) {
+        p_chunk_data->reserve(p_chunk_data->size() + index.size());
+
+        for (const BvoxChunkEntry &entry: index) {
+            check_bvox_entry(entry, file.size());
+
+            std::vector<uint8_t> &chunk = p_chunk_data->emplace_back();
+            decode_bvox_chunk(file.data() + entry.offset, entry.size, header, chunk);
+        }
     }
 
-    if (header.version < BVOX_VERSION) {
-        std::cout << "file version: " << header.version << ", reader version: " << BVOX_VERSION << std::endl;
-        throw std::runtime_error("file version is outdated, use older bvox reader.");
+    if (p_header)
+        *p_header = header;
+
+    return EXIT_SUCCESS;
+}
+
+//
+// typed voxels
+//
+
+// palette indices of a typed chunk as they are stored in the file
+static std::vector<uint8_t> encode_bvox_indices(const std::vector<uint16_t> &indices, const BvoxHeader &header) {
+    std::vector<uint8_t> encoded = header.run_length_encoded
+                                       ? run_length_encode_values(indices, header.rle_format)
+                                       : split_byte_planes(indices.data(), indices.size());
+
+    VSS_COUNT(METRIC_CHUNKS_ENCODED, 1);
+    VSS_COUNT(METRIC_ENCODE_OUTPUT_BYTES, encoded.size());
+
+    return encoded;
+}
+
+static void check_bvox_typed_chunk(const BvoxHeader &header, const size_t chunk_size) {
+    if (header.bit_packed)
+        throw std::runtime_error("typed bvox chunks can not be bit packed.");
+    if (chunk_size != header.chunk_size)
+        throw std::runtime_error("chunk is not the given size.");
+}
+
+// typed chunk as it is stored in the file, safe to call from several threads
+template<typename T>
+static std::vector<uint8_t> encode_bvox_chunk(const std::vector<T> &chunk, const BvoxHeader &header,
+                                              const VoxelPalette &palette) {
+    VSS_SPAN(SPAN_CHUNK_ENCODE);
+
+    check_bvox_voxel_format(header, VoxelTraits<T>::format);
+    check_bvox_typed_chunk(header, chunk.size());
+
+    std::vector<uint16_t> indices(chunk.size());
+    for (size_t i = 0; i < chunk.size(); i++)
+        indices[i] = palette.index(VoxelTraits<T>::to_data(chunk[i]));
+
+    VSS_COUNT(METRIC_ENCODE_INPUT_BYTES, chunk.size() * sizeof(T));
+    return encode_bvox_indices(indices, header);
+}
+
+// typed chunk given as the u32 leaf data of its voxels, e.g. decoded from a svo, for code that only learns the
+// voxel format from a file header
+static std::vector<uint8_t> encode_bvox_chunk_data(const std::vector<uint32_t> &data, const BvoxHeader &header,
+                                                   const VoxelPalette &palette) {
+    VSS_SPAN(SPAN_CHUNK_ENCODE);
+
+    if (header.voxel_format == VOXEL_FORMAT_U8)
+        throw std::runtime_error("u8 bvox chunks have no palette.");
+    check_bvox_typed_chunk(header, data.size());
+
+    std::vector<uint16_t> indices(data.size());
+    for (size_t i = 0; i < data.size(); i++)
+        indices[i] = palette.index(data[i]);
+
+    VSS_COUNT(METRIC_ENCODE_INPUT_BYTES, data.size() * sizeof(uint32_t));
+    return encode_bvox_indices(indices, header);
+}
+
+// every distinct voxel of the chunks gets a palette index, the voxel format is taken from T
+template<typename T>
+static int write_bvox(const std::string &filename, const std::vector<std::vector<T> > &chunk_data,
+                      const BvoxHeader &header, const uint32_t thread_count = 0) {
+    BvoxHeader typed_header = header;
+    typed_header.voxel_format = VoxelTraits<T>::format;
+
+    VoxelPalette palette;
+    for (const std::vector<T> &chunk: chunk_data) {
+        for (const T &value: chunk)
+            palette.add(VoxelTraits<T>::to_data(value));
     }
 
-    while (ifs) {
-        std::vector<uint8_t> chunk;
+    return write_bvox_stream(filename, chunk_data.size(), typed_header, palette.values, [&](auto &&write) {
+        parallel_ordered<std::vector<uint8_t> >(chunk_data.size(), [&](const size_t i) {
+            return encode_bvox_chunk(chunk_data[i], typed_header, palette);
+        }, [&](size_t, std::vector<uint8_t> &&encoded) {
+            write(encoded);
+        }, thread_count);
+    });
+}
 
-        uint8_t byte;
-        while (ifs.read(reinterpret_cast<char *>(&byte), sizeof(byte))) {
-            if (byte == CHUNK_SEPARATOR) {
-                break;
-            }
-            chunk.push_back(byte);
-        }
+// the palette count is checked against the palette limit and the file size before the values are allocated
+// typed chunks given as u32 leaf data, the palette has to hold every value. chunks are encoded in parallel like
+// write_bvox.
+static int write_bvox_data(const std::string &filename, const std::vector<std::vector<uint32_t> > &chunk_data,
+                           const BvoxHeader &header, const VoxelPalette &palette, const uint32_t thread_count = 0) {
+    return write_bvox_stream(filename, chunk_data.size(), header, palette.values, [&](auto &&write) {
+        parallel_ordered<std::vector<uint8_t> >(chunk_data.size(), [&](const size_t i) {
+            return encode_bvox_chunk_data(chunk_data[i], header, palette);
+        }, [&](size_t, std::vector<uint8_t> &&encoded) {
+            write(encoded);
+        }, thread_count);
+    });
+}
+
+static int read_bvox_palette(std::istream &is, const BvoxHeader &header, VoxelPalette *p_palette) {
+    if (header.palette_count > VOXEL_PALETTE_MAX)
+        throw std::runtime_error("palette is too large.");
+    const uint64_t file_size = bvox_stream_size(is);
+    if (header.palette_offset > file_size ||
+        header.palette_count > (file_size - header.palette_offset) / sizeof(uint32_t))
+        throw std::runtime_error("bvox palette exceeds file size.");
+    std::vector<uint32_t> values(header.palette_count);
+
+    is.seekg(static_cast<std::streamoff>(header.palette_offset));
+    is.read(reinterpret_cast<char *>(values.data()), static_cast<std::streamsize>(sizeof(uint32_t) * values.size()));
+    if (!is)
+        throw std::runtime_error("failed to read bvox palette.");
+
+    if (p_palette)
+        *p_palette = VoxelPalette(values);
+
+    return EXIT_SUCCESS;
+}
+
+// decode one encoded typed chunk into a chunk_size buffer
+template<typename T>
+static int decode_bvox_chunk(const uint8_t *data, const size_t size, const BvoxHeader &header,
+                             const VoxelPalette &palette, std::vector<T> &chunk) {
+    VSS_SPAN(SPAN_CHUNK_DECODE);
+    VSS_COUNT(METRIC_CHUNKS_DECODED, 1);
+
+    check_bvox_voxel_format(header, VoxelTraits<T>::format);
 
-        if (header.run_length_encoded) {
-            std::vector<uint8_t> decoded = run_length_decode(chunk);
-            p_chunk_data->push_back(decoded);
-        } else {
-            p_chunk_data->push_back(chunk);
+    std::vector<uint16_t> indices(header.chunk_size);
+    size_t decoded_size = 0;
+    if (header.run_length_encoded) {
+        decoded_size = run_length_decode_values(data, size, indices.data(), indices.size(), header.rle_format);
+    } else if (size == indices.size() * sizeof(uint16_t)) {
+        join_byte_planes(data, indices.size(), indices.data());
+        decoded_size = indices.size();
+    }
+
+    if (decoded_size != header.chunk_size)
+        throw std::runtime_error("chunk is not the given size.");
+
+    chunk.resize(header.chunk_size);
+    for (size_t i = 0; i < chunk.size(); i++)
+        chunk[i] = VoxelTraits<T>::from_data(palette.value(indices[i]));
+
+    return EXIT_SUCCESS;
+}
+
+// random access to a single typed chunk through the chunk index
+template<typename T>
+static int read_bvox_chunk(const std::string &filename, const uint32_t index, std::vector<T> *p_chunk,
+                           BvoxHeader *p_header = nullptr) {
+    std::ifstream ifs(filename, std::ios::binary);
+    if (!ifs.is_open())
+        throw std::runtime_error("failed to open file.");
+
+    BvoxHeader header{};
+    read_bvox_header(ifs, &header);
+    check_bvox_voxel_format(header, VoxelTraits<T>::format);
+
+    const BvoxChunkEntry entry = read_bvox_index_entry(ifs, header, index);
+
+    VoxelPalette palette;
+    read_bvox_palette(ifs, header, &palette);
+
+    const std::vector<uint8_t> encoded = read_bvox_entry(ifs, entry);
+
+    ifs.close();
+
+    std::vector<T> chunk;
+    decode_bvox_chunk(encoded.data(), encoded.size(), header, palette, chunk);
+
+    if (p_chunk)
+        *p_chunk = std::move(chunk);
+    if (p_header)
+        *p_header = header;
+
+    return EXIT_SUCCESS;
+}
+
+template<typename T>
+static int read_bvox(const std::string &filename, std::vector<std::vector<T> > *p_chunk_data, BvoxHeader *p_header) {
+    VSS_SPAN(SPAN_FILE_READ);
+
+    std::ifstream ifs(filename, std::ios::binary);
+    if (!ifs.is_open())
+        throw std::runtime_error("failed to open file.");
+
+    BvoxHeader header{};
+    read_bvox_header(ifs, &header);
+    check_bvox_voxel_format(header, VoxelTraits<T>::format);
+
+    std::vector<BvoxChunkEntry> index;
+    read_bvox_index(ifs, header, &index);
+
+    VoxelPalette palette;
+    read_bvox_palette(ifs, header, &palette);
+
+    if (p_chunk_data) {
+        p_chunk_data->reserve(p_chunk_data->size() + index.size());
+
+        const uint64_t file_size = bvox_stream_size(ifs);
+        std::vector<uint8_t> encoded;
+        for (const BvoxChunkEntry &entry: index) {
+            check_bvox_entry(entry, file_size);
+            encoded.resize(entry.size);
+            ifs.seekg(static_cast<std::streamoff>(entry.offset));
+            ifs.read(reinterpret_cast<char *>(encoded.data()), static_cast<std::streamsize>(encoded.size()));
+            if (!ifs)
+                throw std::runtime_error("failed to read chunk from file.");
+            VSS_COUNT(METRIC_BYTES_READ, encoded.size());
+
+            std::vector<T> &chunk = p_chunk_data->emplace_back();
+            decode_bvox_chunk(encoded.data(), encoded.size(), header, palette, chunk);
         }
     }
 
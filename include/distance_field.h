@@ -0,0 +1,466 @@
+//
+// Created by ludw on 9/23/24.
+//
+
+#ifndef DISTANCE_FIELD_H
+#define DISTANCE_FIELD_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "bvox.h"
+#include "svo.h"
+#include "svo_query.h"
+#include "vox.h"
+#include "vss_simd.h"
+#include "vss_thread.h"
+
+// distance of every cell to the nearest filled cell, zero on filled cells
+#define DISTANCE_FIELD_UNSIGNED 0
+// like unsigned outside, filled cells hold the negative distance to the nearest empty cell
+#define DISTANCE_FIELD_SIGNED 1
+
+// squared distance of cells without any feature in the grid
+#define DISTANCE_FIELD_FAR UINT32_MAX
+// distance along a line without any feature in it, small enough to add one without overflow
+#define DISTANCE_LINE_FAR (1u << 30)
+
+// cells per side of the blocks the hierarchical field skips or transforms as a whole
+#define DISTANCE_FIELD_BLOCK 32
+
+// distances are measured between cell centers in cells. features outside of the grid are not known, so
+// chunks are transformed on their own and their borders are neither filled nor empty.
+
+//
+// line kernels
+//
+
+// one step of the first pass along z: cur = 0 on features, prev + 1 elsewhere
+static void edt_sweep_scalar(const uint8_t *features, const uint32_t *prev, uint32_t *cur, const size_t count) {
+    for (size_t i = 0; i < count; i++)
+        cur[i] = features[i] ? 0 : std::min(prev[i] + 1, DISTANCE_LINE_FAR);
+}
+
+// backwards step of the first pass: cur = min(cur, next + 1)
+static void edt_relax_scalar(const uint32_t *next, uint32_t *cur, const size_t count) {
+    for (size_t i = 0; i < count; i++)
+        cur[i] = std::min(cur[i], next[i] + 1);
+}
+
+#ifdef VSS_X86_SIMD
+VSS_TARGET_AVX2 static void edt_sweep_avx2(const uint8_t *features, const uint32_t *prev, uint32_t *cur,
+                                           const size_t count) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i far = _mm256_set1_epi32(static_cast<int>(DISTANCE_LINE_FAR));
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(features + i));
+        const __m256i empty = _mm256_cmpeq_epi32(_mm256_cvtepu8_epi32(bytes), zero);
+        const __m256i p = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(prev + i));
+        const __m256i d = _mm256_min_epu32(_mm256_add_epi32(p, one), far);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(cur + i), _mm256_and_si256(d, empty));
+    }
+
+    edt_sweep_scalar(features + i, prev + i, cur + i, count - i);
+}
+
+VSS_TARGET_AVX2 static void edt_relax_avx2(const uint32_t *next, uint32_t *cur, const size_t count) {
+    const __m256i one = _mm256_set1_epi32(1);
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i n = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(next + i));
+        const __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(cur + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(cur + i), _mm256_min_epu32(c, _mm256_add_epi32(n, one)));
+    }
+
+    edt_relax_scalar(next + i, cur + i, count - i);
+}
+#endif
+
+static void edt_sweep(const uint8_t *features, const uint32_t *prev, uint32_t *cur, const size_t count) {
+#ifdef VSS_X86_SIMD
+    if (simd_level() >= SIMD_AVX2)
+        return edt_sweep_avx2(features, prev, cur, count);
+#endif
+    edt_sweep_scalar(features, prev, cur, count);
+}
+
+static void edt_relax(const uint32_t *next, uint32_t *cur, const size_t count) {
+#ifdef VSS_X86_SIMD
+    if (simd_level() >= SIMD_AVX2)
+        return edt_relax_avx2(next, cur, count);
+#endif
+    edt_relax_scalar(next, cur, count);
+}
+
+// squared distance transform of one line (felzenszwalb and huttenlocher), d[q] = min over i of (q - i)^2 + f[i].
+// entries of f that are DISTANCE_FIELD_FAR are skipped, v and z are scratch of n and n + 1 entries.
+static void edt_line(const uint32_t *f, const uint32_t n, uint32_t *d, uint32_t *v, double *z) {
+    int k = -1;
+    for (uint32_t q = 0; q < n; q++) {
+        if (f[q] == DISTANCE_FIELD_FAR)
+            continue;
+
+        // drop parabolas of the lower envelope that the new one hides
+        const int64_t fq = static_cast<int64_t>(f[q]) + static_cast<int64_t>(q) * q;
+        double s = -std::numeric_limits<double>::infinity();
+        while (k >= 0) {
+            const int64_t fv = static_cast<int64_t>(f[v[k]]) + static_cast<int64_t>(v[k]) * v[k];
+            s = static_cast<double>(fq - fv) / (2.0 * (static_cast<double>(q) - v[k]));
+            if (s > z[k])
+                break;
+            k--;
+        }
+        if (k < 0)
+            s = -std::numeric_limits<double>::infinity();
+
+        v[++k] = q;
+        z[k] = s;
+    }
+
+    if (k < 0) {
+        std::fill(d, d + n, DISTANCE_FIELD_FAR);
+        return;
+    }
+
+    int j = 0;
+    for (uint32_t q = 0; q < n; q++) {
+        while (j < k && z[j + 1] < q)
+            j++;
+        const int64_t dq = static_cast<int64_t>(q) - v[j];
+        d[q] = static_cast<uint32_t>(dq * dq + f[v[j]]);
+    }
+}
+
+//
+// transform
+//
+
+// squared distance of every cell of a linear dims.x * dims.y * dims.z grid to the nearest feature, features are
+// the non zero bytes. cells without any feature in the grid get DISTANCE_FIELD_FAR. the first pass runs along z
+// on whole rows of x at a time, the exact passes along y and x run on the lines of every z slice.
+static void distance_transform_squared(const uint8_t *features, const glm::uvec3 &dims, uint32_t *squared,
+                                       const uint32_t thread_count = 0) {
+    const size_t row = dims.x;
+    const size_t slice = row * dims.y;
+
+    // distance along z, slices of y are spread over the threads
+    parallel_for(0, dims.y, [&](const size_t y) {
+        const std::vector<uint32_t> far(row, DISTANCE_LINE_FAR);
+
+        for (uint32_t z = 0; z < dims.z; z++) {
+            const size_t i = z * slice + y * row;
+            edt_sweep(features + i, z == 0 ? far.data() : squared + i - slice, squared + i, row);
+        }
+        for (uint32_t z = dims.z - 1; z-- > 0;) {
+            const size_t i = z * slice + y * row;
+            edt_relax(squared + i + slice, squared + i, row);
+        }
+    }, thread_count);
+
+    // lower envelopes along y and x, scalar per line. slices of z are spread over the threads
+    parallel_for(0, dims.z, [&](const size_t z) {
+        const uint32_t n = std::max(dims.x, dims.y);
+        std::vector<uint32_t> f(n), d(n), v(n);
+        std::vector<double> bounds(n + 1);
+        uint32_t *plane = squared + z * slice;
+
+        for (uint32_t x = 0; x < dims.x; x++) {
+            for (uint32_t y = 0; y < dims.y; y++) {
+                const uint32_t line = plane[y * row + x];
+                f[y] = line >= DISTANCE_LINE_FAR ? DISTANCE_FIELD_FAR : line * line;
+            }
+            edt_line(f.data(), dims.y, d.data(), v.data(), bounds.data());
+            for (uint32_t y = 0; y < dims.y; y++)
+                plane[y * row + x] = d[y];
+        }
+
+        for (uint32_t y = 0; y < dims.y; y++) {
+            uint32_t *line = plane + y * row;
+            std::copy(line, line + dims.x, f.data());
+            edt_line(f.data(), dims.x, line, v.data(), bounds.data());
+        }
+    }, thread_count);
+}
+
+// features of a linear grid, filled or empty cells
+static std::vector<uint8_t> distance_features(const uint8_t *cells, const size_t size, const bool filled) {
+    std::vector<uint8_t> features(size);
+    for (size_t i = 0; i < size; i++)
+        features[i] = (cells[i] > 0) == filled;
+    return features;
+}
+
+static void check_distance_field(const uint32_t res, const size_t size, const uint8_t type) {
+    if (res == 0 || (res & (res - 1)) != 0 || res > MORTON_MAX_RES_64)
+        throw std::runtime_error("chunk resolution is not a supported power of two.");
+    if (size != static_cast<size_t>(res) * res * res)
+        throw std::runtime_error("chunk size does not match resolution.");
+    if (type > DISTANCE_FIELD_SIGNED)
+        throw std::runtime_error("unknown distance field type.");
+}
+
+// squared distances to filled cells and, for signed fields, to empty cells of a morton encoded chunk in linear order
+static void distance_field_squared(const uint8_t *cells, const uint32_t res, const size_t size, const uint8_t type,
+                                   std::vector<uint8_t> &linear, std::vector<uint32_t> &to_filled,
+                                   std::vector<uint32_t> &to_empty, const uint32_t thread_count) {
+    check_distance_field(res, size, type);
+
+    linear.resize(size);
+    morton_decode_3d_grid(cells, res, size, linear.data());
+
+    const glm::uvec3 dims(res);
+    to_filled.resize(size);
+    distance_transform_squared(distance_features(linear.data(), size, true).data(), dims, to_filled.data(),
+                               thread_count);
+
+    if (type == DISTANCE_FIELD_SIGNED) {
+        to_empty.resize(size);
+        distance_transform_squared(distance_features(linear.data(), size, false).data(), dims, to_empty.data(),
+                                   thread_count);
+    }
+}
+
+static float distance_from_squared(const uint32_t squared) {
+    return squared == DISTANCE_FIELD_FAR ? std::numeric_limits<float>::infinity()
+                                         : std::sqrt(static_cast<float>(squared));
+}
+
+// exact distances of a morton encoded chunk in morton order. unsigned fields of chunks without filled cells
+// are infinite, as are the insides of completely filled chunks in signed fields.
+static std::vector<float> distance_field(const uint8_t *cells, const uint32_t res, const size_t size,
+                                         const uint8_t type = DISTANCE_FIELD_UNSIGNED,
+                                         const uint32_t thread_count = 0) {
+    std::vector<uint8_t> linear;
+    std::vector<uint32_t> to_filled, to_empty;
+    distance_field_squared(cells, res, size, type, linear, to_filled, to_empty, thread_count);
+
+    std::vector<float> distances(size);
+    parallel_for(0, res, [&](const size_t z) {
+        const size_t begin = z * res * res, end = begin + static_cast<size_t>(res) * res;
+        for (size_t i = begin; i < end; i++) {
+            distances[i] = type == DISTANCE_FIELD_SIGNED && linear[i] > 0
+                               ? -distance_from_squared(to_empty[i])
+                               : distance_from_squared(to_filled[i]);
+        }
+    }, thread_count);
+
+    std::vector<float> field(size);
+    morton_encode_3d_grid(distances.data(), res, size, field.data());
+    return field;
+}
+
+static std::vector<float> distance_field(const std::vector<uint8_t> &chunk, const uint32_t res,
+                                         const uint8_t type = DISTANCE_FIELD_UNSIGNED,
+                                         const uint32_t thread_count = 0) {
+    return distance_field(chunk.data(), res, chunk.size(), type, thread_count);
+}
+
+//
+// quantization
+//
+
+// distances are clamped to max_distance. unsigned fields map [0, max_distance] to the full range of T, signed
+// fields map [-max_distance, max_distance] to it with zero in the middle.
+template<typename T>
+static T quantize_distance(const float distance, const float max_distance, const uint8_t type) {
+    static_assert(std::is_same_v<T, uint8_t> || std::is_same_v<T, uint16_t>, "distances are quantized to u8 or u16.");
+    constexpr float top = std::numeric_limits<T>::max();
+
+    const float d = std::clamp(distance, type == DISTANCE_FIELD_SIGNED ? -max_distance : 0.0f, max_distance);
+    const float unit = type == DISTANCE_FIELD_SIGNED ? (d / max_distance + 1.0f) * 0.5f : d / max_distance;
+    return static_cast<T>(std::lround(unit * top));
+}
+
+template<typename T>
+static float dequantize_distance(const T value, const float max_distance, const uint8_t type) {
+    const float unit = static_cast<float>(value) / static_cast<float>(std::numeric_limits<T>::max());
+    return type == DISTANCE_FIELD_SIGNED ? (unit * 2.0f - 1.0f) * max_distance : unit * max_distance;
+}
+
+template<typename T>
+static T quantize_squared_distance(const uint32_t to_filled, const uint32_t to_empty, const bool filled,
+                                   const float max_distance, const uint8_t type) {
+    if (type == DISTANCE_FIELD_SIGNED && filled)
+        return quantize_distance<T>(-distance_from_squared(to_empty), max_distance, type);
+    return quantize_distance<T>(distance_from_squared(to_filled), max_distance, type);
+}
+
+static void check_max_distance(const float max_distance) {
+    if (!(max_distance > 0.0f))
+        throw std::runtime_error("max distance has to be positive.");
+}
+
+// quantized field of a morton encoded chunk in morton order, see quantize_distance
+template<typename T>
+static std::vector<T> quantized_distance_field(const uint8_t *cells, const uint32_t res, const size_t size,
+                                               const float max_distance, const uint8_t type = DISTANCE_FIELD_UNSIGNED,
+                                               const uint32_t thread_count = 0) {
+    check_max_distance(max_distance);
+
+    std::vector<uint8_t> linear;
+    std::vector<uint32_t> to_filled, to_empty;
+    distance_field_squared(cells, res, size, type, linear, to_filled, to_empty, thread_count);
+
+    std::vector<T> values(size);
+    parallel_for(0, res, [&](const size_t z) {
+        const size_t begin = z * res * res, end = begin + static_cast<size_t>(res) * res;
+        for (size_t i = begin; i < end; i++) {
+            values[i] = quantize_squared_distance<T>(to_filled[i], type == DISTANCE_FIELD_SIGNED ? to_empty[i] : 0,
+                                                     linear[i] > 0, max_distance, type);
+        }
+    }, thread_count);
+
+    std::vector<T> field(size);
+    morton_encode_3d_grid(values.data(), res, size, field.data());
+    return field;
+}
+
+template<typename T>
+static std::vector<T> quantized_distance_field(const std::vector<uint8_t> &chunk, const uint32_t res,
+                                               const float max_distance, const uint8_t type = DISTANCE_FIELD_UNSIGNED,
+                                               const uint32_t thread_count = 0) {
+    return quantized_distance_field<T>(chunk.data(), res, chunk.size(), max_distance, type, thread_count);
+}
+
+//
+// hierarchical field
+//
+
+// the same field as quantized_distance_field for the grid of the tree, computed block by block. every block
+// only sees the cells within max_distance around it, which the tree hands out without visiting empty branches.
+// blocks without filled cells in reach (or without empty ones for signed fields) are written as one value,
+// the others are transformed exactly on their window. blocks are spread over the threads.
+template<typename T>
+static std::vector<T> quantized_distance_field(const Svo &svo, const float max_distance,
+                                               const uint8_t type = DISTANCE_FIELD_UNSIGNED,
+                                               const uint32_t thread_count = 0) {
+    const uint32_t res = svo.root_res;
+    check_distance_field(res, static_cast<size_t>(res) * res * res, type);
+    check_max_distance(max_distance);
+
+    std::vector<T> field(static_cast<size_t>(res) * res * res);
+    const uint32_t block = std::min<uint32_t>(DISTANCE_FIELD_BLOCK, res);
+    const uint32_t blocks = res / block;
+    // cells further than this along any axis are further than max_distance
+    const uint32_t reach = static_cast<uint32_t>(std::min(std::ceil(max_distance), static_cast<float>(res)));
+
+    parallel_for(0, static_cast<size_t>(blocks) * blocks * blocks, [&](const size_t b) {
+        const glm::uvec3 origin = glm::uvec3(b % blocks, b / blocks % blocks, b / blocks / blocks) * block;
+        const glm::uvec3 lo(origin.x >= reach ? origin.x - reach : 0, origin.y >= reach ? origin.y - reach : 0,
+                            origin.z >= reach ? origin.z - reach : 0);
+        const glm::uvec3 hi = glm::min(origin + glm::uvec3(block + reach), glm::uvec3(res));
+        const glm::uvec3 dims = hi - lo;
+        const size_t volume = static_cast<size_t>(dims.x) * dims.y * dims.z;
+
+        // filled cells of the window, leaves above max depth are clipped to it
+        std::vector<uint8_t> filled;
+        size_t filled_volume = 0;
+        if (!svo.nodes.empty()) {
+            svo_overlap_visit(svo.nodes.data(), res, SvoAabb{glm::vec3(lo), glm::vec3(hi)}, [&](const SvoCell &cell) {
+                if (filled.empty())
+                    filled.assign(volume, 0);
+
+                const glm::uvec3 c_lo = glm::max(cell.origin, lo) - lo;
+                const glm::uvec3 c_hi = glm::min(cell.origin + glm::uvec3(cell.size), hi) - lo;
+                for (uint32_t z = c_lo.z; z < c_hi.z; z++) {
+                    for (uint32_t y = c_lo.y; y < c_hi.y; y++) {
+                        const size_t i = (static_cast<size_t>(z) * dims.y + y) * dims.x;
+                        std::fill(filled.begin() + i + c_lo.x, filled.begin() + i + c_hi.x, 1);
+                    }
+                }
+                filled_volume += static_cast<size_t>(c_hi.x - c_lo.x) * (c_hi.y - c_lo.y) * (c_hi.z - c_lo.z);
+                return true;
+            });
+        }
+
+        auto write_block = [&](auto &&value_at) {
+            for (uint32_t z = 0; z < block; z++) {
+                for (uint32_t y = 0; y < block; y++) {
+                    // the x bits of the morton code are stepped with a masked increment
+                    const uint64_t row = morton_encode_3d_64(origin.x, origin.y + y, origin.z + z);
+                    uint64_t x_bits = row & MORTON_MASK_X_64;
+                    const uint64_t rest = row & ~MORTON_MASK_X_64;
+                    for (uint32_t x = 0; x < block; x++) {
+                        field[rest | x_bits] = value_at(origin.x + x - lo.x, origin.y + y - lo.y, origin.z + z - lo.z);
+                        x_bits = ((x_bits | ~MORTON_MASK_X_64) + 1) & MORTON_MASK_X_64;
+                    }
+                }
+            }
+        };
+
+        // nothing in reach on one side, the whole block is clamped
+        if (filled_volume == 0 || (filled_volume == volume && type == DISTANCE_FIELD_SIGNED)) {
+            const T value = quantize_distance<T>(filled_volume == 0 ? max_distance : -max_distance, max_distance,
+                                                 type);
+            write_block([&](uint32_t, uint32_t, uint32_t) { return value; });
+            return;
+        }
+        if (filled_volume == volume) {
+            const T value = quantize_distance<T>(0.0f, max_distance, type);
+            write_block([&](uint32_t, uint32_t, uint32_t) { return value; });
+            return;
+        }
+
+        std::vector<uint32_t> to_filled(volume), to_empty;
+        distance_transform_squared(filled.data(), dims, to_filled.data(), 1);
+        if (type == DISTANCE_FIELD_SIGNED) {
+            std::vector<uint8_t> empty(volume);
+            for (size_t i = 0; i < volume; i++)
+                empty[i] = !filled[i];
+            to_empty.resize(volume);
+            distance_transform_squared(empty.data(), dims, to_empty.data(), 1);
+        }
+
+        write_block([&](const uint32_t x, const uint32_t y, const uint32_t z) {
+            const size_t i = (static_cast<size_t>(z) * dims.y + y) * dims.x + x;
+            return quantize_squared_distance<T>(to_filled[i], to_empty.empty() ? 0 : to_empty[i], filled[i] > 0,
+                                                max_distance, type);
+        });
+    }, thread_count);
+
+    return field;
+}
+
+//
+// bvox channel
+//
+
+// file of the distance fields next to the chunk file, chunks.bvox -> chunks_sdf.bvox
+static std::string bvox_distance_field_filename(const std::string &filename) {
+    const std::filesystem::path path(filename);
+    const std::string name = path.stem().string() + "_sdf" + path.extension().string();
+    return (path.parent_path() / name).string();
+}
+
+// quantized fields of morton encoded chunks, written as a bvox with the same layout next to the chunk file.
+// u8 fields are plain bvox files, u16 fields are typed ones. max_distance and type are not stored.
+template<typename T>
+static int write_bvox_distance_fields(const std::string &filename, const std::vector<std::vector<uint8_t> > &chunk_data,
+                                      const BvoxHeader &header, const float max_distance,
+                                      const uint8_t type = DISTANCE_FIELD_UNSIGNED, const uint32_t thread_count = 0) {
+    if (!header.morton_encoded)
+        throw std::runtime_error("distance fields require morton encoded chunks.");
+
+    std::vector<std::vector<T> > fields(chunk_data.size());
+    for (size_t i = 0; i < chunk_data.size(); i++)
+        fields[i] = quantized_distance_field<T>(chunk_data[i], header.chunk_res, max_distance, type, thread_count);
+
+    BvoxHeader field_header = header;
+    field_header.bit_packed = false;
+    return write_bvox(bvox_distance_field_filename(filename), fields, field_header, thread_count);
+}
+
+#endif //DISTANCE_FIELD_H
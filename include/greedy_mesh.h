@@ -0,0 +1,279 @@
+//
+// Created by ludw on 9/16/24.
+//
+
+#ifndef GREEDY_MESH_H
+#define GREEDY_MESH_H
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "svo.h"
+#include "vox.h"
+#include "vox_types.h"
+#include "vss_simd.h"
+#include "vss_thread.h"
+
+// face directions, the normal of a face points out of its cell
+#define FACE_NEG_X 0
+#define FACE_POS_X 1
+#define FACE_NEG_Y 2
+#define FACE_POS_Y 3
+#define FACE_NEG_Z 4
+#define FACE_POS_Z 5
+#define FACE_COUNT 6
+
+// width x height cells of one face direction with the same material, merged into one rectangle. faces along x
+// span y (width) and z (height), faces along y span x and z, faces along z span x and y.
+struct MeshQuad {
+    // first cell of the quad
+    uint32_t x = 0;
+    uint32_t y = 0;
+    uint32_t z = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t mat = 0;
+    uint8_t face = 0;
+};
+
+// corners of the quad in voxel units, counter clockwise seen from outside the cell
+static void mesh_quad_corners(const MeshQuad &quad, glm::vec3 corners[4]) {
+    const int axis = quad.face / 2;
+    const bool positive = quad.face % 2 == 1;
+
+    glm::vec3 origin(quad.x, quad.y, quad.z);
+    glm::vec3 u(0.0f), v(0.0f);
+    if (positive)
+        origin[axis] += 1.0f;
+    u[axis == 0 ? 1 : 0] = static_cast<float>(quad.width);
+    v[axis == 2 ? 1 : 2] = static_cast<float>(quad.height);
+
+    // u x v points along +x and +z but along -y
+    const bool flip = (axis == 1) == positive;
+    corners[0] = origin;
+    corners[1] = flip ? origin + v : origin + u;
+    corners[2] = origin + u + v;
+    corners[3] = flip ? origin + u : origin + v;
+}
+
+//
+// row masks
+//
+
+static bool mesh_row_test(const uint64_t *row, const uint32_t bit) {
+    return (row[bit / 64] >> (bit % 64)) & 1;
+}
+
+// mask of the bits [begin, end) that fall into word w
+static uint64_t mesh_row_mask(const uint32_t w, const uint32_t begin, const uint32_t end) {
+    const uint32_t lo = std::max(begin, w * 64), hi = std::min(end, w * 64 + 64);
+    if (lo >= hi)
+        return 0;
+    const uint32_t count = hi - lo;
+    return (count == 64 ? ~0ULL : ((1ULL << count) - 1)) << (lo - w * 64);
+}
+
+static bool mesh_row_all(const uint64_t *row, const uint32_t begin, const uint32_t end) {
+    for (uint32_t w = begin / 64; w * 64 < end; w++) {
+        const uint64_t mask = mesh_row_mask(w, begin, end);
+        if ((row[w] & mask) != mask)
+            return false;
+    }
+    return true;
+}
+
+static void mesh_row_clear(uint64_t *row, const uint32_t begin, const uint32_t end) {
+    for (uint32_t w = begin / 64; w * 64 < end; w++)
+        row[w] &= ~mesh_row_mask(w, begin, end);
+}
+
+//
+// greedy meshing
+//
+
+// occupancy of a morton encoded chunk as rows of 64 bit words, rows_x[z * res + y] holds the cells along x and
+// rows_y[z * res + x] the cells along y. faces are culled a whole row at a time between neighbouring rows.
+struct MeshRows {
+    uint32_t res = 0;
+    uint32_t words = 0;
+    std::vector<uint64_t> rows_x;
+    std::vector<uint64_t> rows_y;
+
+    const uint64_t *x_row(const uint32_t y, const uint32_t z) const {
+        return rows_x.data() + (static_cast<size_t>(z) * res + y) * words;
+    }
+
+    const uint64_t *y_row(const uint32_t x, const uint32_t z) const {
+        return rows_y.data() + (static_cast<size_t>(z) * res + x) * words;
+    }
+};
+
+template<typename T>
+static MeshRows mesh_rows(const T *cells, const uint32_t res) {
+    MeshRows rows;
+    rows.res = res;
+    rows.words = (res + 63) / 64;
+    rows.rows_x.assign(static_cast<size_t>(res) * res * rows.words, 0);
+    rows.rows_y.assign(static_cast<size_t>(res) * res * rows.words, 0);
+
+    for (uint32_t z = 0; z < res; z++) {
+        for (uint32_t y = 0; y < res; y++) {
+            // the x bits of the morton code are stepped with a masked increment
+            const uint64_t row = morton_encode_3d_64(0, y, z);
+            uint64_t x_bits = 0;
+            uint64_t *x_row = rows.rows_x.data() + (static_cast<size_t>(z) * res + y) * rows.words;
+
+            for (uint32_t x = 0; x < res; x++) {
+                if (VoxelTraits<T>::to_data(cells[row | x_bits]) != 0) {
+                    x_row[x / 64] |= 1ULL << (x % 64);
+                    rows.rows_y[(static_cast<size_t>(z) * res + x) * rows.words + y / 64] |= 1ULL << (y % 64);
+                }
+                x_bits = ((x_bits | ~MORTON_MASK_X_64) + 1) & MORTON_MASK_X_64;
+            }
+        }
+    }
+
+    return rows;
+}
+
+// merge the visible faces of one plane, rows[v] holds the faces along u. mat_at(u, v) is the material of a face.
+template<typename MatAt, typename Emit>
+static void greedy_mesh_plane(std::vector<uint64_t> &rows, const uint32_t res, const uint32_t words, MatAt &&mat_at,
+                              Emit &&emit) {
+    for (uint32_t v = 0; v < res; v++) {
+        uint64_t *row = rows.data() + static_cast<size_t>(v) * words;
+
+        for (uint32_t w = 0; w < words; w++) {
+            while (row[w] != 0) {
+                const uint32_t u = w * 64 + count_trailing_zeros(row[w]);
+                const uint32_t mat = mat_at(u, v);
+
+                uint32_t u_end = u + 1;
+                while (u_end < res && mesh_row_test(row, u_end) && mat_at(u_end, v) == mat)
+                    u_end++;
+
+                uint32_t v_end = v + 1;
+                while (v_end < res) {
+                    const uint64_t *next = rows.data() + static_cast<size_t>(v_end) * words;
+                    if (!mesh_row_all(next, u, u_end))
+                        break;
+
+                    bool same = true;
+                    for (uint32_t i = u; i < u_end && same; i++)
+                        same = mat_at(i, v_end) == mat;
+                    if (!same)
+                        break;
+
+                    v_end++;
+                }
+
+                for (uint32_t i = v; i < v_end; i++)
+                    mesh_row_clear(rows.data() + static_cast<size_t>(i) * words, u, u_end);
+
+                emit(u, v, u_end - u, v_end - v, mat);
+            }
+        }
+    }
+}
+
+// quads of every visible face of a morton encoded chunk of any voxel type, faces on the chunk border are visible.
+// quads are sorted by face direction and plane and hold the voxel data of their cells as material.
+template<typename T>
+static std::vector<MeshQuad> greedy_mesh(const T *cells, const uint32_t res, const size_t size) {
+    if (res == 0 || (res & (res - 1)) != 0 || res > MORTON_MAX_RES_64)
+        throw std::runtime_error("chunk resolution is not a supported power of two.");
+    if (size != static_cast<size_t>(res) * res * res)
+        throw std::runtime_error("chunk size does not match resolution.");
+
+    const MeshRows rows = mesh_rows(cells, res);
+    const uint32_t words = rows.words;
+    std::vector<uint64_t> plane(static_cast<size_t>(res) * words);
+    std::vector<MeshQuad> quads;
+
+    auto mat = [&](const uint32_t x, const uint32_t y, const uint32_t z) -> uint32_t {
+        return VoxelTraits<T>::to_data(cells[morton_encode_3d_64(x, y, z)]);
+    };
+
+    for (uint8_t face = 0; face < FACE_COUNT; face++) {
+        const int axis = face / 2;
+        const bool positive = face % 2 == 1;
+
+        for (uint32_t d = 0; d < res; d++) {
+            // faces of plane d whose neighbour along the normal is empty, rows are indexed by z (or y for z faces)
+            const bool border = positive ? d + 1 == res : d == 0;
+            const uint32_t n = positive ? d + 1 : d - 1;
+
+            for (uint32_t v = 0; v < res; v++) {
+                const uint64_t *cur, *next = nullptr;
+                if (axis == 0) {
+                    cur = rows.y_row(d, v);
+                    next = border ? nullptr : rows.y_row(n, v);
+                } else if (axis == 1) {
+                    cur = rows.x_row(d, v);
+                    next = border ? nullptr : rows.x_row(n, v);
+                } else {
+                    cur = rows.x_row(v, d);
+                    next = border ? nullptr : rows.x_row(v, n);
+                }
+
+                uint64_t *out = plane.data() + static_cast<size_t>(v) * words;
+                for (uint32_t w = 0; w < words; w++)
+                    out[w] = next ? cur[w] & ~next[w] : cur[w];
+            }
+
+            greedy_mesh_plane(plane, res, words, [&](const uint32_t u, const uint32_t v) {
+                if (axis == 0)
+                    return mat(d, u, v);
+                if (axis == 1)
+                    return mat(u, d, v);
+                return mat(u, v, d);
+            }, [&](const uint32_t u, const uint32_t v, const uint32_t width, const uint32_t height, const uint32_t m) {
+                MeshQuad quad;
+                if (axis == 0) {
+                    quad.x = d, quad.y = u, quad.z = v;
+                } else if (axis == 1) {
+                    quad.x = u, quad.y = d, quad.z = v;
+                } else {
+                    quad.x = u, quad.y = v, quad.z = d;
+                }
+                quad.width = width;
+                quad.height = height;
+                quad.mat = m;
+                quad.face = face;
+                quads.push_back(quad);
+            });
+        }
+    }
+
+    return quads;
+}
+
+template<typename T>
+static std::vector<MeshQuad> greedy_mesh(const std::vector<T> &chunk, const uint32_t res) {
+    return greedy_mesh(chunk.data(), res, chunk.size());
+}
+
+// the tree is expanded into a morton grid first, leaves above max depth become uniform blocks of cells. the grid
+// holds the u32 leaf data, so trees of every voxel type keep their full value as the quad material.
+static std::vector<MeshQuad> greedy_mesh(const Svo &svo) {
+    std::vector<uint32_t> grid(static_cast<size_t>(svo.root_res) * svo.root_res * svo.root_res);
+    svo.decode_grid(grid.data(), grid.size());
+    return greedy_mesh(grid.data(), svo.root_res, grid.size());
+}
+
+// every chunk is meshed on its own, chunks are spread over the threads
+template<typename T = uint8_t>
+static std::vector<std::vector<MeshQuad> > greedy_mesh(const std::vector<std::vector<T> > &chunks,
+                                                       const uint32_t res, const uint32_t thread_count = 0) {
+    std::vector<std::vector<MeshQuad> > meshes(chunks.size());
+    parallel_for(0, chunks.size(), [&](const size_t i) {
+        meshes[i] = greedy_mesh(chunks[i], res);
+    }, thread_count);
+    return meshes;
+}
+
+#endif //GREEDY_MESH_H
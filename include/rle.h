@@ -0,0 +1,361 @@
+//
+// Created by ludw on 8/16/24.
+//
+
+#ifndef RLE_H
+#define RLE_H
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+
+#include "vss_simd.h"
+
+#define RLE_MAX (UINT8_MAX - 1)
+
+// (value, u8 count) pairs, runs longer than RLE_MAX are split
+#define RLE_FORMAT_PAIRS 0
+// value followed by the run length as little endian base 128 varint
+#define RLE_FORMAT_VARINT 1
+
+#define RLE_MAX_VARINT_SIZE 10
+
+//
+// run boundary kernels
+//
+
+// first index in [pos, size) whose value differs from value, size if there is none
+static size_t rle_run_end_scalar(const uint8_t *data, size_t pos, const size_t size, const uint8_t value) {
+    const uint64_t pattern = 0x0101010101010101ULL * value;
+
+    for (; pos + sizeof(uint64_t) <= size; pos += sizeof(uint64_t)) {
+        uint64_t word;
+        std::memcpy(&word, data + pos, sizeof(uint64_t));
+
+        // little endian, lowest differing byte is the first one in memory
+        const uint64_t diff = word ^ pattern;
+        if (diff != 0)
+            return pos + count_trailing_zeros(diff) / 8;
+    }
+
+    for (; pos < size; pos++) {
+        if (data[pos] != value)
+            return pos;
+    }
+
+    return size;
+}
+
+// fill count bytes at dst with value, may write up to 32 bytes past the run when slack is true
+static void rle_fill_scalar(uint8_t *dst, const size_t count, const uint8_t value, const bool slack) {
+    if (!slack || count > 32) {
+        std::memset(dst, value, count);
+        return;
+    }
+
+    const uint64_t pattern = 0x0101010101010101ULL * value;
+    std::memcpy(dst, &pattern, sizeof(uint64_t));
+    std::memcpy(dst + 8, &pattern, sizeof(uint64_t));
+    std::memcpy(dst + 16, &pattern, sizeof(uint64_t));
+    std::memcpy(dst + 24, &pattern, sizeof(uint64_t));
+}
+
+#ifdef VSS_X86_SIMD
+static size_t rle_run_end_sse2(const uint8_t *data, size_t pos, const size_t size, const uint8_t value) {
+    const __m128i pattern = _mm_set1_epi8(static_cast<char>(value));
+
+    for (; pos + 16 <= size; pos += 16) {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + pos));
+        const uint32_t diff = ~static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, pattern))) & 0xFFFF;
+        if (diff != 0)
+            return pos + count_trailing_zeros(diff);
+    }
+
+    return rle_run_end_scalar(data, pos, size, value);
+}
+
+static void rle_fill_sse2(uint8_t *dst, const size_t count, const uint8_t value, const bool slack) {
+    if (!slack || count > 32) {
+        std::memset(dst, value, count);
+        return;
+    }
+
+    const __m128i pattern = _mm_set1_epi8(static_cast<char>(value));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), pattern);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 16), pattern);
+}
+
+VSS_TARGET_AVX2 static size_t rle_run_end_avx2(const uint8_t *data, size_t pos, const size_t size, const uint8_t value) {
+    const __m256i pattern = _mm256_set1_epi8(static_cast<char>(value));
+
+    for (; pos + 32 <= size; pos += 32) {
+        const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + pos));
+        const uint32_t diff = ~static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, pattern)));
+        if (diff != 0)
+            return pos + _tzcnt_u32(diff);
+    }
+
+    return rle_run_end_scalar(data, pos, size, value);
+}
+
+VSS_TARGET_AVX2 static void rle_fill_avx2(uint8_t *dst, const size_t count, const uint8_t value, const bool slack) {
+    const __m256i pattern = _mm256_set1_epi8(static_cast<char>(value));
+
+    if (!slack) {
+        size_t i = 0;
+        for (; i + 32 <= count; i += 32)
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), pattern);
+        std::memset(dst + i, value, count - i);
+        return;
+    }
+
+    // whole 32 byte stores, the tail is overwritten by the following runs
+    for (size_t i = 0; i < count; i += 32)
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), pattern);
+}
+#endif
+
+//
+// varint
+//
+
+static size_t write_varint(uint8_t *dst, uint64_t value) {
+    size_t size = 0;
+    while (value >= 0x80) {
+        dst[size++] = static_cast<uint8_t>(value | 0x80);
+        value >>= 7;
+    }
+    dst[size++] = static_cast<uint8_t>(value);
+    return size;
+}
+
+static uint64_t read_varint(const uint8_t *data, size_t &pos, const size_t size) {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (pos >= size)
+            throw std::runtime_error("truncated varint.");
+
+        const uint8_t byte = data[pos++];
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+            return value;
+    }
+
+    throw std::runtime_error("invalid varint.");
+}
+
+//
+// encoding / decoding
+//
+
+// run boundaries are found with the kernel, runs are emitted in the requested format
+template<size_t (*RunEnd)(const uint8_t *, size_t, size_t, uint8_t)>
+static VSS_INLINE size_t run_length_encode_runs(const uint8_t *data, const size_t size, uint8_t *encoded, const uint8_t format) {
+    size_t out = 0;
+
+    for (size_t pos = 0; pos < size;) {
+        const uint8_t value = data[pos];
+        const size_t end = RunEnd(data, pos + 1, size, value);
+        size_t length = end - pos;
+        pos = end;
+
+        if (format == RLE_FORMAT_VARINT) {
+            encoded[out++] = value;
+            out += write_varint(encoded + out, length);
+            continue;
+        }
+
+        for (; length > RLE_MAX; length -= RLE_MAX) {
+            encoded[out++] = value;
+            encoded[out++] = RLE_MAX;
+        }
+
+        encoded[out++] = value;
+        encoded[out++] = static_cast<uint8_t>(length);
+    }
+
+    return out;
+}
+
+#ifdef VSS_X86_SIMD
+VSS_TARGET_AVX2 static size_t run_length_encode_avx2(const uint8_t *data, const size_t size, uint8_t *encoded,
+                                                     const uint8_t format) {
+    return run_length_encode_runs<rle_run_end_avx2>(data, size, encoded, format);
+}
+#endif
+
+// largest possible encoding, a run of one byte costs two bytes in both formats
+static size_t run_length_encode_bound(const size_t size) {
+    return 2 * size;
+}
+
+// encode into a buffer of at least run_length_encode_bound(size) bytes, returns the encoded size
+static size_t run_length_encode(const uint8_t *data, const size_t size, uint8_t *encoded,
+                                const uint8_t format = RLE_FORMAT_PAIRS) {
+    if (format != RLE_FORMAT_PAIRS && format != RLE_FORMAT_VARINT)
+        throw std::runtime_error("unknown run length format.");
+
+    switch (simd_level()) {
+#ifdef VSS_X86_SIMD
+        case SIMD_AVX2:
+            return run_length_encode_avx2(data, size, encoded, format);
+        case SIMD_SSE2:
+            return run_length_encode_runs<rle_run_end_sse2>(data, size, encoded, format);
+#endif
+        default:
+            return run_length_encode_runs<rle_run_end_scalar>(data, size, encoded, format);
+    }
+}
+
+static std::vector<uint8_t> run_length_encode(const std::vector<uint8_t> &data,
+                                              const uint8_t format = RLE_FORMAT_PAIRS) {
+    // uninitialized scratch, most of it is never touched for compressible data
+    std::unique_ptr<uint8_t[]> scratch(new uint8_t[run_length_encode_bound(data.size())]);
+    const size_t size = run_length_encode(data.data(), data.size(), scratch.get(), format);
+
+    return std::vector<uint8_t>(scratch.get(), scratch.get() + size);
+}
+
+template<void (*Fill)(uint8_t *, size_t, uint8_t, bool)>
+static VSS_INLINE size_t run_length_decode_runs(const uint8_t *data, const size_t size, uint8_t *decoded,
+                                     const size_t decoded_size, const uint8_t format) {
+    size_t pos = 0;
+
+    for (size_t i = 0; i < size;) {
+        const uint8_t value = data[i++];
+
+        uint64_t count;
+        if (format == RLE_FORMAT_VARINT) {
+            count = read_varint(data, i, size);
+        } else {
+            if (i >= size)
+                throw std::runtime_error("invalid encoded vector size.");
+            count = data[i++];
+        }
+
+        if (count > decoded_size - pos)
+            throw std::runtime_error("decoded data exceeds buffer size.");
+
+        // wide stores may run past the run as long as they stay inside the buffer
+        const uint64_t span = count <= 32 ? 32 : (count + 31) & ~static_cast<uint64_t>(31);
+        const bool slack = decoded_size - pos >= span;
+        Fill(decoded + pos, count, value, slack);
+        pos += count;
+    }
+
+    return pos;
+}
+
+#ifdef VSS_X86_SIMD
+VSS_TARGET_AVX2 static size_t run_length_decode_avx2(const uint8_t *data, const size_t size, uint8_t *decoded,
+                                                     const size_t decoded_size, const uint8_t format) {
+    return run_length_decode_runs<rle_fill_avx2>(data, size, decoded, decoded_size, format);
+}
+#endif
+
+// decode straight into a preallocated buffer, returns the number of decoded bytes
+static size_t run_length_decode(const uint8_t *data, const size_t size, uint8_t *decoded, const size_t decoded_size,
+                                const uint8_t format = RLE_FORMAT_PAIRS) {
+    if (format == RLE_FORMAT_PAIRS && size % 2 != 0)
+        throw std::runtime_error("invalid encoded vector size.");
+    if (format != RLE_FORMAT_PAIRS && format != RLE_FORMAT_VARINT)
+        throw std::runtime_error("unknown run length format.");
+
+    switch (simd_level()) {
+#ifdef VSS_X86_SIMD
+        case SIMD_AVX2:
+            return run_length_decode_avx2(data, size, decoded, decoded_size, format);
+        case SIMD_SSE2:
+            return run_length_decode_runs<rle_fill_sse2>(data, size, decoded, decoded_size, format);
+#endif
+        default:
+            return run_length_decode_runs<rle_fill_scalar>(data, size, decoded, decoded_size, format);
+    }
+}
+
+static size_t run_length_decoded_size(const uint8_t *data, const size_t size, const uint8_t format = RLE_FORMAT_PAIRS) {
+    size_t decoded_size = 0;
+
+    for (size_t i = 0; i < size;) {
+        i++;
+        if (format == RLE_FORMAT_VARINT) {
+            decoded_size += read_varint(data, i, size);
+        } else {
+            if (i >= size)
+                throw std::runtime_error("invalid encoded vector size.");
+            decoded_size += data[i++];
+        }
+    }
+
+    return decoded_size;
+}
+
+static std::vector<uint8_t> run_length_decode(const std::vector<uint8_t> &data,
+                                              const uint8_t format = RLE_FORMAT_PAIRS) {
+    std::vector<uint8_t> decoded(run_length_decoded_size(data.data(), data.size(), format));
+    run_length_decode(data.data(), data.size(), decoded.data(), decoded.size(), format);
+
+    return decoded;
+}
+
+//
+// wider values
+//
+
+// the bytes of values wider than a byte are split into one plane per byte, runs of equal values stay runs
+// within every plane and most high byte planes are a single run
+template<typename T>
+static std::vector<uint8_t> split_byte_planes(const T *values, const size_t count) {
+    std::vector<uint8_t> planes(count * sizeof(T));
+    for (size_t i = 0; i < count; i++) {
+        uint8_t bytes[sizeof(T)];
+        std::memcpy(bytes, values + i, sizeof(T));
+        for (size_t b = 0; b < sizeof(T); b++)
+            planes[b * count + i] = bytes[b];
+    }
+    return planes;
+}
+
+template<typename T>
+static void join_byte_planes(const uint8_t *planes, const size_t count, T *values) {
+    for (size_t i = 0; i < count; i++) {
+        uint8_t bytes[sizeof(T)];
+        for (size_t b = 0; b < sizeof(T); b++)
+            bytes[b] = planes[b * count + i];
+        std::memcpy(values + i, bytes, sizeof(T));
+    }
+}
+
+// single byte values are encoded directly, wider values plane by plane
+template<typename T>
+static std::vector<uint8_t> run_length_encode_values(const std::vector<T> &values,
+                                                     const uint8_t format = RLE_FORMAT_PAIRS) {
+    if constexpr (sizeof(T) == 1) {
+        std::unique_ptr<uint8_t[]> scratch(new uint8_t[run_length_encode_bound(values.size())]);
+        const size_t size = run_length_encode(reinterpret_cast<const uint8_t *>(values.data()), values.size(),
+                                              scratch.get(), format);
+        return std::vector<uint8_t>(scratch.get(), scratch.get() + size);
+    } else {
+        return run_length_encode(split_byte_planes(values.data(), values.size()), format);
+    }
+}
+
+// decode count values, returns the number of decoded values
+template<typename T>
+static size_t run_length_decode_values(const uint8_t *data, const size_t size, T *values, const size_t count,
+                                       const uint8_t format = RLE_FORMAT_PAIRS) {
+    if constexpr (sizeof(T) == 1) {
+        return run_length_decode(data, size, reinterpret_cast<uint8_t *>(values), count, format);
+    } else {
+        std::vector<uint8_t> planes(count * sizeof(T));
+        if (run_length_decode(data, size, planes.data(), planes.size(), format) != planes.size())
+            return 0;
+
+        join_byte_planes(planes.data(), count, values);
+        return count;
+    }
+}
+
+#endif //RLE_H
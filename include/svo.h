@@ -9,14 +9,29 @@
 #include <vector>
 #include <algorithm>
 #include <queue>
+#include <cstring>
+#include <span>
+#include <type_traits>
 
 #include "glm/glm.hpp"
 
+#include "vox.h"
+#include "vox_bits.h"
+#include "vox_types.h"
+#include "vss_metrics.h"
+#include "vss_simd.h"
+#include "vss_thread.h"
+
 #define SVO_VERSION 2
 
 #define DEFAULT_MAX_DEPTH 8
 #define CHILD_COUNT 8
 #define DEFAULT_MAT 1
+#define MAX_SPLIT_DEPTH 2
+#define MAX_LOOKUP_DEPTH 21
+
+#define SVO_LAYOUT_BFS 0
+#define SVO_LAYOUT_DFS 1
 
 #define SET_BIT(num, bit) ((num) | (1 << (bit)))
 #define RESET_BIT(num, bit) ((num) & ~(1 << (bit)))
@@ -55,31 +70,753 @@ struct SvoNode {
     }
 };
 
+// node of a single tree level during bottom-up construction, index is the morton index on that level
+struct SvoLevelNode {
+    uint32_t index = 0;
+    SvoNode node;
+};
+
+// floor of log2, 0 for a resolution of 0 or 1
+static uint8_t svo_res_depth(const uint32_t res) {
+    return res > 1 ? static_cast<uint8_t>(63 - count_leading_zeros(res)) : 0;
+}
+
+// material of the last filled cell in range, size has to be a multiple of 8
+static uint8_t svo_last_mat(const uint8_t *cells, const size_t size) {
+    for (size_t i = size; i > 0; i -= sizeof(uint64_t)) {
+        uint64_t word;
+        std::memcpy(&word, cells + i - sizeof(uint64_t), sizeof(uint64_t));
+        if (word == 0)
+            continue;
+
+        for (size_t j = i; j > i - sizeof(uint64_t); j--) {
+            if (cells[j - 1] > 0)
+                return cells[j - 1];
+        }
+    }
+
+    return 0;
+}
+
+// levels of one morton range below its top depth, levels[depth] holds the child blocks of the nodes
+// at depth - 1 with data relative to the start of levels[depth + 1]. parents are the filled nodes at top depth.
+struct SvoLevels {
+    std::vector<std::vector<SvoNode> > levels;
+    std::vector<SvoLevelNode> parents;
+};
+
+// emit the leaf level, each group of 8 leaves belongs to one parent
+static void svo_build_leaves(const uint8_t *cells, const size_t cell_count, const size_t leaf_size,
+                             std::vector<SvoNode> &leaves, std::vector<SvoLevelNode> &parents) {
+    const size_t group_size = leaf_size * CHILD_COUNT;
+    const size_t group_count = cell_count / group_size;
+
+    for (size_t g = 0; g < group_count; g++) {
+        const uint8_t *group = cells + g * group_size;
+
+        uint8_t mats[CHILD_COUNT];
+        if (leaf_size == 1) {
+            uint64_t word;
+            std::memcpy(&word, group, sizeof(uint64_t));
+            if (word == 0)
+                continue;
+
+            std::memcpy(mats, group, CHILD_COUNT);
+        } else {
+            uint8_t filled = 0;
+            for (int c = 0; c < CHILD_COUNT; c++) {
+                mats[c] = svo_last_mat(group + c * leaf_size, leaf_size);
+                filled |= mats[c];
+            }
+
+            if (filled == 0)
+                continue;
+        }
+
+        SvoLevelNode parent{static_cast<uint32_t>(g), SvoNode{static_cast<uint32_t>(leaves.size()), 0}};
+        for (uint8_t c = 0; c < CHILD_COUNT; c++) {
+            leaves.push_back(SvoNode{mats[c], 0});
+            if (mats[c] > 0)
+                parent.node.set_child(c);
+        }
+
+        parents.push_back(parent);
+    }
+}
+
+// voxel data of the last filled cell in range for cells of any voxel type
+template<typename T>
+static uint32_t svo_last_data(const T *cells, const size_t size) {
+    for (size_t i = size; i > 0; i--) {
+        const uint32_t data = VoxelTraits<T>::to_data(cells[i - 1]);
+        if (data > 0)
+            return data;
+    }
+
+    return 0;
+}
+
+// leaf level of a grid of any voxel type, leaves hold the voxel data. u8 grids take svo_build_leaves.
+template<typename T>
+static void svo_build_value_leaves(const T *cells, const size_t cell_count, const size_t leaf_size,
+                                   std::vector<SvoNode> &leaves, std::vector<SvoLevelNode> &parents) {
+    const size_t group_size = leaf_size * CHILD_COUNT;
+    const size_t group_count = cell_count / group_size;
+
+    for (size_t g = 0; g < group_count; g++) {
+        const T *group = cells + g * group_size;
+
+        uint32_t mats[CHILD_COUNT];
+        uint32_t filled = 0;
+        for (int c = 0; c < CHILD_COUNT; c++) {
+            mats[c] = svo_last_data(group + c * leaf_size, leaf_size);
+            filled |= mats[c];
+        }
+
+        if (filled == 0)
+            continue;
+
+        SvoLevelNode parent{static_cast<uint32_t>(g), SvoNode{static_cast<uint32_t>(leaves.size()), 0}};
+        for (uint8_t c = 0; c < CHILD_COUNT; c++) {
+            leaves.push_back(SvoNode{mats[c], 0});
+            if (mats[c] > 0)
+                parent.node.set_child(c);
+        }
+
+        parents.push_back(parent);
+    }
+}
+
+// emit one inner level, children are sorted by morton index so siblings are adjacent
+static void svo_build_level(const std::vector<SvoLevelNode> &children, std::vector<SvoNode> &level,
+                            std::vector<SvoLevelNode> &parents) {
+    parents.clear();
+
+    for (size_t i = 0; i < children.size();) {
+        const uint32_t group = children[i].index / CHILD_COUNT;
+
+        SvoLevelNode parent{group, SvoNode{static_cast<uint32_t>(level.size()), 0}};
+        level.resize(level.size() + CHILD_COUNT);
+
+        for (; i < children.size() && children[i].index / CHILD_COUNT == group; i++) {
+            const uint8_t child = children[i].index % CHILD_COUNT;
+            level[parent.node.data + child] = children[i].node;
+            parent.node.set_child(child);
+        }
+
+        parents.push_back(parent);
+    }
+}
+
+// leaf level from an occupancy grid, with one cell per leaf every byte of a word is the child mask of one parent
+static void svo_build_occupancy_leaves(const uint64_t *words, const size_t begin, const size_t cell_count,
+                                       const size_t leaf_size, const uint32_t mat, std::vector<SvoNode> &leaves,
+                                       std::vector<SvoLevelNode> &parents) {
+    const size_t group_size = leaf_size * CHILD_COUNT;
+    const size_t group_count = cell_count / group_size;
+
+    for (size_t g = 0; g < group_count; g++) {
+        const size_t group = begin + g * group_size;
+
+        uint8_t mask = 0;
+        if (leaf_size == 1) {
+            mask = static_cast<uint8_t>(words[group / OCCUPANCY_WORD_CELLS] >> (group % OCCUPANCY_WORD_CELLS));
+        } else {
+            for (uint8_t c = 0; c < CHILD_COUNT; c++) {
+                if (!occupancy_range_empty(words, group + c * leaf_size, group + (c + 1) * leaf_size))
+                    mask = SET_BIT(mask, c);
+            }
+        }
+
+        if (mask == 0)
+            continue;
+
+        parents.push_back(SvoLevelNode{static_cast<uint32_t>(g), SvoNode{static_cast<uint32_t>(leaves.size()), mask}});
+        for (uint8_t c = 0; c < CHILD_COUNT; c++)
+            leaves.push_back(SvoNode{CHECK_BIT(mask, c) ? mat : 0, 0});
+    }
+}
+
+// emit_leaves(leaves, parents) fills the leaf level of the range
+template<typename EmitLeaves>
+static SvoLevels svo_build_levels(EmitLeaves &&emit_leaves, const uint8_t max_depth, const uint8_t top_depth) {
+    SvoLevels out;
+    out.levels.resize(max_depth + 1);
+    emit_leaves(out.levels[max_depth], out.parents);
+
+    std::vector<SvoLevelNode> next_parents;
+    for (uint8_t depth = max_depth - 1; depth > top_depth; depth--) {
+        svo_build_level(out.parents, out.levels[depth], next_parents);
+        std::swap(out.parents, next_parents);
+    }
+
+    return out;
+}
+
+// path of a previous single lookup. spatially coherent lookups that pass the same cache resume below the deepest
+// node they share with it instead of starting at the root. opt in, keep one per thread. it is dropped when the
+// tree was rebuilt or edited since its last use, call reset() after changing nodes by hand.
+struct SvoLookupCache {
+    const SvoNode *nodes = nullptr;
+    uint64_t revision = 0;
+    uint64_t code = 0;
+    uint8_t depth = 0;
+    uint32_t path[MAX_LOOKUP_DEPTH + 1]{};
+
+    void reset() {
+        nodes = nullptr;
+    }
+};
+
 class Svo {
 public:
     std::vector<SvoNode> nodes;
     uint32_t root_res = 0;
     uint8_t max_depth = DEFAULT_MAX_DEPTH;
 
+    // start of unused 8 node child blocks left behind by edits
+    std::vector<uint32_t> free_blocks;
+    // bumped by every build and edit, invalidates lookup caches
+    uint64_t revision = 0;
+
+    // aggregated material of every node so any depth can serve as a lod, empty until build_lod is called
+    // and dropped again by edits
+    std::vector<uint32_t> lod_mats;
+
     Svo() {
     }
 
-    Svo(const std::vector<uint8_t> &vox_grid, const uint32_t grid_res, const uint8_t loc_max_depth = DEFAULT_MAX_DEPTH) {
+    Svo(const std::vector<uint8_t> &vox_grid, const uint32_t grid_res, const uint8_t loc_max_depth = DEFAULT_MAX_DEPTH,
+        const uint32_t thread_count = 1) {
         max_depth = loc_max_depth;
-        nodes.reserve(vox_grid.size());
-        nodes.push_back(SvoNode()); // add root
-
         root_res = grid_res;
 
         // indices are morton encoded, thats why this algorithm works
-        for (size_t i = 0; i < vox_grid.size(); i++) {
-            const uint8_t mat = vox_grid[i];
+        build(vox_grid.data(), vox_grid.size(), thread_count);
+
+        VSS_EVENT("octree size: " << nodes.size() << " | grid size: " << vox_grid.size() << " | compression: "
+                  << (float) nodes.size() / (float) vox_grid.size());
+    }
+
+    // bottom-up construction from a morton encoded grid, every 8 consecutive nodes of a level
+    // are the children of one node on the level above. levels are built from the leaves up and
+    // laid out breadth first with the root at index 0, only existing child blocks are allocated.
+    //
+    // with a thread count other than 1 the grid is split into 8 or 64 morton subranges that are built
+    // in parallel and stitched together, the resulting nodes are identical to the single threaded build.
+    int build(const uint8_t *vox_grid, const size_t grid_size, const uint32_t thread_count = 1) {
+        return build_levels(grid_size, thread_count, [&](const size_t begin, const size_t count, const size_t leaf_size,
+                                                         std::vector<SvoNode> &leaves,
+                                                         std::vector<SvoLevelNode> &parents) {
+            if (max_depth == 0)
+                leaves.push_back(SvoNode{svo_last_mat(vox_grid, grid_size), 0});
+            else
+                svo_build_leaves(vox_grid + begin, count, leaf_size, leaves, parents);
+        });
+    }
+
+    // same tree from a morton encoded grid of any voxel type, leaves hold VoxelTraits<T>::to_data of their voxel
+    template<typename T>
+    int build(const T *vox_grid, const size_t grid_size, const uint32_t thread_count = 1) {
+        if constexpr (std::is_same_v<T, uint8_t>) {
+            return build(static_cast<const uint8_t *>(vox_grid), grid_size, thread_count);
+        } else {
+            return build_levels(grid_size, thread_count, [&](const size_t begin, const size_t count,
+                                                             const size_t leaf_size, std::vector<SvoNode> &leaves,
+                                                             std::vector<SvoLevelNode> &parents) {
+                if (max_depth == 0)
+                    leaves.push_back(SvoNode{svo_last_data(vox_grid, grid_size), 0});
+                else
+                    svo_build_value_leaves(vox_grid + begin, count, leaf_size, leaves, parents);
+            });
+        }
+    }
+
+    // same tree from a morton encoded occupancy grid, every set cell gets mat. the leaf level is read
+    // straight from the words without unpacking.
+    int build(const uint64_t *words, const size_t grid_size, const uint32_t mat, const uint32_t thread_count = 1) {
+        check_occupancy_cell_count(grid_size);
+
+        return build_levels(grid_size, thread_count, [&](const size_t begin, const size_t count, const size_t leaf_size,
+                                                         std::vector<SvoNode> &leaves,
+                                                         std::vector<SvoLevelNode> &parents) {
+            if (max_depth == 0)
+                leaves.push_back(SvoNode{occupancy_range_empty(words, 0, grid_size) ? 0 : mat, 0});
+            else
+                svo_build_occupancy_leaves(words, begin, count, leaf_size, mat, leaves, parents);
+        });
+    }
+
+    // emit_leaves(begin, count, leaf_size, leaves, parents) builds the leaf level of the cells [begin, begin + count),
+    // for a tree without children it is asked for the root only
+    template<typename EmitLeaves>
+    int build_levels(const size_t grid_size, const uint32_t thread_count, EmitLeaves &&emit_leaves) {
+        const uint8_t res_depth = svo_res_depth(root_res);
+        if ((static_cast<uint32_t>(1) << res_depth) != root_res)
+            throw std::runtime_error("grid resolution is not a power of two.");
+        if (max_depth > res_depth)
+            throw std::runtime_error("max depth exceeds grid resolution.");
+        if (grid_size != static_cast<size_t>(root_res) * root_res * root_res)
+            throw std::runtime_error("grid size does not match resolution.");
+
+        VSS_SPAN(SPAN_SVO_BUILD);
+
+        nodes.clear();
+        free_blocks.clear();
+        lod_mats.clear();
+        revision++;
+
+        // cells covered by one leaf node
+        const size_t leaf_size = static_cast<size_t>(1) << (3 * (res_depth - max_depth));
+
+        if (max_depth == 0) {
+            std::vector<SvoLevelNode> parents;
+            emit_leaves(0, grid_size, grid_size, nodes, parents);
+            VSS_COUNT(METRIC_NODES_ALLOCATED, nodes.size());
+            return EXIT_SUCCESS;
+        }
+
+        // subranges need at least one level of their own
+        const uint8_t split_depth = thread_count == 1 ? 0 : std::min<uint8_t>(MAX_SPLIT_DEPTH, max_depth - 1);
+        const size_t subtree_count = static_cast<size_t>(1) << (3 * split_depth);
+        const size_t subtree_size = grid_size / subtree_count;
+
+        std::vector<SvoLevels> subtrees(subtree_count);
+        parallel_for(0, subtree_count, [&](const size_t k) {
+            subtrees[k] = svo_build_levels([&](std::vector<SvoNode> &leaves, std::vector<SvoLevelNode> &parents) {
+                emit_leaves(k * subtree_size, subtree_size, leaf_size, leaves, parents);
+            }, max_depth, split_depth);
+        }, thread_count);
+
+        // position of every subtree inside the levels below the split
+        std::vector<std::vector<uint32_t> > offsets(subtree_count + 1, std::vector<uint32_t>(max_depth + 2, 0));
+        for (size_t k = 0; k < subtree_count; k++) {
+            for (uint8_t depth = split_depth + 1; depth <= max_depth; depth++)
+                offsets[k + 1][depth] = offsets[k][depth] + static_cast<uint32_t>(subtrees[k].levels[depth].size());
+        }
+
+        // levels above the split, built from the subtree roots
+        SvoLevels top;
+        top.levels.resize(split_depth + 1);
+        for (size_t k = 0; k < subtree_count; k++) {
+            for (SvoLevelNode parent: subtrees[k].parents) {
+                parent.index += static_cast<uint32_t>(k);
+                parent.node.data += offsets[k][split_depth + 1];
+                top.parents.push_back(parent);
+            }
+        }
+
+        std::vector<SvoLevelNode> next_parents;
+        for (uint8_t depth = split_depth; depth > 0; depth--) {
+            svo_build_level(top.parents, top.levels[depth], next_parents);
+            std::swap(top.parents, next_parents);
+        }
+
+        if (top.parents.empty()) {
+            nodes.push_back(SvoNode());
+            VSS_COUNT(METRIC_NODES_ALLOCATED, nodes.size());
+            return EXIT_SUCCESS;
+        }
+
+        // link levels into one breadth first array
+        std::vector<uint32_t> base(max_depth + 2, 1);
+        for (uint8_t depth = 1; depth <= max_depth; depth++) {
+            const uint32_t level_size = depth <= split_depth
+                                            ? static_cast<uint32_t>(top.levels[depth].size())
+                                            : offsets[subtree_count][depth];
+            base[depth + 1] = base[depth] + level_size;
+        }
+
+        nodes.resize(base[max_depth + 1]);
+
+        nodes[0] = top.parents[0].node;
+        nodes[0].data += base[1];
+
+        for (uint8_t depth = 1; depth <= split_depth; depth++) {
+            std::copy(top.levels[depth].begin(), top.levels[depth].end(), nodes.begin() + base[depth]);
+            for (uint32_t i = base[depth]; i < base[depth + 1]; i++) {
+                if (nodes[i].is_parent())
+                    nodes[i].data += base[depth + 1];
+            }
+        }
+
+        parallel_for(0, subtree_count, [&](const size_t k) {
+            for (uint8_t depth = split_depth + 1; depth <= max_depth; depth++) {
+                std::vector<SvoNode> &level = subtrees[k].levels[depth];
+                SvoNode *dst = nodes.data() + base[depth] + offsets[k][depth];
+                const uint32_t child_base = base[depth + 1] + offsets[k][depth + 1];
+
+                for (size_t i = 0; i < level.size(); i++) {
+                    dst[i] = level[i];
+                    if (depth < max_depth && dst[i].is_parent())
+                        dst[i].data += child_base;
+                }
+
+                std::vector<SvoNode>().swap(level);
+            }
+        }, thread_count);
+
+        VSS_COUNT(METRIC_NODES_ALLOCATED, nodes.size());
+        return EXIT_SUCCESS;
+    }
+
+    // material at a voxel, 0 for empty or out of bounds voxels
+    uint32_t get(const uint32_t x, const uint32_t y, const uint32_t z) const {
+        if (x >= root_res || y >= root_res || z >= root_res)
+            return 0;
+        return lookup<false>(morton_encode_3d_64(x, y, z), nullptr);
+    }
+
+    // same lookup resuming from the path of the previous one, for coherent probes like neighbours of a cell
+    uint32_t get(const uint32_t x, const uint32_t y, const uint32_t z, SvoLookupCache &cache) const {
+        if (x >= root_res || y >= root_res || z >= root_res)
+            return 0;
+        if (cache.nodes != nodes.data() || cache.revision != revision) {
+            cache.nodes = nodes.data();
+            cache.revision = revision;
+            cache.depth = 0;
+            cache.path[0] = 0;
+        }
+        return lookup<true>(morton_encode_3d_64(x, y, z), &cache);
+    }
+
+    // typed voxel at a position for trees built from a grid of T
+    template<typename T>
+    T get_voxel(const uint32_t x, const uint32_t y, const uint32_t z) const {
+        return VoxelTraits<T>::from_data(get(x, y, z));
+    }
 
-            if (mat > 0)
-                insert_node(static_cast<uint32_t>(i), max_depth, mat);
+    // batched lookup, queries are sorted by morton code so shared path prefixes are only descended once
+    std::vector<uint32_t> get_many(const std::span<const glm::uvec3> positions) const {
+        std::vector<std::pair<uint64_t, uint32_t> > queries;
+        queries.reserve(positions.size());
+
+        std::vector<uint32_t> mats(positions.size(), 0);
+        for (size_t i = 0; i < positions.size(); i++) {
+            const glm::uvec3 &pos = positions[i];
+            if (pos.x < root_res && pos.y < root_res && pos.z < root_res)
+                queries.emplace_back(morton_encode_3d_64(pos.x, pos.y, pos.z), static_cast<uint32_t>(i));
+        }
+
+        // lsd radix sort over the used code bits
+        std::vector<std::pair<uint64_t, uint32_t> > sorted(queries.size());
+        const uint32_t code_bits = 3 * svo_res_depth(root_res);
+        for (uint32_t shift = 0; shift < code_bits; shift += 8) {
+            size_t counts[257] = {};
+            for (const auto &query: queries)
+                counts[((query.first >> shift) & 0xFF) + 1]++;
+            for (int b = 0; b < 256; b++)
+                counts[b + 1] += counts[b];
+            for (const auto &query: queries)
+                sorted[counts[(query.first >> shift) & 0xFF]++] = query;
+            std::swap(queries, sorted);
+        }
+
+        SvoLookupCache cache;
+        cache.nodes = nodes.data();
+        cache.revision = revision;
+        for (const auto &[code, index]: queries)
+            mats[index] = lookup<true>(code, &cache);
+
+        return mats;
+    }
+
+private:
+    // descend to the leaf of code. with Resume the walk starts below the deepest node code shares with the
+    // previous code of the cache and records its path, a cache at depth 0 starts at the root. without it the
+    // cache is not touched and may be null.
+    template<bool Resume>
+    uint32_t lookup(const uint64_t code, SvoLookupCache *cache) const {
+        const uint8_t res_depth = svo_res_depth(root_res);
+        if (res_depth > MAX_LOOKUP_DEPTH)
+            throw std::runtime_error("grid resolution too large for lookups.");
+
+        uint8_t depth = 0;
+        uint32_t current = 0;
+        if constexpr (Resume) {
+            // deepest node the previous code shares with this one
+            const uint64_t diff = code ^ cache->code;
+            const uint8_t shared = diff == 0
+                                       ? res_depth
+                                       : static_cast<uint8_t>(res_depth - 1 - (63 - count_leading_zeros(diff)) / 3);
+            depth = std::min(shared, cache->depth);
+            current = cache->path[depth];
+        }
+
+        uint32_t mat = 0;
+        for (;; depth++) {
+            const SvoNode &node = nodes[current];
+            if (node.is_leaf()) {
+                mat = node.data;
+                break;
+            }
+
+            const uint8_t child = static_cast<uint8_t>((code >> (3 * (res_depth - 1 - depth))) & 0x7);
+            if (!node.exists_child(child))
+                break;
+
+            current = node.data + child;
+            if constexpr (Resume)
+                cache->path[depth + 1] = current;
+        }
+
+        if constexpr (Resume) {
+            cache->code = code;
+            cache->depth = depth;
+        }
+
+        return mat;
+    }
+
+public:
+    //
+    // editing
+    //
+
+    // set the material of a voxel, leaves on the path are subdivided and uniform blocks collapse again
+    int set_voxel(const uint32_t x, const uint32_t y, const uint32_t z, const uint32_t mat) {
+        if (x >= root_res || y >= root_res || z >= root_res)
+            throw std::runtime_error("voxel out of bounds.");
+        if (nodes.empty())
+            nodes.push_back(SvoNode());
+
+        const uint8_t res_depth = svo_res_depth(root_res);
+        const uint64_t code = morton_encode_3d_64(x, y, z);
+        lod_mats.clear();
+        revision++;
+
+        uint32_t path[MAX_LOOKUP_DEPTH + 1];
+        path[0] = 0;
+
+        uint8_t depth = 0;
+        for (; depth < max_depth; depth++) {
+            const uint32_t current = path[depth];
+
+            if (nodes[current].is_leaf()) {
+                // the whole leaf already has this material
+                if (nodes[current].data == mat)
+                    return EXIT_SUCCESS;
+
+                subdivide(current);
+            }
+
+            const uint8_t child = static_cast<uint8_t>((code >> (3 * (res_depth - 1 - depth))) & 0x7);
+            path[depth + 1] = nodes[current].data + child;
+        }
+
+        nodes[path[max_depth]] = SvoNode{mat, 0};
+
+        // fix child masks on the way up and merge blocks that became uniform
+        for (int d = max_depth - 1; d >= 0; d--) {
+            const uint32_t parent = path[d];
+            const uint8_t child = static_cast<uint8_t>((code >> (3 * (res_depth - 1 - d))) & 0x7);
+
+            if (nodes[path[d + 1]].is_filled())
+                nodes[parent].set_child(child);
+            else
+                nodes[parent].reset_child(child);
+
+            collapse(parent);
+        }
+
+        return EXIT_SUCCESS;
+    }
+
+    int clear_voxel(const uint32_t x, const uint32_t y, const uint32_t z) {
+        return set_voxel(x, y, z, 0);
+    }
+
+    // turn a leaf into a parent of 8 leaves with the same material
+    void subdivide(const uint32_t index) {
+        const SvoNode leaf = nodes[index];
+        const uint32_t block = allocate_block();
+
+        for (uint8_t c = 0; c < CHILD_COUNT; c++)
+            nodes[block + c] = SvoNode{leaf.data, 0};
+
+        nodes[index] = SvoNode{block, static_cast<uint8_t>(leaf.data > 0 ? UINT8_MAX : 0)};
+    }
+
+    // merge the children of a parent into one leaf if they are all leaves of the same material.
+    // the child mask is not checked since a parent whose last child was just cleared has none left.
+    bool collapse(const uint32_t index) {
+        const uint32_t block = nodes[index].data;
+        for (uint8_t c = 0; c < CHILD_COUNT; c++) {
+            if (!nodes[block + c].is_leaf() || nodes[block + c].data != nodes[block].data)
+                return false;
         }
 
-        std::cout << "octree size: " << nodes.size() << " | grid size: " << vox_grid.size() << " | compression: " << (float) nodes.size() / (float) vox_grid.size() << std::endl;
+        nodes[index] = SvoNode{nodes[block].data, 0};
+        free_block(block);
+
+        return true;
+    }
+
+    uint32_t allocate_block() {
+        if (!free_blocks.empty()) {
+            const uint32_t block = free_blocks.back();
+            free_blocks.pop_back();
+            return block;
+        }
+
+        const uint32_t block = static_cast<uint32_t>(nodes.size());
+        nodes.resize(nodes.size() + CHILD_COUNT);
+        VSS_COUNT(METRIC_NODES_ALLOCATED, CHILD_COUNT);
+        return block;
+    }
+
+    void free_block(const uint32_t block) {
+        std::fill_n(nodes.begin() + block, CHILD_COUNT, SvoNode());
+        free_blocks.push_back(block);
+    }
+
+    // rewrite the node array without free blocks, breadth first keeps every level together,
+    // depth first keeps every subtree together
+    int compact(const uint8_t layout = SVO_LAYOUT_BFS) {
+        if (nodes.empty())
+            return EXIT_SUCCESS;
+
+        std::vector<SvoNode> compacted;
+        compacted.reserve(nodes.size() - free_blocks.size() * CHILD_COUNT);
+        compacted.push_back(nodes[0]);
+
+        const bool has_lod = !lod_mats.empty();
+        std::vector<uint32_t> compacted_lods;
+        if (has_lod)
+            compacted_lods.push_back(lod_mats[0]);
+
+        // breadth first visits the compacted array in order, depth first keeps a stack of pending parents
+        std::vector<uint32_t> pending = {0};
+        size_t next = 0;
+
+        while (layout == SVO_LAYOUT_DFS ? !pending.empty() : next < compacted.size()) {
+            uint32_t index;
+            if (layout == SVO_LAYOUT_DFS) {
+                index = pending.back();
+                pending.pop_back();
+            } else {
+                index = static_cast<uint32_t>(next++);
+            }
+
+            if (!compacted[index].is_parent())
+                continue;
+
+            const uint32_t source = compacted[index].data;
+            const uint32_t block = static_cast<uint32_t>(compacted.size());
+            compacted[index].data = block;
+            compacted.insert(compacted.end(), nodes.begin() + source, nodes.begin() + source + CHILD_COUNT);
+            if (has_lod)
+                compacted_lods.insert(compacted_lods.end(), lod_mats.begin() + source,
+                                      lod_mats.begin() + source + CHILD_COUNT);
+
+            if (layout == SVO_LAYOUT_DFS) {
+                for (int c = CHILD_COUNT - 1; c >= 0; c--)
+                    pending.push_back(block + c);
+            }
+        }
+
+        nodes = std::move(compacted);
+        lod_mats = std::move(compacted_lods);
+        free_blocks.clear();
+        revision++;
+
+        return EXIT_SUCCESS;
+    }
+
+    //
+    // level of detail
+    //
+
+    int build_lod(const uint8_t mode = LOD_MAJORITY) {
+        lod_mats.assign(nodes.size(), 0);
+        if (!nodes.empty())
+            build_lod_node(0, 0, mode);
+
+        return EXIT_SUCCESS;
+    }
+
+    // returns the number of filled leaf cells below the node
+    uint64_t build_lod_node(const uint32_t index, const uint8_t depth, const uint8_t mode) {
+        const SvoNode node = nodes[index];
+        if (node.is_leaf()) {
+            lod_mats[index] = node.data;
+            return node.data > 0 ? static_cast<uint64_t>(1) << (3 * (max_depth - depth)) : 0;
+        }
+
+        uint32_t mats[CHILD_COUNT]{};
+        uint64_t filled[CHILD_COUNT]{};
+        uint64_t total = 0;
+        for (uint8_t c = 0; c < CHILD_COUNT; c++) {
+            if (!node.exists_child(c))
+                continue;
+
+            filled[c] = build_lod_node(node.data + c, depth + 1, mode);
+            mats[c] = lod_mats[node.data + c];
+            total += filled[c];
+        }
+
+        lod_mats[index] = lod_select(mats, filled, static_cast<uint64_t>(1) << (3 * (max_depth - depth - 1)), mode);
+        return total;
+    }
+
+    // material of the cell containing the voxel at the given depth, leaves above it answer for their whole cell
+    uint32_t get_lod(const uint32_t x, const uint32_t y, const uint32_t z, const uint8_t depth) const {
+        if (lod_mats.size() != nodes.size())
+            throw std::runtime_error("svo has no lod materials.");
+        if (nodes.empty() || x >= root_res || y >= root_res || z >= root_res)
+            return 0;
+
+        const uint8_t res_depth = svo_res_depth(root_res);
+        const uint64_t code = morton_encode_3d_64(x, y, z);
+
+        uint32_t current = 0;
+        for (uint8_t d = 0; d < depth && nodes[current].is_parent(); d++) {
+            const uint8_t child = static_cast<uint8_t>((code >> (3 * (res_depth - 1 - d))) & 0x7);
+            if (!nodes[current].exists_child(child))
+                return 0;
+
+            current = nodes[current].data + child;
+        }
+
+        return lod_mats[current];
+    }
+
+    // inverse of build, writes the morton encoded grid. a leaf fills its whole cell with its material,
+    // cells below missing children stay empty.
+    template<typename T = uint8_t>
+    int decode_grid(T *vox_grid, const size_t grid_size) const {
+        if (grid_size != static_cast<size_t>(root_res) * root_res * root_res)
+            throw std::runtime_error("grid is not the size of the svo.");
+
+        std::fill(vox_grid, vox_grid + grid_size, VoxelTraits<T>::from_data(0));
+        if (nodes.empty())
+            return EXIT_SUCCESS;
+
+        struct Cell {
+            uint32_t index;
+            size_t offset;
+            size_t size;
+        };
+
+        std::vector<Cell> stack = {Cell{0, 0, grid_size}};
+        while (!stack.empty()) {
+            const Cell cell = stack.back();
+            stack.pop_back();
+
+            const SvoNode &node = nodes[cell.index];
+            if (node.is_leaf()) {
+                std::fill(vox_grid + cell.offset, vox_grid + cell.offset + cell.size, VoxelTraits<T>::from_data(node.data));
+                continue;
+            }
+
+            const size_t child_size = cell.size / CHILD_COUNT;
+            for (uint8_t c = 0; c < CHILD_COUNT; c++) {
+                if (node.exists_child(c))
+                    stack.push_back(Cell{node.data + c, cell.offset + c * child_size, child_size});
+            }
+        }
+
+        return EXIT_SUCCESS;
     }
 
     int insert_node(const uint32_t morton_index, const uint8_t max_depth, const uint8_t mat) {
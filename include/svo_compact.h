@@ -0,0 +1,273 @@
+//
+// Created by ludw on 8/19/24.
+//
+
+#ifndef SVO_COMPACT_H
+#define SVO_COMPACT_H
+
+#include <cstdint>
+#include <vector>
+#include <stdexcept>
+
+#include "svo.h"
+#include "vss_simd.h"
+
+#define COMPACT_POINTER_BITS 24
+#define COMPACT_POINTER_MAX ((1u << COMPACT_POINTER_BITS) - 1)
+
+// child mask in the low 8 bits, the upper 24 bits hold the index of the first child relative to the
+// start of the next level, or the material for leaves. only existing children are stored, so child c
+// sits at pointer + popcount of the mask bits below c.
+struct SvoCompactNode {
+    uint32_t bits = 0;
+
+    static SvoCompactNode make(const uint32_t pointer, const uint8_t child_mask) {
+        if (pointer > COMPACT_POINTER_MAX)
+            throw std::runtime_error("compact node pointer out of range.");
+        return SvoCompactNode{pointer << 8 | child_mask};
+    }
+
+    uint8_t child_mask() const {
+        return static_cast<uint8_t>(bits & 0xFF);
+    }
+
+    uint32_t pointer() const {
+        return bits >> 8;
+    }
+
+    uint32_t data() const {
+        return bits >> 8;
+    }
+
+    bool is_leaf() const {
+        return child_mask() == 0;
+    }
+
+    bool is_parent() const {
+        return child_mask() > 0;
+    }
+
+    bool exists_child(const uint8_t index) const {
+        return CHECK_BIT(child_mask(), index);
+    }
+
+    uint32_t child_offset(const uint8_t index) const {
+        return pointer() + popcount(child_mask() & ((1u << index) - 1));
+    }
+};
+
+static_assert(sizeof(SvoCompactNode) == 4, "compact node has to be 4 bytes.");
+
+// leaves keep 24 bits of voxel data, enough for u8 and u16 voxels but not for the 32 bit formats
+static void check_compact_voxel_format(const uint8_t format) {
+    if (format == VOXEL_FORMAT_RGBA8)
+        throw std::runtime_error("compact nodes cannot hold rgba8 voxels.");
+    if (format == VOXEL_FORMAT_MAT_NORMAL)
+        throw std::runtime_error("compact nodes cannot hold mat normal voxels.");
+}
+
+// node of a single tree level during bottom-up construction, index is the morton index on that level
+struct SvoCompactLevelNode {
+    uint32_t index = 0;
+    SvoCompactNode node;
+};
+
+// levels are stored breadth first, level_offsets[depth] is the index of the first node at depth
+class SvoCompact {
+public:
+    std::vector<SvoCompactNode> nodes;
+    std::vector<uint32_t> level_offsets;
+    uint32_t root_res = 0;
+    uint8_t max_depth = DEFAULT_MAX_DEPTH;
+
+    SvoCompact() {
+    }
+
+    SvoCompact(const std::vector<uint8_t> &vox_grid, const uint32_t grid_res, const uint8_t loc_max_depth = DEFAULT_MAX_DEPTH) {
+        max_depth = loc_max_depth;
+        root_res = grid_res;
+
+        build(vox_grid.data(), vox_grid.size());
+    }
+
+    // index of a child of node, which lies at depth
+    uint32_t child_index(const uint32_t node, const uint8_t depth, const uint8_t child) const {
+        return level_offsets[depth + 1] + nodes[node].child_offset(child);
+    }
+
+    // bottom-up construction from a morton encoded grid like Svo::build, but empty children are never stored
+    int build(const uint8_t *vox_grid, const size_t grid_size) {
+        const uint8_t res_depth = svo_res_depth(root_res);
+        if ((static_cast<uint32_t>(1) << res_depth) != root_res)
+            throw std::runtime_error("grid resolution is not a power of two.");
+        if (max_depth > res_depth)
+            throw std::runtime_error("max depth exceeds grid resolution.");
+        if (grid_size != static_cast<size_t>(root_res) * root_res * root_res)
+            throw std::runtime_error("grid size does not match resolution.");
+
+        nodes.clear();
+        level_offsets.assign(max_depth + 1, 0);
+
+        // cells covered by one leaf node
+        const size_t leaf_size = static_cast<size_t>(1) << (3 * (res_depth - max_depth));
+
+        if (max_depth == 0) {
+            nodes.push_back(SvoCompactNode::make(svo_last_mat(vox_grid, grid_size), 0));
+            return EXIT_SUCCESS;
+        }
+
+        std::vector<std::vector<SvoCompactNode> > levels(max_depth + 1);
+        std::vector<SvoCompactLevelNode> parents;
+        std::vector<SvoCompactLevelNode> next_parents;
+
+        const size_t group_size = leaf_size * CHILD_COUNT;
+        const size_t group_count = grid_size / group_size;
+        std::vector<SvoCompactNode> &leaves = levels[max_depth];
+
+        for (size_t g = 0; g < group_count; g++) {
+            const uint8_t *group = vox_grid + g * group_size;
+
+            uint8_t mats[CHILD_COUNT];
+            if (leaf_size == 1) {
+                uint64_t word;
+                std::memcpy(&word, group, sizeof(uint64_t));
+                if (word == 0)
+                    continue;
+
+                std::memcpy(mats, group, CHILD_COUNT);
+            } else {
+                uint8_t filled = 0;
+                for (int c = 0; c < CHILD_COUNT; c++) {
+                    mats[c] = svo_last_mat(group + c * leaf_size, leaf_size);
+                    filled |= mats[c];
+                }
+
+                if (filled == 0)
+                    continue;
+            }
+
+            const uint32_t pointer = static_cast<uint32_t>(leaves.size());
+            uint8_t child_mask = 0;
+            for (uint8_t c = 0; c < CHILD_COUNT; c++) {
+                if (mats[c] > 0) {
+                    leaves.push_back(SvoCompactNode::make(mats[c], 0));
+                    child_mask = SET_BIT(child_mask, c);
+                }
+            }
+
+            parents.push_back({static_cast<uint32_t>(g), SvoCompactNode::make(pointer, child_mask)});
+        }
+
+        for (uint8_t depth = max_depth - 1; depth > 0; depth--) {
+            std::vector<SvoCompactNode> &level = levels[depth];
+            next_parents.clear();
+
+            for (size_t i = 0; i < parents.size();) {
+                const uint32_t group = parents[i].index / CHILD_COUNT;
+                const uint32_t pointer = static_cast<uint32_t>(level.size());
+                uint8_t child_mask = 0;
+
+                for (; i < parents.size() && parents[i].index / CHILD_COUNT == group; i++) {
+                    level.push_back(parents[i].node);
+                    child_mask = SET_BIT(child_mask, parents[i].index % CHILD_COUNT);
+                }
+
+                next_parents.push_back({group, SvoCompactNode::make(pointer, child_mask)});
+            }
+
+            std::swap(parents, next_parents);
+        }
+
+        nodes.push_back(parents.empty() ? SvoCompactNode() : parents[0].node);
+
+        for (uint8_t depth = 1; depth <= max_depth; depth++) {
+            level_offsets[depth] = static_cast<uint32_t>(nodes.size());
+            nodes.insert(nodes.end(), levels[depth].begin(), levels[depth].end());
+            std::vector<SvoCompactNode>().swap(levels[depth]);
+        }
+
+        return EXIT_SUCCESS;
+    }
+};
+
+//
+// conversion
+//
+
+// breadth first walk over the classic tree, keeping only existing children
+static SvoCompact compact_svo(const Svo &svo) {
+    SvoCompact compact;
+    compact.root_res = svo.root_res;
+    compact.max_depth = svo.max_depth;
+    compact.level_offsets.assign(svo.max_depth + 1, 0);
+
+    std::vector<uint32_t> level = {0};
+    std::vector<uint32_t> next_level;
+
+    for (uint8_t depth = 0; depth <= svo.max_depth; depth++) {
+        compact.level_offsets[depth] = static_cast<uint32_t>(compact.nodes.size());
+        next_level.clear();
+
+        for (const uint32_t index: level) {
+            const SvoNode &node = svo.nodes[index];
+
+            if (node.is_leaf()) {
+                compact.nodes.push_back(SvoCompactNode::make(node.data, 0));
+                continue;
+            }
+
+            compact.nodes.push_back(SvoCompactNode::make(static_cast<uint32_t>(next_level.size()), node.child_mask));
+            for (uint8_t c = 0; c < CHILD_COUNT; c++) {
+                if (node.exists_child(c))
+                    next_level.push_back(node.data + c);
+            }
+        }
+
+        std::swap(level, next_level);
+    }
+
+    return compact;
+}
+
+// back to the classic layout, parents keep their order so the result matches Svo::build
+static Svo expand_svo(const SvoCompact &compact) {
+    Svo svo;
+    svo.root_res = compact.root_res;
+    svo.max_depth = compact.max_depth;
+
+    if (compact.nodes.empty())
+        return svo;
+
+    svo.nodes.push_back(SvoNode());
+
+    std::vector<std::pair<uint32_t, uint32_t> > level = {{0, 0}}; // compact index, classic index
+    std::vector<std::pair<uint32_t, uint32_t> > next_level;
+
+    for (uint8_t depth = 0; depth <= compact.max_depth && !level.empty(); depth++) {
+        next_level.clear();
+
+        for (const auto &[index, classic]: level) {
+            const SvoCompactNode &node = compact.nodes[index];
+
+            if (node.is_leaf()) {
+                svo.nodes[classic] = SvoNode{node.data(), 0};
+                continue;
+            }
+
+            const uint32_t block = static_cast<uint32_t>(svo.nodes.size());
+            svo.nodes[classic] = SvoNode{block, node.child_mask()};
+            svo.nodes.resize(svo.nodes.size() + CHILD_COUNT);
+
+            for (uint8_t c = 0; c < CHILD_COUNT; c++) {
+                if (node.exists_child(c))
+                    next_level.push_back({compact.child_index(index, depth, c), block + c});
+            }
+        }
+
+        std::swap(level, next_level);
+    }
+
+    return svo;
+}
+
+#endif //SVO_COMPACT_H
@@ -0,0 +1,290 @@
+//
+// Created by ludw on 9/18/24.
+//
+
+#ifndef SVO_CSG_H
+#define SVO_CSG_H
+
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "svo.h"
+
+// b is written over a
+#define SVO_CSG_UNION 0
+// a without the cells b fills
+#define SVO_CSG_SUBTRACT 1
+// a where b fills a cell
+#define SVO_CSG_INTERSECT 2
+
+#define SVO_REGION_EMPTY 0
+#define SVO_REGION_UNIFORM 1
+#define SVO_REGION_MIXED 2
+
+// content of a node or region, mat is only set for uniform regions
+struct SvoRegion {
+    uint8_t state = SVO_REGION_EMPTY;
+    uint32_t mat = 0;
+};
+
+static SvoRegion svo_region_merge(const SvoRegion a, const SvoRegion b) {
+    if (a.state == SVO_REGION_MIXED || b.state == SVO_REGION_MIXED)
+        return SvoRegion{SVO_REGION_MIXED, 0};
+    if (a.state == b.state && a.mat == b.mat)
+        return a;
+    return SvoRegion{SVO_REGION_MIXED, 0};
+}
+
+static SvoRegion svo_region_summary(const Svo &svo, const uint32_t index, std::vector<SvoRegion> &regions) {
+    const SvoNode &node = svo.nodes[index];
+    if (node.is_leaf())
+        return regions[index] = node.data > 0 ? SvoRegion{SVO_REGION_UNIFORM, node.data} : SvoRegion{};
+
+    SvoRegion region = svo_region_summary(svo, node.data, regions);
+    for (uint8_t c = 1; c < CHILD_COUNT; c++)
+        region = svo_region_merge(region, svo_region_summary(svo, node.data + c, regions));
+
+    return regions[index] = region;
+}
+
+// content of every reachable node, built trees keep uniform regions subdivided down to max depth
+static std::vector<SvoRegion> svo_region_summaries(const Svo &svo) {
+    std::vector<SvoRegion> regions(svo.nodes.size());
+    if (!svo.nodes.empty())
+        svo_region_summary(svo, 0, regions);
+    return regions;
+}
+
+// combines two trees node by node, see svo_csg
+class SvoCsg {
+public:
+    SvoCsg(const Svo &loc_a, const Svo &loc_b, const uint8_t loc_op, const glm::ivec3 &loc_offset)
+        : a(loc_a), b(loc_b) {
+        op = loc_op;
+        offset[0] = loc_offset.x;
+        offset[1] = loc_offset.y;
+        offset[2] = loc_offset.z;
+
+        if (op > SVO_CSG_INTERSECT)
+            throw std::runtime_error("unknown csg operation.");
+
+        const uint32_t leaf_size = a.root_res >> a.max_depth;
+        if (!b.nodes.empty() && (b.root_res >> b.max_depth) != leaf_size)
+            throw std::runtime_error("csg operands differ in leaf size.");
+        for (const int64_t o: offset) {
+            if (o % static_cast<int64_t>(leaf_size) != 0)
+                throw std::runtime_error("csg offset is not aligned to leaves.");
+        }
+
+        a_regions = svo_region_summaries(a);
+        b_regions = svo_region_summaries(b);
+    }
+
+    Svo run() {
+        out.root_res = a.root_res;
+        out.max_depth = a.max_depth;
+        out.nodes.push_back(SvoNode());
+
+        const uint64_t origin[3] = {0, 0, 0};
+        const SvoNode root = a.nodes.empty()
+                                 ? combine(NO_NODE, 0, origin, a.root_res, 0)
+                                 : combine(0, 0, origin, a.root_res, 0);
+        out.nodes[0] = root;
+
+        out.compact();
+        return std::move(out);
+    }
+
+private:
+    static constexpr uint32_t NO_NODE = UINT32_MAX;
+
+    const Svo &a;
+    const Svo &b;
+    uint8_t op = SVO_CSG_UNION;
+    int64_t offset[3]{};
+    std::vector<SvoRegion> a_regions;
+    std::vector<SvoRegion> b_regions;
+    Svo out;
+
+    // content of b in the cube [lo, lo + size) of its own space, cells outside of b are empty. stops at the
+    // first node that makes the cube mixed and never descends into uniform nodes.
+    SvoRegion classify_b(const int64_t lo[3], const uint64_t size) const {
+        const auto res = static_cast<int64_t>(b.root_res);
+        const auto cube = static_cast<int64_t>(size);
+
+        bool outside = b.nodes.empty();
+        bool partial = false;
+        for (int k = 0; k < 3; k++) {
+            outside = outside || lo[k] >= res || lo[k] + cube <= 0;
+            partial = partial || lo[k] < 0 || lo[k] + cube > res;
+        }
+        if (outside)
+            return SvoRegion{};
+
+        // the part outside of b counts as empty
+        bool any = partial;
+        SvoRegion region{};
+
+        struct Item {
+            uint32_t index;
+            int64_t origin[3];
+            int64_t size;
+        };
+
+        std::vector<Item> stack = {Item{0, {0, 0, 0}, res}};
+        while (!stack.empty()) {
+            const Item item = stack.back();
+            stack.pop_back();
+
+            bool overlaps = true, contained = true;
+            for (int k = 0; k < 3; k++) {
+                overlaps = overlaps && item.origin[k] < lo[k] + cube && lo[k] < item.origin[k] + item.size;
+                contained = contained && lo[k] <= item.origin[k] && item.origin[k] + item.size <= lo[k] + cube;
+            }
+            if (!overlaps)
+                continue;
+
+            const SvoRegion &node_region = b_regions[item.index];
+            if (node_region.state == SVO_REGION_MIXED) {
+                if (contained)
+                    return node_region;
+
+                const SvoNode &node = b.nodes[item.index];
+                const int64_t child_size = item.size / 2;
+                for (uint8_t c = 0; c < CHILD_COUNT; c++) {
+                    stack.push_back(Item{node.data + c, {item.origin[0] + (c & 1) * child_size,
+                                                         item.origin[1] + ((c >> 1) & 1) * child_size,
+                                                         item.origin[2] + ((c >> 2) & 1) * child_size}, child_size});
+                }
+                continue;
+            }
+
+            region = any ? svo_region_merge(region, node_region) : node_region;
+            any = true;
+            if (region.state == SVO_REGION_MIXED)
+                return region;
+        }
+
+        return region;
+    }
+
+    SvoRegion region_a(const uint32_t index, const uint32_t mat) const {
+        if (index != NO_NODE)
+            return a_regions[index];
+        return mat > 0 ? SvoRegion{SVO_REGION_UNIFORM, mat} : SvoRegion{};
+    }
+
+    static SvoNode leaf(const SvoRegion &region) {
+        return SvoNode{region.state == SVO_REGION_UNIFORM ? region.mat : 0, 0};
+    }
+
+    // subtree of a, uniform subtrees become leaves
+    SvoNode copy_a(const uint32_t index, const uint32_t mat) {
+        const SvoRegion region = region_a(index, mat);
+        if (region.state != SVO_REGION_MIXED)
+            return leaf(region);
+
+        const SvoNode node = a.nodes[index];
+        const auto block = static_cast<uint32_t>(out.nodes.size());
+        out.nodes.resize(out.nodes.size() + CHILD_COUNT);
+        for (uint8_t c = 0; c < CHILD_COUNT; c++) {
+            const SvoNode child = copy_a(node.data + c, 0);
+            out.nodes[block + c] = child;
+        }
+
+        return SvoNode{block, node.child_mask};
+    }
+
+    // result for the cube of a at origin, index is the node of a or NO_NODE inside a leaf of material mat
+    SvoNode combine(const uint32_t index, const uint32_t mat, const uint64_t origin[3], const uint64_t size,
+                    const uint8_t depth) {
+        const SvoRegion region = region_a(index, mat);
+
+        if (op != SVO_CSG_UNION && region.state == SVO_REGION_EMPTY)
+            return SvoNode();
+
+        const int64_t lo[3] = {static_cast<int64_t>(origin[0]) - offset[0], static_cast<int64_t>(origin[1]) - offset[1],
+                               static_cast<int64_t>(origin[2]) - offset[2]};
+        const SvoRegion b_region = classify_b(lo, size);
+
+        switch (op) {
+            case SVO_CSG_UNION:
+                if (b_region.state == SVO_REGION_UNIFORM)
+                    return leaf(b_region);
+                if (b_region.state == SVO_REGION_EMPTY)
+                    return copy_a(index, mat);
+                break;
+            case SVO_CSG_SUBTRACT:
+                if (b_region.state == SVO_REGION_UNIFORM)
+                    return SvoNode();
+                if (b_region.state == SVO_REGION_EMPTY)
+                    return copy_a(index, mat);
+                break;
+            default:
+                if (b_region.state == SVO_REGION_EMPTY)
+                    return SvoNode();
+                if (b_region.state == SVO_REGION_UNIFORM)
+                    return copy_a(index, mat);
+                break;
+        }
+
+        if (depth >= out.max_depth)
+            throw std::runtime_error("csg operands are not aligned.");
+
+        // a leaf of a is split into 8 leaves of its material
+        const bool parent = index != NO_NODE && a.nodes[index].is_parent();
+        const uint32_t leaf_mat = index == NO_NODE ? mat : a.nodes[index].data;
+
+        const auto block = static_cast<uint32_t>(out.nodes.size());
+        out.nodes.resize(out.nodes.size() + CHILD_COUNT);
+
+        const uint64_t child_size = size / 2;
+        SvoNode node{block, 0};
+        bool uniform = true;
+        for (uint8_t c = 0; c < CHILD_COUNT; c++) {
+            const uint64_t child_origin[3] = {origin[0] + (c & 1) * child_size, origin[1] + ((c >> 1) & 1) * child_size,
+                                              origin[2] + ((c >> 2) & 1) * child_size};
+            const SvoNode child = parent
+                                      ? combine(a.nodes[index].data + c, 0, child_origin, child_size, depth + 1)
+                                      : combine(NO_NODE, leaf_mat, child_origin, child_size, depth + 1);
+            out.nodes[block + c] = child;
+
+            if (child.is_filled())
+                node.set_child(c);
+            uniform = uniform && child.is_leaf() && child.data == out.nodes[block].data;
+        }
+
+        // leaf children allocate nothing, so the block is still the last one
+        if (uniform) {
+            const uint32_t data = out.nodes[block].data;
+            out.nodes.resize(block);
+            return SvoNode{data, 0};
+        }
+
+        return node;
+    }
+};
+
+// combine two trees into a new compacted tree with the size of a. b is placed at offset in voxels of a, cells
+// of b outside of a are dropped. both trees need the same leaf size and the offset has to be a multiple of it.
+// subtrees where b is empty or uniform are copied or dropped without descending into them.
+static Svo svo_csg(const Svo &a, const Svo &b, const uint8_t op, const glm::ivec3 &offset = glm::ivec3(0)) {
+    return SvoCsg(a, b, op, offset).run();
+}
+
+static Svo svo_union(const Svo &a, const Svo &b, const glm::ivec3 &offset = glm::ivec3(0)) {
+    return svo_csg(a, b, SVO_CSG_UNION, offset);
+}
+
+static Svo svo_subtract(const Svo &a, const Svo &b, const glm::ivec3 &offset = glm::ivec3(0)) {
+    return svo_csg(a, b, SVO_CSG_SUBTRACT, offset);
+}
+
+static Svo svo_intersect(const Svo &a, const Svo &b, const glm::ivec3 &offset = glm::ivec3(0)) {
+    return svo_csg(a, b, SVO_CSG_INTERSECT, offset);
+}
+
+#endif //SVO_CSG_H
@@ -0,0 +1,170 @@
+//
+// Created by ludw on 8/21/24.
+//
+
+#ifndef SVO_DAG_H
+#define SVO_DAG_H
+
+#include <array>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "svo.h"
+
+// block of 8 sibling nodes with their child pointers already remapped
+struct SvoDagBlock {
+    std::array<uint64_t, CHILD_COUNT> nodes{};
+
+    bool operator==(const SvoDagBlock &other) const {
+        return nodes == other.nodes;
+    }
+};
+
+struct SvoDagBlockHash {
+    size_t operator()(const SvoDagBlock &block) const {
+        uint64_t hash = 0x9E3779B97F4A7C15ULL;
+        for (const uint64_t node: block.nodes) {
+            hash ^= node + 0x9E3779B97F4A7C15ULL + (hash << 6) + (hash >> 2);
+            hash *= 0xBF58476D1CE4E5B9ULL;
+        }
+        return static_cast<size_t>(hash ^ (hash >> 31));
+    }
+};
+
+// sparse voxel dag, same node layout as Svo but identical child blocks are stored once and shared
+// between parents. nodes are laid out level by level with the root at index 0, so any traversal
+// written against Svo (child c of a parent at data + c) works unchanged. nodes must not be edited in place.
+class SvoDag {
+public:
+    std::vector<SvoNode> nodes;
+    uint32_t root_res = 0;
+    uint8_t max_depth = DEFAULT_MAX_DEPTH;
+
+    SvoDag() {
+    }
+
+    explicit SvoDag(const Svo &svo) {
+        reduce(svo);
+    }
+
+    // merge identical subtrees level by level from the leaves up
+    int reduce(const Svo &svo) {
+        root_res = svo.root_res;
+        max_depth = svo.max_depth;
+        nodes.clear();
+
+        if (svo.nodes.empty())
+            return EXIT_SUCCESS;
+
+        // parents on every depth of the source tree
+        std::vector<std::vector<uint32_t> > parents(max_depth + 1);
+        if (svo.nodes[0].is_parent())
+            parents[0].push_back(0);
+
+        for (uint8_t depth = 0; depth < max_depth; depth++) {
+            for (const uint32_t index: parents[depth]) {
+                for (uint8_t c = 0; c < CHILD_COUNT; c++) {
+                    if (svo.nodes[svo.nodes[index].data + c].is_parent())
+                        parents[depth + 1].push_back(svo.nodes[index].data + c);
+                }
+            }
+        }
+
+        // source block start -> unique block, relative to the start of its level
+        std::vector<uint32_t> block_remap(svo.nodes.size(), 0);
+        std::vector<std::vector<SvoNode> > levels(max_depth + 1);
+
+        for (int depth = max_depth - 1; depth >= 0; depth--) {
+            std::vector<SvoNode> &level = levels[depth + 1];
+            std::unordered_map<SvoDagBlock, uint32_t, SvoDagBlockHash> unique_blocks;
+            unique_blocks.reserve(parents[depth].size());
+
+            for (const uint32_t index: parents[depth]) {
+                const uint32_t block_start = svo.nodes[index].data;
+
+                SvoDagBlock block;
+                SvoNode children[CHILD_COUNT];
+                for (uint8_t c = 0; c < CHILD_COUNT; c++) {
+                    children[c] = svo.nodes[block_start + c];
+                    if (children[c].is_parent())
+                        children[c].data = block_remap[children[c].data];
+
+                    block.nodes[c] = static_cast<uint64_t>(children[c].data) << 8 | children[c].child_mask;
+                }
+
+                const auto [it, inserted] = unique_blocks.try_emplace(block, static_cast<uint32_t>(level.size()));
+                if (inserted)
+                    level.insert(level.end(), children, children + CHILD_COUNT);
+
+                block_remap[block_start] = it->second;
+            }
+        }
+
+        // link levels into one array
+        std::vector<uint32_t> base(max_depth + 2, 1);
+        for (uint8_t depth = 1; depth <= max_depth; depth++)
+            base[depth + 1] = base[depth] + static_cast<uint32_t>(levels[depth].size());
+
+        nodes.reserve(base[max_depth + 1]);
+
+        SvoNode root = svo.nodes[0];
+        if (root.is_parent())
+            root.data = block_remap[root.data] + base[1];
+        nodes.push_back(root);
+
+        for (uint8_t depth = 1; depth <= max_depth; depth++) {
+            for (SvoNode node: levels[depth]) {
+                if (node.is_parent())
+                    node.data += base[depth + 1];
+                nodes.push_back(node);
+            }
+        }
+
+        return EXIT_SUCCESS;
+    }
+};
+
+// unfold shared blocks into a tree, the result matches Svo::build for the same grid
+static Svo expand_dag(const std::vector<SvoNode> &dag_nodes, const uint32_t root_res, const uint8_t max_depth) {
+    Svo svo;
+    svo.root_res = root_res;
+    svo.max_depth = max_depth;
+
+    if (dag_nodes.empty())
+        return svo;
+
+    svo.nodes.push_back(dag_nodes[0]);
+
+    std::vector<uint32_t> level = {0}; // tree indices, data still points into the dag
+    std::vector<uint32_t> next_level;
+
+    while (!level.empty()) {
+        next_level.clear();
+
+        for (const uint32_t index: level) {
+            if (!svo.nodes[index].is_parent())
+                continue;
+
+            const uint32_t source = svo.nodes[index].data;
+            const uint32_t block = static_cast<uint32_t>(svo.nodes.size());
+            svo.nodes[index].data = block;
+
+            for (uint8_t c = 0; c < CHILD_COUNT; c++) {
+                svo.nodes.push_back(dag_nodes[source + c]);
+                if (dag_nodes[source + c].is_parent())
+                    next_level.push_back(block + c);
+            }
+        }
+
+        std::swap(level, next_level);
+    }
+
+    return svo;
+}
+
+static Svo expand_dag(const SvoDag &dag) {
+    return expand_dag(dag.nodes, dag.root_res, dag.max_depth);
+}
+
+#endif //SVO_DAG_H
@@ -0,0 +1,390 @@
+//
+// Created by ludw on 9/20/24.
+//
+
+#ifndef SVO_QUERY_H
+#define SVO_QUERY_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "svo.h"
+#include "svo_dag.h"
+#include "vss_thread.h"
+
+// shapes are in grid space like rays, the octree covers [0, root_res] on every axis. shapes overlap a cell
+// when they share a volume with it, touching a face is not an overlap.
+
+struct SvoAabb {
+    glm::vec3 min{0.0f};
+    glm::vec3 max{0.0f};
+};
+
+struct SvoSphere {
+    glm::vec3 center{0.0f};
+    float radius = 0.0f;
+};
+
+// all points within radius of the segment from a to b
+struct SvoCapsule {
+    glm::vec3 a{0.0f};
+    glm::vec3 b{0.0f};
+    float radius = 0.0f;
+};
+
+// filled leaf, a cube of size cells starting at origin
+struct SvoCell {
+    glm::uvec3 origin{0};
+    uint32_t size = 0;
+    uint32_t mat = 0;
+};
+
+struct SvoSweepHit {
+    bool hit = false;
+    // fraction of the movement until the box touches the cell
+    float t = 1.0f;
+    // face of the cell that was hit, zero when the box already overlaps the cell at the start
+    glm::ivec3 normal{0};
+    SvoCell cell;
+};
+
+//
+// shape / box tests
+//
+
+static float box_distance2(const glm::vec3 &p, const glm::vec3 &lo, const glm::vec3 &hi) {
+    float d2 = 0.0f;
+    for (int k = 0; k < 3; k++) {
+        const float d = std::max({lo[k] - p[k], 0.0f, p[k] - hi[k]});
+        d2 += d * d;
+    }
+    return d2;
+}
+
+// squared distance between a segment and a box. the distance along the segment is piecewise quadratic with
+// breaks where a coordinate crosses a box face, every piece is minimized in closed form.
+static float segment_box_distance2(const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &lo, const glm::vec3 &hi) {
+    const glm::vec3 d = b - a;
+
+    float breaks[8];
+    int count = 0;
+    breaks[count++] = 0.0f;
+    breaks[count++] = 1.0f;
+    for (int k = 0; k < 3; k++) {
+        if (d[k] == 0.0f)
+            continue;
+        for (const float face: {lo[k], hi[k]}) {
+            const float t = (face - a[k]) / d[k];
+            if (t <= 0.0f || t >= 1.0f)
+                continue;
+
+            // insertion into the sorted breaks
+            int i = count++;
+            for (; i > 0 && breaks[i - 1] > t; i--)
+                breaks[i] = breaks[i - 1];
+            breaks[i] = t;
+        }
+    }
+
+    float best = box_distance2(a, lo, hi);
+    for (int i = 0; i + 1 < count; i++) {
+        const float t0 = breaks[i], t1 = breaks[i + 1];
+        const glm::vec3 mid = a + d * ((t0 + t1) * 0.5f);
+
+        // axes outside of the box on this piece contribute (d t + c)^2
+        float dd = 0.0f, dc = 0.0f;
+        for (int k = 0; k < 3; k++) {
+            const float face = mid[k] < lo[k] ? lo[k] : (mid[k] > hi[k] ? hi[k] : mid[k]);
+            if (face == mid[k])
+                continue;
+            dd += d[k] * d[k];
+            dc += d[k] * (a[k] - face);
+        }
+
+        const float t = dd > 0.0f ? std::clamp(-dc / dd, t0, t1) : t0;
+        best = std::min({best, box_distance2(a + d * t, lo, hi), box_distance2(a + d * t1, lo, hi)});
+    }
+
+    return best;
+}
+
+static bool shape_overlaps_box(const SvoAabb &box, const glm::vec3 &lo, const glm::vec3 &hi) {
+    return box.min.x < hi.x && box.max.x > lo.x && box.min.y < hi.y && box.max.y > lo.y && box.min.z < hi.z &&
+           box.max.z > lo.z;
+}
+
+static bool shape_overlaps_box(const SvoSphere &sphere, const glm::vec3 &lo, const glm::vec3 &hi) {
+    return box_distance2(sphere.center, lo, hi) < sphere.radius * sphere.radius;
+}
+
+static bool shape_overlaps_box(const SvoCapsule &capsule, const glm::vec3 &lo, const glm::vec3 &hi) {
+    return segment_box_distance2(capsule.a, capsule.b, lo, hi) < capsule.radius * capsule.radius;
+}
+
+//
+// overlap queries
+//
+
+// visits every filled leaf overlapping the shape, branches are only entered through existing children.
+// visit(cell) returns false to stop, the function returns false if it was stopped.
+template<typename Shape, typename Visit>
+static bool svo_overlap_visit(const SvoNode *nodes, const uint32_t root_res, const Shape &shape, Visit &&visit) {
+    if (root_res == 0)
+        return true;
+    if (svo_res_depth(root_res) > MAX_LOOKUP_DEPTH)
+        throw std::runtime_error("grid resolution too large for queries.");
+
+    struct Item {
+        uint32_t index;
+        glm::uvec3 origin;
+        uint32_t size;
+    };
+
+    // the children of one node per level, deeper trees are refused above
+    Item stack[CHILD_COUNT * (MAX_LOOKUP_DEPTH + 1)];
+    int top = 0;
+    stack[top++] = Item{0, glm::uvec3(0), root_res};
+
+    while (top > 0) {
+        const Item item = stack[--top];
+        const glm::vec3 lo(item.origin);
+        if (!shape_overlaps_box(shape, lo, lo + glm::vec3(static_cast<float>(item.size))))
+            continue;
+
+        const SvoNode &node = nodes[item.index];
+        if (node.is_leaf()) {
+            if (node.data > 0 && !visit(SvoCell{item.origin, item.size, node.data}))
+                return false;
+            continue;
+        }
+
+        const uint32_t child_size = item.size / 2;
+        for (uint8_t c = 0; c < CHILD_COUNT; c++) {
+            if (!node.exists_child(c))
+                continue;
+            const glm::uvec3 offset(c & 1, (c >> 1) & 1, (c >> 2) & 1);
+            stack[top++] = Item{node.data + c, item.origin + offset * child_size, child_size};
+        }
+    }
+
+    return true;
+}
+
+// true at the first filled leaf that overlaps the shape
+template<typename Shape>
+static bool svo_overlaps(const SvoNode *nodes, const uint32_t root_res, const Shape &shape) {
+    return !svo_overlap_visit(nodes, root_res, shape, [](const SvoCell &) { return false; });
+}
+
+// appends every filled leaf that overlaps the shape, leaves above max depth are returned as one cell
+template<typename Shape>
+static int svo_overlap_cells(const SvoNode *nodes, const uint32_t root_res, const Shape &shape,
+                             std::vector<SvoCell> &cells) {
+    svo_overlap_visit(nodes, root_res, shape, [&](const SvoCell &cell) {
+        cells.push_back(cell);
+        return true;
+    });
+    return EXIT_SUCCESS;
+}
+
+//
+// sweep
+//
+
+// entry time, exit time and entry axis of a moving point against a box. axes without movement need the point
+// strictly inside, so boxes that only slide along a face do not hit it.
+static bool sweep_slab(const glm::vec3 &p, const glm::vec3 &delta, const glm::vec3 &lo, const glm::vec3 &hi,
+                       float &t_enter, float &t_exit, int &axis) {
+    t_enter = -std::numeric_limits<float>::infinity();
+    t_exit = std::numeric_limits<float>::infinity();
+    axis = -1;
+
+    for (int k = 0; k < 3; k++) {
+        if (delta[k] == 0.0f) {
+            if (p[k] <= lo[k] || p[k] >= hi[k])
+                return false;
+            continue;
+        }
+
+        const float inv = 1.0f / delta[k];
+        float t0 = (lo[k] - p[k]) * inv, t1 = (hi[k] - p[k]) * inv;
+        if (t0 > t1)
+            std::swap(t0, t1);
+
+        if (t0 > t_enter) {
+            t_enter = t0;
+            axis = k;
+        }
+        t_exit = std::min(t_exit, t1);
+    }
+
+    return t_enter < t_exit && t_exit > 0.0f && t_enter <= 1.0f;
+}
+
+// first filled leaf the box touches while it moves by delta. the box is shrunk to its center and every node
+// grown by the half extents, nodes are visited near to far and skipped once they start behind the best hit.
+static SvoSweepHit svo_sweep(const SvoNode *nodes, const uint32_t root_res, const SvoAabb &box,
+                             const glm::vec3 &delta) {
+    SvoSweepHit best;
+    if (root_res == 0)
+        return best;
+    if (svo_res_depth(root_res) > MAX_LOOKUP_DEPTH)
+        throw std::runtime_error("grid resolution too large for queries.");
+
+    const glm::vec3 center = (box.min + box.max) * 0.5f;
+    const glm::vec3 half = (box.max - box.min) * 0.5f;
+
+    struct Item {
+        uint32_t index;
+        glm::uvec3 origin;
+        uint32_t size;
+        float t;
+    };
+
+    Item stack[CHILD_COUNT * (MAX_LOOKUP_DEPTH + 1)];
+    int top = 0;
+    stack[top++] = Item{0, glm::uvec3(0), root_res, 0.0f};
+
+    while (top > 0) {
+        const Item item = stack[--top];
+        if (best.hit && item.t >= best.t)
+            continue;
+
+        const SvoNode &node = nodes[item.index];
+        if (node.is_leaf()) {
+            if (node.data == 0)
+                continue;
+
+            const glm::vec3 lo(item.origin);
+            float t_enter, t_exit;
+            int axis;
+            if (!sweep_slab(center, delta, lo - half, lo + glm::vec3(static_cast<float>(item.size)) + half, t_enter,
+                            t_exit, axis))
+                continue;
+
+            const float t = std::max(t_enter, 0.0f);
+            if (best.hit && t >= best.t)
+                continue;
+
+            best.hit = true;
+            best.t = t;
+            best.normal = glm::ivec3(0);
+            if (t_enter >= 0.0f && axis >= 0)
+                best.normal[axis] = delta[axis] > 0.0f ? -1 : 1;
+            best.cell = SvoCell{item.origin, item.size, node.data};
+            continue;
+        }
+
+        // children that are hit are pushed far to near
+        Item children[CHILD_COUNT];
+        int count = 0;
+        const uint32_t child_size = item.size / 2;
+        for (uint8_t c = 0; c < CHILD_COUNT; c++) {
+            if (!node.exists_child(c))
+                continue;
+
+            const glm::uvec3 origin = item.origin + glm::uvec3(c & 1, (c >> 1) & 1, (c >> 2) & 1) * child_size;
+            const glm::vec3 lo(origin);
+            float t_enter, t_exit;
+            int axis;
+            if (!sweep_slab(center, delta, lo - half, lo + glm::vec3(static_cast<float>(child_size)) + half, t_enter,
+                            t_exit, axis))
+                continue;
+
+            const float t = std::max(t_enter, 0.0f);
+            if (best.hit && t >= best.t)
+                continue;
+
+            int i = count++;
+            for (; i > 0 && children[i - 1].t < t; i--)
+                children[i] = children[i - 1];
+            children[i] = Item{node.data + c, origin, child_size, t};
+        }
+
+        for (int i = 0; i < count; i++)
+            stack[top++] = children[i];
+    }
+
+    return best;
+}
+
+//
+// tree types
+//
+
+template<typename Shape>
+static bool svo_overlaps(const Svo &svo, const Shape &shape) {
+    return !svo.nodes.empty() && svo_overlaps(svo.nodes.data(), svo.root_res, shape);
+}
+
+template<typename Shape>
+static bool svo_overlaps(const SvoDag &dag, const Shape &shape) {
+    return !dag.nodes.empty() && svo_overlaps(dag.nodes.data(), dag.root_res, shape);
+}
+
+template<typename Shape>
+static int svo_overlap_cells(const Svo &svo, const Shape &shape, std::vector<SvoCell> &cells) {
+    if (svo.nodes.empty())
+        return EXIT_SUCCESS;
+    return svo_overlap_cells(svo.nodes.data(), svo.root_res, shape, cells);
+}
+
+template<typename Shape>
+static int svo_overlap_cells(const SvoDag &dag, const Shape &shape, std::vector<SvoCell> &cells) {
+    if (dag.nodes.empty())
+        return EXIT_SUCCESS;
+    return svo_overlap_cells(dag.nodes.data(), dag.root_res, shape, cells);
+}
+
+static SvoSweepHit svo_sweep(const Svo &svo, const SvoAabb &box, const glm::vec3 &delta) {
+    return svo.nodes.empty() ? SvoSweepHit() : svo_sweep(svo.nodes.data(), svo.root_res, box, delta);
+}
+
+static SvoSweepHit svo_sweep(const SvoDag &dag, const SvoAabb &box, const glm::vec3 &delta) {
+    return dag.nodes.empty() ? SvoSweepHit() : svo_sweep(dag.nodes.data(), dag.root_res, box, delta);
+}
+
+//
+// batches
+//
+
+// one flag per shape, shapes are spread over the threads
+template<typename Shape>
+static std::vector<uint8_t> svo_overlaps_many(const Svo &svo, const std::vector<Shape> &shapes,
+                                              const uint32_t thread_count = 0) {
+    std::vector<uint8_t> results(shapes.size());
+    parallel_for(0, shapes.size(), [&](const size_t i) {
+        results[i] = svo_overlaps(svo, shapes[i]);
+    }, thread_count);
+    return results;
+}
+
+template<typename Shape>
+static std::vector<std::vector<SvoCell> > svo_overlap_cells_many(const Svo &svo, const std::vector<Shape> &shapes,
+                                                                 const uint32_t thread_count = 0) {
+    std::vector<std::vector<SvoCell> > results(shapes.size());
+    parallel_for(0, shapes.size(), [&](const size_t i) {
+        svo_overlap_cells(svo, shapes[i], results[i]);
+    }, thread_count);
+    return results;
+}
+
+static std::vector<SvoSweepHit> svo_sweep_many(const Svo &svo, const std::vector<SvoAabb> &boxes,
+                                               const std::vector<glm::vec3> &deltas, const uint32_t thread_count = 0) {
+    if (boxes.size() != deltas.size())
+        throw std::runtime_error("sweep boxes and movements differ in count.");
+
+    std::vector<SvoSweepHit> results(boxes.size());
+    parallel_for(0, boxes.size(), [&](const size_t i) {
+        results[i] = svo_sweep(svo, boxes[i], deltas[i]);
+    }, thread_count);
+    return results;
+}
+
+#endif //SVO_QUERY_H
@@ -0,0 +1,449 @@
+//
+// Created by ludw on 8/24/24.
+//
+
+#ifndef SVO_RAY_H
+#define SVO_RAY_H
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "bsvo.h"
+#include "svo.h"
+#include "svo_dag.h"
+#include "vss_simd.h"
+#include "vss_thread.h"
+
+#define RAY_MAX_DEPTH 23
+#define RAY_PACKET_SIZE 8
+#define RAY_DIR_EPSILON 1e-8f
+
+// rays and hits are in grid space, the octree covers [0, root_res] on every axis
+struct SvoRay {
+    glm::vec3 origin{0.0f};
+    glm::vec3 direction{0.0f, 0.0f, 1.0f};
+    float t_min = 0.0f;
+    float t_max = std::numeric_limits<float>::infinity();
+};
+
+struct SvoHit {
+    bool hit = false;
+    float t = 0.0f;
+    glm::vec3 position{0.0f};
+    // face the ray entered through, zero when the ray starts inside a filled leaf
+    glm::ivec3 normal{0};
+    uint32_t material = 0;
+    uint32_t node = 0;
+};
+
+struct SvoCamera {
+    glm::vec3 position{0.0f};
+    glm::vec3 target{0.0f, 0.0f, 1.0f};
+    glm::vec3 up{0.0f, 1.0f, 0.0f};
+    // vertical field of view in radians
+    float fov_y = 1.0f;
+};
+
+// ray moved into the octant where every direction component is positive, the octree is mirrored instead
+struct SvoMirroredRay {
+    float origin[3];
+    float inv_dir[3];
+    uint8_t mirror = 0;
+};
+
+static SvoMirroredRay mirror_ray(const SvoRay &ray, const float res) {
+    SvoMirroredRay mirrored;
+    for (int a = 0; a < 3; a++) {
+        float d = ray.direction[a];
+        if (std::fabs(d) < RAY_DIR_EPSILON)
+            d = std::signbit(d) ? -RAY_DIR_EPSILON : RAY_DIR_EPSILON;
+
+        if (d < 0.0f) {
+            mirrored.origin[a] = res - ray.origin[a];
+            d = -d;
+            mirrored.mirror |= static_cast<uint8_t>(1 << a);
+        } else {
+            mirrored.origin[a] = ray.origin[a];
+        }
+
+        mirrored.inv_dir[a] = 1.0f / d;
+    }
+    return mirrored;
+}
+
+static int max_axis(const float *v) {
+    if (v[0] >= v[1] && v[0] >= v[2])
+        return 0;
+    return v[1] >= v[2] ? 1 : 2;
+}
+
+static int min_axis(const float *v) {
+    if (v[0] <= v[1] && v[0] <= v[2])
+        return 0;
+    return v[1] <= v[2] ? 1 : 2;
+}
+
+static SvoHit make_hit(const SvoRay &ray, const uint8_t mirror, const float *t0, const float t_enter,
+                       const uint32_t node, const uint32_t material) {
+    SvoHit hit;
+    hit.hit = true;
+    hit.t = t_enter > ray.t_min ? t_enter : ray.t_min;
+    hit.position = ray.origin + ray.direction * hit.t;
+    hit.node = node;
+    hit.material = material;
+
+    if (t_enter >= ray.t_min) {
+        const int axis = max_axis(t0);
+        hit.normal[axis] = (mirror >> axis) & 1 ? 1 : -1;
+    }
+
+    return hit;
+}
+
+//
+// single ray
+//
+
+// first child of a node the ray enters, in mirrored space
+static uint8_t ray_first_child(const float *t0, const float *tm) {
+    const float t_enter = t0[max_axis(t0)];
+    uint8_t child = 0;
+    for (int a = 0; a < 3; a++) {
+        if (tm[a] < t_enter)
+            child |= static_cast<uint8_t>(1 << a);
+    }
+    return child;
+}
+
+// sibling the ray moves to after leaving child, CHILD_COUNT if it leaves the parent
+static uint8_t ray_next_child(const uint8_t child, const float *t1) {
+    const uint8_t bit = static_cast<uint8_t>(1 << min_axis(t1));
+    return child & bit ? CHILD_COUNT : child | bit;
+}
+
+// parametric front to back traversal after revelles et al. with a stack of one frame per level
+static SvoHit ray_cast(const SvoNode *nodes, const uint32_t root_res, const uint8_t max_depth, const SvoRay &ray) {
+    if (max_depth > RAY_MAX_DEPTH)
+        throw std::runtime_error("max depth too large for ray casting.");
+
+    const SvoMirroredRay m = mirror_ray(ray, static_cast<float>(root_res));
+
+    struct Frame {
+        uint32_t node;
+        float t0[3];
+        float t1[3];
+        uint8_t child;
+    };
+
+    Frame stack[RAY_MAX_DEPTH + 1];
+    Frame &root = stack[0];
+    root.node = 0;
+    for (int a = 0; a < 3; a++) {
+        root.t0[a] = -m.origin[a] * m.inv_dir[a];
+        root.t1[a] = (static_cast<float>(root_res) - m.origin[a]) * m.inv_dir[a];
+    }
+
+    const float t_enter = root.t0[max_axis(root.t0)];
+    const float t_exit = root.t1[min_axis(root.t1)];
+    if (t_enter >= t_exit || t_exit < ray.t_min || t_enter > ray.t_max)
+        return SvoHit();
+
+    if (nodes[0].is_leaf()) {
+        if (nodes[0].data == 0)
+            return SvoHit();
+        return make_hit(ray, m.mirror, root.t0, t_enter, 0, nodes[0].data);
+    }
+
+    float tm[3];
+    for (int a = 0; a < 3; a++)
+        tm[a] = 0.5f * (root.t0[a] + root.t1[a]);
+    root.child = ray_first_child(root.t0, tm);
+
+    int top = 0;
+    while (top >= 0) {
+        Frame &frame = stack[top];
+        if (frame.child >= CHILD_COUNT) {
+            top--;
+            continue;
+        }
+
+        const uint8_t child = frame.child;
+        float t0[3], t1[3];
+        for (int a = 0; a < 3; a++) {
+            const float mid = 0.5f * (frame.t0[a] + frame.t1[a]);
+            t0[a] = (child >> a) & 1 ? mid : frame.t0[a];
+            t1[a] = (child >> a) & 1 ? frame.t1[a] : mid;
+        }
+        frame.child = ray_next_child(child, t1);
+
+        const float child_enter = t0[max_axis(t0)];
+        const float child_exit = t1[min_axis(t1)];
+        if (child_exit < ray.t_min)
+            continue;
+        if (child_enter > ray.t_max) {
+            // every following child is further away
+            frame.child = CHILD_COUNT;
+            continue;
+        }
+
+        const uint8_t real_child = child ^ m.mirror;
+        if (!nodes[frame.node].exists_child(real_child))
+            continue;
+
+        const uint32_t index = nodes[frame.node].data + real_child;
+        if (nodes[index].is_leaf()) {
+            // empty leaves, e.g. parents of a partially loaded tree whose lod material is 0
+            if (nodes[index].data == 0)
+                continue;
+            return make_hit(ray, m.mirror, t0, child_enter, index, nodes[index].data);
+        }
+
+        Frame &next = stack[++top];
+        next.node = index;
+        for (int a = 0; a < 3; a++) {
+            next.t0[a] = t0[a];
+            next.t1[a] = t1[a];
+            tm[a] = 0.5f * (t0[a] + t1[a]);
+        }
+        next.child = ray_first_child(t0, tm);
+    }
+
+    return SvoHit();
+}
+
+//
+// packets
+//
+
+// packet in structure of arrays form, all rays share the mirror mask
+struct SvoRayPacket {
+    alignas(32) float origin[3][RAY_PACKET_SIZE];
+    alignas(32) float inv_dir[3][RAY_PACKET_SIZE];
+    alignas(32) float t_min[RAY_PACKET_SIZE];
+    alignas(32) float t_max[RAY_PACKET_SIZE];
+};
+
+// rays of the packet that overlap the mirrored box [lo, lo + size]
+static uint8_t ray_packet_box_scalar(const SvoRayPacket &packet, const float *lo, const float size) {
+    uint8_t mask = 0;
+    for (int r = 0; r < RAY_PACKET_SIZE; r++) {
+        float t_enter = packet.t_min[r];
+        float t_exit = packet.t_max[r];
+        for (int a = 0; a < 3; a++) {
+            const float t0 = (lo[a] - packet.origin[a][r]) * packet.inv_dir[a][r];
+            const float t1 = (lo[a] + size - packet.origin[a][r]) * packet.inv_dir[a][r];
+            t_enter = t0 > t_enter ? t0 : t_enter;
+            t_exit = t1 < t_exit ? t1 : t_exit;
+        }
+        if (t_enter <= t_exit)
+            mask |= static_cast<uint8_t>(1 << r);
+    }
+    return mask;
+}
+
+#ifdef VSS_X86_SIMD
+VSS_TARGET_AVX2 static uint8_t ray_packet_box_avx2(const SvoRayPacket &packet, const float *lo, const float size) {
+    __m256 t_enter = _mm256_load_ps(packet.t_min);
+    __m256 t_exit = _mm256_load_ps(packet.t_max);
+
+    for (int a = 0; a < 3; a++) {
+        const __m256 origin = _mm256_load_ps(packet.origin[a]);
+        const __m256 inv_dir = _mm256_load_ps(packet.inv_dir[a]);
+        const __m256 t0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(lo[a]), origin), inv_dir);
+        const __m256 t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(lo[a] + size), origin), inv_dir);
+        t_enter = _mm256_max_ps(t0, t_enter);
+        t_exit = _mm256_min_ps(t1, t_exit);
+    }
+
+    return static_cast<uint8_t>(_mm256_movemask_ps(_mm256_cmp_ps(t_enter, t_exit, _CMP_LE_OQ)));
+}
+#endif
+
+// coherent packet traversal, children are visited in mirrored index order which is front to back for
+// every ray of the octant. the packet descends while any ray overlaps a node and rays retire on their
+// first leaf. packets with mixed direction signs fall back to single rays.
+static void ray_cast_packet(const SvoNode *nodes, const uint32_t root_res, const uint8_t max_depth,
+                            const SvoRay *rays, SvoHit *hits) {
+    if (max_depth > RAY_MAX_DEPTH)
+        throw std::runtime_error("max depth too large for ray casting.");
+
+    const float res = static_cast<float>(root_res);
+
+    SvoRayPacket packet;
+    SvoMirroredRay mirrored[RAY_PACKET_SIZE];
+    for (int r = 0; r < RAY_PACKET_SIZE; r++) {
+        mirrored[r] = mirror_ray(rays[r], res);
+        hits[r] = SvoHit();
+
+        if (mirrored[r].mirror != mirrored[0].mirror) {
+            for (int i = 0; i < RAY_PACKET_SIZE; i++)
+                hits[i] = ray_cast(nodes, root_res, max_depth, rays[i]);
+            return;
+        }
+
+        for (int a = 0; a < 3; a++) {
+            packet.origin[a][r] = mirrored[r].origin[a];
+            packet.inv_dir[a][r] = mirrored[r].inv_dir[a];
+        }
+        packet.t_min[r] = rays[r].t_min;
+        packet.t_max[r] = rays[r].t_max;
+    }
+
+    const uint8_t mirror = mirrored[0].mirror;
+    auto box_test = ray_packet_box_scalar;
+#ifdef VSS_X86_SIMD
+    if (simd_level() >= SIMD_AVX2)
+        box_test = ray_packet_box_avx2;
+#endif
+
+    struct Entry {
+        uint32_t node;
+        float lo[3];
+        float size;
+        uint8_t mask;
+    };
+
+    // every level can hold up to 8 pending children
+    Entry stack[CHILD_COUNT * (RAY_MAX_DEPTH + 1)];
+    int size = 0;
+
+    const float root_lo[3] = {0.0f, 0.0f, 0.0f};
+    const uint8_t root_mask = box_test(packet, root_lo, res);
+    if (root_mask != 0)
+        stack[size++] = {0, {0.0f, 0.0f, 0.0f}, res, root_mask};
+
+    uint8_t done = 0;
+    while (size > 0) {
+        const Entry entry = stack[--size];
+
+        const uint8_t active = entry.mask & ~done;
+        if (active == 0)
+            continue;
+
+        const SvoNode &node = nodes[entry.node];
+        if (node.is_leaf()) {
+            if (node.data == 0)
+                continue;
+
+            for (int r = 0; r < RAY_PACKET_SIZE; r++) {
+                if (!((active >> r) & 1))
+                    continue;
+
+                float t0[3];
+                for (int a = 0; a < 3; a++)
+                    t0[a] = (entry.lo[a] - packet.origin[a][r]) * packet.inv_dir[a][r];
+
+                hits[r] = make_hit(rays[r], mirror, t0, t0[max_axis(t0)], entry.node, node.data);
+            }
+
+            done |= active;
+            if (done == UINT8_MAX)
+                return;
+            continue;
+        }
+
+        // push back to front so the nearest child is popped first
+        const float half = 0.5f * entry.size;
+        for (int c = CHILD_COUNT - 1; c >= 0; c--) {
+            const uint8_t real_child = static_cast<uint8_t>(c) ^ mirror;
+            if (!node.exists_child(real_child))
+                continue;
+
+            Entry child;
+            child.node = node.data + real_child;
+            child.size = half;
+            for (int a = 0; a < 3; a++)
+                child.lo[a] = entry.lo[a] + ((c >> a) & 1 ? half : 0.0f);
+
+            child.mask = active & box_test(packet, child.lo, half);
+            if (child.mask != 0)
+                stack[size++] = child;
+        }
+    }
+}
+
+//
+// images
+//
+
+static SvoRay camera_ray(const SvoCamera &camera, const uint32_t width, const uint32_t height,
+                         const uint32_t x, const uint32_t y) {
+    const glm::vec3 forward = glm::normalize(camera.target - camera.position);
+    const glm::vec3 right = glm::normalize(glm::cross(forward, camera.up));
+    const glm::vec3 up = glm::cross(right, forward);
+
+    const float scale = std::tan(0.5f * camera.fov_y);
+    const float aspect = static_cast<float>(width) / static_cast<float>(height);
+    const float u = (2.0f * (static_cast<float>(x) + 0.5f) / static_cast<float>(width) - 1.0f) * scale * aspect;
+    const float v = (1.0f - 2.0f * (static_cast<float>(y) + 0.5f) / static_cast<float>(height)) * scale;
+
+    SvoRay ray;
+    ray.origin = camera.position;
+    ray.direction = glm::normalize(forward + right * u + up * v);
+    return ray;
+}
+
+// trace one primary ray per pixel, rows of 4x2 pixel packets are spread over the threads
+static void render_svo(const SvoNode *nodes, const uint32_t root_res, const uint8_t max_depth,
+                       const SvoCamera &camera, const uint32_t width, const uint32_t height,
+                       std::vector<SvoHit> &hits, const bool use_packets = true, const uint32_t thread_count = 0) {
+    hits.assign(static_cast<size_t>(width) * height, SvoHit());
+
+    const uint32_t tile_rows = (height + 1) / 2;
+    parallel_for(0, tile_rows, [&](const size_t row) {
+        for (uint32_t tile_x = 0; tile_x < width; tile_x += 4) {
+            SvoRay rays[RAY_PACKET_SIZE];
+            SvoHit packet_hits[RAY_PACKET_SIZE];
+            uint32_t px[RAY_PACKET_SIZE], py[RAY_PACKET_SIZE];
+
+            for (int r = 0; r < RAY_PACKET_SIZE; r++) {
+                // clamp to the image border, duplicates are simply traced twice
+                px[r] = std::min(tile_x + r % 4, width - 1);
+                py[r] = std::min(static_cast<uint32_t>(row) * 2 + r / 4, height - 1);
+                rays[r] = camera_ray(camera, width, height, px[r], py[r]);
+            }
+
+            if (use_packets) {
+                ray_cast_packet(nodes, root_res, max_depth, rays, packet_hits);
+            } else {
+                for (int r = 0; r < RAY_PACKET_SIZE; r++)
+                    packet_hits[r] = ray_cast(nodes, root_res, max_depth, rays[r]);
+            }
+
+            for (int r = 0; r < RAY_PACKET_SIZE; r++)
+                hits[static_cast<size_t>(py[r]) * width + px[r]] = packet_hits[r];
+        }
+    }, thread_count);
+}
+
+//
+// tree types
+//
+
+static SvoHit ray_cast(const Svo &svo, const SvoRay &ray) {
+    return ray_cast(svo.nodes.data(), svo.root_res, svo.max_depth, ray);
+}
+
+static SvoHit ray_cast(const SvoDag &dag, const SvoRay &ray) {
+    return ray_cast(dag.nodes.data(), dag.root_res, dag.max_depth, ray);
+}
+
+static SvoHit ray_cast(const SvoView &view, const SvoRay &ray) {
+    return ray_cast(view.nodes, view.root_res(), view.max_depth(), ray);
+}
+
+static void render_svo(const Svo &svo, const SvoCamera &camera, const uint32_t width, const uint32_t height,
+                       std::vector<SvoHit> &hits, const bool use_packets = true, const uint32_t thread_count = 0) {
+    render_svo(svo.nodes.data(), svo.root_res, svo.max_depth, camera, width, height, hits, use_packets, thread_count);
+}
+
+static void render_svo(const SvoDag &dag, const SvoCamera &camera, const uint32_t width, const uint32_t height,
+                       std::vector<SvoHit> &hits, const bool use_packets = true, const uint32_t thread_count = 0) {
+    render_svo(dag.nodes.data(), dag.root_res, dag.max_depth, camera, width, height, hits, use_packets, thread_count);
+}
+
+#endif //SVO_RAY_H
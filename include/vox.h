@@ -5,13 +5,30 @@
 #ifndef VOX_H
 #define VOX_H
 
+#include <array>
 #include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
 
 #include <glm/glm.hpp>
 
+#include "vss_simd.h"
+
 #define POS_TO_INDEX(x, y, z, res) (x + y * res + z * res * res)
 #define INDEX_TO_POS(index, res) (glm::uvec3(index % res, (index / res) % res, index / (res * res)))
 
+// 64 bit morton codes hold 21 bits per axis
+#define MORTON_MAX_RES_64 (1u << 21)
+#define MORTON_MASK_X_64 0x1249249249249249ULL
+#define MORTON_TILE_RES 16
+
+// lod material of a parent cell: most common material of the filled children, or weighted by the filled
+// volume below every child with cells less than half filled staying empty
+#define LOD_MAJORITY 0
+#define LOD_OCCUPANCY 1
+#define MAX_LOD_LEVELS 21
+
 
 static uint32_t spread_bits(const uint8_t byte) {
     uint32_t x = byte;
@@ -41,21 +58,265 @@ static void morton_decode_3d(const uint32_t morton_code, uint8_t &x, uint8_t &y,
     z = compare_bits(morton_code >> 2);
 }
 
-static void morton_encode_3d_grid(const uint8_t *grid, const uint32_t res, const uint32_t size, uint8_t *morton_grid) {
-    for (uint32_t i = 0; i < size; i++) {
-        const glm::uvec3 pos = INDEX_TO_POS(i, res);
-        morton_grid[morton_encode_3d(pos.x, pos.y, pos.z)] = grid[i];
+//
+// 64 bit morton codes
+//
+
+static uint64_t spread_bits_64(const uint32_t value) {
+    uint64_t x = value & 0x1FFFFF;
+    x = (x | (x << 32)) & 0x1F00000000FFFFULL;
+    x = (x | (x << 16)) & 0x1F0000FF0000FFULL;
+    x = (x | (x << 8)) & 0x100F00F00F00F00FULL;
+    x = (x | (x << 4)) & 0x10C30C30C30C30C3ULL;
+    x = (x | (x << 2)) & MORTON_MASK_X_64;
+    return x;
+}
+
+static uint32_t compact_bits_64(uint64_t x) {
+    x &= MORTON_MASK_X_64;
+    x = (x | (x >> 2)) & 0x10C30C30C30C30C3ULL;
+    x = (x | (x >> 4)) & 0x100F00F00F00F00FULL;
+    x = (x | (x >> 8)) & 0x1F0000FF0000FFULL;
+    x = (x | (x >> 16)) & 0x1F00000000FFFFULL;
+    x = (x | (x >> 32)) & 0x1FFFFF;
+    return static_cast<uint32_t>(x);
+}
+
+// byte -> 24 bit spread, used by the table kernel
+static constexpr std::array<uint32_t, 256> MORTON_SPREAD_LUT = [] {
+    std::array<uint32_t, 256> lut{};
+    for (uint32_t i = 0; i < 256; i++) {
+        for (uint32_t bit = 0; bit < 8; bit++)
+            lut[i] |= ((i >> bit) & 1) << (3 * bit);
+    }
+    return lut;
+}();
+
+// 9 interleaved bits -> 3 bits per axis packed as x | y << 3 | z << 6
+static constexpr std::array<uint16_t, 512> MORTON_COMPACT_LUT = [] {
+    std::array<uint16_t, 512> lut{};
+    for (uint32_t i = 0; i < 512; i++) {
+        for (uint32_t bit = 0; bit < 3; bit++) {
+            lut[i] |= ((i >> (3 * bit)) & 1) << bit;
+            lut[i] |= ((i >> (3 * bit + 1)) & 1) << (bit + 3);
+            lut[i] |= ((i >> (3 * bit + 2)) & 1) << (bit + 6);
+        }
+    }
+    return lut;
+}();
+
+static uint64_t morton_encode_3d_lut(const uint32_t x, const uint32_t y, const uint32_t z) {
+    uint64_t code = 0;
+    for (uint32_t shift = 0; shift < 24; shift += 8) {
+        const uint64_t bits = MORTON_SPREAD_LUT[(x >> shift) & 0xFF]
+                              | (MORTON_SPREAD_LUT[(y >> shift) & 0xFF] << 1)
+                              | (MORTON_SPREAD_LUT[(z >> shift) & 0xFF] << 2);
+        code |= bits << (3 * shift);
+    }
+    return code & 0x7FFFFFFFFFFFFFFFULL;
+}
+
+static void morton_decode_3d_lut(const uint64_t code, uint32_t &x, uint32_t &y, uint32_t &z) {
+    x = y = z = 0;
+    for (uint32_t group = 0; group < 7; group++) {
+        const uint16_t bits = MORTON_COMPACT_LUT[(code >> (9 * group)) & 0x1FF];
+        x |= static_cast<uint32_t>(bits & 0x7) << (3 * group);
+        y |= static_cast<uint32_t>((bits >> 3) & 0x7) << (3 * group);
+        z |= static_cast<uint32_t>((bits >> 6) & 0x7) << (3 * group);
+    }
+}
+
+#ifdef VSS_X86_SIMD
+VSS_TARGET_BMI2 static uint64_t morton_encode_3d_bmi2(const uint32_t x, const uint32_t y, const uint32_t z) {
+    return _pdep_u64(x, MORTON_MASK_X_64) | _pdep_u64(y, MORTON_MASK_X_64 << 1) | _pdep_u64(z, MORTON_MASK_X_64 << 2);
+}
+
+VSS_TARGET_BMI2 static void morton_decode_3d_bmi2(const uint64_t code, uint32_t &x, uint32_t &y, uint32_t &z) {
+    x = static_cast<uint32_t>(_pext_u64(code, MORTON_MASK_X_64));
+    y = static_cast<uint32_t>(_pext_u64(code, MORTON_MASK_X_64 << 1));
+    z = static_cast<uint32_t>(_pext_u64(code, MORTON_MASK_X_64 << 2));
+}
+#endif
+
+// pdep / pext when the cpu has bmi2, lookup tables otherwise. coordinates must be below MORTON_MAX_RES_64
+static uint64_t morton_encode_3d_64(const uint32_t x, const uint32_t y, const uint32_t z) {
+#ifdef VSS_X86_SIMD
+    if (simd_level() >= SIMD_AVX2)
+        return morton_encode_3d_bmi2(x, y, z);
+#endif
+    return morton_encode_3d_lut(x, y, z);
+}
+
+static void morton_decode_3d_64(const uint64_t code, uint32_t &x, uint32_t &y, uint32_t &z) {
+#ifdef VSS_X86_SIMD
+    if (simd_level() >= SIMD_AVX2) {
+        morton_decode_3d_bmi2(code, x, y, z);
+        return;
+    }
+#endif
+    morton_decode_3d_lut(code, x, y, z);
+}
+
+//
+// grid conversion
+//
+
+// linear offset of every cell of a morton tile relative to the tile origin, in morton order
+static std::vector<uint64_t> morton_tile_offsets(const uint32_t res, const uint32_t tile_res) {
+    std::vector<uint64_t> offsets(static_cast<size_t>(tile_res) * tile_res * tile_res);
+    for (size_t k = 0; k < offsets.size(); k++) {
+        uint32_t x, y, z;
+        morton_decode_3d_64(k, x, y, z);
+        offsets[k] = x + y * static_cast<uint64_t>(res) + z * static_cast<uint64_t>(res) * res;
+    }
+    return offsets;
+}
+
+// the grid is walked tile by tile, morton order is contiguous inside a tile and every tile only touches
+// a small block of the linear grid. only the tile origin is computed per tile, cells use the offset table.
+// works for cells of any voxel type.
+template<bool Encode, typename T>
+static void morton_convert_3d_grid(const T *src, const uint32_t res, const size_t size, T *dst) {
+    if (res == 0 || (res & (res - 1)) != 0 || res > MORTON_MAX_RES_64)
+        throw std::runtime_error("grid resolution is not a supported power of two.");
+    if (size != static_cast<size_t>(res) * res * res)
+        throw std::runtime_error("grid size does not match resolution.");
+
+    const uint32_t tile_res = res < MORTON_TILE_RES ? res : MORTON_TILE_RES;
+    const size_t tile_size = static_cast<size_t>(tile_res) * tile_res * tile_res;
+    const size_t tile_count = size / tile_size;
+    const std::vector<uint64_t> offsets = morton_tile_offsets(res, tile_res);
+
+    for (size_t t = 0; t < tile_count; t++) {
+        uint32_t x, y, z;
+        morton_decode_3d_64(t, x, y, z);
+
+        const uint64_t origin = static_cast<uint64_t>(x) * tile_res
+                                + static_cast<uint64_t>(y) * tile_res * res
+                                + static_cast<uint64_t>(z) * tile_res * res * res;
+        const size_t morton_origin = t * tile_size;
+
+        for (size_t k = 0; k < tile_size; k++) {
+            if constexpr (Encode)
+                dst[morton_origin + k] = src[origin + offsets[k]];
+            else
+                dst[origin + offsets[k]] = src[morton_origin + k];
+        }
+    }
+}
+
+template<typename T>
+static void morton_encode_3d_grid(const T *grid, const uint32_t res, const size_t size, T *morton_grid) {
+    morton_convert_3d_grid<true>(grid, res, size, morton_grid);
+}
+
+template<typename T>
+static void morton_decode_3d_grid(const T *morton_grid, const uint32_t res, const size_t size, T *grid) {
+    morton_convert_3d_grid<false>(morton_grid, res, size, grid);
+}
+
+//
+// level of detail
+//
+
+// filled holds the number of filled full resolution cells below every child, child_volume the cells per child
+static uint32_t lod_select(const uint32_t *mats, const uint64_t *filled, const uint64_t child_volume, const uint8_t mode) {
+    uint64_t weights[8];
+    uint64_t total = 0;
+    for (int c = 0; c < 8; c++) {
+        weights[c] = mats[c] == 0 ? 0 : mode == LOD_OCCUPANCY ? filled[c] : 1;
+        total += mode == LOD_OCCUPANCY ? filled[c] : weights[c];
+    }
+
+    if (mode == LOD_OCCUPANCY ? total * 2 < child_volume * 8 : total == 0)
+        return 0;
+
+    // ties go to the first child in morton order
+    uint32_t best = 0;
+    uint64_t best_weight = 0;
+    for (int a = 0; a < 8; a++) {
+        if (weights[a] == 0)
+            continue;
+
+        uint64_t weight = 0;
+        for (int b = a; b < 8; b++) {
+            if (mats[b] == mats[a])
+                weight += weights[b];
+        }
+
+        if (weight > best_weight) {
+            best = mats[a];
+            best_weight = weight;
+        }
     }
+
+    return best;
 }
 
-static void morton_decode_3d_grid(const uint8_t *morton_grid, const uint32_t res, const uint32_t size, uint8_t *grid) {
-    for (uint32_t i = 0; i < size; i++) {
-        uint8_t x, y, z;
-        morton_decode_3d(i, x, y, z);
+// all lod levels of a morton grid in one pass, lods[0] has half the resolution of the grid.
+// every level keeps the 8 children of the cell it is currently aggregating.
+static std::vector<std::vector<uint8_t> > morton_downsample_3d_grid(const uint8_t *morton_grid, const uint32_t res,
+                                                                   const size_t size, const uint8_t lod_count,
+                                                                   const uint8_t mode) {
+    if (res == 0 || (res & (res - 1)) != 0 || res > MORTON_MAX_RES_64)
+        throw std::runtime_error("grid resolution is not a supported power of two.");
+    if (size != static_cast<size_t>(res) * res * res)
+        throw std::runtime_error("grid size does not match resolution.");
+    if (lod_count == 0 || lod_count > MAX_LOD_LEVELS || (static_cast<uint32_t>(1) << lod_count) > res)
+        throw std::runtime_error("too many lod levels for grid resolution.");
 
-        const uint32_t index = POS_TO_INDEX(x, y, z, res);
-        grid[index] = morton_grid[i];
+    std::vector<std::vector<uint8_t> > lods(lod_count);
+    for (uint8_t l = 0; l < lod_count; l++)
+        lods[l].resize(size >> (3 * (l + 1)));
+
+    uint32_t mats[MAX_LOD_LEVELS][8];
+    uint64_t filled[MAX_LOD_LEVELS][8];
+
+    // the finest level reads 8 cells at once, empty and uniform groups skip the material vote
+    for (size_t g = 0; g < size / 8; g++) {
+        const uint8_t *group = morton_grid + g * 8;
+
+        uint64_t word;
+        std::memcpy(&word, group, sizeof(uint64_t));
+
+        uint32_t mat;
+        uint64_t count;
+        if (word == 0) {
+            mat = 0;
+            count = 0;
+        } else if (word == group[0] * 0x0101010101010101ULL) {
+            mat = group[0];
+            count = 8;
+        } else {
+            count = 0;
+            for (int c = 0; c < 8; c++) {
+                mats[0][c] = group[c];
+                filled[0][c] = group[c] > 0;
+                count += filled[0][c];
+            }
+            mat = lod_select(mats[0], filled[0], 1, mode);
+        }
+        lods[0][g] = static_cast<uint8_t>(mat);
+
+        size_t index = g;
+        for (uint8_t l = 1; l < lod_count; l++) {
+            const size_t child = index & 0x7;
+            mats[l][child] = mat;
+            filled[l][child] = count;
+            if (child != 7)
+                break;
+
+            index >>= 3;
+            mat = lod_select(mats[l], filled[l], static_cast<uint64_t>(1) << (3 * l), mode);
+            count = 0;
+            for (int c = 0; c < 8; c++)
+                count += filled[l][c];
+
+            lods[l][index] = static_cast<uint8_t>(mat);
+        }
     }
+
+    return lods;
 }
 
 #endif //VOX_H
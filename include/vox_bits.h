@@ -0,0 +1,479 @@
+//
+// Created by ludw on 8/27/24.
+//
+
+#ifndef VOX_BITS_H
+#define VOX_BITS_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "vox.h"
+#include "vss_simd.h"
+
+// bit i of word w is cell 64 * w + i. with morton encoded cells every byte of a word holds 8 siblings,
+// so one word covers 8 octants on the level above the cells.
+#define OCCUPANCY_WORD_CELLS 64
+
+#define OCCUPANCY_AND 0
+#define OCCUPANCY_OR 1
+#define OCCUPANCY_XOR 2
+// cells set in the first grid but not in the second
+#define OCCUPANCY_ANDNOT 3
+
+static size_t occupancy_word_count(const size_t cell_count) {
+    return (cell_count + OCCUPANCY_WORD_CELLS - 1) / OCCUPANCY_WORD_CELLS;
+}
+
+static void check_occupancy_cell_count(const size_t cell_count) {
+    if (cell_count % OCCUPANCY_WORD_CELLS != 0)
+        throw std::runtime_error("occupancy grids need a multiple of 64 cells.");
+}
+
+//
+// packing kernels
+//
+
+// one bit per non zero byte of the 8 bytes
+static uint8_t occupancy_pack_byte(const uint8_t *cells) {
+    uint64_t word;
+    std::memcpy(&word, cells, sizeof(uint64_t));
+
+    // high bit of every non zero byte, then gathered into the top byte
+    const uint64_t high = (word | ((word & 0x7F7F7F7F7F7F7F7FULL) + 0x7F7F7F7F7F7F7F7FULL)) & 0x8080808080808080ULL;
+    return static_cast<uint8_t>((high >> 7) * 0x0102040810204080ULL >> 56);
+}
+
+// 8 bytes holding value where the bits are set
+static uint64_t occupancy_unpack_byte(const uint8_t bits, const uint8_t value) {
+    const uint64_t spread = ((((bits * 0x0101010101010101ULL) & 0x8040201008040201ULL) + 0x7F7F7F7F7F7F7F7FULL) >> 7)
+                            & 0x0101010101010101ULL;
+    return spread * value;
+}
+
+static void occupancy_pack_scalar(const uint8_t *cells, const size_t word_count, uint64_t *words) {
+    for (size_t w = 0; w < word_count; w++) {
+        uint64_t word = 0;
+        for (int b = 0; b < 8; b++)
+            word |= static_cast<uint64_t>(occupancy_pack_byte(cells + w * 64 + b * 8)) << (8 * b);
+        words[w] = word;
+    }
+}
+
+static void occupancy_unpack_scalar(const uint64_t *words, const size_t word_count, const uint8_t value,
+                                    uint8_t *cells) {
+    for (size_t w = 0; w < word_count; w++) {
+        for (int b = 0; b < 8; b++) {
+            const uint64_t bytes = occupancy_unpack_byte(static_cast<uint8_t>(words[w] >> (8 * b)), value);
+            std::memcpy(cells + w * 64 + b * 8, &bytes, sizeof(uint64_t));
+        }
+    }
+}
+
+static size_t occupancy_count_scalar(const uint64_t *words, const size_t word_count) {
+    size_t count = 0;
+    for (size_t w = 0; w < word_count; w++)
+        count += popcount(words[w]);
+    return count;
+}
+
+static uint64_t occupancy_or_scalar(const uint64_t *words, const size_t word_count) {
+    uint64_t any = 0;
+    for (size_t w = 0; w < word_count; w++)
+        any |= words[w];
+    return any;
+}
+
+template<uint8_t Op>
+static VSS_INLINE uint64_t occupancy_op(const uint64_t a, const uint64_t b) {
+    if constexpr (Op == OCCUPANCY_AND)
+        return a & b;
+    else if constexpr (Op == OCCUPANCY_OR)
+        return a | b;
+    else if constexpr (Op == OCCUPANCY_XOR)
+        return a ^ b;
+    else
+        return a & ~b;
+}
+
+template<uint8_t Op>
+static void occupancy_combine_scalar(const uint64_t *a, const uint64_t *b, uint64_t *out, const size_t word_count) {
+    for (size_t w = 0; w < word_count; w++)
+        out[w] = occupancy_op<Op>(a[w], b[w]);
+}
+
+#ifdef VSS_X86_SIMD
+static void occupancy_pack_sse2(const uint8_t *cells, const size_t word_count, uint64_t *words) {
+    const __m128i zero = _mm_setzero_si128();
+
+    for (size_t w = 0; w < word_count; w++) {
+        uint64_t word = 0;
+        for (int q = 0; q < 4; q++) {
+            const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(cells + w * 64 + q * 16));
+            const uint32_t empty = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, zero)));
+            word |= static_cast<uint64_t>(~empty & 0xFFFF) << (16 * q);
+        }
+        words[w] = word;
+    }
+}
+
+VSS_TARGET_AVX2 static void occupancy_pack_avx2(const uint8_t *cells, const size_t word_count, uint64_t *words) {
+    const __m256i zero = _mm256_setzero_si256();
+
+    for (size_t w = 0; w < word_count; w++) {
+        const __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(cells + w * 64));
+        const __m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(cells + w * 64 + 32));
+        const uint32_t empty_low = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, zero)));
+        const uint32_t empty_high = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, zero)));
+        words[w] = ~(static_cast<uint64_t>(empty_high) << 32 | empty_low);
+    }
+}
+
+// every byte of the output selects its source byte of the 32 bit input and tests its own bit
+VSS_TARGET_AVX2 static void occupancy_unpack_avx2(const uint64_t *words, const size_t word_count, const uint8_t value,
+                                                  uint8_t *cells) {
+    const __m256i select = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+                                            2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+    const __m256i bit = _mm256_set1_epi64x(static_cast<int64_t>(0x8040201008040201ULL));
+    const __m256i fill = _mm256_set1_epi8(static_cast<char>(value));
+
+    for (size_t w = 0; w < word_count; w++) {
+        for (int h = 0; h < 2; h++) {
+            const __m256i source = _mm256_set1_epi32(static_cast<int>(words[w] >> (32 * h)));
+            const __m256i bytes = _mm256_and_si256(_mm256_shuffle_epi8(source, select), bit);
+            const __m256i set = _mm256_cmpeq_epi8(bytes, bit);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(cells + w * 64 + h * 32), _mm256_and_si256(set, fill));
+        }
+    }
+}
+
+// nibble lookup popcount, byte counts are summed per 64 bit lane
+VSS_TARGET_AVX2 static size_t occupancy_count_avx2(const uint64_t *words, const size_t word_count) {
+    const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low_mask = _mm256_set1_epi8(0x0F);
+
+    __m256i sum = _mm256_setzero_si256();
+    size_t w = 0;
+    for (; w + 4 <= word_count; w += 4) {
+        const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(words + w));
+        const __m256i low = _mm256_shuffle_epi8(lookup, _mm256_and_si256(block, low_mask));
+        const __m256i high = _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(block, 4), low_mask));
+        sum = _mm256_add_epi64(sum, _mm256_sad_epu8(_mm256_add_epi8(low, high), _mm256_setzero_si256()));
+    }
+
+    alignas(32) uint64_t lanes[4];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), sum);
+    size_t count = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    for (; w < word_count; w++)
+        count += _mm_popcnt_u64(words[w]);
+
+    return count;
+}
+
+static uint64_t occupancy_or_sse2(const uint64_t *words, const size_t word_count) {
+    __m128i any = _mm_setzero_si128();
+    size_t w = 0;
+    for (; w + 2 <= word_count; w += 2)
+        any = _mm_or_si128(any, _mm_loadu_si128(reinterpret_cast<const __m128i *>(words + w)));
+
+    alignas(16) uint64_t lanes[2];
+    _mm_store_si128(reinterpret_cast<__m128i *>(lanes), any);
+    return lanes[0] | lanes[1] | occupancy_or_scalar(words + w, word_count - w);
+}
+
+// stops at the first non empty block of 16 words
+VSS_TARGET_AVX2 static uint64_t occupancy_or_avx2(const uint64_t *words, const size_t word_count) {
+    size_t w = 0;
+    for (; w + 16 <= word_count; w += 16) {
+        const __m256i *block = reinterpret_cast<const __m256i *>(words + w);
+        const __m256i any = _mm256_or_si256(_mm256_or_si256(_mm256_loadu_si256(block), _mm256_loadu_si256(block + 1)),
+                                            _mm256_or_si256(_mm256_loadu_si256(block + 2), _mm256_loadu_si256(block + 3)));
+        if (!_mm256_testz_si256(any, any))
+            return 1;
+    }
+
+    return occupancy_or_scalar(words + w, word_count - w);
+}
+
+template<uint8_t Op>
+static VSS_INLINE __m128i occupancy_op_sse2(const __m128i a, const __m128i b) {
+    if constexpr (Op == OCCUPANCY_AND)
+        return _mm_and_si128(a, b);
+    else if constexpr (Op == OCCUPANCY_OR)
+        return _mm_or_si128(a, b);
+    else if constexpr (Op == OCCUPANCY_XOR)
+        return _mm_xor_si128(a, b);
+    else
+        return _mm_andnot_si128(b, a);
+}
+
+template<uint8_t Op>
+static void occupancy_combine_sse2(const uint64_t *a, const uint64_t *b, uint64_t *out, const size_t word_count) {
+    size_t w = 0;
+    for (; w + 2 <= word_count; w += 2) {
+        const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + w));
+        const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + w));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + w), occupancy_op_sse2<Op>(va, vb));
+    }
+
+    occupancy_combine_scalar<Op>(a + w, b + w, out + w, word_count - w);
+}
+
+template<uint8_t Op>
+VSS_TARGET_AVX2 static VSS_INLINE __m256i occupancy_op_avx2(const __m256i a, const __m256i b) {
+    if constexpr (Op == OCCUPANCY_AND)
+        return _mm256_and_si256(a, b);
+    else if constexpr (Op == OCCUPANCY_OR)
+        return _mm256_or_si256(a, b);
+    else if constexpr (Op == OCCUPANCY_XOR)
+        return _mm256_xor_si256(a, b);
+    else
+        return _mm256_andnot_si256(b, a);
+}
+
+template<uint8_t Op>
+VSS_TARGET_AVX2 static void occupancy_combine_avx2(const uint64_t *a, const uint64_t *b, uint64_t *out,
+                                                   const size_t word_count) {
+    size_t w = 0;
+    for (; w + 4 <= word_count; w += 4) {
+        const __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + w));
+        const __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + w));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + w), occupancy_op_avx2<Op>(va, vb));
+    }
+
+    occupancy_combine_scalar<Op>(a + w, b + w, out + w, word_count - w);
+}
+#endif
+
+//
+// conversion
+//
+
+static void pack_occupancy(const uint8_t *cells, const size_t cell_count, uint64_t *words) {
+    check_occupancy_cell_count(cell_count);
+    const size_t word_count = cell_count / OCCUPANCY_WORD_CELLS;
+
+    switch (simd_level()) {
+#ifdef VSS_X86_SIMD
+        case SIMD_AVX2:
+            return occupancy_pack_avx2(cells, word_count, words);
+        case SIMD_SSE2:
+            return occupancy_pack_sse2(cells, word_count, words);
+#endif
+        default:
+            return occupancy_pack_scalar(cells, word_count, words);
+    }
+}
+
+static std::vector<uint64_t> pack_occupancy(const std::vector<uint8_t> &cells) {
+    std::vector<uint64_t> words(occupancy_word_count(cells.size()));
+    pack_occupancy(cells.data(), cells.size(), words.data());
+    return words;
+}
+
+// set cells become value, all materials are lost when packing
+static void unpack_occupancy(const uint64_t *words, const size_t cell_count, uint8_t *cells, const uint8_t value = 1) {
+    check_occupancy_cell_count(cell_count);
+    const size_t word_count = cell_count / OCCUPANCY_WORD_CELLS;
+
+    switch (simd_level()) {
+#ifdef VSS_X86_SIMD
+        case SIMD_AVX2:
+            return occupancy_unpack_avx2(words, word_count, value, cells);
+#endif
+        default:
+            return occupancy_unpack_scalar(words, word_count, value, cells);
+    }
+}
+
+static std::vector<uint8_t> unpack_occupancy(const std::vector<uint64_t> &words, const uint8_t value = 1) {
+    std::vector<uint8_t> cells(words.size() * OCCUPANCY_WORD_CELLS);
+    unpack_occupancy(words.data(), cells.size(), cells.data(), value);
+    return cells;
+}
+
+//
+// queries
+//
+
+static size_t occupancy_count(const uint64_t *words, const size_t word_count) {
+    switch (simd_level()) {
+#ifdef VSS_X86_SIMD
+        case SIMD_AVX2:
+            return occupancy_count_avx2(words, word_count);
+#endif
+        default:
+            return occupancy_count_scalar(words, word_count);
+    }
+}
+
+static size_t occupancy_count(const std::vector<uint64_t> &words) {
+    return occupancy_count(words.data(), words.size());
+}
+
+static bool occupancy_words_empty(const uint64_t *words, const size_t word_count) {
+    switch (simd_level()) {
+#ifdef VSS_X86_SIMD
+        case SIMD_AVX2:
+            return occupancy_or_avx2(words, word_count) == 0;
+        case SIMD_SSE2:
+            return occupancy_or_sse2(words, word_count) == 0;
+#endif
+        default:
+            return occupancy_or_scalar(words, word_count) == 0;
+    }
+}
+
+// true if no cell in [begin, end) is set, in morton order every octree node covers one such range
+static bool occupancy_range_empty(const uint64_t *words, const size_t begin, const size_t end) {
+    if (begin >= end)
+        return true;
+
+    const size_t first = begin / OCCUPANCY_WORD_CELLS;
+    const size_t last = (end - 1) / OCCUPANCY_WORD_CELLS;
+    const uint64_t first_mask = ~static_cast<uint64_t>(0) << (begin % OCCUPANCY_WORD_CELLS);
+    const uint64_t last_mask = ~static_cast<uint64_t>(0) >> (OCCUPANCY_WORD_CELLS - 1 - (end - 1) % OCCUPANCY_WORD_CELLS);
+
+    if (first == last)
+        return (words[first] & first_mask & last_mask) == 0;
+
+    if ((words[first] & first_mask) != 0 || (words[last] & last_mask) != 0)
+        return false;
+
+    return occupancy_words_empty(words + first + 1, last - first - 1);
+}
+
+// cells of a 4x4x4 word whose coordinate on one axis lies in [lo, hi), indexed by axis * 25 + lo * 5 + hi
+static constexpr std::array<uint64_t, 75> OCCUPANCY_AXIS_MASKS = [] {
+    std::array<uint64_t, 75> masks{};
+    for (int axis = 0; axis < 3; axis++) {
+        for (int lo = 0; lo <= 4; lo++) {
+            for (int hi = 0; hi <= 4; hi++) {
+                for (int k = 0; k < 64; k++) {
+                    const int coord = ((k >> axis) & 1) | (((k >> (axis + 3)) & 1) << 1);
+                    if (coord >= lo && coord < hi)
+                        masks[axis * 25 + lo * 5 + hi] |= static_cast<uint64_t>(1) << k;
+                }
+            }
+        }
+    }
+    return masks;
+}();
+
+// true if no cell of the morton encoded grid inside [min, max) is set. the box is split into octree
+// nodes, nodes fully inside the box are tested as one morton range, partially covered 4x4x4 nodes as
+// one masked word and small partially covered nodes are skipped early when their whole range is empty.
+static bool occupancy_box_empty(const uint64_t *words, const uint32_t res, const glm::uvec3 min, const glm::uvec3 max) {
+    const glm::uvec3 lo = glm::min(min, glm::uvec3(res));
+    const glm::uvec3 hi = glm::min(max, glm::uvec3(res));
+    if (lo.x >= hi.x || lo.y >= hi.y || lo.z >= hi.z)
+        return true;
+
+    struct Cell {
+        glm::uvec3 origin;
+        uint32_t size;
+        uint64_t code;
+    };
+
+    // at most 7 siblings are pending per level
+    Cell stack[8 * (MAX_LOD_LEVELS + 1)];
+    size_t top = 0;
+    stack[top++] = {glm::uvec3(0), res, 0};
+
+    while (top > 0) {
+        const Cell cell = stack[--top];
+
+        const glm::uvec3 end = cell.origin + glm::uvec3(cell.size);
+        if (cell.origin.x >= hi.x || cell.origin.y >= hi.y || cell.origin.z >= hi.z ||
+            end.x <= lo.x || end.y <= lo.y || end.z <= lo.z)
+            continue;
+
+        const uint64_t volume = static_cast<uint64_t>(cell.size) * cell.size * cell.size;
+        if (cell.origin.x >= lo.x && cell.origin.y >= lo.y && cell.origin.z >= lo.z &&
+            end.x <= hi.x && end.y <= hi.y && end.z <= hi.z) {
+            if (!occupancy_range_empty(words, cell.code, cell.code + volume))
+                return false;
+            continue;
+        }
+
+        if (volume == OCCUPANCY_WORD_CELLS) {
+            uint64_t mask = ~static_cast<uint64_t>(0);
+            for (int axis = 0; axis < 3; axis++) {
+                const uint32_t a = std::max(lo[axis], cell.origin[axis]) - cell.origin[axis];
+                const uint32_t b = std::min(hi[axis], end[axis]) - cell.origin[axis];
+                mask &= OCCUPANCY_AXIS_MASKS[axis * 25 + a * 5 + b];
+            }
+
+            if ((words[cell.code / OCCUPANCY_WORD_CELLS] & mask) != 0)
+                return false;
+            continue;
+        }
+
+        if (volume <= OCCUPANCY_WORD_CELLS * OCCUPANCY_WORD_CELLS &&
+            occupancy_range_empty(words, cell.code, cell.code + volume))
+            continue;
+
+        const uint32_t half = cell.size / 2;
+        const uint64_t child_volume = volume / 8;
+        for (uint8_t c = 0; c < 8; c++) {
+            const glm::uvec3 offset((c & 1) ? half : 0, (c & 2) ? half : 0, (c & 4) ? half : 0);
+            stack[top++] = {cell.origin + offset, half, cell.code + c * child_volume};
+        }
+    }
+
+    return true;
+}
+
+//
+// boolean operations
+//
+
+template<uint8_t Op>
+static void occupancy_combine_op(const uint64_t *a, const uint64_t *b, uint64_t *out, const size_t word_count) {
+    switch (simd_level()) {
+#ifdef VSS_X86_SIMD
+        case SIMD_AVX2:
+            return occupancy_combine_avx2<Op>(a, b, out, word_count);
+        case SIMD_SSE2:
+            return occupancy_combine_sse2<Op>(a, b, out, word_count);
+#endif
+        default:
+            return occupancy_combine_scalar<Op>(a, b, out, word_count);
+    }
+}
+
+// out may alias either input
+static void occupancy_combine(const uint64_t *a, const uint64_t *b, uint64_t *out, const size_t word_count,
+                              const uint8_t op) {
+    switch (op) {
+        case OCCUPANCY_AND:
+            return occupancy_combine_op<OCCUPANCY_AND>(a, b, out, word_count);
+        case OCCUPANCY_OR:
+            return occupancy_combine_op<OCCUPANCY_OR>(a, b, out, word_count);
+        case OCCUPANCY_XOR:
+            return occupancy_combine_op<OCCUPANCY_XOR>(a, b, out, word_count);
+        case OCCUPANCY_ANDNOT:
+            return occupancy_combine_op<OCCUPANCY_ANDNOT>(a, b, out, word_count);
+        default:
+            throw std::runtime_error("unknown occupancy operation.");
+    }
+}
+
+static std::vector<uint64_t> occupancy_combine(const std::vector<uint64_t> &a, const std::vector<uint64_t> &b,
+                                               const uint8_t op) {
+    if (a.size() != b.size())
+        throw std::runtime_error("occupancy grids differ in size.");
+
+    std::vector<uint64_t> out(a.size());
+    occupancy_combine(a.data(), b.data(), out.data(), a.size(), op);
+    return out;
+}
+
+#endif //VOX_BITS_H
@@ -0,0 +1,199 @@
+//
+// Created by ludw on 9/11/24.
+//
+
+#ifndef VOX_TYPES_H
+#define VOX_TYPES_H
+
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+// voxel payload stored in a file, u8 voxels are stored as they are, all others as palette indices
+#define VOXEL_FORMAT_U8 0
+#define VOXEL_FORMAT_U16 1
+#define VOXEL_FORMAT_RGBA8 2
+#define VOXEL_FORMAT_MAT_NORMAL 3
+
+// largest palette of a file, palette indices are stored as u16
+#define VOXEL_PALETTE_MAX (UINT16_MAX + 1)
+
+struct Rgba8 {
+    uint8_t r = 0;
+    uint8_t g = 0;
+    uint8_t b = 0;
+    uint8_t a = 0;
+
+    bool operator==(const Rgba8 &other) const = default;
+};
+
+// material with an octahedral encoded normal
+struct MatNormal {
+    uint16_t mat = 0;
+    uint8_t normal_u = 0;
+    uint8_t normal_v = 0;
+
+    bool operator==(const MatNormal &other) const = default;
+};
+
+//
+// voxel traits
+//
+
+// every voxel type maps to the u32 data of a svo leaf and back, data 0 is the empty voxel.
+// specialize VoxelTraits to store other types.
+template<typename T>
+struct VoxelTraits;
+
+template<>
+struct VoxelTraits<uint8_t> {
+    static constexpr uint8_t format = VOXEL_FORMAT_U8;
+
+    static uint32_t to_data(const uint8_t value) {
+        return value;
+    }
+
+    static uint8_t from_data(const uint32_t data) {
+        return static_cast<uint8_t>(data);
+    }
+};
+
+template<>
+struct VoxelTraits<uint16_t> {
+    static constexpr uint8_t format = VOXEL_FORMAT_U16;
+
+    static uint32_t to_data(const uint16_t value) {
+        return value;
+    }
+
+    static uint16_t from_data(const uint32_t data) {
+        return static_cast<uint16_t>(data);
+    }
+};
+
+// the u32 leaf data itself, for code that handles every voxel type alike. it has no voxel format of its own and
+// can not be stored in files.
+template<>
+struct VoxelTraits<uint32_t> {
+    static uint32_t to_data(const uint32_t value) {
+        return value;
+    }
+
+    static uint32_t from_data(const uint32_t data) {
+        return data;
+    }
+};
+
+// only fully transparent black is empty
+template<>
+struct VoxelTraits<Rgba8> {
+    static constexpr uint8_t format = VOXEL_FORMAT_RGBA8;
+
+    static uint32_t to_data(const Rgba8 value) {
+        return value.r | value.g << 8 | value.b << 16 | static_cast<uint32_t>(value.a) << 24;
+    }
+
+    static Rgba8 from_data(const uint32_t data) {
+        return Rgba8{static_cast<uint8_t>(data), static_cast<uint8_t>(data >> 8), static_cast<uint8_t>(data >> 16),
+                     static_cast<uint8_t>(data >> 24)};
+    }
+};
+
+// material 0 is empty whatever its normal
+template<>
+struct VoxelTraits<MatNormal> {
+    static constexpr uint8_t format = VOXEL_FORMAT_MAT_NORMAL;
+
+    static uint32_t to_data(const MatNormal value) {
+        if (value.mat == 0)
+            return 0;
+        return value.mat | value.normal_u << 16 | static_cast<uint32_t>(value.normal_v) << 24;
+    }
+
+    static MatNormal from_data(const uint32_t data) {
+        return MatNormal{static_cast<uint16_t>(data), static_cast<uint8_t>(data >> 16), static_cast<uint8_t>(data >> 24)};
+    }
+};
+
+// calls fn(std::type_identity<T>{}) with the voxel type T stored under format, for code that only learns the
+// voxel type from a file header
+template<typename Fn>
+static decltype(auto) visit_voxel_format(const uint8_t format, Fn &&fn) {
+    switch (format) {
+        case VOXEL_FORMAT_U8:
+            return fn(std::type_identity<uint8_t>{});
+        case VOXEL_FORMAT_U16:
+            return fn(std::type_identity<uint16_t>{});
+        case VOXEL_FORMAT_RGBA8:
+            return fn(std::type_identity<Rgba8>{});
+        case VOXEL_FORMAT_MAT_NORMAL:
+            return fn(std::type_identity<MatNormal>{});
+        default:
+            throw std::runtime_error("unknown voxel format.");
+    }
+}
+
+//
+// palette
+//
+
+// distinct voxel data values of a file, index 0 is always the empty voxel
+class VoxelPalette {
+public:
+    std::vector<uint32_t> values = {0};
+
+    VoxelPalette() {
+        indices.emplace(0, 0);
+    }
+
+    explicit VoxelPalette(const std::vector<uint32_t> &loc_values) {
+        if (loc_values.empty() || loc_values[0] != 0)
+            throw std::runtime_error("palette does not start with the empty voxel.");
+        if (loc_values.size() > VOXEL_PALETTE_MAX)
+            throw std::runtime_error("palette is too large.");
+
+        values = loc_values;
+        for (size_t i = 0; i < values.size(); i++)
+            indices.emplace(values[i], static_cast<uint16_t>(i));
+    }
+
+    // index of data, added to the palette if it is new
+    uint16_t add(const uint32_t data) {
+        const auto it = indices.find(data);
+        if (it != indices.end())
+            return it->second;
+
+        if (values.size() == VOXEL_PALETTE_MAX)
+            throw std::runtime_error("palette is full.");
+
+        const auto index = static_cast<uint16_t>(values.size());
+        values.push_back(data);
+        indices.emplace(data, index);
+        return index;
+    }
+
+    // index of data that is known to be in the palette, safe to call from several threads
+    uint16_t index(const uint32_t data) const {
+        const auto it = indices.find(data);
+        if (it == indices.end())
+            throw std::runtime_error("voxel is not in the palette.");
+        return it->second;
+    }
+
+    uint32_t value(const uint16_t index) const {
+        if (index >= values.size())
+            throw std::runtime_error("palette index out of bounds.");
+        return values[index];
+    }
+
+    size_t size() const {
+        return values.size();
+    }
+
+private:
+    std::unordered_map<uint32_t, uint16_t> indices;
+};
+
+#endif //VOX_TYPES_H
@@ -0,0 +1,401 @@
+//
+// Created by ludw on 9/13/24.
+//
+
+#ifndef VOXELIZE_H
+#define VOXELIZE_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "svo.h"
+#include "vox.h"
+#include "vss_metrics.h"
+#include "vss_thread.h"
+#include "world.h"
+
+// slack added to every separating axis interval, keeps cells that only touch a triangle filled
+#define VOXELIZE_EPSILON 1e-9
+
+struct Mesh {
+    std::vector<glm::vec3> vertices;
+    // three vertex indices per triangle
+    std::vector<uint32_t> indices;
+
+    size_t triangle_count() const {
+        return indices.size() / 3;
+    }
+};
+
+struct VoxelizeOptions {
+    // world position of the min corner of voxel (0, 0, 0)
+    glm::vec3 origin{0.0f};
+    float voxel_size = 1.0f;
+    uint32_t chunk_res = 256;
+    uint8_t mat = DEFAULT_MAT;
+};
+
+// one chunk touched by the mesh, cells are morton encoded and ready for Svo::build
+struct VoxelizedChunk {
+    ChunkCoord coord;
+    std::vector<uint8_t> cells;
+};
+
+//
+// obj
+//
+
+// vertex index of an obj face corner, obj indices start at 1 and negative ones count back from the last vertex
+static uint32_t obj_vertex_index(const std::string &corner, const size_t vertex_count) {
+    const long index = std::stol(corner.substr(0, corner.find('/')));
+    const long resolved = index < 0 ? static_cast<long>(vertex_count) + index : index - 1;
+    if (index == 0 || resolved < 0 || resolved >= static_cast<long>(vertex_count))
+        throw std::runtime_error("obj face index out of bounds.");
+    return static_cast<uint32_t>(resolved);
+}
+
+// vertices and faces of an obj file, polygons are split into triangle fans. everything else is ignored.
+static int read_obj(const std::string &filename, Mesh *p_mesh) {
+    std::ifstream ifs(filename);
+    if (!ifs.is_open())
+        throw std::runtime_error("failed to open file.");
+
+    Mesh mesh;
+    std::string line;
+    while (std::getline(ifs, line)) {
+        std::istringstream ss(line);
+        std::string type;
+        ss >> type;
+
+        if (type == "v") {
+            glm::vec3 v;
+            if (!(ss >> v.x >> v.y >> v.z))
+                throw std::runtime_error("invalid obj vertex.");
+            mesh.vertices.push_back(v);
+        } else if (type == "f") {
+            std::vector<uint32_t> face;
+            std::string corner;
+            while (ss >> corner)
+                face.push_back(obj_vertex_index(corner, mesh.vertices.size()));
+            if (face.size() < 3)
+                throw std::runtime_error("obj face has less than three vertices.");
+
+            for (size_t i = 1; i + 1 < face.size(); i++)
+                mesh.indices.insert(mesh.indices.end(), {face[0], face[i], face[i + 1]});
+        }
+    }
+
+    VSS_EVENT("read obj file: " << filename << " | vertices: " << mesh.vertices.size() << " | triangles: "
+              << mesh.triangle_count());
+
+    if (p_mesh)
+        *p_mesh = std::move(mesh);
+
+    return EXIT_SUCCESS;
+}
+
+//
+// triangle / box overlap
+//
+
+// separating axis setup of one triangle in voxel space. a cell overlaps the triangle iff its center c satisfies
+// lo <= dot(axis, c) <= hi on the triangle normal and the 9 edge cross axes, the 3 box axes are covered by the
+// bounding box of the triangle. with y and z fixed every axis bounds the center x to an interval, so a whole row
+// of cells is resolved at once instead of testing every cell.
+struct TriangleAxes {
+    double axis[10][3];
+    double lo[10];
+    double hi[10];
+    double min[3];
+    double max[3];
+};
+
+static TriangleAxes triangle_axes(const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c) {
+    const double v[3][3] = {{a.x, a.y, a.z}, {b.x, b.y, b.z}, {c.x, c.y, c.z}};
+    double e[3][3];
+    for (int i = 0; i < 3; i++) {
+        for (int k = 0; k < 3; k++)
+            e[i][k] = v[(i + 1) % 3][k] - v[i][k];
+    }
+
+    TriangleAxes t{};
+    // normal
+    t.axis[0][0] = e[0][1] * e[1][2] - e[0][2] * e[1][1];
+    t.axis[0][1] = e[0][2] * e[1][0] - e[0][0] * e[1][2];
+    t.axis[0][2] = e[0][0] * e[1][1] - e[0][1] * e[1][0];
+    // unit box axis u cross edge i
+    for (int u = 0; u < 3; u++) {
+        for (int i = 0; i < 3; i++) {
+            double *axis = t.axis[1 + u * 3 + i];
+            axis[u] = 0;
+            axis[(u + 1) % 3] = -e[i][(u + 2) % 3];
+            axis[(u + 2) % 3] = e[i][(u + 1) % 3];
+        }
+    }
+
+    for (int n = 0; n < 10; n++) {
+        const double *axis = t.axis[n];
+        double p_min = INFINITY, p_max = -INFINITY;
+        for (const auto &p: v) {
+            const double d = axis[0] * p[0] + axis[1] * p[1] + axis[2] * p[2];
+            p_min = std::min(p_min, d);
+            p_max = std::max(p_max, d);
+        }
+
+        // projected radius of a unit cell
+        const double r = 0.5 * (std::abs(axis[0]) + std::abs(axis[1]) + std::abs(axis[2]));
+        const double slack = VOXELIZE_EPSILON * (1.0 + r);
+        t.lo[n] = p_min - r - slack;
+        t.hi[n] = p_max + r + slack;
+    }
+
+    for (int k = 0; k < 3; k++) {
+        t.min[k] = std::min({v[0][k], v[1][k], v[2][k]});
+        t.max[k] = std::max({v[0][k], v[1][k], v[2][k]});
+    }
+
+    return t;
+}
+
+// cells [x_begin, x_end) of row (y, z) within the cells [x_lo, x_hi) that overlap the triangle, false if there
+// are none
+static bool triangle_row_span(const TriangleAxes &t, const int64_t x_lo, const int64_t x_hi, const int64_t y,
+                              const int64_t z, int64_t &x_begin, int64_t &x_end) {
+    const double cy = static_cast<double>(y) + 0.5;
+    const double cz = static_cast<double>(z) + 0.5;
+
+    // bounds of the center x
+    double c_min = static_cast<double>(x_lo) + 0.5;
+    double c_max = static_cast<double>(x_hi) - 0.5;
+    for (int n = 0; n < 10; n++) {
+        const double *axis = t.axis[n];
+        const double yz = axis[1] * cy + axis[2] * cz;
+
+        if (axis[0] == 0) {
+            if (yz < t.lo[n] || yz > t.hi[n])
+                return false;
+            continue;
+        }
+
+        double a = (t.lo[n] - yz) / axis[0];
+        double b = (t.hi[n] - yz) / axis[0];
+        if (a > b)
+            std::swap(a, b);
+        c_min = std::max(c_min, a);
+        c_max = std::min(c_max, b);
+        if (c_min > c_max)
+            return false;
+    }
+
+    x_begin = static_cast<int64_t>(std::ceil(c_min - 0.5));
+    x_end = static_cast<int64_t>(std::floor(c_max - 0.5)) + 1;
+    return x_begin < x_end;
+}
+
+//
+// voxelization
+//
+
+static glm::vec3 voxel_space(const glm::vec3 &p, const VoxelizeOptions &options) {
+    return (p - options.origin) / options.voxel_size;
+}
+
+// one past the last cell of the mesh along each axis, a mesh from 0 to n spans the n cells [0, n)
+static std::array<int64_t, 3> voxelize_mesh_end(const Mesh &mesh, const VoxelizeOptions &options) {
+    if (mesh.indices.size() % 3 != 0)
+        throw std::runtime_error("mesh index count is not a multiple of three.");
+    if (!(options.voxel_size > 0))
+        throw std::runtime_error("voxel size is not positive.");
+
+    glm::vec3 min(INFINITY), max(-INFINITY);
+    for (const uint32_t vertex: mesh.indices) {
+        if (vertex >= mesh.vertices.size())
+            throw std::runtime_error("mesh index out of bounds.");
+
+        const glm::vec3 p = voxel_space(mesh.vertices[vertex], options);
+        min = glm::min(min, p);
+        max = glm::max(max, p);
+    }
+
+    std::array<int64_t, 3> end{};
+    if (mesh.indices.empty())
+        return end;
+
+    for (int k = 0; k < 3; k++)
+        end[k] = std::max(static_cast<int64_t>(std::ceil(max[k])), static_cast<int64_t>(std::floor(min[k])) + 1);
+    return end;
+}
+
+// cells [begin, end) along one axis of a bounding box from lo to hi. the upper bound is exclusive, a box ending
+// on a cell boundary does not reach into the next cell and a flat box keeps the cell above it. the cells stay
+// below mesh_end, so a face on the max side of the mesh lands in the last cell of the mesh.
+static void voxelize_cell_range(const double lo, const double hi, const int64_t mesh_end, int64_t &begin,
+                                int64_t &end) {
+    begin = static_cast<int64_t>(std::floor(lo));
+    end = std::max(static_cast<int64_t>(std::ceil(hi)), begin + 1);
+    begin = std::min(begin, mesh_end - 1);
+    end = std::min(end, mesh_end);
+}
+
+// set every cell of the morton encoded chunk that overlaps one of the triangles to mat (conservative)
+static int voxelize_chunk(const Mesh &mesh, const std::vector<uint32_t> &triangles, const ChunkCoord &coord,
+                          const VoxelizeOptions &options, const std::array<int64_t, 3> &mesh_end, uint8_t *cells) {
+    const int64_t res = options.chunk_res;
+    const int64_t chunk_origin[3] = {coord.x * res, coord.y * res, coord.z * res};
+
+    for (const uint32_t tri: triangles) {
+        const TriangleAxes t = triangle_axes(voxel_space(mesh.vertices[mesh.indices[tri * 3]], options),
+                                             voxel_space(mesh.vertices[mesh.indices[tri * 3 + 1]], options),
+                                             voxel_space(mesh.vertices[mesh.indices[tri * 3 + 2]], options));
+
+        // cell range of the bounding box, local to the chunk
+        int64_t lo[3], hi[3];
+        for (int k = 0; k < 3; k++) {
+            voxelize_cell_range(t.min[k], t.max[k], mesh_end[k], lo[k], hi[k]);
+            lo[k] = std::max<int64_t>(lo[k] - chunk_origin[k], 0);
+            hi[k] = std::min<int64_t>(hi[k] - chunk_origin[k], res);
+        }
+
+        for (int64_t z = lo[2]; z < hi[2]; z++) {
+            for (int64_t y = lo[1]; y < hi[1]; y++) {
+                int64_t x_begin, x_end;
+                if (!triangle_row_span(t, chunk_origin[0] + lo[0], chunk_origin[0] + hi[0], chunk_origin[1] + y,
+                                       chunk_origin[2] + z, x_begin, x_end))
+                    continue;
+
+                x_begin = std::max(x_begin - chunk_origin[0], lo[0]);
+                x_end = std::min(x_end - chunk_origin[0], hi[0]);
+                if (x_begin >= x_end)
+                    continue;
+
+                // the x bits of the morton code are stepped with a masked increment
+                const uint64_t row = morton_encode_3d_64(0, static_cast<uint32_t>(y), static_cast<uint32_t>(z));
+                uint64_t x_bits = morton_encode_3d_64(static_cast<uint32_t>(x_begin), 0, 0);
+                for (int64_t x = x_begin; x < x_end; x++) {
+                    cells[row | x_bits] = options.mat;
+                    x_bits = ((x_bits | ~MORTON_MASK_X_64) + 1) & MORTON_MASK_X_64;
+                }
+            }
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// triangles of the mesh grouped by the chunks their bounding box touches, chunks sorted by z, y, x
+static std::vector<std::pair<ChunkCoord, std::vector<uint32_t> > >
+voxelize_bin_triangles(const Mesh &mesh, const VoxelizeOptions &options, const std::array<int64_t, 3> &mesh_end) {
+    if (options.chunk_res == 0 || (options.chunk_res & (options.chunk_res - 1)) != 0)
+        throw std::runtime_error("chunk resolution is not a power of two.");
+
+    const int32_t res = static_cast<int32_t>(options.chunk_res);
+    std::unordered_map<ChunkCoord, std::vector<uint32_t>, ChunkCoordHash> bins;
+
+    for (uint32_t tri = 0; tri < mesh.triangle_count(); tri++) {
+        glm::vec3 min(INFINITY), max(-INFINITY);
+        for (int i = 0; i < 3; i++) {
+            const glm::vec3 p = voxel_space(mesh.vertices[mesh.indices[tri * 3 + i]], options);
+            min = glm::min(min, p);
+            max = glm::max(max, p);
+        }
+
+        ChunkCoord lo, hi;
+        int32_t *lo_axes[3] = {&lo.x, &lo.y, &lo.z};
+        int32_t *hi_axes[3] = {&hi.x, &hi.y, &hi.z};
+        for (int k = 0; k < 3; k++) {
+            int64_t begin, end;
+            voxelize_cell_range(min[k], max[k], mesh_end[k], begin, end);
+            *lo_axes[k] = floor_div(static_cast<int32_t>(begin), res);
+            *hi_axes[k] = floor_div(static_cast<int32_t>(end - 1), res);
+        }
+
+        for (int32_t z = lo.z; z <= hi.z; z++) {
+            for (int32_t y = lo.y; y <= hi.y; y++) {
+                for (int32_t x = lo.x; x <= hi.x; x++)
+                    bins[ChunkCoord{x, y, z}].push_back(tri);
+            }
+        }
+    }
+
+    std::vector<std::pair<ChunkCoord, std::vector<uint32_t> > > chunks(bins.begin(), bins.end());
+    std::sort(chunks.begin(), chunks.end(), [](const auto &a, const auto &b) {
+        if (a.first.z != b.first.z)
+            return a.first.z < b.first.z;
+        if (a.first.y != b.first.y)
+            return a.first.y < b.first.y;
+        return a.first.x < b.first.x;
+    });
+
+    return chunks;
+}
+
+// conservative surface voxelization straight into morton encoded chunks, chunks are voxelized in parallel.
+// chunks whose cells stay empty are dropped.
+static std::vector<VoxelizedChunk> voxelize_mesh(const Mesh &mesh, const VoxelizeOptions &options,
+                                                 const uint32_t thread_count = 0) {
+    const std::array<int64_t, 3> mesh_end = voxelize_mesh_end(mesh, options);
+    const auto bins = voxelize_bin_triangles(mesh, options, mesh_end);
+    const size_t chunk_size = static_cast<size_t>(options.chunk_res) * options.chunk_res * options.chunk_res;
+
+    std::vector<VoxelizedChunk> chunks(bins.size());
+    parallel_for(0, bins.size(), [&](const size_t i) {
+        chunks[i].coord = bins[i].first;
+        chunks[i].cells.assign(chunk_size, 0);
+        voxelize_chunk(mesh, bins[i].second, bins[i].first, options, mesh_end, chunks[i].cells.data());
+    }, thread_count);
+
+    std::erase_if(chunks, [](const VoxelizedChunk &chunk) {
+        return std::all_of(chunk.cells.begin(), chunk.cells.end(), [](const uint8_t v) { return v == 0; });
+    });
+
+    return chunks;
+}
+
+// voxelize into the chunks of a world, chunks are stored in order as they are finished. cells the world
+// already has are kept, the mesh is added on top of them. new chunks that stay empty are not stored.
+static int voxelize_mesh(World &world, const Mesh &mesh, const VoxelizeOptions &options,
+                         const uint32_t thread_count = 0) {
+    if (world.chunk_format.chunk_res != options.chunk_res)
+        throw std::runtime_error("chunk resolution does not match world.");
+
+    const std::array<int64_t, 3> mesh_end = voxelize_mesh_end(mesh, options);
+    const auto bins = voxelize_bin_triangles(mesh, options, mesh_end);
+    const BvoxHeader &format = world.chunk_format;
+    if (format.chunk_size != static_cast<size_t>(format.chunk_res) * format.chunk_res * format.chunk_res)
+        throw std::runtime_error("chunk size does not match resolution.");
+
+    parallel_ordered<std::vector<uint8_t> >(bins.size(), [&](const size_t i) {
+        std::vector<uint8_t> cells(format.chunk_size, 0);
+        const auto existing = world.chunk(bins[i].first);
+        // world chunks are handed out in morton order
+        if (existing)
+            cells = *existing;
+
+        voxelize_chunk(mesh, bins[i].second, bins[i].first, options, mesh_end, cells.data());
+
+        if (!existing && std::all_of(cells.begin(), cells.end(), [](const uint8_t v) { return v == 0; }))
+            return std::vector<uint8_t>();
+        if (format.morton_encoded)
+            return cells;
+
+        std::vector<uint8_t> linear(cells.size());
+        morton_decode_3d_grid(cells.data(), format.chunk_res, cells.size(), linear.data());
+        return linear;
+    }, [&](const size_t i, std::vector<uint8_t> &&cells) {
+        if (!cells.empty())
+            world.store_chunk(bins[i].first, cells);
+    }, thread_count);
+
+    return EXIT_SUCCESS;
+}
+
+#endif //VOXELIZE_H
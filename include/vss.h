@@ -9,7 +9,23 @@
 
 #include "bsvo.h"
 #include "bvox.h"
+#include "distance_field.h"
+#include "greedy_mesh.h"
+#include "rle.h"
 #include "svo.h"
+#include "svo_compact.h"
+#include "svo_csg.h"
+#include "svo_dag.h"
+#include "svo_query.h"
+#include "svo_ray.h"
 #include "vox.h"
+#include "vox_bits.h"
+#include "vox_types.h"
+#include "voxelize.h"
+#include "vss_cache.h"
+#include "vss_simd.h"
+#include "vss_thread.h"
+#include "world.h"
+#include "world_loader.h"
 
 #endif //VSS_H
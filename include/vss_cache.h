@@ -0,0 +1,108 @@
+//
+// Created by ludw on 8/29/24.
+//
+
+#ifndef VSS_CACHE_H
+#define VSS_CACHE_H
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+
+struct CacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    size_t bytes = 0;
+    size_t peak_bytes = 0;
+    size_t entries = 0;
+};
+
+// least recently used cache with a byte budget, values are shared so evicted entries stay valid for
+// everyone still holding them. not thread safe, callers serialize access.
+template<typename Key, typename Value, typename Hash = std::hash<Key> >
+class LruCache {
+public:
+    size_t capacity_bytes = 0;
+    CacheStats stats;
+
+    LruCache() {
+    }
+
+    explicit LruCache(const size_t loc_capacity_bytes) {
+        capacity_bytes = loc_capacity_bytes;
+    }
+
+    // nullptr on a miss, a hit moves the entry to the front
+    std::shared_ptr<const Value> get(const Key &key) {
+        const auto it = index.find(key);
+        if (it == index.end()) {
+            stats.misses++;
+            return nullptr;
+        }
+
+        stats.hits++;
+        entries.splice(entries.begin(), entries, it->second);
+        return it->second->value;
+    }
+
+    bool contains(const Key &key) const {
+        return index.find(key) != index.end();
+    }
+
+    // insert or replace, then evict from the back until the budget holds. an entry larger than the whole
+    // budget is still kept until the next insert.
+    void put(const Key &key, std::shared_ptr<const Value> value, const size_t bytes) {
+        erase(key);
+
+        entries.push_front(Entry{key, std::move(value), bytes});
+        index[key] = entries.begin();
+        stats.bytes += bytes;
+        stats.entries = entries.size();
+
+        while (stats.bytes > capacity_bytes && entries.size() > 1) {
+            const Entry &last = entries.back();
+            stats.bytes -= last.bytes;
+            index.erase(last.key);
+            entries.pop_back();
+            stats.evictions++;
+        }
+
+        stats.entries = entries.size();
+        if (stats.bytes > stats.peak_bytes)
+            stats.peak_bytes = stats.bytes;
+    }
+
+    bool erase(const Key &key) {
+        const auto it = index.find(key);
+        if (it == index.end())
+            return false;
+
+        stats.bytes -= it->second->bytes;
+        entries.erase(it->second);
+        index.erase(it);
+        stats.entries = entries.size();
+        return true;
+    }
+
+    void clear() {
+        entries.clear();
+        index.clear();
+        stats.bytes = 0;
+        stats.entries = 0;
+    }
+
+private:
+    struct Entry {
+        Key key;
+        std::shared_ptr<const Value> value;
+        size_t bytes;
+    };
+
+    std::list<Entry> entries;
+    std::unordered_map<Key, typename std::list<Entry>::iterator, Hash> index;
+};
+
+#endif //VSS_CACHE_H
@@ -0,0 +1,236 @@
+//
+// Created by ludw on 9/9/24.
+//
+
+#ifndef VSS_METRICS_H
+#define VSS_METRICS_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <string>
+
+// counters
+#define METRIC_BYTES_READ 0
+#define METRIC_BYTES_WRITTEN 1
+#define METRIC_NODES_ALLOCATED 2
+#define METRIC_CHUNKS_ENCODED 3
+#define METRIC_CHUNKS_DECODED 4
+// cell bytes going into the chunk encoder and encoded bytes coming out, their ratio is the compression
+#define METRIC_ENCODE_INPUT_BYTES 5
+#define METRIC_ENCODE_OUTPUT_BYTES 6
+#define METRIC_COUNT 7
+
+// timing spans
+#define SPAN_CHUNK_ENCODE 0
+#define SPAN_CHUNK_DECODE 1
+#define SPAN_SVO_BUILD 2
+#define SPAN_FILE_READ 3
+#define SPAN_FILE_WRITE 4
+#define SPAN_COUNT 5
+
+static const char *metric_name(const uint8_t counter) {
+    static constexpr const char *names[METRIC_COUNT] = {
+        "bytes_read", "bytes_written", "nodes_allocated", "chunks_encoded", "chunks_decoded", "encode_input_bytes",
+        "encode_output_bytes",
+    };
+    return counter < METRIC_COUNT ? names[counter] : "unknown";
+}
+
+static const char *span_name(const uint8_t span) {
+    static constexpr const char *names[SPAN_COUNT] = {
+        "chunk_encode", "chunk_decode", "svo_build", "file_read", "file_write",
+    };
+    return span < SPAN_COUNT ? names[span] : "unknown";
+}
+
+// receives counters, finished spans and events from the library. calls can come from any thread.
+class MetricsSink {
+public:
+    virtual ~MetricsSink() = default;
+
+    virtual void count(uint8_t counter, uint64_t value) = 0;
+
+    virtual void span(uint8_t span, uint64_t nanoseconds) = 0;
+
+    // events are only formatted for sinks that want them
+    virtual bool wants_events() const {
+        return false;
+    }
+
+    virtual void event(const std::string &) {
+    }
+};
+
+// sink the library reports to, nullptr disables reporting
+static std::atomic<MetricsSink *> &metrics_sink() {
+    static std::atomic<MetricsSink *> sink{nullptr};
+    return sink;
+}
+
+static void set_metrics_sink(MetricsSink *sink) {
+    metrics_sink().store(sink, std::memory_order_release);
+}
+
+static void metrics_count(const uint8_t counter, const uint64_t value) {
+    if (MetricsSink *sink = metrics_sink().load(std::memory_order_acquire))
+        sink->count(counter, value);
+}
+
+// times its scope, the clock is only read while a sink is installed
+class MetricsSpan {
+public:
+    explicit MetricsSpan(const uint8_t loc_span) {
+        span = loc_span;
+        sink = metrics_sink().load(std::memory_order_acquire);
+        if (sink)
+            start = std::chrono::steady_clock::now();
+    }
+
+    MetricsSpan(const MetricsSpan &) = delete;
+
+    MetricsSpan &operator=(const MetricsSpan &) = delete;
+
+    ~MetricsSpan() {
+        if (!sink)
+            return;
+
+        const auto end = std::chrono::steady_clock::now();
+        sink->span(span, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()));
+    }
+
+private:
+    MetricsSink *sink;
+    uint8_t span;
+    std::chrono::steady_clock::time_point start;
+};
+
+// instrumentation points, file and build messages go through VSS_EVENT. with VSS_NO_METRICS defined they compile
+// to nothing, otherwise a disabled sink costs one atomic load per call.
+#ifdef VSS_NO_METRICS
+#define VSS_COUNT(counter, value) ((void) 0)
+#define VSS_SPAN(span) ((void) 0)
+#define VSS_EVENT(message) ((void) 0)
+#else
+#define VSS_CONCAT_INNER(a, b) a##b
+#define VSS_CONCAT(a, b) VSS_CONCAT_INNER(a, b)
+#define VSS_COUNT(counter, value) metrics_count(counter, static_cast<uint64_t>(value))
+#define VSS_SPAN(span) const MetricsSpan VSS_CONCAT(vss_span_, __LINE__)(span)
+#define VSS_EVENT(message)                                                                          \
+    do {                                                                                            \
+        MetricsSink *vss_event_sink = metrics_sink().load(std::memory_order_acquire);               \
+        if (vss_event_sink && vss_event_sink->wants_events()) {                                     \
+            std::ostringstream vss_event_stream;                                                    \
+            vss_event_stream << message;                                                            \
+            vss_event_sink->event(vss_event_stream.str());                                          \
+        }                                                                                           \
+    } while (0)
+#endif
+
+struct SpanStats {
+    uint64_t count = 0;
+    uint64_t total_ns = 0;
+    uint64_t max_ns = 0;
+};
+
+struct MetricsSnapshot {
+    std::array<uint64_t, METRIC_COUNT> counters{};
+    std::array<SpanStats, SPAN_COUNT> spans{};
+
+    // encoded size over cell size of every encoded chunk, 0 before the first one
+    double compression_ratio() const {
+        const uint64_t input = counters[METRIC_ENCODE_INPUT_BYTES];
+        return input > 0 ? static_cast<double>(counters[METRIC_ENCODE_OUTPUT_BYTES]) / static_cast<double>(input) : 0;
+    }
+};
+
+// default sink, aggregates everything in atomics and exports it on demand. events are written to the log
+// stream if one is set, e.g. &std::cout to get the old debug output back.
+class MetricsAggregator : public MetricsSink {
+public:
+    // can be swapped while other threads report
+    std::atomic<std::ostream *> log{nullptr};
+
+    void count(const uint8_t counter, const uint64_t value) override {
+        if (counter < METRIC_COUNT)
+            counters[counter].fetch_add(value, std::memory_order_relaxed);
+    }
+
+    void span(const uint8_t span, const uint64_t nanoseconds) override {
+        if (span >= SPAN_COUNT)
+            return;
+
+        SpanSlot &slot = spans[span];
+        slot.count.fetch_add(1, std::memory_order_relaxed);
+        slot.total_ns.fetch_add(nanoseconds, std::memory_order_relaxed);
+
+        uint64_t max = slot.max_ns.load(std::memory_order_relaxed);
+        while (nanoseconds > max && !slot.max_ns.compare_exchange_weak(max, nanoseconds, std::memory_order_relaxed)) {
+        }
+    }
+
+    bool wants_events() const override {
+        return log.load(std::memory_order_acquire) != nullptr;
+    }
+
+    void event(const std::string &message) override {
+        std::lock_guard<std::mutex> lock(log_mutex);
+        if (std::ostream *stream = log.load(std::memory_order_acquire))
+            *stream << message << '\n';
+    }
+
+    MetricsSnapshot snapshot() const {
+        MetricsSnapshot out;
+        for (uint8_t c = 0; c < METRIC_COUNT; c++)
+            out.counters[c] = counters[c].load(std::memory_order_relaxed);
+        for (uint8_t s = 0; s < SPAN_COUNT; s++) {
+            out.spans[s].count = spans[s].count.load(std::memory_order_relaxed);
+            out.spans[s].total_ns = spans[s].total_ns.load(std::memory_order_relaxed);
+            out.spans[s].max_ns = spans[s].max_ns.load(std::memory_order_relaxed);
+        }
+        return out;
+    }
+
+    void reset() {
+        for (std::atomic<uint64_t> &counter: counters)
+            counter.store(0, std::memory_order_relaxed);
+        for (SpanSlot &slot: spans) {
+            slot.count.store(0, std::memory_order_relaxed);
+            slot.total_ns.store(0, std::memory_order_relaxed);
+            slot.max_ns.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // one line per counter and span
+    void report(std::ostream &os) const {
+        const MetricsSnapshot stats = snapshot();
+        for (uint8_t c = 0; c < METRIC_COUNT; c++)
+            os << metric_name(c) << ": " << stats.counters[c] << '\n';
+        os << "compression_ratio: " << stats.compression_ratio() << '\n';
+
+        for (uint8_t s = 0; s < SPAN_COUNT; s++) {
+            const SpanStats &span = stats.spans[s];
+            const double mean_us = span.count > 0 ? static_cast<double>(span.total_ns) / span.count / 1e3 : 0;
+            os << span_name(s) << ": " << span.count << " spans | total: " << span.total_ns / 1e6 << " ms | mean: "
+               << mean_us << " us | max: " << span.max_ns / 1e3 << " us" << '\n';
+        }
+    }
+
+private:
+    struct SpanSlot {
+        std::atomic<uint64_t> count{0};
+        std::atomic<uint64_t> total_ns{0};
+        std::atomic<uint64_t> max_ns{0};
+    };
+
+    std::array<std::atomic<uint64_t>, METRIC_COUNT> counters{};
+    std::array<SpanSlot, SPAN_COUNT> spans{};
+    mutable std::mutex log_mutex;
+};
+
+#endif //VSS_METRICS_H
@@ -1,10 +0,0 @@
-//
-// Created by Ludw on 7/28/2024.
-//
-
-#ifndef VSS_VSS_PROP_H
-#define VSS_VSS_PROP_H
-
-#define DEBUG
-
-#endif //VSS_VSS_PROP_H
@@ -0,0 +1,82 @@
+//
+// Created by ludw on 8/16/24.
+//
+
+#ifndef VSS_SIMD_H
+#define VSS_SIMD_H
+
+#include <cstdint>
+
+// x86-64 kernels are compiled with per function target attributes and picked at runtime,
+// define VSS_NO_SIMD to build the scalar paths only
+#if !defined(VSS_NO_SIMD) && defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define VSS_X86_SIMD
+#include <immintrin.h>
+
+#define VSS_TARGET_AVX2 __attribute__((target("avx2,bmi,bmi2,popcnt")))
+#define VSS_TARGET_BMI2 __attribute__((target("bmi,bmi2")))
+#endif
+
+// shared loops are force inlined into the per target entry points so the kernels inline with them
+#if defined(__GNUC__) || defined(__clang__)
+#define VSS_INLINE inline __attribute__((always_inline))
+#else
+#define VSS_INLINE inline
+#endif
+
+#define SIMD_SCALAR 0
+#define SIMD_SSE2 1
+#define SIMD_AVX2 2
+
+// highest instruction set level supported by the cpu, sse2 is part of x86-64
+static int detect_simd_level() {
+#ifdef VSS_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2") && __builtin_cpu_supports("popcnt"))
+        return SIMD_AVX2;
+    return SIMD_SSE2;
+#else
+    return SIMD_SCALAR;
+#endif
+}
+
+// level used by the dispatching functions, can be lowered to test or compare the fallbacks
+static int &simd_level() {
+    static int level = detect_simd_level();
+    return level;
+}
+
+static int count_trailing_zeros(const uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(x);
+#else
+    int n = 0;
+    while (((x >> n) & 1) == 0)
+        n++;
+    return n;
+#endif
+}
+
+static int count_leading_zeros(const uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_clzll(x);
+#else
+    int n = 0;
+    while (((x >> (63 - n)) & 1) == 0)
+        n++;
+    return n;
+#endif
+}
+
+static int popcount(const uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcountll(x);
+#else
+    uint64_t v = x - ((x >> 1) & 0x5555555555555555ULL);
+    v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+    v = (v + (v >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return static_cast<int>((v * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+#endif //VSS_SIMD_H
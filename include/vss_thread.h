@@ -0,0 +1,218 @@
+//
+// Created by ludw on 8/14/24.
+//
+
+#ifndef VSS_THREAD_H
+#define VSS_THREAD_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+static uint32_t resolve_thread_count(const uint32_t thread_count) {
+    if (thread_count > 0)
+        return thread_count;
+
+    const uint32_t hardware = std::thread::hardware_concurrency();
+    return hardware > 0 ? hardware : 1;
+}
+
+// run fn(i) for every i in [begin, end), indices are handed out dynamically so uneven work balances itself.
+// a thread count of 0 uses all hardware threads, the first exception thrown by fn is rethrown on the caller.
+template<typename F>
+static void parallel_for(const size_t begin, const size_t end, F &&fn, const uint32_t thread_count = 0) {
+    if (begin >= end)
+        return;
+
+    size_t workers = resolve_thread_count(thread_count);
+    if (workers > end - begin)
+        workers = end - begin;
+
+    if (workers <= 1) {
+        for (size_t i = begin; i < end; i++)
+            fn(i);
+        return;
+    }
+
+    std::atomic<size_t> next(begin);
+    std::exception_ptr error;
+    std::mutex error_mutex;
+
+    auto work = [&]() {
+        try {
+            for (size_t i = next.fetch_add(1); i < end; i = next.fetch_add(1))
+                fn(i);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if (!error)
+                error = std::current_exception();
+            next.store(end);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(workers - 1);
+    for (size_t t = 1; t < workers; t++)
+        threads.emplace_back(work);
+
+    work();
+
+    for (std::thread &thread: threads)
+        thread.join();
+
+    if (error)
+        std::rethrow_exception(error);
+}
+
+// produce(i) runs on worker threads for every i in [0, count), consume(i, value) runs on the calling thread
+// strictly in index order. at most window results are in flight, workers wait for the writer before running
+// further ahead. the first exception from either side stops the remaining work and is rethrown.
+template<typename T, typename Produce, typename Consume>
+static void parallel_ordered(const size_t count, Produce &&produce, Consume &&consume, const uint32_t thread_count = 0,
+                             size_t window = 0) {
+    if (count == 0)
+        return;
+
+    size_t workers = resolve_thread_count(thread_count);
+    if (workers > count)
+        workers = count;
+    if (window == 0)
+        window = 2 * workers;
+
+    std::vector<std::optional<T> > slots(window);
+    std::mutex mutex;
+    std::condition_variable produced;
+    std::condition_variable consumed;
+    size_t next = 0;
+    size_t written = 0;
+    bool failed = false;
+    std::exception_ptr error;
+
+    auto set_error = [&](std::exception_ptr current) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!error)
+            error = std::move(current);
+        failed = true;
+        produced.notify_all();
+        consumed.notify_all();
+    };
+
+    auto work = [&]() {
+        try {
+            for (;;) {
+                size_t i;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    consumed.wait(lock, [&]() { return failed || next >= count || next < written + window; });
+                    if (failed || next >= count)
+                        return;
+                    i = next++;
+                }
+
+                T value = produce(i);
+
+                std::lock_guard<std::mutex> lock(mutex);
+                slots[i % window].emplace(std::move(value));
+                produced.notify_all();
+            }
+        } catch (...) {
+            set_error(std::current_exception());
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(workers);
+    for (size_t t = 0; t < workers; t++)
+        threads.emplace_back(work);
+
+    try {
+        for (size_t i = 0; i < count; i++) {
+            T value;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                produced.wait(lock, [&]() { return failed || slots[i % window].has_value(); });
+                if (failed)
+                    break;
+
+                value = std::move(*slots[i % window]);
+                slots[i % window].reset();
+                written++;
+                consumed.notify_all();
+            }
+
+            consume(i, std::move(value));
+        }
+    } catch (...) {
+        set_error(std::current_exception());
+    }
+
+    for (std::thread &thread: threads)
+        thread.join();
+
+    if (error)
+        std::rethrow_exception(error);
+}
+
+// fifo between pipeline stages. push blocks while the queue is full so a fast producer can not run ahead of
+// its consumers, pop blocks while it is empty. after close pushes fail and pops drain the remaining items.
+template<typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(const size_t loc_capacity) {
+        capacity = loc_capacity > 0 ? loc_capacity : 1;
+    }
+
+    // false if the queue was closed, the item is dropped
+    bool push(T item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_full.wait(lock, [&]() { return closed || items.size() < capacity; });
+        if (closed)
+            return false;
+
+        items.push_back(std::move(item));
+        not_empty.notify_one();
+        return true;
+    }
+
+    // false once the queue is closed and empty
+    bool pop(T &item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_empty.wait(lock, [&]() { return closed || !items.empty(); });
+        if (items.empty())
+            return false;
+
+        item = std::move(items.front());
+        items.pop_front();
+        not_full.notify_one();
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        not_full.notify_all();
+        not_empty.notify_all();
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return items.size();
+    }
+
+private:
+    mutable std::mutex mutex;
+    std::condition_variable not_full;
+    std::condition_variable not_empty;
+    std::deque<T> items;
+    size_t capacity;
+    bool closed = false;
+};
+
+#endif //VSS_THREAD_H
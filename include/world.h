@@ -0,0 +1,444 @@
+//
+// Created by ludw on 8/29/24.
+//
+
+#ifndef WORLD_H
+#define WORLD_H
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "bvox.h"
+#include "svo.h"
+#include "vss_cache.h"
+#include "vss_metrics.h"
+
+#define WORLD_VERSION 1
+
+// chunks per axis of one region file
+#define WORLD_REGION_RES 8
+#define WORLD_INDEX_FILENAME "world.index"
+
+// default cache budgets
+#define WORLD_CHUNK_CACHE_BYTES (static_cast<size_t>(256) << 20)
+#define WORLD_SVO_CACHE_BYTES (static_cast<size_t>(256) << 20)
+
+struct ChunkCoord {
+    int32_t x = 0;
+    int32_t y = 0;
+    int32_t z = 0;
+
+    bool operator==(const ChunkCoord &other) const {
+        return x == other.x && y == other.y && z == other.z;
+    }
+};
+
+struct ChunkCoordHash {
+    size_t operator()(const ChunkCoord &coord) const {
+        // large odd multipliers spread neighbouring coordinates over the table
+        uint64_t h = static_cast<uint32_t>(coord.x) * 0x9E3779B97F4A7C15ULL;
+        h ^= static_cast<uint32_t>(coord.y) * 0xC2B2AE3D27D4EB4FULL;
+        h ^= static_cast<uint32_t>(coord.z) * 0x165667B19E3779F9ULL;
+        return static_cast<size_t>(h ^ (h >> 29));
+    }
+};
+
+struct WorldHeader {
+    alignas(4) uint8_t version;
+    alignas(4) uint32_t region_res;
+    alignas(4) uint32_t chunk_count;
+};
+
+// position of one chunk, index is its entry in the region file
+struct WorldChunkEntry {
+    int32_t x;
+    int32_t y;
+    int32_t z;
+    uint32_t index;
+};
+
+struct WorldStats {
+    CacheStats chunks;
+    CacheStats svos;
+    uint64_t chunk_reads = 0;
+    uint64_t svo_builds = 0;
+};
+
+static int32_t floor_div(const int32_t a, const int32_t b) {
+    return a / b - (a % b != 0 && (a < 0) != (b < 0));
+}
+
+// chunks addressed by integer coordinates. chunks are grouped into region bvox files of
+// region_res^3 chunks, the world index maps coordinates to their entry in the region file.
+// decoded chunks and svos built from them are kept in two lru caches with separate byte budgets.
+//
+// storing a chunk again appends a new version to its region file, the old data is left unreferenced.
+// every store appends one entry to the world index, later entries of a chunk replace earlier ones. the index
+// is rewritten once superseded entries outnumber the live ones.
+// all members are safe to call from several threads. every region file has a reader writer lock, chunks are
+// read under a shared lock and appended under an exclusive one. every store bumps the generation of its
+// chunk, chunks and svos read before a store are returned but not cached.
+class World {
+public:
+    std::string directory;
+    // format of new region files, chunk_res and chunk_size have to match stored chunks
+    BvoxHeader chunk_format{};
+    uint32_t region_res = WORLD_REGION_RES;
+    uint8_t svo_max_depth = DEFAULT_MAX_DEPTH;
+
+    World() {
+    }
+
+    World(const std::string &loc_directory, const BvoxHeader &loc_chunk_format,
+          const size_t chunk_cache_bytes = WORLD_CHUNK_CACHE_BYTES,
+          const size_t svo_cache_bytes = WORLD_SVO_CACHE_BYTES) {
+        chunk_cache.capacity_bytes = chunk_cache_bytes;
+        svo_cache.capacity_bytes = svo_cache_bytes;
+        open(loc_directory, loc_chunk_format);
+    }
+
+    // create the directory or load the index of an existing world
+    int open(const std::string &loc_directory, const BvoxHeader &loc_chunk_format) {
+        std::scoped_lock lock(index_mutex, mutex);
+
+        directory = loc_directory;
+        chunk_format = loc_chunk_format;
+        chunk_index.clear();
+        chunk_cache.clear();
+        svo_cache.clear();
+
+        std::filesystem::create_directories(directory);
+
+        const std::string filename = index_filename();
+        if (!std::filesystem::exists(filename))
+            return write_index(index_entries_locked());
+
+        std::ifstream ifs(filename, std::ios::binary);
+        if (!ifs.is_open())
+            throw std::runtime_error("failed to open file.");
+
+        WorldHeader header{};
+        if (!ifs.read(reinterpret_cast<char *>(&header), sizeof(header)))
+            throw std::runtime_error("file is too small for world header.");
+        if (header.version != WORLD_VERSION)
+            throw std::runtime_error("unsupported world version.");
+
+        // the count is checked against the file size before the entries are allocated
+        const uint64_t file_size = std::filesystem::file_size(filename);
+        if (header.chunk_count > (file_size - sizeof(header)) / sizeof(WorldChunkEntry))
+            throw std::runtime_error("world index exceeds file size.");
+
+        std::vector<WorldChunkEntry> entries(header.chunk_count);
+        if (!ifs.read(reinterpret_cast<char *>(entries.data()),
+                      static_cast<std::streamsize>(sizeof(WorldChunkEntry) * entries.size())))
+            throw std::runtime_error("failed to read world index.");
+
+        region_res = header.region_res;
+        index_entries = entries.size();
+        for (const WorldChunkEntry &entry: entries)
+            chunk_index[ChunkCoord{entry.x, entry.y, entry.z}] = entry.index;
+
+        VSS_EVENT("opened world: " << directory << " | region res: " << region_res << " | chunks: "
+                  << chunk_index.size());
+
+        return EXIT_SUCCESS;
+    }
+
+    // shrinking a budget evicts on the next insert
+    void set_cache_budget(const size_t chunk_cache_bytes, const size_t svo_cache_bytes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        chunk_cache.capacity_bytes = chunk_cache_bytes;
+        svo_cache.capacity_bytes = svo_cache_bytes;
+    }
+
+    bool has_chunk(const ChunkCoord &coord) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return chunk_index.find(coord) != chunk_index.end();
+    }
+
+    size_t chunk_count() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return chunk_index.size();
+    }
+
+    ChunkCoord region_of(const ChunkCoord &coord) const {
+        const int32_t res = static_cast<int32_t>(region_res);
+        return ChunkCoord{floor_div(coord.x, res), floor_div(coord.y, res), floor_div(coord.z, res)};
+    }
+
+    std::string region_filename(const ChunkCoord &region) const {
+        const std::string name = "r." + std::to_string(region.x) + "." + std::to_string(region.y) + "." +
+                                 std::to_string(region.z) + ".bvox";
+        return (std::filesystem::path(directory) / name).string();
+    }
+
+    // append the chunk to its region file, cached copies of the old version are dropped
+    int store_chunk(const ChunkCoord &coord, const std::vector<uint8_t> &chunk) {
+        std::unique_lock<std::shared_mutex> region_lock(region_mutex(coord));
+
+        const std::string filename = region_filename(region_of(coord));
+        if (!std::filesystem::exists(filename))
+            write_empty_bvox(filename, chunk_format);
+
+        BvoxHeader header{};
+        get_bvox_header(filename, &header);
+        append_to_bvox(filename, chunk);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            chunk_index[coord] = header.chunk_count;
+            generations[coord]++;
+            chunk_cache.erase(coord);
+            svo_cache.erase(coord);
+        }
+
+        // the region lock keeps the entries of one chunk in store order
+        return append_index(WorldChunkEntry{coord.x, coord.y, coord.z, header.chunk_count});
+    }
+
+    // decoded chunk, paged in from its region file on a miss. nullptr if the world has no such chunk.
+    std::shared_ptr<const std::vector<uint8_t> > chunk(const ChunkCoord &coord) {
+        if (std::shared_ptr<const std::vector<uint8_t> > cached = cached_chunk(coord))
+            return cached;
+
+        const uint64_t generation = chunk_generation(coord);
+        std::string filename;
+        uint32_t index;
+        if (!locate_chunk(coord, &filename, &index))
+            return nullptr;
+
+        auto chunk = std::make_shared<std::vector<uint8_t> >();
+        BvoxHeader header{};
+        {
+            const std::shared_lock<std::shared_mutex> region_lock = lock_region_shared(coord);
+            read_bvox_chunk(filename, index, chunk.get(), &header);
+        }
+        morton_order_chunk(*chunk, header);
+
+        insert_chunk(coord, chunk, generation);
+        return chunk;
+    }
+
+    // svo of a chunk, built from the cached or paged in chunk on a miss
+    std::shared_ptr<const Svo> svo(const ChunkCoord &coord) {
+        if (std::shared_ptr<const Svo> cached = cached_svo(coord))
+            return cached;
+
+        const uint64_t generation = chunk_generation(coord);
+        const std::shared_ptr<const std::vector<uint8_t> > grid = chunk(coord);
+        if (!grid)
+            return nullptr;
+
+        std::shared_ptr<const Svo> svo = build_svo(*grid);
+        insert_svo(coord, svo, generation);
+        return svo;
+    }
+
+    //
+    // single steps of chunk() and svo(), used by the async loader to run them on different threads
+    //
+
+    // number of stores of a chunk so far, taken before locating a chunk and handed to the inserts
+    uint64_t chunk_generation(const ChunkCoord &coord) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return current_generation(coord);
+    }
+
+    // held while reading from the region file of a chunk, stores to the region wait for it
+    std::shared_lock<std::shared_mutex> lock_region_shared(const ChunkCoord &coord) {
+        return std::shared_lock<std::shared_mutex>(region_mutex(coord));
+    }
+
+    // region file and entry of a chunk, false if the world has no such chunk
+    bool locate_chunk(const ChunkCoord &coord, std::string *p_filename, uint32_t *p_index) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        const auto it = chunk_index.find(coord);
+        if (it == chunk_index.end())
+            return false;
+
+        if (p_filename)
+            *p_filename = region_filename(region_of(coord));
+        if (p_index)
+            *p_index = it->second;
+        return true;
+    }
+
+    std::shared_ptr<const std::vector<uint8_t> > cached_chunk(const ChunkCoord &coord) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return chunk_cache.get(coord);
+    }
+
+    std::shared_ptr<const Svo> cached_svo(const ChunkCoord &coord) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return svo_cache.get(coord);
+    }
+
+    // skipped if the chunk was stored again since its generation was taken
+    void insert_chunk(const ChunkCoord &coord, const std::shared_ptr<const std::vector<uint8_t> > &chunk,
+                      const uint64_t generation) {
+        std::lock_guard<std::mutex> lock(mutex);
+        chunk_reads++;
+        if (current_generation(coord) == generation)
+            chunk_cache.put(coord, chunk, chunk->capacity());
+    }
+
+    void insert_svo(const ChunkCoord &coord, const std::shared_ptr<const Svo> &svo, const uint64_t generation) {
+        std::lock_guard<std::mutex> lock(mutex);
+        svo_builds++;
+        if (current_generation(coord) == generation)
+            svo_cache.put(coord, svo, svo_bytes(*svo));
+    }
+
+    // the svo builder and lookups expect morton order
+    static void morton_order_chunk(std::vector<uint8_t> &chunk, const BvoxHeader &header) {
+        if (header.morton_encoded)
+            return;
+
+        std::vector<uint8_t> morton_chunk(chunk.size());
+        morton_encode_3d_grid(chunk.data(), header.chunk_res, chunk.size(), morton_chunk.data());
+        chunk.swap(morton_chunk);
+    }
+
+    std::shared_ptr<const Svo> build_svo(const std::vector<uint8_t> &grid) const {
+        auto svo = std::make_shared<Svo>();
+        svo->root_res = chunk_format.chunk_res;
+        svo->max_depth = std::min(svo_max_depth, svo_res_depth(chunk_format.chunk_res));
+        svo->build(grid.data(), grid.size());
+        return svo;
+    }
+
+    WorldStats stats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        WorldStats out;
+        out.chunks = chunk_cache.stats;
+        out.svos = svo_cache.stats;
+        out.chunk_reads = chunk_reads;
+        out.svo_builds = svo_builds;
+        return out;
+    }
+
+    static size_t svo_bytes(const Svo &svo) {
+        return sizeof(SvoNode) * svo.nodes.capacity() + sizeof(uint32_t) * svo.lod_mats.capacity() +
+               sizeof(uint32_t) * svo.free_blocks.capacity();
+    }
+
+private:
+    mutable std::mutex mutex;
+    // serializes writes to the index file, taken before mutex
+    std::mutex index_mutex;
+    // entries in the index file including superseded ones
+    size_t index_entries = 0;
+    std::unordered_map<ChunkCoord, uint32_t, ChunkCoordHash> chunk_index;
+    LruCache<ChunkCoord, std::vector<uint8_t>, ChunkCoordHash> chunk_cache{WORLD_CHUNK_CACHE_BYTES};
+    LruCache<ChunkCoord, Svo, ChunkCoordHash> svo_cache{WORLD_SVO_CACHE_BYTES};
+    uint64_t chunk_reads = 0;
+    uint64_t svo_builds = 0;
+    // stores per chunk and locks per region, entries are never removed so references stay valid
+    std::unordered_map<ChunkCoord, uint64_t, ChunkCoordHash> generations;
+    std::unordered_map<ChunkCoord, std::unique_ptr<std::shared_mutex>, ChunkCoordHash> region_mutexes;
+
+    // caller holds the lock
+    uint64_t current_generation(const ChunkCoord &coord) const {
+        const auto it = generations.find(coord);
+        return it == generations.end() ? 0 : it->second;
+    }
+
+    std::shared_mutex &region_mutex(const ChunkCoord &coord) {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::unique_ptr<std::shared_mutex> &region = region_mutexes[region_of(coord)];
+        if (!region)
+            region = std::make_unique<std::shared_mutex>();
+        return *region;
+    }
+
+    std::string index_filename() const {
+        return (std::filesystem::path(directory) / WORLD_INDEX_FILENAME).string();
+    }
+
+    // caller holds the lock
+    std::vector<WorldChunkEntry> index_entries_locked() const {
+        std::vector<WorldChunkEntry> entries;
+        entries.reserve(chunk_index.size());
+        for (const auto &[coord, index]: chunk_index)
+            entries.push_back(WorldChunkEntry{coord.x, coord.y, coord.z, index});
+        return entries;
+    }
+
+    WorldHeader index_header(const size_t entry_count) const {
+        WorldHeader header{};
+        header.version = WORLD_VERSION;
+        header.region_res = region_res;
+        header.chunk_count = static_cast<uint32_t>(entry_count);
+        return header;
+    }
+
+    // the entry is written past the last counted one before the count is raised, an append cut short leaves
+    // the index as it was. caller holds neither lock.
+    int append_index(const WorldChunkEntry &entry) {
+        std::lock_guard<std::mutex> index_lock(index_mutex);
+
+        {
+            std::fstream fs(index_filename(), std::ios::binary | std::ios::in | std::ios::out);
+            if (!fs.is_open())
+                throw std::runtime_error("failed to open file.");
+
+            fs.seekp(static_cast<std::streamoff>(sizeof(WorldHeader) + sizeof(WorldChunkEntry) * index_entries));
+            fs.write(reinterpret_cast<const char *>(&entry), sizeof(entry));
+            fs.flush();
+
+            const WorldHeader header = index_header(index_entries + 1);
+            fs.seekp(0);
+            fs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+            fs.close();
+            if (fs.fail())
+                throw std::runtime_error("failed to write to file.");
+        }
+        index_entries++;
+
+        std::vector<WorldChunkEntry> entries;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (index_entries <= 2 * chunk_index.size())
+                return EXIT_SUCCESS;
+            entries = index_entries_locked();
+        }
+
+        return write_index(entries);
+    }
+
+    // the whole index is written to a temporary file that replaces the old one, caller holds index_mutex
+    int write_index(const std::vector<WorldChunkEntry> &entries) {
+        const WorldHeader header = index_header(entries.size());
+        const std::string filename = index_filename();
+        const std::string tmp_filename = filename + ".tmp";
+
+        std::ofstream ofs(tmp_filename, std::ios::out | std::ios::binary);
+        if (!ofs.is_open())
+            throw std::runtime_error("failed to open file.");
+
+        ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        ofs.write(reinterpret_cast<const char *>(entries.data()),
+                  static_cast<std::streamsize>(sizeof(WorldChunkEntry) * entries.size()));
+
+        ofs.close();
+        if (ofs.fail())
+            throw std::runtime_error("failed to write to file.");
+
+        std::filesystem::rename(tmp_filename, filename);
+        index_entries = entries.size();
+
+        return EXIT_SUCCESS;
+    }
+};
+
+#endif //WORLD_H
@@ -0,0 +1,411 @@
+//
+// Created by ludw on 9/2/24.
+//
+
+#ifndef WORLD_LOADER_H
+#define WORLD_LOADER_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "bvox.h"
+#include "svo.h"
+#include "vss_thread.h"
+#include "world.h"
+
+// items between two stages, a full queue stalls the stage in front of it
+#define WORLD_LOADER_QUEUE_CAPACITY 16
+
+// called with the svo, or nullptr if the world has no such chunk. error is set if the load failed. exceptions
+// thrown by the callback are dropped.
+using SvoCallback = std::function<void(std::shared_ptr<const Svo> svo, std::exception_ptr error)>;
+
+// asynchronous chunk and svo loads for a world, run as a pipeline of three stages:
+// one reader thread doing the file io, decode workers doing rle decoding and morton ordering and svo builders.
+// the stages are connected by bounded queues, so disk latency overlaps with decoding and building of earlier
+// chunks. results go into the world caches, concurrent requests for the same chunk share one load.
+//
+// prefetch hints are loaded after all outstanding demand requests, a demand request for a hinted chunk that
+// was not started yet moves it to the front.
+class WorldLoader {
+public:
+    // a thread count of 0 splits the hardware threads between decoding and building
+    explicit WorldLoader(World &loc_world, uint32_t decode_threads = 0, uint32_t build_threads = 0,
+                         const size_t queue_capacity = WORLD_LOADER_QUEUE_CAPACITY)
+        : world(loc_world), decode_queue(queue_capacity), build_queue(queue_capacity) {
+        const uint32_t hardware = resolve_thread_count(0);
+        if (decode_threads == 0)
+            decode_threads = std::max(1u, hardware / 2);
+        if (build_threads == 0)
+            build_threads = std::max(1u, hardware - hardware / 2);
+
+        reader = std::thread(&WorldLoader::read_stage, this);
+        for (uint32_t t = 0; t < decode_threads; t++)
+            decoders.emplace_back(&WorldLoader::decode_stage, this);
+        for (uint32_t t = 0; t < build_threads; t++)
+            builders.emplace_back(&WorldLoader::build_stage, this);
+    }
+
+    WorldLoader(const WorldLoader &) = delete;
+
+    WorldLoader &operator=(const WorldLoader &) = delete;
+
+    ~WorldLoader() {
+        stop();
+    }
+
+    // decoded chunk in morton order, nullptr if the world has no such chunk
+    std::future<std::shared_ptr<const std::vector<uint8_t> > > load_chunk(const ChunkCoord &coord) {
+        std::promise<std::shared_ptr<const std::vector<uint8_t> > > promise;
+        std::future<std::shared_ptr<const std::vector<uint8_t> > > future = promise.get_future();
+
+        if (std::shared_ptr<const std::vector<uint8_t> > cached = world.cached_chunk(coord)) {
+            promise.set_value(std::move(cached));
+            return future;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        Job &job = enqueue(coord, true);
+        if (job.decoded)
+            promise.set_value(job.chunk);
+        else
+            job.chunk_waiters.push_back(std::move(promise));
+
+        return future;
+    }
+
+    std::future<std::shared_ptr<const Svo> > load_svo(const ChunkCoord &coord) {
+        auto promise = std::make_shared<std::promise<std::shared_ptr<const Svo> > >();
+        std::future<std::shared_ptr<const Svo> > future = promise->get_future();
+
+        load_svo(coord, [promise](std::shared_ptr<const Svo> svo, const std::exception_ptr error) {
+            if (error)
+                promise->set_exception(error);
+            else
+                promise->set_value(std::move(svo));
+        });
+
+        return future;
+    }
+
+    // the callback runs on a pipeline thread, or on the caller if the svo is cached
+    void load_svo(const ChunkCoord &coord, SvoCallback callback) {
+        if (std::shared_ptr<const Svo> cached = world.cached_svo(coord)) {
+            callback(std::move(cached), nullptr);
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        Job &job = enqueue(coord, true);
+        job.want_svo = true;
+        job.svo_waiters.push_back(std::move(callback));
+    }
+
+    // build the svos of chunks that are likely needed soon, e.g. the next ring around a moving player
+    void prefetch(const std::vector<ChunkCoord> &coords) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const ChunkCoord &coord: coords)
+            enqueue(coord, false).want_svo = true;
+    }
+
+    // block until every request made so far has completed
+    void wait_idle() {
+        std::unique_lock<std::mutex> lock(mutex);
+        idle.wait(lock, [&]() { return jobs.empty(); });
+    }
+
+    // requests that are not loaded yet
+    size_t pending() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return jobs.size();
+    }
+
+    // finish the loads already in the pipeline and fail the ones still waiting for the reader
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping)
+                return;
+            stopping = true;
+            requested.notify_all();
+        }
+
+        // each stage drains its input queue before the next one is closed
+        reader.join();
+        decode_queue.close();
+        for (std::thread &thread: decoders)
+            thread.join();
+        build_queue.close();
+        for (std::thread &thread: builders)
+            thread.join();
+
+        std::vector<ChunkCoord> abandoned;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (const auto &[coord, job]: jobs)
+                abandoned.push_back(coord);
+        }
+
+        const std::exception_ptr error = std::make_exception_ptr(std::runtime_error("world loader was stopped."));
+        for (const ChunkCoord &coord: abandoned)
+            fail(coord, error);
+    }
+
+private:
+    // one requested chunk, shared by every request for it until it is loaded
+    struct Job {
+        bool started = false;
+        bool want_svo = false;
+        bool decoded = false;
+        std::shared_ptr<const std::vector<uint8_t> > chunk;
+        std::vector<std::promise<std::shared_ptr<const std::vector<uint8_t> > > > chunk_waiters;
+        std::vector<SvoCallback> svo_waiters;
+    };
+
+    struct EncodedChunk {
+        ChunkCoord coord;
+        uint64_t generation = 0;
+        BvoxHeader header{};
+        std::vector<uint8_t> encoded;
+    };
+
+    struct DecodedChunk {
+        ChunkCoord coord;
+        uint64_t generation = 0;
+        std::shared_ptr<const std::vector<uint8_t> > chunk;
+    };
+
+    World &world;
+
+    mutable std::mutex mutex;
+    std::condition_variable requested;
+    std::condition_variable idle;
+    std::unordered_map<ChunkCoord, Job, ChunkCoordHash> jobs;
+    std::deque<ChunkCoord> demand;
+    std::deque<ChunkCoord> hints;
+    bool stopping = false;
+
+    BoundedQueue<EncodedChunk> decode_queue;
+    BoundedQueue<DecodedChunk> build_queue;
+
+    std::thread reader;
+    std::vector<std::thread> decoders;
+    std::vector<std::thread> builders;
+
+    // caller holds the lock. a coord can sit in both request queues, the reader skips started jobs.
+    Job &enqueue(const ChunkCoord &coord, const bool is_demand) {
+        if (stopping)
+            throw std::runtime_error("world loader was stopped.");
+
+        const auto [it, inserted] = jobs.try_emplace(coord);
+        if (inserted || (is_demand && !it->second.started)) {
+            (is_demand ? demand : hints).push_back(coord);
+            requested.notify_one();
+        }
+
+        return it->second;
+    }
+
+    //
+    // stages
+    //
+
+    void read_stage() {
+        for (;;) {
+            ChunkCoord coord;
+            bool svo_only;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                requested.wait(lock, [&]() { return stopping || !demand.empty() || !hints.empty(); });
+                if (stopping)
+                    return;
+
+                std::deque<ChunkCoord> &queue = demand.empty() ? hints : demand;
+                coord = queue.front();
+                queue.pop_front();
+
+                const auto it = jobs.find(coord);
+                if (it == jobs.end() || it->second.started)
+                    continue;
+                it->second.started = true;
+                svo_only = it->second.want_svo && it->second.chunk_waiters.empty();
+            }
+
+            try {
+                // results are only cached if the chunk was not stored again while it was loaded
+                const uint64_t generation = world.chunk_generation(coord);
+
+                // an earlier load may have filled the caches since the request
+                if (svo_only) {
+                    if (std::shared_ptr<const Svo> cached = world.cached_svo(coord)) {
+                        finish_svo(coord, std::move(cached));
+                        continue;
+                    }
+                }
+                if (std::shared_ptr<const std::vector<uint8_t> > cached = world.cached_chunk(coord)) {
+                    finish_chunk(coord, generation, std::move(cached));
+                    continue;
+                }
+
+                std::string filename;
+                uint32_t index;
+                if (!world.locate_chunk(coord, &filename, &index)) {
+                    finish_chunk(coord, generation, nullptr);
+                    continue;
+                }
+
+                EncodedChunk item;
+                item.coord = coord;
+                item.generation = generation;
+                {
+                    const std::shared_lock<std::shared_mutex> region_lock = world.lock_region_shared(coord);
+                    read_bvox_chunk_encoded(filename, index, &item.encoded, &item.header);
+                }
+                if (!decode_queue.push(std::move(item)))
+                    throw std::runtime_error("world loader was stopped.");
+            } catch (...) {
+                fail(coord, std::current_exception());
+            }
+        }
+    }
+
+    void decode_stage() {
+        EncodedChunk item;
+        while (decode_queue.pop(item)) {
+            try {
+                auto chunk = std::make_shared<std::vector<uint8_t> >();
+                decode_bvox_chunk(item.encoded.data(), item.encoded.size(), item.header, *chunk);
+                World::morton_order_chunk(*chunk, item.header);
+
+                world.insert_chunk(item.coord, chunk, item.generation);
+                finish_chunk(item.coord, item.generation, std::move(chunk));
+            } catch (...) {
+                fail(item.coord, std::current_exception());
+            }
+        }
+    }
+
+    void build_stage() {
+        DecodedChunk item;
+        while (build_queue.pop(item)) {
+            try {
+                std::shared_ptr<const Svo> svo = world.build_svo(*item.chunk);
+                world.insert_svo(item.coord, svo, item.generation);
+                finish_svo(item.coord, std::move(svo));
+            } catch (...) {
+                fail(item.coord, std::current_exception());
+            }
+        }
+    }
+
+    //
+    // completion, waiters are always called outside of the lock
+    //
+
+    // a throwing callback must not keep the other waiters of its job from being called
+    static void call_waiter(SvoCallback &callback, std::shared_ptr<const Svo> svo, const std::exception_ptr &error) {
+        try {
+            callback(std::move(svo), error);
+        } catch (...) {
+            VSS_EVENT("world loader callback threw.");
+        }
+    }
+
+    // hand the chunk to its waiters, then to the builders if a svo was requested. nullptr for a missing chunk.
+    void finish_chunk(const ChunkCoord &coord, const uint64_t generation,
+                      std::shared_ptr<const std::vector<uint8_t> > chunk) {
+        std::vector<std::promise<std::shared_ptr<const std::vector<uint8_t> > > > chunk_waiters;
+        std::vector<SvoCallback> svo_waiters;
+        bool build;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            Job &job = jobs.at(coord);
+            job.decoded = true;
+            job.chunk = chunk;
+            chunk_waiters.swap(job.chunk_waiters);
+
+            build = job.want_svo && chunk;
+            if (!build) {
+                svo_waiters.swap(job.svo_waiters);
+                erase_job(coord);
+            }
+        }
+
+        for (auto &promise: chunk_waiters)
+            promise.set_value(chunk);
+        for (SvoCallback &callback: svo_waiters)
+            call_waiter(callback, nullptr, nullptr);
+
+        if (build && !build_queue.push(DecodedChunk{coord, generation, std::move(chunk)}))
+            throw std::runtime_error("world loader was stopped.");
+    }
+
+    // chunk requests that arrived after the reader skipped the chunk for a cached svo keep the job, it goes back
+    // to the front of the reader queue as a chunk load
+    void finish_svo(const ChunkCoord &coord, const std::shared_ptr<const Svo> &svo) {
+        std::vector<std::promise<std::shared_ptr<const std::vector<uint8_t> > > > chunk_waiters;
+        std::vector<SvoCallback> svo_waiters;
+        std::shared_ptr<const std::vector<uint8_t> > chunk;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            Job &job = jobs.at(coord);
+            svo_waiters.swap(job.svo_waiters);
+
+            if (job.decoded || job.chunk_waiters.empty()) {
+                chunk_waiters.swap(job.chunk_waiters);
+                chunk = job.chunk;
+                erase_job(coord);
+            } else {
+                job.started = false;
+                job.want_svo = false;
+                demand.push_front(coord);
+                requested.notify_one();
+            }
+        }
+
+        for (auto &promise: chunk_waiters)
+            promise.set_value(chunk);
+        for (SvoCallback &callback: svo_waiters)
+            call_waiter(callback, svo, nullptr);
+    }
+
+    void fail(const ChunkCoord &coord, const std::exception_ptr &error) {
+        std::vector<std::promise<std::shared_ptr<const std::vector<uint8_t> > > > chunk_waiters;
+        std::vector<SvoCallback> svo_waiters;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            const auto it = jobs.find(coord);
+            if (it == jobs.end())
+                return;
+            chunk_waiters.swap(it->second.chunk_waiters);
+            svo_waiters.swap(it->second.svo_waiters);
+            erase_job(coord);
+        }
+
+        for (auto &promise: chunk_waiters)
+            promise.set_exception(error);
+        for (SvoCallback &callback: svo_waiters)
+            call_waiter(callback, nullptr, error);
+    }
+
+    // caller holds the lock
+    void erase_job(const ChunkCoord &coord) {
+        jobs.erase(coord);
+        if (jobs.empty())
+            idle.notify_all();
+    }
+};
+
+#endif //WORLD_LOADER_H
@@ -0,0 +1,427 @@
+//
+// Created by ludw on 9/6/24.
+//
+
+// microbenchmarks of the grid, rle, bvox, svo and bsvo paths on seeded datasets.
+//
+// every benchmark is repeated until it ran for at least min time, the median iteration is reported as
+// ns per voxel and MB/s of grid data. results are printed as a table and optionally written as json.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#include "../include/vss.h"
+
+#define BENCH_DEFAULT_RES 128
+#define BENCH_DEFAULT_MIN_TIME 0.2
+#define BENCH_MIN_ITERATIONS 3
+#define BENCH_MAX_ITERATIONS 10000
+#define BENCH_SEED 1234
+
+struct BenchDataset {
+    std::string name;
+    // morton encoded, the input of everything but the morton benchmark
+    std::vector<uint8_t> grid;
+    // the same cells in row major order
+    std::vector<uint8_t> linear_grid;
+};
+
+struct BenchResult {
+    std::string name;
+    std::string dataset;
+    uint64_t iterations = 0;
+    double ns_per_iteration = 0;
+    double ns_per_voxel = 0;
+    double mb_per_second = 0;
+    // peak resident set size during this benchmark, 0 where it can not be measured
+    size_t peak_rss = 0;
+};
+
+// the process wide peak only grows, so it is reset to the current rss before every benchmark (linux 4.0+).
+// freed heap pages are handed back first, otherwise the largest earlier benchmark stays resident.
+// false where the peak can not be reset.
+static bool reset_peak_rss() {
+#if defined(__GLIBC__)
+    malloc_trim(0);
+#endif
+    std::ofstream ofs("/proc/self/clear_refs");
+    if (!ofs.is_open())
+        return false;
+    ofs << "5";
+    ofs.close();
+    return !ofs.fail();
+}
+
+// peak resident set size since the last reset in bytes, from VmHWM
+static size_t peak_rss_bytes() {
+    std::ifstream ifs("/proc/self/status");
+    std::string line;
+    while (std::getline(ifs, line)) {
+        if (line.rfind("VmHWM:", 0) == 0)
+            return static_cast<size_t>(std::stoull(line.substr(6))) * 1024;
+    }
+    return 0;
+}
+
+// keeps results alive so the compiler can not drop the measured work
+static volatile uint64_t bench_sink = 0;
+
+static void consume(const uint64_t value) {
+    bench_sink = bench_sink + value;
+}
+
+//
+// datasets
+//
+
+static BenchDataset make_dataset(const std::string &name, std::vector<uint8_t> linear_grid, const uint32_t res) {
+    BenchDataset dataset;
+    dataset.name = name;
+    dataset.grid.resize(linear_grid.size());
+    morton_encode_3d_grid(linear_grid.data(), res, linear_grid.size(), dataset.grid.data());
+    dataset.linear_grid = std::move(linear_grid);
+    return dataset;
+}
+
+// one 64 bit draw decides 8 cells, density is quantized to 1/256
+static BenchDataset random_dataset(const uint32_t res, const double density, const uint64_t seed) {
+    const size_t size = static_cast<size_t>(res) * res * res;
+    const uint32_t threshold = static_cast<uint32_t>(std::lround(density * 256.0));
+
+    std::vector<uint8_t> grid(size);
+    std::mt19937_64 gen(seed);
+    for (size_t i = 0; i < size; i += 8) {
+        uint64_t bits = gen();
+        for (size_t b = 0; b < 8 && i + b < size; b++, bits >>= 8)
+            grid[i + b] = (bits & 0xFF) < threshold ? DEFAULT_MAT : 0;
+    }
+
+    std::ostringstream name;
+    name << "random_" << density;
+    return make_dataset(name.str(), std::move(grid), res);
+}
+
+// solid cube over the middle half of every axis, as in the sample data
+static BenchDataset cube_dataset(const uint32_t res) {
+    std::vector<uint8_t> grid(static_cast<size_t>(res) * res * res);
+    for (uint32_t z = res / 4; z < 3 * res / 4; z++) {
+        for (uint32_t y = res / 4; y < 3 * res / 4; y++) {
+            for (uint32_t x = res / 4; x < 3 * res / 4; x++)
+                grid[POS_TO_INDEX(x, y, static_cast<size_t>(z), res)] = DEFAULT_MAT;
+        }
+    }
+
+    return make_dataset("solid_cube", std::move(grid), res);
+}
+
+// heightmap of two octaves of value noise with a grass layer on top
+static BenchDataset terrain_dataset(const uint32_t res, const uint64_t seed) {
+    constexpr uint32_t lattice = 17;
+    std::mt19937_64 gen(seed);
+    std::uniform_real_distribution<float> dist(0.0f, 1.0f);
+
+    std::vector<float> values(lattice * lattice);
+    for (float &value: values)
+        value = dist(gen);
+
+    auto noise = [&](const float u, const float v) {
+        const float fu = u * (lattice - 1);
+        const float fv = v * (lattice - 1);
+        const uint32_t iu = std::min(static_cast<uint32_t>(fu), lattice - 2);
+        const uint32_t iv = std::min(static_cast<uint32_t>(fv), lattice - 2);
+        float tu = fu - static_cast<float>(iu);
+        float tv = fv - static_cast<float>(iv);
+        tu = tu * tu * (3.0f - 2.0f * tu);
+        tv = tv * tv * (3.0f - 2.0f * tv);
+
+        const float a = values[iu + iv * lattice] * (1 - tu) + values[iu + 1 + iv * lattice] * tu;
+        const float b = values[iu + (iv + 1) * lattice] * (1 - tu) + values[iu + 1 + (iv + 1) * lattice] * tu;
+        return a * (1 - tv) + b * tv;
+    };
+
+    std::vector<uint8_t> grid(static_cast<size_t>(res) * res * res);
+    for (uint32_t z = 0; z < res; z++) {
+        for (uint32_t x = 0; x < res; x++) {
+            const float u = static_cast<float>(x) / static_cast<float>(res);
+            const float v = static_cast<float>(z) / static_cast<float>(res);
+            const float h = 0.7f * noise(u, v) + 0.3f * noise(std::fmod(4 * u, 1.0f), std::fmod(4 * v, 1.0f));
+
+            const uint32_t height = std::min(res, 1 + static_cast<uint32_t>(h * static_cast<float>(res) * 0.75f));
+            for (uint32_t y = 0; y < height; y++)
+                grid[POS_TO_INDEX(x, y, static_cast<size_t>(z), res)] = y + 1 == height ? 2 : DEFAULT_MAT;
+        }
+    }
+
+    return make_dataset("terrain", std::move(grid), res);
+}
+
+//
+// harness
+//
+
+static BenchResult run_benchmark(const std::string &name, const BenchDataset &dataset, const double min_time,
+                                 const std::function<uint64_t()> &fn) {
+    const bool rss = reset_peak_rss();
+
+    // warm up caches and the allocator
+    consume(fn());
+
+    std::vector<double> times;
+    double total = 0;
+    while ((total < min_time || times.size() < BENCH_MIN_ITERATIONS) && times.size() < BENCH_MAX_ITERATIONS) {
+        const auto start = std::chrono::high_resolution_clock::now();
+        consume(fn());
+        const auto end = std::chrono::high_resolution_clock::now();
+
+        const double seconds = std::chrono::duration<double>(end - start).count();
+        times.push_back(seconds);
+        total += seconds;
+    }
+
+    std::sort(times.begin(), times.end());
+    const double median = times[times.size() / 2];
+
+    BenchResult result;
+    result.name = name;
+    result.dataset = dataset.name;
+    result.iterations = times.size();
+    result.ns_per_iteration = median * 1e9;
+    result.ns_per_voxel = median * 1e9 / static_cast<double>(dataset.grid.size());
+    result.mb_per_second = static_cast<double>(dataset.grid.size()) / median / 1e6;
+    result.peak_rss = rss ? peak_rss_bytes() : 0;
+    return result;
+}
+
+static std::vector<BenchResult> run_dataset(const BenchDataset &dataset, const uint32_t res, const double min_time,
+                                            const std::string &filter) {
+    const size_t size = dataset.grid.size();
+    const std::string bvox_filename = "bench_" + dataset.name + ".bvox";
+    const std::string bsvo_filename = "bench_" + dataset.name + ".bsvo";
+
+    BvoxHeader bvox_header{};
+    bvox_header.chunk_res = res;
+    bvox_header.chunk_size = static_cast<uint32_t>(size);
+    bvox_header.run_length_encoded = true;
+    bvox_header.morton_encoded = true;
+    bvox_header.rle_format = RLE_FORMAT_VARINT;
+
+    const std::vector<uint8_t> encoded = run_length_encode(dataset.grid, RLE_FORMAT_VARINT);
+    const std::vector<std::vector<uint8_t> > chunk_data = {dataset.grid};
+
+    Svo svo;
+    svo.root_res = res;
+    svo.max_depth = svo_res_depth(res);
+    svo.build(dataset.grid.data(), size);
+
+    BsvoHeader bsvo_header{};
+    bsvo_header.max_depth = svo.max_depth;
+    bsvo_header.root_res = svo.root_res;
+
+    const uint32_t threads = resolve_thread_count(0);
+    std::vector<uint8_t> scratch(size);
+
+    const std::vector<std::pair<std::string, std::function<uint64_t()> > > benchmarks = {
+        {"morton_encode_3d_grid", [&]() {
+            morton_encode_3d_grid(dataset.linear_grid.data(), res, size, scratch.data());
+            return static_cast<uint64_t>(scratch[size / 2]);
+        }},
+        {"run_length_encode", [&]() {
+            return static_cast<uint64_t>(run_length_encode(dataset.grid, RLE_FORMAT_VARINT).size());
+        }},
+        {"run_length_decode", [&]() {
+            return static_cast<uint64_t>(run_length_decode(encoded.data(), encoded.size(), scratch.data(), size,
+                                                           RLE_FORMAT_VARINT));
+        }},
+        {"write_bvox", [&]() {
+            write_bvox(bvox_filename, chunk_data, bvox_header);
+            return static_cast<uint64_t>(1);
+        }},
+        {"read_bvox", [&]() {
+            std::vector<std::vector<uint8_t> > read_data;
+            BvoxHeader header{};
+            read_bvox(bvox_filename, &read_data, &header);
+            return static_cast<uint64_t>(read_data[0].size());
+        }},
+        {"svo_build", [&]() {
+            Svo built;
+            built.root_res = res;
+            built.max_depth = svo_res_depth(res);
+            built.build(dataset.grid.data(), size);
+            return static_cast<uint64_t>(built.nodes.size());
+        }},
+        {"svo_build_threads_" + std::to_string(threads), [&]() {
+            Svo built;
+            built.root_res = res;
+            built.max_depth = svo_res_depth(res);
+            built.build(dataset.grid.data(), size, threads);
+            return static_cast<uint64_t>(built.nodes.size());
+        }},
+        {"greedy_mesh", [&]() {
+            return static_cast<uint64_t>(greedy_mesh(dataset.grid, res).size());
+        }},
+        {"write_bsvo", [&]() {
+            write_bsvo(bsvo_filename, svo, bsvo_header);
+            return static_cast<uint64_t>(1);
+        }},
+        {"read_bsvo", [&]() {
+            Svo read_svo;
+            BsvoHeader header{};
+            read_bsvo(bsvo_filename, &read_svo, &header);
+            return static_cast<uint64_t>(read_svo.nodes.size());
+        }},
+    };
+
+    // the read benchmarks need their files, write them once up front
+    write_bvox(bvox_filename, chunk_data, bvox_header);
+    write_bsvo(bsvo_filename, svo, bsvo_header);
+
+    std::vector<BenchResult> results;
+    for (const auto &[name, fn]: benchmarks) {
+        const std::string full_name = name + "/" + dataset.name;
+        if (!filter.empty() && full_name.find(filter) == std::string::npos)
+            continue;
+
+        results.push_back(run_benchmark(name, dataset, min_time, fn));
+
+        const BenchResult &result = results.back();
+        std::cout << std::left << std::setw(44) << full_name << std::right << std::setw(10) << result.iterations
+                  << std::setw(14) << std::fixed << std::setprecision(3) << result.ns_per_voxel << " ns/voxel"
+                  << std::setw(12) << std::setprecision(1) << result.mb_per_second << " MB/s" << std::setw(10)
+                  << (result.peak_rss > 0 ? std::to_string(result.peak_rss / (1024 * 1024)) : "-") << " MiB rss"
+                  << std::endl;
+    }
+
+    std::filesystem::remove(bvox_filename);
+    std::filesystem::remove(bsvo_filename);
+
+    return results;
+}
+
+//
+// output
+//
+
+// google benchmark like layout, times are in nanoseconds
+static int write_json(const std::string &filename, const std::vector<BenchResult> &results, const uint32_t res,
+                      const double min_time) {
+    std::ofstream ofs(filename);
+    if (!ofs.is_open())
+        throw std::runtime_error("failed to open file.");
+
+    ofs << std::setprecision(6);
+    ofs << "{\n";
+    ofs << "  \"context\": {\n";
+    ofs << "    \"library\": \"vss\",\n";
+    ofs << "    \"grid_res\": " << res << ",\n";
+    ofs << "    \"voxels\": " << static_cast<uint64_t>(res) * res * res << ",\n";
+    ofs << "    \"seed\": " << BENCH_SEED << ",\n";
+    ofs << "    \"min_time\": " << min_time << ",\n";
+    ofs << "    \"num_threads\": " << resolve_thread_count(0) << ",\n";
+    ofs << "    \"simd_level\": " << simd_level() << "\n";
+    ofs << "  },\n";
+    ofs << "  \"benchmarks\": [\n";
+
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult &result = results[i];
+        ofs << "    {\n";
+        ofs << "      \"name\": \"" << result.name << "/" << result.dataset << "\",\n";
+        ofs << "      \"benchmark\": \"" << result.name << "\",\n";
+        ofs << "      \"dataset\": \"" << result.dataset << "\",\n";
+        ofs << "      \"iterations\": " << result.iterations << ",\n";
+        ofs << "      \"real_time\": " << result.ns_per_iteration << ",\n";
+        ofs << "      \"time_unit\": \"ns\",\n";
+        ofs << "      \"ns_per_voxel\": " << result.ns_per_voxel << ",\n";
+        ofs << "      \"mb_per_second\": " << result.mb_per_second;
+        if (result.peak_rss > 0)
+            ofs << ",\n      \"peak_rss_bytes\": " << result.peak_rss;
+        ofs << "\n";
+        ofs << "    }" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+
+    ofs << "  ]\n";
+    ofs << "}\n";
+
+    ofs.close();
+    if (ofs.fail())
+        throw std::runtime_error("failed to write to file.");
+
+    return EXIT_SUCCESS;
+}
+
+static void print_usage() {
+    std::cerr << "usage: vss_bench [--res n] [--min-time seconds] [--filter text] [--json file]" << std::endl;
+}
+
+int main(const int argc, char **argv) {
+    uint32_t res = BENCH_DEFAULT_RES;
+    double min_time = BENCH_DEFAULT_MIN_TIME;
+    std::string filter;
+    std::string json_filename;
+
+    for (int a = 1; a < argc; a++) {
+        const std::string arg = argv[a];
+        if (a + 1 >= argc) {
+            print_usage();
+            return EXIT_FAILURE;
+        }
+
+        if (arg == "--res")
+            res = static_cast<uint32_t>(std::stoul(argv[++a]));
+        else if (arg == "--min-time")
+            min_time = std::stod(argv[++a]);
+        else if (arg == "--filter")
+            filter = argv[++a];
+        else if (arg == "--json")
+            json_filename = argv[++a];
+        else {
+            print_usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (res < 2 || (res & (res - 1)) != 0) {
+        std::cerr << "grid resolution has to be a power of two." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::vector<BenchResult> results;
+    try {
+        const std::vector<std::function<BenchDataset()> > datasets = {
+            [&]() { return random_dataset(res, 0.01, BENCH_SEED); },
+            [&]() { return random_dataset(res, 0.1, BENCH_SEED + 1); },
+            [&]() { return random_dataset(res, 0.5, BENCH_SEED + 2); },
+            [&]() { return cube_dataset(res); },
+            [&]() { return terrain_dataset(res, BENCH_SEED + 3); },
+        };
+
+        // datasets are generated one at a time, only the grids of the running dataset are resident
+        for (const auto &make: datasets) {
+            const BenchDataset dataset = make();
+            std::vector<BenchResult> dataset_results = run_dataset(dataset, res, min_time, filter);
+            results.insert(results.end(), dataset_results.begin(), dataset_results.end());
+        }
+
+        if (!json_filename.empty())
+            write_json(json_filename, results, res, min_time);
+    } catch (const std::exception &e) {
+        std::cerr << "benchmark failed: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
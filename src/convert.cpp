@@ -0,0 +1,294 @@
+//
+// Created by ludw on 9/4/24.
+//
+
+// batch conversion between directories of bvox and bsvo files.
+//
+// every chunk of name.bvox becomes name.<chunk>.bsvo, the files name.<chunk>.bsvo are joined back into name.bvox
+// in chunk order. a bsvo file without a chunk number becomes chunk 0, name.bsvo next to name.0.bsvo is refused.
+// chunks are read, decoded and built or encoded on all worker threads, the output is written in order on the main
+// thread. typed files keep their voxel format both ways, their palette is collected once per file from the values
+// found by the workers. if any file fails, the files written so far are removed again.
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "../include/vss.h"
+
+struct ConvertTask {
+    std::string input;
+    uint32_t chunk;
+    std::string output;
+    // last chunk of its output file, bsvo to bvox only
+    bool last;
+};
+
+struct ConvertStats {
+    size_t files = 0;
+    size_t chunks = 0;
+    uint64_t voxels = 0;
+    uint64_t bytes_in = 0;
+    uint64_t bytes_out = 0;
+    // every output file that was started, removed again if the batch fails
+    std::vector<std::string> outputs;
+};
+
+static std::vector<std::filesystem::path> list_files(const std::string &directory, const std::string &extension) {
+    std::vector<std::filesystem::path> files;
+    for (const auto &entry: std::filesystem::directory_iterator(directory)) {
+        if (entry.is_regular_file() && entry.path().extension() == extension)
+            files.push_back(entry.path());
+    }
+
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+static uint64_t file_bytes(const std::string &filename) {
+    return static_cast<uint64_t>(std::filesystem::file_size(filename));
+}
+
+// one chunk of a bvox file of voxel type T as an svo, the leaves keep the voxel data of T
+template<typename T>
+static Svo build_chunk_svo(const ConvertTask &task, const uint8_t max_depth) {
+    std::vector<T> chunk;
+    BvoxHeader header{};
+    read_bvox_chunk(task.input, task.chunk, &chunk, &header);
+
+    // svos are built from morton order
+    if (!header.morton_encoded) {
+        std::vector<T> morton_chunk(chunk.size());
+        morton_encode_3d_grid(chunk.data(), header.chunk_res, chunk.size(), morton_chunk.data());
+        chunk.swap(morton_chunk);
+    }
+
+    Svo svo;
+    svo.root_res = header.chunk_res;
+    svo.max_depth = std::min(max_depth, svo_res_depth(header.chunk_res));
+    svo.build(chunk.data(), chunk.size());
+    return svo;
+}
+
+static int convert_bvox_to_bsvo(const std::string &input_directory, const std::string &output_directory,
+                                const uint8_t max_depth, const uint32_t thread_count, ConvertStats &stats) {
+    std::vector<ConvertTask> tasks;
+    std::vector<uint8_t> voxel_formats;
+    for (const std::filesystem::path &path: list_files(input_directory, ".bvox")) {
+        BvoxHeader header{};
+        get_bvox_header(path.string(), &header);
+
+        for (uint32_t c = 0; c < header.chunk_count; c++) {
+            const std::string name = path.stem().string() + "." + std::to_string(c) + ".bsvo";
+            tasks.push_back(ConvertTask{path.string(), c, (std::filesystem::path(output_directory) / name).string(),
+                                        false});
+            voxel_formats.push_back(header.voxel_format);
+        }
+
+        stats.bytes_in += file_bytes(path.string());
+    }
+
+    parallel_ordered<Svo>(tasks.size(), [&](const size_t i) {
+        return visit_voxel_format(voxel_formats[i], [&](auto type) {
+            return build_chunk_svo<typename decltype(type)::type>(tasks[i], max_depth);
+        });
+    }, [&](const size_t i, Svo &&svo) {
+        BsvoHeader header{};
+        header.max_depth = svo.max_depth;
+        header.root_res = svo.root_res;
+        header.voxel_format = voxel_formats[i];
+        stats.outputs.push_back(tasks[i].output);
+        write_bsvo(tasks[i].output, svo, header);
+
+        stats.files++;
+        stats.chunks++;
+        stats.voxels += static_cast<uint64_t>(svo.root_res) * svo.root_res * svo.root_res;
+        stats.bytes_out += file_bytes(tasks[i].output);
+    }, thread_count);
+
+    return EXIT_SUCCESS;
+}
+
+static int convert_bsvo_to_bvox(const std::string &input_directory, const std::string &output_directory,
+                                const uint32_t thread_count, ConvertStats &stats) {
+    // chunk number -> file for every output file
+    std::map<std::string, std::map<uint32_t, std::string> > groups;
+    for (const std::filesystem::path &path: list_files(input_directory, ".bsvo")) {
+        const std::filesystem::path stem = path.stem();
+        const std::string number = stem.extension().string();
+
+        const bool numbered = number.size() > 1 &&
+                              std::all_of(number.begin() + 1, number.end(), [](const unsigned char c) {
+                                  return std::isdigit(c) != 0;
+                              });
+
+        // name.bsvo and name.0.bsvo would both be chunk 0 of name.bvox
+        const std::string name = numbered ? stem.stem().string() : stem.string();
+        const uint32_t chunk = numbered ? static_cast<uint32_t>(std::stoul(number.substr(1))) : 0;
+        const auto [it, inserted] = groups[name].try_emplace(chunk, path.string());
+        if (!inserted)
+            throw std::runtime_error(it->second + " and " + path.string() + " are both chunk " +
+                                     std::to_string(chunk) + " of " + name + ".bvox.");
+
+        stats.bytes_in += file_bytes(path.string());
+    }
+
+    std::vector<ConvertTask> tasks;
+    for (const auto &[name, chunks]: groups) {
+        const std::string output = (std::filesystem::path(output_directory) / (name + ".bvox")).string();
+        for (const auto &[chunk, input]: chunks)
+            tasks.push_back(ConvertTask{input, chunk, output, false});
+        tasks.back().last = true;
+    }
+
+    struct EncodedChunk {
+        BvoxHeader header{};
+        std::vector<uint8_t> encoded;
+        // typed chunks share one palette per file, they are passed on as leaf data with their distinct values
+        std::vector<uint32_t> data;
+        std::vector<uint32_t> values;
+    };
+
+    std::vector<std::vector<uint8_t> > file_chunks;
+    std::vector<std::vector<uint32_t> > file_data;
+    VoxelPalette file_palette;
+    BvoxHeader file_header{};
+
+    parallel_ordered<EncodedChunk>(tasks.size(), [&](const size_t i) {
+        Svo svo;
+        BsvoHeader bsvo_header{};
+        read_bsvo(tasks[i].input, &svo, &bsvo_header);
+
+        EncodedChunk out;
+        out.header.chunk_res = svo.root_res;
+        out.header.chunk_size = svo.root_res * svo.root_res * svo.root_res;
+        out.header.run_length_encoded = true;
+        out.header.morton_encoded = true;
+        out.header.rle_format = RLE_FORMAT_VARINT;
+        out.header.voxel_format = bsvo_header.voxel_format;
+
+        if (out.header.voxel_format != VOXEL_FORMAT_U8) {
+            out.data.resize(out.header.chunk_size);
+            svo.decode_grid(out.data.data(), out.data.size());
+
+            // runs of one value are common, only their first voxel is looked up
+            VoxelPalette palette;
+            for (size_t v = 0; v < out.data.size(); v++) {
+                if (v == 0 || out.data[v] != out.data[v - 1])
+                    palette.add(out.data[v]);
+            }
+            out.values = std::move(palette.values);
+            return out;
+        }
+
+        std::vector<uint8_t> grid(out.header.chunk_size);
+        svo.decode_grid(grid.data(), grid.size());
+        out.encoded = encode_bvox_chunk(grid, out.header);
+        return out;
+    }, [&](const size_t i, EncodedChunk &&chunk) {
+        if (file_chunks.empty() && file_data.empty())
+            file_header = chunk.header;
+        else if (file_header.chunk_res != chunk.header.chunk_res)
+            throw std::runtime_error("chunks of one bvox file differ in resolution.");
+        else if (file_header.voxel_format != chunk.header.voxel_format)
+            throw std::runtime_error("chunks of one bvox file differ in voxel format.");
+
+        if (chunk.header.voxel_format == VOXEL_FORMAT_U8) {
+            file_chunks.push_back(std::move(chunk.encoded));
+        } else {
+            for (const uint32_t value: chunk.values)
+                file_palette.add(value);
+            file_data.push_back(std::move(chunk.data));
+        }
+        stats.chunks++;
+        stats.voxels += chunk.header.chunk_size;
+
+        if (tasks[i].last) {
+            stats.outputs.push_back(tasks[i].output);
+            if (file_header.voxel_format == VOXEL_FORMAT_U8)
+                write_bvox_encoded(tasks[i].output, file_chunks, file_header);
+            else
+                write_bvox_data(tasks[i].output, file_data, file_header, file_palette, thread_count);
+            file_chunks.clear();
+            file_data.clear();
+            file_palette = VoxelPalette();
+
+            stats.files++;
+            stats.bytes_out += file_bytes(tasks[i].output);
+        }
+    }, thread_count);
+
+    return EXIT_SUCCESS;
+}
+
+static void print_usage() {
+    std::cerr << "usage: vss_convert <input directory> <output directory> [--threads n] [--max-depth n]" << std::endl;
+    std::cerr << "converts every .bvox file to .bsvo files and every .bsvo file back to .bvox files" << std::endl;
+}
+
+int main(const int argc, char **argv) {
+    if (argc < 3) {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    const std::string input_directory = argv[1];
+    const std::string output_directory = argv[2];
+    uint32_t thread_count = 0;
+    uint8_t max_depth = DEFAULT_MAX_DEPTH;
+
+    for (int a = 3; a < argc; a++) {
+        const std::string arg = argv[a];
+        if (arg == "--threads" && a + 1 < argc) {
+            thread_count = static_cast<uint32_t>(std::stoul(argv[++a]));
+        } else if (arg == "--max-depth" && a + 1 < argc) {
+            max_depth = static_cast<uint8_t>(std::stoul(argv[++a]));
+        } else {
+            print_usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (std::filesystem::exists(output_directory) && std::filesystem::equivalent(input_directory, output_directory)) {
+        std::cerr << "input and output directory are the same." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    ConvertStats stats;
+    const auto start = std::chrono::high_resolution_clock::now();
+
+    try {
+        std::filesystem::create_directories(output_directory);
+        convert_bvox_to_bsvo(input_directory, output_directory, max_depth, thread_count, stats);
+        convert_bsvo_to_bvox(input_directory, output_directory, thread_count, stats);
+    } catch (const std::exception &e) {
+        // no partial batch is left behind
+        std::error_code error;
+        for (const std::string &output: stats.outputs)
+            std::filesystem::remove(output, error);
+
+        std::cerr << "conversion failed: " << e.what() << std::endl;
+        if (!stats.outputs.empty())
+            std::cerr << "removed " << stats.outputs.size() << " written files" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const auto end = std::chrono::high_resolution_clock::now();
+    const double seconds = std::chrono::duration<double>(end - start).count();
+    const double mib = 1024.0 * 1024.0;
+
+    std::cout << "converted " << stats.chunks << " chunks into " << stats.files << " files on "
+              << resolve_thread_count(thread_count) << " threads in " << seconds << " s" << std::endl;
+    std::cout << "read: " << stats.bytes_in / mib << " MiB | written: " << stats.bytes_out / mib << " MiB" << std::endl;
+    std::cout << "throughput: " << stats.chunks / seconds << " chunks/s | " << stats.voxels / seconds / 1e6
+              << " Mvoxels/s | " << stats.bytes_in / mib / seconds << " MiB/s read | "
+              << stats.bytes_out / mib / seconds << " MiB/s written" << std::endl;
+
+    return EXIT_SUCCESS;
+}
@@ -7,6 +7,9 @@
 #include <vector>
 #include <cmath>
 #include <random>
+#include <chrono>
+#include <limits>
+#include <sstream>
 
 #include "../include/vss.h"
 
@@ -60,6 +63,344 @@ int test_bvox_read_write() {
     return EXIT_SUCCESS;
 }
 
+int test_bvox_chunk_index() {
+    constexpr uint32_t chunk_res = 32;
+    constexpr uint32_t chunk_size = chunk_res * chunk_res * chunk_res;
+
+    std::vector<std::vector<uint8_t>> chunk_data;
+    for (const float probability: {0.0f, 0.1f, 0.5f, 1.0f, 0.3f})
+        chunk_data.push_back(gen_rand_vox_grid(chunk_size, probability));
+
+    BvoxHeader header{};
+    header.chunk_res = chunk_res;
+    header.chunk_size = chunk_size;
+    header.run_length_encoded = true;
+    header.morton_encoded = true;
+
+    // first chunks written at once, the rest appended
+    write_bvox("index_test.bvox", {chunk_data[0], chunk_data[1]}, header);
+    for (size_t i = 2; i < chunk_data.size(); i++)
+        append_to_bvox("index_test.bvox", chunk_data[i]);
+
+    std::vector<std::vector<uint8_t>> read_chunk_data;
+    BvoxHeader read_header{};
+    read_bvox("index_test.bvox", &read_chunk_data, &read_header);
+
+    if (read_header.chunk_count != chunk_data.size() || read_chunk_data != chunk_data) {
+        std::cerr << "indexed bvox data does not match." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // random access in reverse order
+    for (uint32_t i = static_cast<uint32_t>(chunk_data.size()); i > 0; i--) {
+        std::vector<uint8_t> chunk;
+        read_bvox_chunk("index_test.bvox", i - 1, &chunk);
+
+        if (chunk != chunk_data[i - 1]) {
+            std::cerr << "bvox chunk " << i - 1 << " does not match." << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    // an entry whose offset plus size wraps around is rejected, as is one far larger than the file
+    {
+        std::fstream fs("index_test.bvox", std::ios::binary | std::ios::in | std::ios::out);
+        const BvoxChunkEntry crafted[2] = {{UINT64_MAX - 10, 100}, {0, 1ULL << 50}};
+        fs.seekp(static_cast<std::streamoff>(read_header.index_offset));
+        fs.write(reinterpret_cast<const char *>(crafted), sizeof(crafted));
+    }
+
+    // every reader refuses it before allocating, as does an index that claims more chunks than fit the file
+    auto refused = [](const auto &read) {
+        try {
+            read();
+        } catch (const std::runtime_error &) {
+            return true;
+        }
+        return false;
+    };
+
+    std::vector<uint8_t> encoded;
+    std::vector<uint64_t> words;
+    bool caught = refused([&] { read_bvox("index_test.bvox", &read_chunk_data, nullptr); }) &&
+                  refused([&] { read_bvox_chunk("index_test.bvox", 0, &encoded); }) &&
+                  refused([&] { read_bvox_chunk("index_test.bvox", 1, &encoded); }) &&
+                  refused([&] { read_bvox_chunk_encoded("index_test.bvox", 1, &encoded); }) &&
+                  refused([&] { read_bvox_chunk_bits("index_test.bvox", 1, &words); });
+
+    {
+        std::fstream fs("index_test.bvox", std::ios::binary | std::ios::in | std::ios::out);
+        BvoxHeader crafted = read_header;
+        crafted.chunk_count = UINT32_MAX;
+        fs.write(reinterpret_cast<const char *>(&crafted), sizeof(crafted));
+    }
+
+    caught = caught && refused([&] { read_bvox_chunk("index_test.bvox", 7, &encoded); }) &&
+             refused([&] { append_to_bvox("index_test.bvox", chunk_data[0]); });
+
+    if (!caught) {
+        std::cerr << "bvox bounds check does not match." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << std::endl;
+
+    return EXIT_SUCCESS;
+}
+
+// reference reader, one stream call per byte and decoding through intermediate vectors
+int read_bvox_bytewise(const std::string &filename, std::vector<std::vector<uint8_t>> *p_chunk_data) {
+    std::ifstream ifs(filename, std::ios::binary);
+    BvoxHeader header{};
+    read_bvox_header(ifs, &header);
+
+    std::vector<BvoxChunkEntry> index;
+    read_bvox_index(ifs, header, &index);
+
+    for (const BvoxChunkEntry &entry: index) {
+        ifs.seekg(static_cast<std::streamoff>(entry.offset));
+
+        std::vector<uint8_t> chunk;
+        uint8_t byte;
+        for (uint64_t i = 0; i < entry.size && ifs.read(reinterpret_cast<char *>(&byte), sizeof(byte)); i++)
+            chunk.push_back(byte);
+
+        std::vector<uint8_t> decoded;
+        for (size_t i = 0; i < chunk.size(); i += 2)
+            decoded.insert(decoded.end(), chunk[i + 1], chunk[i]);
+
+        p_chunk_data->push_back(decoded);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int benchmark_bvox_read() {
+    std::vector<uint8_t> solid(CHUNK_SIZE, DEFAULT_MAT);
+    const std::vector<std::pair<std::string, std::vector<uint8_t>>> datasets = {
+        {"random 0.1", gen_rand_vox_grid(CHUNK_SIZE, 0.1f)},
+        {"random 0.5", gen_rand_vox_grid(CHUNK_SIZE, 0.5f)},
+        {"solid", solid},
+    };
+
+    BvoxHeader header{};
+    header.chunk_res = CHUNK_RES;
+    header.chunk_size = CHUNK_SIZE;
+    header.run_length_encoded = true;
+    header.morton_encoded = true;
+
+    for (const auto &[name, chunk]: datasets) {
+        write_bvox("read_bench.bvox", {chunk, chunk}, header);
+        const double mb = 2.0 * CHUNK_SIZE / (1024.0 * 1024.0);
+
+        auto start = std::chrono::high_resolution_clock::now();
+        std::vector<std::vector<uint8_t>> reference;
+        read_bvox_bytewise("read_bench.bvox", &reference);
+        auto end = std::chrono::high_resolution_clock::now();
+        const double reference_s = std::chrono::duration<double>(end - start).count();
+
+        start = std::chrono::high_resolution_clock::now();
+        std::vector<std::vector<uint8_t>> read_chunk_data;
+        read_bvox("read_bench.bvox", &read_chunk_data, nullptr);
+        end = std::chrono::high_resolution_clock::now();
+        const double read_s = std::chrono::duration<double>(end - start).count();
+
+        std::cout << "bvox read " << name << " | bytewise: " << mb / reference_s << " MB/s | bulk: "
+                  << mb / read_s << " MB/s" << std::endl;
+
+        if (reference != read_chunk_data || read_chunk_data[1] != chunk) {
+            std::cerr << "bulk bvox read does not match." << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::cout << std::endl;
+
+    return EXIT_SUCCESS;
+}
+
+// reference encoder, compares one byte at a time
+std::vector<uint8_t> run_length_encode_bytewise(const std::vector<uint8_t> &data) {
+    std::vector<uint8_t> encoded;
+    uint8_t current = data[0];
+    uint8_t count = 1;
+
+    for (size_t i = 1; i < data.size(); i++) {
+        if (data[i] == current) {
+            if (count == RLE_MAX) {
+                encoded.push_back(current);
+                encoded.push_back(count);
+                count = 0;
+            }
+            count++;
+        } else {
+            encoded.push_back(current);
+            encoded.push_back(count);
+            current = data[i];
+            count = 1;
+        }
+    }
+
+    encoded.push_back(current);
+    encoded.push_back(count);
+
+    return encoded;
+}
+
+// mostly empty chunk with a filled floor and some noise, similar to terrain
+std::vector<uint8_t> gen_terrain_chunk() {
+    std::vector<uint8_t> chunk(CHUNK_SIZE);
+    std::mt19937 gen(7);
+    std::uniform_int_distribution<int> dist(0, 7);
+
+    for (uint32_t z = 0; z < CHUNK_RES; z++) {
+        for (uint32_t x = 0; x < CHUNK_RES; x++) {
+            const uint32_t height = CHUNK_RES / 8 + dist(gen);
+            for (uint32_t y = 0; y < height; y++)
+                chunk[POS_TO_INDEX(x, y, z, CHUNK_RES)] = y + 1 == height ? 2 : DEFAULT_MAT;
+        }
+    }
+
+    std::vector<uint8_t> morton_chunk(CHUNK_SIZE);
+    morton_encode_3d_grid(chunk.data(), CHUNK_RES, CHUNK_SIZE, morton_chunk.data());
+    return morton_chunk;
+}
+
+int test_rle_kernels() {
+    std::vector<std::pair<std::string, std::vector<uint8_t>>> datasets = {
+        {"random 0.1", gen_rand_vox_grid(CHUNK_SIZE, 0.1f)},
+        {"random 0.5", gen_rand_vox_grid(CHUNK_SIZE, 0.5f)},
+        {"terrain", gen_terrain_chunk()},
+        {"empty", std::vector<uint8_t>(CHUNK_SIZE)},
+    };
+
+    // odd sizes and runs around the pair limit
+    for (const size_t size: {1, 31, 33, 254, 255, 508, 509, 1000}) {
+        std::vector<uint8_t> data(size, 3);
+        data[size / 2] = 4;
+        datasets.push_back({"edge " + std::to_string(size), data});
+    }
+
+    const int detected = simd_level();
+    for (int level = SIMD_SCALAR; level <= detected; level++) {
+        simd_level() = level;
+
+        for (const auto &[name, data]: datasets) {
+            const std::vector<uint8_t> reference = run_length_encode_bytewise(data);
+
+            auto start = std::chrono::high_resolution_clock::now();
+            const std::vector<uint8_t> pairs = run_length_encode(data, RLE_FORMAT_PAIRS);
+            auto end = std::chrono::high_resolution_clock::now();
+            const double encode_s = std::chrono::duration<double>(end - start).count();
+
+            start = std::chrono::high_resolution_clock::now();
+            const std::vector<uint8_t> decoded = run_length_decode(pairs, RLE_FORMAT_PAIRS);
+            end = std::chrono::high_resolution_clock::now();
+            const double decode_s = std::chrono::duration<double>(end - start).count();
+
+            const std::vector<uint8_t> varint = run_length_encode(data, RLE_FORMAT_VARINT);
+            const std::vector<uint8_t> varint_decoded = run_length_decode(varint, RLE_FORMAT_VARINT);
+
+            if (pairs != reference || decoded != data || varint_decoded != data) {
+                std::cerr << "rle " << name << " does not match at simd level " << level << "." << std::endl;
+                simd_level() = detected;
+                return EXIT_FAILURE;
+            }
+
+            if (data.size() == CHUNK_SIZE) {
+                const double mb = CHUNK_SIZE / (1024.0 * 1024.0);
+                std::cout << "rle " << name << " | simd level: " << level << " | encode: " << mb / encode_s
+                          << " MB/s | decode: " << mb / decode_s << " MB/s | pairs: " << pairs.size()
+                          << " bytes | varint: " << varint.size() << " bytes" << std::endl;
+            }
+        }
+    }
+
+    simd_level() = detected;
+
+    std::cout << std::endl;
+
+    return EXIT_SUCCESS;
+}
+
+int test_morton_64() {
+    std::mt19937 gen(11);
+    std::uniform_int_distribution<uint32_t> dist(0, MORTON_MAX_RES_64 - 1);
+
+    for (int i = 0; i < 100000; i++) {
+        const uint32_t x = dist(gen), y = dist(gen), z = dist(gen);
+        const uint64_t code = spread_bits_64(x) | (spread_bits_64(y) << 1) | (spread_bits_64(z) << 2);
+
+        uint32_t lx, ly, lz, dx, dy, dz;
+        morton_decode_3d_lut(code, lx, ly, lz);
+        morton_decode_3d_64(code, dx, dy, dz);
+
+        if (morton_encode_3d_lut(x, y, z) != code || morton_encode_3d_64(x, y, z) != code ||
+            compact_bits_64(code) != x || lx != x || ly != y || lz != z || dx != x || dy != y || dz != z) {
+            std::cerr << "64 bit morton code does not match." << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        if (morton_encode_3d_64(x & 0xFF, y & 0xFF, z & 0xFF) != morton_encode_3d(x & 0xFF, y & 0xFF, z & 0xFF)) {
+            std::cerr << "64 bit morton code does not match 32 bit code." << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    // reference conversion, one division and one scattered write per voxel
+    const std::vector<uint8_t> chunk = gen_rand_vox_grid(CHUNK_SIZE, 0.5f);
+    std::vector<uint8_t> reference(CHUNK_SIZE);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (uint32_t i = 0; i < CHUNK_SIZE; i++) {
+        const glm::uvec3 pos = INDEX_TO_POS(i, CHUNK_RES);
+        reference[morton_encode_3d(pos.x, pos.y, pos.z)] = chunk[i];
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    const double reference_ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+    std::vector<uint8_t> morton_chunk(CHUNK_SIZE);
+    start = std::chrono::high_resolution_clock::now();
+    morton_encode_3d_grid(chunk.data(), CHUNK_RES, CHUNK_SIZE, morton_chunk.data());
+    end = std::chrono::high_resolution_clock::now();
+    const double encode_ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+    std::vector<uint8_t> decoded(CHUNK_SIZE);
+    start = std::chrono::high_resolution_clock::now();
+    morton_decode_3d_grid(morton_chunk.data(), CHUNK_RES, CHUNK_SIZE, decoded.data());
+    end = std::chrono::high_resolution_clock::now();
+    const double decode_ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+    std::cout << "morton grid | per voxel encode: " << reference_ms << " ms | tiled encode: " << encode_ms
+              << " ms | tiled decode: " << decode_ms << " ms" << std::endl;
+
+    if (morton_chunk != reference || decoded != chunk) {
+        std::cerr << "tiled morton grid does not match." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // grids smaller than one tile
+    for (const uint32_t res: {1, 2, 8, 16, 32}) {
+        const size_t size = static_cast<size_t>(res) * res * res;
+        const std::vector<uint8_t> small = gen_rand_vox_grid(size, 0.5f);
+        std::vector<uint8_t> small_morton(size), small_decoded(size);
+        morton_encode_3d_grid(small.data(), res, size, small_morton.data());
+        morton_decode_3d_grid(small_morton.data(), res, size, small_decoded.data());
+
+        for (uint32_t i = 0; i < size; i++) {
+            const glm::uvec3 pos = INDEX_TO_POS(i, res);
+            if (small_morton[morton_encode_3d_64(pos.x, pos.y, pos.z)] != small[i] || small_decoded != small) {
+                std::cerr << "morton grid of res " << res << " does not match." << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    std::cout << std::endl;
+
+    return EXIT_SUCCESS;
+}
+
 int test_bsvo_read_write() {
     const std::vector<uint8_t> chunk = gen_rand_vox_grid(CHUNK_SIZE, 0.3f);
     std::vector<uint8_t> morton_chunk(CHUNK_SIZE);
@@ -198,30 +539,2237 @@ int simple_test_data() {
     return EXIT_SUCCESS;
 }
 
-void print_header_info() {
-    std::cout << "bvox header size: " << sizeof(BvoxHeader) << std::endl;
-    std::cout << "offset of bvox header version: " << offsetof(BvoxHeader, version) << std::endl;
-    std::cout << "offset of bvox header chunk_res: " << offsetof(BvoxHeader, chunk_res) << std::endl;
-    std::cout << "offset of bvox header chunk_size: " << offsetof(BvoxHeader, chunk_size) << std::endl;
-    std::cout << "offset of bvox header run_length_encoded: " << offsetof(BvoxHeader, run_length_encoded) << std::endl;
-    std::cout << "offset of bvox header morton_encoded: " << offsetof(BvoxHeader, morton_encoded) << std::endl;
+// reference build, inserting every voxel from the root
+Svo build_svo_per_voxel(const std::vector<uint8_t> &morton_grid, const uint32_t res, const uint8_t max_depth) {
+    Svo svo;
+    svo.root_res = res;
+    svo.max_depth = max_depth;
+    svo.nodes.push_back(SvoNode());
 
-    std::cout << "bsvo header size: " << sizeof(BsvoHeader) << std::endl;
-    std::cout << "offset of bsvo header version: " << offsetof(BsvoHeader, version) << std::endl;
-    std::cout << "offset of bsvo header max_depth: " << offsetof(BsvoHeader, max_depth) << std::endl;
-    std::cout << "offset of bsvo header root_res: " << offsetof(BsvoHeader, root_res) << std::endl;
-    std::cout << "offset of bsvo header run_length_encoded: " << offsetof(BsvoHeader, run_length_encoded) << std::endl;
+    for (size_t i = 0; i < morton_grid.size(); i++) {
+        if (morton_grid[i] > 0)
+            svo.insert_node(static_cast<uint32_t>(i), max_depth, morton_grid[i]);
+    }
 
-    std::cout << std::endl << std::endl;
+    return svo;
+}
+
+// expand the leaves of a full depth svo back into a morton grid
+void svo_to_morton_grid(const Svo &svo, const uint32_t node, const uint32_t cell_size, const uint32_t offset,
+                        std::vector<uint8_t> &morton_grid) {
+    if (svo.nodes[node].is_leaf()) {
+        std::fill_n(morton_grid.begin() + offset, cell_size, static_cast<uint8_t>(svo.nodes[node].data));
+        return;
+    }
+
+    const uint32_t child_size = cell_size / CHILD_COUNT;
+    for (uint8_t c = 0; c < CHILD_COUNT; c++) {
+        if (svo.nodes[node].exists_child(c))
+            svo_to_morton_grid(svo, svo.nodes[node].data + c, child_size, offset + c * child_size, morton_grid);
+    }
+}
+
+int compare_svo_build(const std::string &name, const std::vector<uint8_t> &morton_grid) {
+    auto start = std::chrono::high_resolution_clock::now();
+    const Svo reference = build_svo_per_voxel(morton_grid, CHUNK_RES, DEFAULT_MAX_DEPTH);
+    auto end = std::chrono::high_resolution_clock::now();
+    const double reference_ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+    start = std::chrono::high_resolution_clock::now();
+    Svo svo;
+    svo.root_res = CHUNK_RES;
+    svo.max_depth = DEFAULT_MAX_DEPTH;
+    svo.build(morton_grid.data(), morton_grid.size());
+    end = std::chrono::high_resolution_clock::now();
+    const double build_ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+    std::cout << name << " | per voxel insert: " << reference_ms << " ms, " << reference.nodes.size()
+              << " nodes | bottom up: " << build_ms << " ms, " << svo.nodes.size() << " nodes" << std::endl;
+
+    std::vector<uint8_t> reference_grid(CHUNK_SIZE);
+    std::vector<uint8_t> built_grid(CHUNK_SIZE);
+    svo_to_morton_grid(reference, 0, CHUNK_SIZE, 0, reference_grid);
+    svo_to_morton_grid(svo, 0, CHUNK_SIZE, 0, built_grid);
+
+    if (reference_grid != built_grid || built_grid != morton_grid || svo.nodes.size() != reference.nodes.size()) {
+        std::cerr << "bottom up svo does not match per voxel svo." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int benchmark_svo_build() {
+    std::vector<uint8_t> morton_chunk(CHUNK_SIZE);
+
+    for (const float probability: {0.1f, 0.3f}) {
+        const std::vector<uint8_t> chunk = gen_rand_vox_grid(CHUNK_SIZE, probability);
+        morton_encode_3d_grid(chunk.data(), CHUNK_RES, CHUNK_SIZE, morton_chunk.data());
+
+        if (compare_svo_build("random " + std::to_string(probability), morton_chunk) != EXIT_SUCCESS)
+            return EXIT_FAILURE;
+    }
+
+    std::vector<uint8_t> chunk(CHUNK_SIZE);
+    for (int x = CHUNK_RES / 4; x < 3 * CHUNK_RES / 4; x++) {
+        for (int y = CHUNK_RES / 4; y < 3 * CHUNK_RES / 4; y++) {
+            for (int z = CHUNK_RES / 4; z < 3 * CHUNK_RES / 4; z++) {
+                chunk[POS_TO_INDEX(x, y, z, CHUNK_RES)] = DEFAULT_MAT;
+            }
+        }
+    }
+    morton_encode_3d_grid(chunk.data(), CHUNK_RES, CHUNK_SIZE, morton_chunk.data());
+
+    if (compare_svo_build("solid cube", morton_chunk) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+
+    std::cout << std::endl;
+
+    return EXIT_SUCCESS;
+}
+
+int test_svo_parallel_build() {
+    const std::vector<uint8_t> chunk = gen_rand_vox_grid(CHUNK_SIZE, 0.1f);
+    std::vector<uint8_t> morton_chunk(CHUNK_SIZE);
+    morton_encode_3d_grid(chunk.data(), CHUNK_RES, CHUNK_SIZE, morton_chunk.data());
+
+    // at least 4 threads so the stitching is exercised on small machines as well
+    const uint32_t thread_count = std::max<uint32_t>(4, resolve_thread_count(0));
+
+    for (const uint8_t max_depth: {1, 2, 5, DEFAULT_MAX_DEPTH}) {
+        Svo serial;
+        serial.root_res = CHUNK_RES;
+        serial.max_depth = max_depth;
+        serial.build(morton_chunk.data(), morton_chunk.size());
+
+        auto start = std::chrono::high_resolution_clock::now();
+        Svo parallel;
+        parallel.root_res = CHUNK_RES;
+        parallel.max_depth = max_depth;
+        parallel.build(morton_chunk.data(), morton_chunk.size(), thread_count);
+        auto end = std::chrono::high_resolution_clock::now();
+
+        std::cout << "parallel svo build | max depth: " << static_cast<int>(max_depth) << " | threads: "
+                  << thread_count << " | "
+                  << std::chrono::duration<double, std::milli>(end - start).count() << " ms" << std::endl;
+
+        if (serial.nodes.size() != parallel.nodes.size()) {
+            std::cerr << "parallel svo size does not match." << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        for (size_t i = 0; i < serial.nodes.size(); i++) {
+            if (serial.nodes[i].data != parallel.nodes[i].data || serial.nodes[i].child_mask != parallel.nodes[i].child_mask) {
+                std::cerr << "parallel svo data does not match." << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    std::cout << std::endl;
+
+    return EXIT_SUCCESS;
+}
+
+int test_bsvo_view() {
+    const std::vector<uint8_t> chunk = gen_rand_vox_grid(CHUNK_SIZE, 0.1f);
+    std::vector<uint8_t> morton_chunk(CHUNK_SIZE);
+    morton_encode_3d_grid(chunk.data(), CHUNK_RES, CHUNK_SIZE, morton_chunk.data());
+
+    const Svo svo = Svo(morton_chunk, CHUNK_RES);
+
+    BsvoHeader bsvo_header{};
+    bsvo_header.max_depth = svo.max_depth;
+    bsvo_header.root_res = svo.root_res;
+    bsvo_header.run_length_encoded = false;
+
+    write_bsvo("view_test.bsvo", svo, bsvo_header);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    Svo read_svo;
+    read_bsvo("view_test.bsvo", &read_svo, nullptr);
+    auto end = std::chrono::high_resolution_clock::now();
+    const double read_ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+    start = std::chrono::high_resolution_clock::now();
+    const SvoView view("view_test.bsvo");
+    end = std::chrono::high_resolution_clock::now();
+    const double map_ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+    std::cout << "bsvo read: " << read_ms << " ms | bsvo map: " << map_ms << " ms" << std::endl;
+
+    if (view.size() != svo.nodes.size() || read_svo.nodes.size() != svo.nodes.size() ||
+        view.root_res() != svo.root_res || view.max_depth() != svo.max_depth) {
+        std::cerr << "bsvo view size does not match." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    for (size_t i = 0; i < svo.nodes.size(); i++) {
+        if (svo.nodes[i].data != view[i].data || svo.nodes[i].child_mask != view[i].child_mask ||
+            svo.nodes[i].data != read_svo.nodes[i].data || svo.nodes[i].child_mask != read_svo.nodes[i].child_mask) {
+            std::cerr << "bsvo view data does not match." << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    // node formats the view does not know are refused instead of being read as classic nodes
+    std::filesystem::copy_file("view_test.bsvo", "view_test_unknown.bsvo",
+                               std::filesystem::copy_options::overwrite_existing);
+    {
+        std::fstream fs("view_test_unknown.bsvo", std::ios::in | std::ios::out | std::ios::binary);
+        const uint8_t unknown_format = BSVO_NODES_DAG + 1;
+        fs.seekp(offsetof(BsvoHeader, node_format));
+        fs.write(reinterpret_cast<const char *>(&unknown_format), 1);
+    }
+
+    bool refused = false;
+    try {
+        const SvoView unknown_view("view_test_unknown.bsvo");
+    } catch (const std::runtime_error &) {
+        refused = true;
+    }
+
+    if (!refused) {
+        std::cerr << "bsvo view node format check does not match." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << std::endl;
+
+    return EXIT_SUCCESS;
+}
+
+int test_svo_compact() {
+    std::vector<uint8_t> solid(CHUNK_SIZE, DEFAULT_MAT);
+    const std::vector<std::pair<std::string, std::vector<uint8_t>>> datasets = {
+        {"random 0.1", gen_rand_vox_grid(CHUNK_SIZE, 0.1f)},
+        {"terrain", gen_terrain_chunk()},
+        {"solid", solid},
+    };
+
+    for (const auto &[name, data]: datasets) {
+        std::vector<uint8_t> morton_chunk(CHUNK_SIZE);
+        morton_encode_3d_grid(data.data(), CHUNK_RES, CHUNK_SIZE, morton_chunk.data());
+
+        for (const uint8_t max_depth: {3, DEFAULT_MAX_DEPTH}) {
+            Svo svo;
+            svo.root_res = CHUNK_RES;
+            svo.max_depth = max_depth;
+            svo.build(morton_chunk.data(), morton_chunk.size());
+
+            const SvoCompact compact(morton_chunk, CHUNK_RES, max_depth);
+            const SvoCompact converted = compact_svo(svo);
+
+            BsvoHeader bsvo_header{};
+            bsvo_header.max_depth = svo.max_depth;
+            bsvo_header.root_res = svo.root_res;
+            write_bsvo("compact_test.bsvo", compact, bsvo_header);
+            write_bsvo("classic_test.bsvo", svo, bsvo_header);
+
+            Svo expanded;
+            read_bsvo("compact_test.bsvo", &expanded, nullptr);
+            SvoCompact read_compact;
+            read_bsvo("classic_test.bsvo", &read_compact, nullptr);
+
+            bool match = compact.nodes.size() == converted.nodes.size() && compact.level_offsets == converted.level_offsets
+                         && read_compact.nodes.size() == compact.nodes.size() && expanded.nodes.size() == svo.nodes.size();
+            for (size_t i = 0; match && i < compact.nodes.size(); i++)
+                match = compact.nodes[i].bits == converted.nodes[i].bits && compact.nodes[i].bits == read_compact.nodes[i].bits;
+            for (size_t i = 0; match && i < svo.nodes.size(); i++)
+                match = svo.nodes[i].data == expanded.nodes[i].data && svo.nodes[i].child_mask == expanded.nodes[i].child_mask;
+
+            if (!match) {
+                std::cerr << "compact svo " << name << " does not match." << std::endl;
+                return EXIT_FAILURE;
+            }
+
+            std::cout << "compact svo " << name << " | max depth: " << static_cast<int>(max_depth) << " | classic: "
+                      << svo.nodes.size() * sizeof(SvoNode) << " bytes | compact: "
+                      << compact.nodes.size() * sizeof(SvoCompactNode) << " bytes | classic file: "
+                      << std::filesystem::file_size("classic_test.bsvo") << " bytes | compact file: "
+                      << std::filesystem::file_size("compact_test.bsvo") << " bytes" << std::endl;
+        }
+    }
+
+    std::cout << std::endl;
+
+    return EXIT_SUCCESS;
+}
+
+int test_svo_dag() {
+    std::vector<uint8_t> solid(CHUNK_SIZE, DEFAULT_MAT);
+    const std::vector<std::pair<std::string, std::vector<uint8_t>>> datasets = {
+        {"random 0.1", gen_rand_vox_grid(CHUNK_SIZE, 0.1f)},
+        {"terrain", gen_terrain_chunk()},
+        {"solid", solid},
+    };
+
+    for (const auto &[name, data]: datasets) {
+        std::vector<uint8_t> morton_chunk(CHUNK_SIZE);
+        morton_encode_3d_grid(data.data(), CHUNK_RES, CHUNK_SIZE, morton_chunk.data());
+
+        Svo svo;
+        svo.root_res = CHUNK_RES;
+        svo.max_depth = DEFAULT_MAX_DEPTH;
+        svo.build(morton_chunk.data(), morton_chunk.size());
+
+        auto start = std::chrono::high_resolution_clock::now();
+        const SvoDag dag(svo);
+        auto end = std::chrono::high_resolution_clock::now();
+
+        BsvoHeader bsvo_header{};
+        write_bsvo("dag_test.bsvo", dag, bsvo_header);
+
+        Svo expanded;
+        read_bsvo("dag_test.bsvo", &expanded, nullptr);
+        const SvoView view("dag_test.bsvo");
+
+        bool match = expanded.nodes.size() == svo.nodes.size() && view.size() == dag.nodes.size();
+        for (size_t i = 0; match && i < svo.nodes.size(); i++)
+            match = svo.nodes[i].data == expanded.nodes[i].data && svo.nodes[i].child_mask == expanded.nodes[i].child_mask;
+
+        if (!match) {
+            std::cerr << "svo dag " << name << " does not match." << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        std::cout << "svo dag " << name << " | tree nodes: " << svo.nodes.size() << " | dag nodes: " << dag.nodes.size()
+                  << " | reduction: " << std::chrono::duration<double, std::milli>(end - start).count() << " ms"
+                  << std::endl;
+    }
+
+    std::cout << std::endl;
+
+    return EXIT_SUCCESS;
+}
+
+// reference voxel walk after amanatides and woo over a morton grid
+SvoHit ray_cast_grid(const std::vector<uint8_t> &morton_grid, const uint32_t res, const SvoRay &ray) {
+    float t_enter = 0.0f, t_exit = std::numeric_limits<float>::infinity();
+    for (int a = 0; a < 3; a++) {
+        const float inv = 1.0f / ray.direction[a];
+        float t0 = -ray.origin[a] * inv, t1 = (static_cast<float>(res) - ray.origin[a]) * inv;
+        if (t0 > t1)
+            std::swap(t0, t1);
+        t_enter = std::max(t_enter, t0);
+        t_exit = std::min(t_exit, t1);
+    }
+    if (t_enter >= t_exit)
+        return SvoHit();
+
+    const glm::vec3 start = ray.origin + ray.direction * t_enter;
+    int cell[3], step[3];
+    float t_next[3], t_delta[3];
+    for (int a = 0; a < 3; a++) {
+        cell[a] = std::clamp(static_cast<int>(std::floor(start[a])), 0, static_cast<int>(res) - 1);
+        step[a] = ray.direction[a] < 0 ? -1 : 1;
+        t_delta[a] = std::fabs(1.0f / ray.direction[a]);
+        const float boundary = static_cast<float>(cell[a] + (step[a] > 0 ? 1 : 0));
+        t_next[a] = (boundary - ray.origin[a]) / ray.direction[a];
+    }
+
+    while (true) {
+        const uint8_t mat = morton_grid[morton_encode_3d(cell[0], cell[1], cell[2])];
+        if (mat > 0) {
+            SvoHit hit;
+            hit.hit = true;
+            hit.material = mat;
+            hit.t = t_enter;
+            return hit;
+        }
+
+        const int a = t_next[0] < t_next[1] ? (t_next[0] < t_next[2] ? 0 : 2) : (t_next[1] < t_next[2] ? 1 : 2);
+        cell[a] += step[a];
+        if (cell[a] < 0 || cell[a] >= static_cast<int>(res))
+            return SvoHit();
+        t_enter = t_next[a];
+        t_next[a] += t_delta[a];
+    }
+}
+
+int write_ppm(const std::string &filename, const uint32_t width, const uint32_t height, const std::vector<SvoHit> &hits) {
+    std::ofstream ofs(filename, std::ios::out | std::ios::binary);
+    if (!ofs.is_open())
+        throw std::runtime_error("failed to open file.");
+
+    ofs << "P6\n" << width << " " << height << "\n255\n";
+    for (const SvoHit &hit: hits) {
+        uint8_t rgb[3] = {40, 60, 90};
+        if (hit.hit) {
+            const float light = 0.4f + 0.3f * static_cast<float>(hit.normal.y) + 0.15f * static_cast<float>(hit.normal.x)
+                                + 0.1f * static_cast<float>(hit.normal.z);
+            const float base[3] = {hit.material == 2 ? 90.0f : 150.0f, hit.material == 2 ? 200.0f : 120.0f, 80.0f};
+            for (int c = 0; c < 3; c++)
+                rgb[c] = static_cast<uint8_t>(std::clamp(base[c] * (0.5f + light), 0.0f, 255.0f));
+        }
+        ofs.write(reinterpret_cast<const char *>(rgb), sizeof(rgb));
+    }
+
+    ofs.close();
+    if (ofs.fail())
+        throw std::runtime_error("failed to write to file.");
+
+    return EXIT_SUCCESS;
+}
+
+int benchmark_ray_cast() {
+    const std::vector<uint8_t> morton_chunk = gen_terrain_chunk();
+    const Svo svo = Svo(morton_chunk, CHUNK_RES);
+    const SvoDag dag(svo);
+
+    // random rays against the reference walk
+    std::mt19937 gen(3);
+    std::uniform_real_distribution<float> pos(-64.0f, CHUNK_RES + 64.0f);
+    size_t mismatches = 0;
+    for (int i = 0; i < 20000; i++) {
+        SvoRay ray;
+        ray.origin = glm::vec3(pos(gen), pos(gen), pos(gen));
+        ray.direction = glm::normalize(glm::vec3(pos(gen), pos(gen), pos(gen)) - ray.origin);
+
+        const SvoHit reference = ray_cast_grid(morton_chunk, CHUNK_RES, ray);
+        const SvoHit hit = ray_cast(svo, ray);
+        const SvoHit dag_hit = ray_cast(dag, ray);
+        if (hit.hit != reference.hit || hit.material != reference.material || std::fabs(hit.t - reference.t) > 1e-2f ||
+            dag_hit.hit != hit.hit || dag_hit.t != hit.t)
+            mismatches++;
+    }
+
+    if (mismatches > 2) {
+        std::cerr << "svo ray cast does not match grid walk for " << mismatches << " rays." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    constexpr uint32_t width = 512, height = 512;
+    SvoCamera camera;
+    camera.position = glm::vec3(-80.0f, 160.0f, -80.0f);
+    camera.target = glm::vec3(CHUNK_RES / 2.0f, 20.0f, CHUNK_RES / 2.0f);
+
+    std::vector<SvoHit> single_hits, packet_hits;
+    auto start = std::chrono::high_resolution_clock::now();
+    render_svo(svo, camera, width, height, single_hits, false, 1);
+    auto end = std::chrono::high_resolution_clock::now();
+    const double single_s = std::chrono::duration<double>(end - start).count();
+
+    start = std::chrono::high_resolution_clock::now();
+    render_svo(svo, camera, width, height, packet_hits, true, 1);
+    end = std::chrono::high_resolution_clock::now();
+    const double packet_s = std::chrono::duration<double>(end - start).count();
+
+    start = std::chrono::high_resolution_clock::now();
+    render_svo(svo, camera, width, height, packet_hits, true, 0);
+    end = std::chrono::high_resolution_clock::now();
+    const double threaded_s = std::chrono::duration<double>(end - start).count();
+
+    mismatches = 0;
+    for (size_t i = 0; i < single_hits.size(); i++) {
+        if (single_hits[i].hit != packet_hits[i].hit || single_hits[i].material != packet_hits[i].material ||
+            std::fabs(single_hits[i].t - packet_hits[i].t) > 1e-3f)
+            mismatches++;
+    }
+
+    if (mismatches > single_hits.size() / 1000) {
+        std::cerr << "packet ray cast does not match single rays for " << mismatches << " pixels." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const double rays = static_cast<double>(width) * height;
+    std::cout << "ray cast " << width << "x" << height << " | single: " << rays / single_s / 1e6
+              << " Mrays/s | packets: " << rays / packet_s / 1e6 << " Mrays/s | packets on "
+              << resolve_thread_count(0) << " threads: " << rays / threaded_s / 1e6 << " Mrays/s" << std::endl;
+
+    write_ppm("ray_cast.ppm", width, height, packet_hits);
+
+    std::cout << std::endl;
+
+    return EXIT_SUCCESS;
+}
+
+int test_svo_lookup() {
+    const std::vector<uint8_t> morton_chunk = gen_terrain_chunk();
+    const Svo svo = Svo(morton_chunk, CHUNK_RES);
+
+    std::mt19937 gen(5);
+    std::uniform_int_distribution<uint32_t> coord(0, CHUNK_RES - 1);
+
+    std::vector<glm::uvec3> positions(1000000);
+    for (glm::uvec3 &pos: positions)
+        pos = glm::uvec3(coord(gen), coord(gen) / 4, coord(gen));
+
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<uint32_t> single(positions.size());
+    for (size_t i = 0; i < positions.size(); i++)
+        single[i] = svo.get(positions[i].x, positions[i].y, positions[i].z);
+    auto end = std::chrono::high_resolution_clock::now();
+    const double single_ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+    start = std::chrono::high_resolution_clock::now();
+    const std::vector<uint32_t> batched = svo.get_many(positions);
+    end = std::chrono::high_resolution_clock::now();
+    const double batched_ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+    // a cell and its 6 neighbours for every cell of a few layers near the terrain surface
+    std::vector<glm::uvec3> probes;
+    for (uint32_t z = 1; z < CHUNK_RES - 1; z += 4) {
+        for (uint32_t x = 1; x < CHUNK_RES - 1; x++) {
+            for (uint32_t y = 30; y < 34; y++) {
+                for (int n = 0; n < 7; n++)
+                    probes.emplace_back(x + (n == 0) - (n == 1), y + (n == 2) - (n == 3), z + (n == 4) - (n == 5));
+            }
+        }
+    }
+
+    start = std::chrono::high_resolution_clock::now();
+    size_t uncached_sum = 0;
+    for (const glm::uvec3 &pos: probes)
+        uncached_sum += svo.get(pos.x, pos.y, pos.z);
+    end = std::chrono::high_resolution_clock::now();
+    const double uncached_ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+    start = std::chrono::high_resolution_clock::now();
+    SvoLookupCache cache;
+    size_t cached_sum = 0;
+    for (const glm::uvec3 &pos: probes)
+        cached_sum += svo.get(pos.x, pos.y, pos.z, cache);
+    end = std::chrono::high_resolution_clock::now();
+    const double cached_ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+    for (size_t i = 0; i < positions.size(); i++) {
+        const glm::uvec3 &pos = positions[i];
+        const uint8_t expected = morton_chunk[morton_encode_3d(pos.x, pos.y, pos.z)];
+        if (single[i] != expected || batched[i] != expected) {
+            std::cerr << "svo lookup does not match grid." << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (cached_sum != uncached_sum || svo.get(CHUNK_RES, 0, 0) != 0 || svo.get(CHUNK_RES, 0, 0, cache) != 0) {
+        std::cerr << "cached svo lookup does not match." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "svo lookup | " << positions.size() << " random: " << single_ms << " ms | batched: " << batched_ms
+              << " ms | " << probes.size() << " neighbour probes: " << uncached_ms << " ms | cached: " << cached_ms
+              << " ms" << std::endl;
+
+    std::cout << std::endl;
+
+    return EXIT_SUCCESS;
+}
+
+int test_svo_edit() {
+    std::vector<uint8_t> morton_chunk = gen_terrain_chunk();
+    Svo svo = Svo(morton_chunk, CHUNK_RES);
+
+    std::mt19937 gen(9);
+    std::uniform_int_distribution<uint32_t> coord(0, CHUNK_RES - 1);
+    std::uniform_int_distribution<uint32_t> mat(0, 3);
+
+    // random single voxel edits, about a quarter of them clear
+    const size_t edit_count = 100000;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < edit_count; i++) {
+        const uint32_t x = coord(gen), y = coord(gen) / 2, z = coord(gen), m = mat(gen);
+        svo.set_voxel(x, y, z, m);
+        morton_chunk[morton_encode_3d(x, y, z)] = static_cast<uint8_t>(m);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    const double edit_ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+    start = std::chrono::high_resolution_clock::now();
+    Svo rebuilt;
+    rebuilt.root_res = CHUNK_RES;
+    rebuilt.max_depth = DEFAULT_MAX_DEPTH;
+    rebuilt.build(morton_chunk.data(), morton_chunk.size());
+    end = std::chrono::high_resolution_clock::now();
+    const double build_ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+    std::vector<uint8_t> edited_grid(CHUNK_SIZE);
+    svo_to_morton_grid(svo, 0, CHUNK_SIZE, 0, edited_grid);
+    if (edited_grid != morton_chunk) {
+        std::cerr << "edited svo does not match grid." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // filling a whole octant collapses it into a single leaf
+    const size_t edited_nodes = svo.nodes.size() - svo.free_blocks.size() * CHILD_COUNT;
+    for (uint32_t x = 0; x < CHUNK_RES / 2; x++) {
+        for (uint32_t y = 0; y < CHUNK_RES / 2; y++) {
+            for (uint32_t z = 0; z < CHUNK_RES / 2; z++) {
+                svo.set_voxel(x, y, z, 2);
+                morton_chunk[morton_encode_3d(x, y, z)] = 2;
+            }
+        }
+    }
+
+    if (svo.nodes[svo.nodes[0].data].is_parent() || svo.nodes[svo.nodes[0].data].data != 2 ||
+        svo.nodes.size() - svo.free_blocks.size() * CHILD_COUNT >= edited_nodes) {
+        std::cerr << "filled svo octant did not collapse." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // a cache used before an edit must not return stale nodes
+    SvoLookupCache cache;
+    svo.get(1, 1, 1, cache);
+    svo.clear_voxel(1, 1, 1);
+    morton_chunk[morton_encode_3d(1, 1, 1)] = 0;
+    if (svo.get(1, 1, 1, cache) != 0 || svo.get(1, 1, 1) != 0) {
+        std::cerr << "svo lookup cache is stale after edit." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const size_t free_nodes = svo.free_blocks.size() * CHILD_COUNT;
+    const size_t sparse_nodes = svo.nodes.size();
+
+    rebuilt.build(morton_chunk.data(), morton_chunk.size());
+    for (const uint8_t layout: {SVO_LAYOUT_DFS, SVO_LAYOUT_BFS}) {
+        svo.compact(layout);
+
+        std::vector<uint8_t> compacted_grid(CHUNK_SIZE);
+        svo_to_morton_grid(svo, 0, CHUNK_SIZE, 0, compacted_grid);
+        if (compacted_grid != morton_chunk || !svo.free_blocks.empty() || svo.nodes.size() != sparse_nodes - free_nodes) {
+            std::cerr << "compacted svo does not match grid." << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    // breadth first order places the child blocks in the order of their parents
+    uint32_t last_block = 0;
+    for (const SvoNode &node: svo.nodes) {
+        if (!node.is_parent())
+            continue;
+
+        if (node.data <= last_block) {
+            std::cerr << "compacted svo is not breadth first." << std::endl;
+            return EXIT_FAILURE;
+        }
+        last_block = node.data;
+    }
+
+    std::cout << "svo edit | " << edit_count << " edits: " << edit_ms << " ms (" << edit_ms * 1000000.0 / edit_count
+              << " ns per edit) | rebuild: " << build_ms << " ms | " << free_nodes << " of " << sparse_nodes
+              << " nodes freed before compaction | " << svo.nodes.size() << " nodes compacted, "
+              << rebuilt.nodes.size() << " rebuilt" << std::endl;
+
+    std::cout << std::endl;
+
+    return EXIT_SUCCESS;
+}
+
+int test_svo_lod() {
+    const std::vector<uint8_t> morton_chunk = gen_terrain_chunk();
+    Svo svo = Svo(morton_chunk, CHUNK_RES);
+
+    std::mt19937 gen(13);
+    std::uniform_int_distribution<uint32_t> coord(0, CHUNK_RES - 1);
+
+    // svo lods and downsampled grids aggregate the same way
+    for (const uint8_t mode: {LOD_OCCUPANCY, LOD_MAJORITY}) {
+        auto start = std::chrono::high_resolution_clock::now();
+        svo.build_lod(mode);
+        auto end = std::chrono::high_resolution_clock::now();
+        const double lod_ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+        start = std::chrono::high_resolution_clock::now();
+        const std::vector<std::vector<uint8_t>> lods =
+                morton_downsample_3d_grid(morton_chunk.data(), CHUNK_RES, CHUNK_SIZE, DEFAULT_MAX_DEPTH, mode);
+        end = std::chrono::high_resolution_clock::now();
+        const double downsample_ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+        for (int i = 0; i < 100000; i++) {
+            const uint32_t x = coord(gen), y = coord(gen), z = coord(gen);
+            for (uint8_t lod = 1; lod <= DEFAULT_MAX_DEPTH; lod++) {
+                const uint64_t code = morton_encode_3d_64(x >> lod, y >> lod, z >> lod);
+                if (svo.get_lod(x, y, z, DEFAULT_MAX_DEPTH - lod) != lods[lod - 1][code]) {
+                    std::cerr << "svo lod does not match downsampled grid." << std::endl;
+                    return EXIT_FAILURE;
+                }
+            }
+
+            if (svo.get_lod(x, y, z, DEFAULT_MAX_DEPTH) != svo.get(x, y, z)) {
+                std::cerr << "svo lod does not match svo at full depth." << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+
+        std::cout << "svo lod | mode " << static_cast<int>(mode) << " | svo: " << lod_ms << " ms | grid: "
+                  << downsample_ms << " ms" << std::endl;
+    }
+
+    BvoxHeader header{};
+    header.chunk_res = CHUNK_RES;
+    header.chunk_size = CHUNK_SIZE;
+    header.run_length_encoded = true;
+    header.morton_encoded = true;
+
+    const std::vector<std::vector<uint8_t>> lods =
+            morton_downsample_3d_grid(morton_chunk.data(), CHUNK_RES, CHUNK_SIZE, 3, LOD_MAJORITY);
+    write_bvox_lods("lod_test.bvox", {morton_chunk}, header, 3);
+    for (uint8_t lod = 1; lod <= 3; lod++) {
+        std::vector<std::vector<uint8_t>> read_chunk_data;
+        BvoxHeader read_header{};
+        read_bvox(bvox_lod_filename("lod_test.bvox", lod), &read_chunk_data, &read_header);
+
+        if (read_header.chunk_res != static_cast<uint32_t>(CHUNK_RES >> lod) || read_chunk_data[0] != lods[lod - 1]) {
+            std::cerr << "bvox lod does not match downsampled grid." << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    BsvoHeader bsvo_header{};
+    bsvo_header.max_depth = svo.max_depth;
+    bsvo_header.root_res = svo.root_res;
+    write_bsvo("lod_test.bsvo", svo, bsvo_header);
+
+    Svo full;
+    read_bsvo("lod_test.bsvo", &full, nullptr);
+    if (full.lod_mats != svo.lod_mats) {
+        std::cerr << "bsvo lod materials do not match." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // coarse levels only, the deepest loaded parents turn into leaves
+    for (const uint8_t level_count: {1, 4, 6, 9, 12}) {
+        auto start = std::chrono::high_resolution_clock::now();
+        Svo coarse;
+        read_bsvo_levels("lod_test.bsvo", level_count, &coarse, nullptr);
+        auto end = std::chrono::high_resolution_clock::now();
+        const double read_ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+        const uint8_t depth = std::min<uint8_t>(level_count - 1, DEFAULT_MAX_DEPTH);
+        for (int i = 0; i < 100000; i++) {
+            const uint32_t x = coord(gen), y = coord(gen), z = coord(gen);
+            const uint32_t mat = coarse.get(x, y, z);
+            if (mat != svo.get_lod(x, y, z, depth) || coarse.get_lod(x, y, z, depth) != mat) {
+                std::cerr << "partial bsvo does not match svo lod." << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+
+        std::cout << "bsvo levels | " << static_cast<int>(level_count) << " levels: " << coarse.nodes.size()
+                  << " of " << svo.nodes.size() << " nodes in " << read_ms << " ms" << std::endl;
+    }
+
+    // occupancy lods of sparse parents are empty, such collapsed parents are not referenced and rays never
+    // stop on them
+    svo.build_lod(LOD_OCCUPANCY);
+    write_bsvo("lod_occupancy_test.bsvo", svo, bsvo_header);
+    std::uniform_real_distribution<float> pos(-64.0f, CHUNK_RES + 64.0f);
+    for (const uint8_t level_count: {2, 4, 6}) {
+        Svo coarse;
+        read_bsvo_levels("lod_occupancy_test.bsvo", level_count, &coarse, nullptr);
+
+        for (const SvoNode &node: coarse.nodes) {
+            for (uint8_t c = 0; c < CHILD_COUNT; c++) {
+                if (node.exists_child(c) && coarse.nodes[node.data + c].is_empty()) {
+                    std::cerr << "partial bsvo references an empty child." << std::endl;
+                    return EXIT_FAILURE;
+                }
+            }
+        }
+
+        for (int i = 0; i < 2000; i++) {
+            SvoRay ray;
+            ray.origin = glm::vec3(pos(gen), pos(gen), pos(gen));
+            ray.direction = glm::normalize(glm::vec3(pos(gen), pos(gen), pos(gen)) - ray.origin);
+            const SvoHit hit = ray_cast(coarse, ray);
+            if (hit.hit && hit.material == 0) {
+                std::cerr << "partial bsvo ray hit an empty node." << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    std::cout << std::endl;
+
+    return EXIT_SUCCESS;
+}
+
+bool occupancy_box_empty_bytewise(const std::vector<uint8_t> &morton_grid, const glm::uvec3 min, const glm::uvec3 max) {
+    for (uint32_t z = min.z; z < max.z; z++) {
+        for (uint32_t y = min.y; y < max.y; y++) {
+            for (uint32_t x = min.x; x < max.x; x++) {
+                if (morton_grid[morton_encode_3d(x, y, z)] != 0)
+                    return false;
+            }
+        }
+    }
+    return true;
+}
+
+int test_occupancy() {
+    std::vector<uint8_t> terrain = gen_terrain_chunk();
+    const std::vector<uint8_t> random = gen_rand_vox_grid(CHUNK_SIZE, 0.3f);
+
+    std::vector<uint8_t> filled(CHUNK_SIZE);
+    for (size_t i = 0; i < CHUNK_SIZE; i++)
+        filled[i] = terrain[i] != 0;
+    const size_t filled_count = CHUNK_SIZE - std::count(filled.begin(), filled.end(), 0);
+
+    const int detected = simd_level();
+    simd_level() = SIMD_SCALAR;
+    const std::vector<uint64_t> reference = pack_occupancy(terrain);
+    const std::vector<uint64_t> random_words = pack_occupancy(random);
+    std::vector<std::vector<uint64_t>> reference_ops;
+    for (uint8_t op = OCCUPANCY_AND; op <= OCCUPANCY_ANDNOT; op++)
+        reference_ops.push_back(occupancy_combine(reference, random_words, op));
+
+    for (int level = SIMD_SCALAR; level <= detected; level++) {
+        simd_level() = level;
+
+        auto start = std::chrono::high_resolution_clock::now();
+        const std::vector<uint64_t> words = pack_occupancy(terrain);
+        auto end = std::chrono::high_resolution_clock::now();
+        const double pack_ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+        start = std::chrono::high_resolution_clock::now();
+        const std::vector<uint8_t> unpacked = unpack_occupancy(words);
+        end = std::chrono::high_resolution_clock::now();
+        const double unpack_ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+        start = std::chrono::high_resolution_clock::now();
+        const size_t count = occupancy_count(words);
+        end = std::chrono::high_resolution_clock::now();
+        const double count_us = std::chrono::duration<double, std::micro>(end - start).count();
+
+        if (words != reference || unpacked != filled || count != filled_count) {
+            std::cerr << "occupancy conversion does not match at simd level " << level << "." << std::endl;
+            simd_level() = detected;
+            return EXIT_FAILURE;
+        }
+
+        for (uint8_t op = OCCUPANCY_AND; op <= OCCUPANCY_ANDNOT; op++) {
+            if (occupancy_combine(words, random_words, op) != reference_ops[op]) {
+                std::cerr << "occupancy operation does not match at simd level " << level << "." << std::endl;
+                simd_level() = detected;
+                return EXIT_FAILURE;
+            }
+        }
+
+        // morton ranges with unaligned ends
+        std::mt19937 gen(21);
+        std::uniform_int_distribution<size_t> cell(0, CHUNK_SIZE);
+        for (int i = 0; i < 1000; i++) {
+            size_t begin = cell(gen), end_cell = cell(gen);
+            if (begin > end_cell)
+                std::swap(begin, end_cell);
+            end_cell = std::min(end_cell, begin + (i % 2 == 0 ? 100 : CHUNK_SIZE));
+
+            const bool expected = std::all_of(filled.begin() + begin, filled.begin() + end_cell,
+                                              [](const uint8_t v) { return v == 0; });
+            if (occupancy_range_empty(words.data(), begin, end_cell) != expected) {
+                std::cerr << "occupancy range query does not match at simd level " << level << "." << std::endl;
+                simd_level() = detected;
+                return EXIT_FAILURE;
+            }
+        }
+
+        std::cout << "occupancy | simd level: " << level << " | pack: " << pack_ms << " ms | unpack: " << unpack_ms
+                  << " ms | count: " << count_us << " us" << std::endl;
+    }
+
+    simd_level() = detected;
+
+    // boxes around the terrain surface, bytewise against packed
+    std::mt19937 gen(22);
+    std::uniform_int_distribution<uint32_t> coord(0, CHUNK_RES - 1);
+    std::uniform_int_distribution<uint32_t> extent(1, 24);
+    std::vector<std::pair<glm::uvec3, glm::uvec3>> boxes;
+    for (int i = 0; i < 20000; i++) {
+        const glm::uvec3 min(coord(gen), CHUNK_RES / 8 - 4 + coord(gen) % 24, coord(gen));
+        boxes.push_back({min, glm::min(min + glm::uvec3(extent(gen), extent(gen), extent(gen)), glm::uvec3(CHUNK_RES))});
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<bool> bytewise;
+    for (const auto &[min, max]: boxes)
+        bytewise.push_back(occupancy_box_empty_bytewise(terrain, min, max));
+    auto end = std::chrono::high_resolution_clock::now();
+    const double bytewise_ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+    start = std::chrono::high_resolution_clock::now();
+    std::vector<bool> packed;
+    for (const auto &[min, max]: boxes)
+        packed.push_back(occupancy_box_empty(reference.data(), CHUNK_RES, min, max));
+    end = std::chrono::high_resolution_clock::now();
+    const double packed_ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+    if (bytewise != packed || !occupancy_box_empty(reference.data(), CHUNK_RES, glm::uvec3(0, 100, 0), glm::uvec3(CHUNK_RES))
+        || occupancy_box_empty(reference.data(), CHUNK_RES, glm::uvec3(0), glm::uvec3(CHUNK_RES))) {
+        std::cerr << "occupancy box query does not match." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "occupancy box | " << boxes.size() << " boxes bytewise: " << bytewise_ms << " ms | packed: "
+              << packed_ms << " ms" << std::endl;
+
+    // bit packed bvox files
+    BvoxHeader header{};
+    header.chunk_res = CHUNK_RES;
+    header.chunk_size = CHUNK_SIZE;
+    header.run_length_encoded = true;
+    header.morton_encoded = true;
+    header.bit_packed = true;
+    write_bvox("bits_test.bvox", {terrain, random}, header);
+
+    std::vector<std::vector<uint8_t>> read_chunk_data;
+    read_bvox("bits_test.bvox", &read_chunk_data, nullptr);
+    std::vector<uint64_t> read_words;
+    read_bvox_chunk_bits("bits_test.bvox", 1, &read_words);
+
+    if (read_chunk_data.size() != 2 || read_chunk_data[0] != filled || read_chunk_data[1] != random
+        || read_words != random_words) {
+        std::cerr << "bit packed bvox does not match." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // svo straight from the words
+    for (const uint8_t max_depth: {DEFAULT_MAX_DEPTH, 5, 0}) {
+        for (const uint32_t thread_count: {1u, 0u}) {
+            Svo from_bytes;
+            from_bytes.root_res = CHUNK_RES;
+            from_bytes.max_depth = max_depth;
+            start = std::chrono::high_resolution_clock::now();
+            from_bytes.build(filled.data(), filled.size(), thread_count);
+            end = std::chrono::high_resolution_clock::now();
+            const double bytes_ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+            Svo from_words;
+            from_words.root_res = CHUNK_RES;
+            from_words.max_depth = max_depth;
+            start = std::chrono::high_resolution_clock::now();
+            from_words.build(reference.data(), CHUNK_SIZE, 1, thread_count);
+            end = std::chrono::high_resolution_clock::now();
+            const double words_ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+            const bool equal = std::equal(from_bytes.nodes.begin(), from_bytes.nodes.end(), from_words.nodes.begin(),
+                                          from_words.nodes.end(), [](const SvoNode &a, const SvoNode &b) {
+                                              return a.data == b.data && a.child_mask == b.child_mask;
+                                          });
+            if (!equal) {
+                std::cerr << "svo from occupancy does not match svo from bytes." << std::endl;
+                return EXIT_FAILURE;
+            }
+
+            if (max_depth == DEFAULT_MAX_DEPTH)
+                std::cout << "svo from occupancy | threads: " << thread_count << " | bytes: " << bytes_ms
+                          << " ms | words: " << words_ms << " ms" << std::endl;
+        }
+    }
+
+    std::cout << std::endl;
+
+    return EXIT_SUCCESS;
+}
+
+int test_world() {
+    constexpr uint32_t res = 32;
+    constexpr size_t size = res * res * res;
+
+    std::filesystem::remove_all("world_test");
+
+    BvoxHeader format{};
+    format.chunk_res = res;
+    format.chunk_size = size;
+    format.run_length_encoded = true;
+    format.morton_encoded = true;
+    format.rle_format = RLE_FORMAT_VARINT;
+
+    // chunks on both sides of the origin, spread over several regions
+    std::vector<std::pair<ChunkCoord, std::vector<uint8_t>>> chunks;
+    {
+        World world("world_test", format, 4 * size, 1 << 20);
+        world.region_res = 2;
+
+        std::mt19937 gen(31);
+        std::uniform_int_distribution<int> mat(0, 3);
+        for (int32_t z = -2; z < 2; z++) {
+            for (int32_t x = -2; x < 3; x++) {
+                std::vector<uint8_t> chunk(size);
+                for (uint8_t &v: chunk)
+                    v = mat(gen) == 0 ? 1 + mat(gen) : 0;
+                chunks.push_back({ChunkCoord{x, x + z, z}, chunk});
+                world.store_chunk(chunks.back().first, chunk);
+            }
+        }
+
+        // a second version replaces the first
+        chunks[3].second.assign(size, 7);
+        world.store_chunk(chunks[3].first, chunks[3].second);
+    }
+
+    World world("world_test", format, 4 * size, 1 << 20);
+    if (world.chunk_count() != chunks.size() || world.region_res != 2 || world.has_chunk(ChunkCoord{9, 9, 9})
+        || world.chunk(ChunkCoord{9, 9, 9}) != nullptr) {
+        std::cerr << "world index does not match." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // two passes over all chunks with room for four, every access misses
+    for (int pass = 0; pass < 2; pass++) {
+        for (const auto &[coord, chunk]: chunks) {
+            if (*world.chunk(coord) != chunk) {
+                std::cerr << "world chunk does not match." << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    // repeated access to a small working set hits
+    for (int i = 0; i < 10; i++) {
+        for (size_t c = 0; c < 3; c++)
+            world.chunk(chunks[c].first);
+    }
+
+    for (size_t c = 0; c < chunks.size(); c++) {
+        const std::shared_ptr<const Svo> svo = world.svo(chunks[c].first);
+        const Svo reference = Svo(chunks[c].second, res, 5);
+        if (svo->nodes.size() != reference.nodes.size() || world.svo(chunks[c].first) != svo) {
+            std::cerr << "world svo does not match." << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    const WorldStats stats = world.stats();
+    if (stats.chunks.bytes > 4 * size || stats.chunks.evictions == 0 || stats.chunks.hits < 27
+        || stats.chunks.misses != stats.chunk_reads + 1 || stats.svo_builds != chunks.size()) {
+        std::cerr << "world cache statistics do not match." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // readers race a writer that keeps storing new versions into the same region. every read is a complete
+    // version, versions never go back for one reader and the caches end up with the last one.
+    {
+        constexpr uint32_t race_res = 32;
+        constexpr size_t race_size = race_res * race_res * race_res;
+        constexpr int versions = 250;
+
+        BvoxHeader race_format = format;
+        race_format.chunk_res = race_res;
+        race_format.chunk_size = race_size;
+
+        std::filesystem::remove_all("world_race_test");
+        World race_world("world_race_test", race_format);
+        const ChunkCoord coords[2] = {ChunkCoord{0, 0, 0}, ChunkCoord{1, 0, 0}};
+
+        auto version_chunk = [&](const int version) {
+            std::vector<uint8_t> chunk(race_size);
+            for (size_t i = 0; i < chunk.size(); i++)
+                chunk[i] = static_cast<uint8_t>((version + i) % 251 + 1);
+            return chunk;
+        };
+
+        for (const ChunkCoord &coord: coords)
+            race_world.store_chunk(coord, version_chunk(0));
+
+        // the version is in the first cell, the rest has to match it. odd readers go through the svo cache.
+        auto read_version = [&](const int reader, const ChunkCoord &coord) {
+            std::vector<uint8_t> grid(race_size);
+            if (reader % 2 == 0) {
+                const std::shared_ptr<const std::vector<uint8_t> > chunk = race_world.chunk(coord);
+                if (!chunk)
+                    return -1;
+                grid = *chunk;
+            } else {
+                const std::shared_ptr<const Svo> svo = race_world.svo(coord);
+                if (!svo)
+                    return -1;
+                svo->decode_grid(grid.data(), grid.size());
+            }
+
+            const int version = grid[0] - 1;
+            return grid == version_chunk(version) ? version : -1;
+        };
+
+        std::atomic<bool> writing(true);
+        std::atomic<int> torn(0);
+        std::vector<std::thread> readers;
+        for (int t = 0; t < 4; t++) {
+            readers.emplace_back([&, t]() {
+                int last[2] = {0, 0};
+                while (writing) {
+                    for (int c = 0; c < 2; c++) {
+                        const int version = read_version(t, coords[c]);
+                        if (version < last[c])
+                            torn++;
+                        last[c] = version;
+                    }
+                }
+            });
+        }
+
+        for (int v = 1; v < versions; v++)
+            race_world.store_chunk(coords[v % 2], version_chunk(v));
+        writing = false;
+        for (std::thread &reader: readers)
+            reader.join();
+
+        if (torn != 0 || read_version(0, coords[0]) != versions - 2 || read_version(0, coords[1]) != versions - 1 ||
+            read_version(1, coords[0]) != versions - 2 || read_version(1, coords[1]) != versions - 1) {
+            std::cerr << "concurrent world reads and stores do not match." << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        // the index is appended to and rewritten once superseded entries dominate. bytes of an append cut short
+        // are ignored, a count that exceeds the file is refused.
+        const std::string index_filename = "world_race_test/" WORLD_INDEX_FILENAME;
+        const bool compacted = std::filesystem::file_size(index_filename) <=
+                               sizeof(WorldHeader) + 2 * sizeof(coords) / sizeof(coords[0]) * sizeof(WorldChunkEntry);
+        {
+            std::ofstream ofs(index_filename, std::ios::binary | std::ios::app);
+            ofs.write("torn entry", 10);
+        }
+
+        World reopened("world_race_test", race_format);
+        const bool reloaded = reopened.chunk_count() == 2 && *reopened.chunk(coords[1]) == version_chunk(versions - 1);
+
+        {
+            std::fstream fs(index_filename, std::ios::binary | std::ios::in | std::ios::out);
+            WorldHeader header{};
+            fs.read(reinterpret_cast<char *>(&header), sizeof(header));
+            header.chunk_count = UINT32_MAX;
+            fs.seekp(0);
+            fs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        }
+
+        bool refused = false;
+        try {
+            World crafted("world_race_test", race_format);
+        } catch (const std::runtime_error &) {
+            refused = true;
+        }
+
+        if (!compacted || !reloaded || !refused) {
+            std::cerr << "world index does not match after rewrites." << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::cout << "world | " << chunks.size() << " chunks | chunk cache: " << stats.chunks.hits << " hits, "
+              << stats.chunks.misses << " misses, " << stats.chunks.evictions << " evictions, "
+              << stats.chunks.peak_bytes << " peak bytes | svo cache: " << stats.svos.hits << " hits, "
+              << stats.svos.misses << " misses, " << stats.svos.evictions << " evictions" << std::endl;
+
+    std::cout << std::endl;
+
+    return EXIT_SUCCESS;
+}
+
+int test_world_loader() {
+    constexpr uint32_t res = 64;
+    constexpr size_t size = res * res * res;
+    constexpr int32_t side = 4;
+
+    std::filesystem::remove_all("world_loader_test");
+
+    BvoxHeader format{};
+    format.chunk_res = res;
+    format.chunk_size = size;
+    format.run_length_encoded = true;
+    format.morton_encoded = false;
+    format.rle_format = RLE_FORMAT_VARINT;
+
+    std::vector<ChunkCoord> coords;
+    {
+        World world("world_loader_test", format);
+        world.region_res = 2;
+
+        std::mt19937 gen(16);
+        std::uniform_int_distribution<int> mat(0, 7);
+        for (int32_t z = 0; z < side; z++) {
+            for (int32_t y = 0; y < side; y++) {
+                for (int32_t x = 0; x < side; x++) {
+                    std::vector<uint8_t> chunk(size);
+                    for (uint8_t &v: chunk)
+                        v = mat(gen) == 0 ? 1 + mat(gen) : 0;
+                    coords.push_back(ChunkCoord{x, y, z});
+                    world.store_chunk(coords.back(), chunk);
+                }
+            }
+        }
+    }
+
+    // synchronous reference on a separate world, so both start with cold caches
+    World reference("world_loader_test", format);
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<std::shared_ptr<const Svo>> expected;
+    for (const ChunkCoord &coord: coords)
+        expected.push_back(reference.svo(coord));
+    auto end = std::chrono::high_resolution_clock::now();
+    const auto sync_ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+
+    World world("world_loader_test", format);
+    start = std::chrono::high_resolution_clock::now();
+    std::vector<std::shared_ptr<const Svo>> loaded(coords.size());
+    {
+        WorldLoader loader(world);
+
+        // the second half is only hinted, the first half is requested directly
+        loader.prefetch(std::vector<ChunkCoord>(coords.begin() + coords.size() / 2, coords.end()));
+
+        std::vector<std::future<std::shared_ptr<const Svo>>> futures;
+        for (size_t c = 0; c < coords.size() / 2; c++)
+            futures.push_back(loader.load_svo(coords[c]));
+
+        // a chunk and a svo request for the same coordinate share one load
+        std::future<std::shared_ptr<const std::vector<uint8_t>>> chunk = loader.load_chunk(coords[1]);
+
+        std::atomic<int> missing(0);
+        loader.load_svo(ChunkCoord{-1, 0, 0}, [&](std::shared_ptr<const Svo> svo, std::exception_ptr error) {
+            if (!svo && !error)
+                missing++;
+        });
+
+        for (size_t c = 0; c < futures.size(); c++)
+            loaded[c] = futures[c].get();
+
+        loader.wait_idle();
+        for (size_t c = coords.size() / 2; c < coords.size(); c++)
+            loaded[c] = loader.load_svo(coords[c]).get();
+
+        if (*chunk.get() != *world.chunk(coords[1]) || missing != 1 || loader.pending() != 0) {
+            std::cerr << "world loader requests do not match." << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    end = std::chrono::high_resolution_clock::now();
+    const auto async_ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+
+    for (size_t c = 0; c < coords.size(); c++) {
+        const Svo &a = *loaded[c];
+        const Svo &b = *expected[c];
+        if (a.nodes.size() != b.nodes.size() || !std::equal(a.nodes.begin(), a.nodes.end(), b.nodes.begin(),
+            [](const SvoNode &l, const SvoNode &r) { return l.data == r.data && l.child_mask == r.child_mask; })) {
+            std::cerr << "world loader svo does not match." << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    const WorldStats stats = world.stats();
+    if (stats.chunk_reads != coords.size() || stats.svo_builds != coords.size()) {
+        std::cerr << "world loader statistics do not match." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // a throwing callback does not keep the other waiters of its chunk from being called
+    {
+        World cold("world_loader_test", format);
+        WorldLoader loader(cold);
+
+        std::atomic<int> called(0);
+        for (int i = 0; i < 4; i++) {
+            loader.load_svo(coords[0], [&, i](std::shared_ptr<const Svo> svo, std::exception_ptr) {
+                called++;
+                if (i % 2 == 0 || !svo)
+                    throw std::runtime_error("callback failed.");
+            });
+        }
+        std::future<std::shared_ptr<const Svo>> svo = loader.load_svo(coords[0]);
+        std::future<std::shared_ptr<const std::vector<uint8_t>>> chunk = loader.load_chunk(coords[0]);
+
+        // waiters of a job are called in request order, the future is resolved after the callbacks
+        const bool resolved = svo.get()->nodes.size() == expected[0]->nodes.size() && chunk.get();
+        loader.wait_idle();
+        if (!resolved || called != 4 || loader.pending() != 0) {
+            std::cerr << "world loader waiters do not match after a callback threw." << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::cout << "world loader | " << coords.size() << " chunks of " << res << "^3 | sync: " << sync_ms
+              << " ms | pipelined: " << async_ms << " ms" << std::endl;
+
+    std::cout << std::endl;
+
+    return EXIT_SUCCESS;
+}
+
+int test_parallel_convert() {
+    constexpr uint32_t res = 64;
+    constexpr size_t size = res * res * res;
+
+    std::mt19937 gen(17);
+    std::uniform_int_distribution<int> mat(0, 15);
+    std::vector<std::vector<uint8_t>> chunks(12, std::vector<uint8_t>(size));
+    for (size_t c = 0; c < chunks.size(); c++) {
+        for (uint8_t &v: chunks[c])
+            v = mat(gen) < static_cast<int>(c) ? 1 + mat(gen) : 0;
+    }
+
+    BvoxHeader header{};
+    header.chunk_res = res;
+    header.chunk_size = size;
+    header.run_length_encoded = true;
+    header.morton_encoded = true;
+    header.rle_format = RLE_FORMAT_VARINT;
+
+    // the parallel writer produces the same file
+    write_bvox("convert_serial.bvox", chunks, header, 1);
+    write_bvox("convert_parallel.bvox", chunks, header, 4);
+    std::ifstream serial("convert_serial.bvox", std::ios::binary);
+    std::ifstream parallel("convert_parallel.bvox", std::ios::binary);
+    const std::vector<char> serial_bytes((std::istreambuf_iterator<char>(serial)), std::istreambuf_iterator<char>());
+    const std::vector<char> parallel_bytes((std::istreambuf_iterator<char>(parallel)), std::istreambuf_iterator<char>());
+    if (serial_bytes.empty() || serial_bytes != parallel_bytes) {
+        std::cerr << "parallel bvox file does not match." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // svos are built out of order and consumed in order, decoding them restores the chunks
+    size_t expected = 0;
+    bool in_order = true;
+    parallel_ordered<Svo>(chunks.size(), [&](const size_t i) {
+        Svo svo;
+        svo.root_res = res;
+        svo.max_depth = svo_res_depth(res);
+        svo.build(chunks[i].data(), chunks[i].size());
+        return svo;
+    }, [&](const size_t i, Svo &&svo) {
+        std::vector<uint8_t> grid(size);
+        svo.decode_grid(grid.data(), grid.size());
+        in_order = in_order && i == expected++ && grid == chunks[i];
+    }, 4, 3);
+
+    if (!in_order || expected != chunks.size()) {
+        std::cerr << "ordered svo conversion does not match." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // errors of a worker reach the caller
+    bool caught = false;
+    try {
+        parallel_ordered<int>(100, [](const size_t i) {
+            if (i == 37)
+                throw std::runtime_error("failed task.");
+            return static_cast<int>(i);
+        }, [](size_t, int) {}, 4);
+    } catch (const std::runtime_error &) {
+        caught = true;
+    }
+
+    if (!caught) {
+        std::cerr << "ordered conversion error does not match." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << std::endl;
+
+    return EXIT_SUCCESS;
+}
+
+int test_metrics() {
+    const std::vector<uint8_t> terrain = gen_terrain_chunk();
+
+    BvoxHeader header{};
+    header.chunk_res = CHUNK_RES;
+    header.chunk_size = CHUNK_SIZE;
+    header.run_length_encoded = true;
+    header.morton_encoded = true;
+    header.rle_format = RLE_FORMAT_VARINT;
+
+    std::ostringstream log;
+    MetricsAggregator metrics;
+    metrics.log = &log;
+    set_metrics_sink(&metrics);
+
+    write_bvox("metrics_test.bvox", {terrain, terrain}, header);
+    std::vector<std::vector<uint8_t>> chunk_data;
+    read_bvox("metrics_test.bvox", &chunk_data, &header);
+
+    Svo svo;
+    svo.root_res = CHUNK_RES;
+    svo.build(chunk_data[0].data(), chunk_data[0].size());
+
+    set_metrics_sink(nullptr);
+
+    // nothing is recorded without a sink
+    read_bvox("metrics_test.bvox", &chunk_data, &header);
+
+    const MetricsSnapshot stats = metrics.snapshot();
+    const uint64_t file_size = std::filesystem::file_size("metrics_test.bvox");
+    const std::vector<uint8_t> encoded = run_length_encode(terrain, RLE_FORMAT_VARINT);
+
+    if (stats.counters[METRIC_BYTES_WRITTEN] != file_size || stats.counters[METRIC_BYTES_READ] != file_size
+        || stats.counters[METRIC_CHUNKS_ENCODED] != 2 || stats.counters[METRIC_CHUNKS_DECODED] != 2
+        || stats.counters[METRIC_NODES_ALLOCATED] != svo.nodes.size()
+        || stats.compression_ratio() != static_cast<double>(encoded.size()) / CHUNK_SIZE
+        || stats.spans[SPAN_CHUNK_ENCODE].count != 2 || stats.spans[SPAN_SVO_BUILD].count != 1
+        || log.str().find("writing bvox file: metrics_test.bvox") == std::string::npos) {
+        std::cerr << "metrics do not match." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    metrics.report(std::cout);
+
+    metrics.reset();
+    if (metrics.snapshot().counters[METRIC_BYTES_READ] != 0) {
+        std::cerr << "metrics reset does not match." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << std::endl;
+
+    return EXIT_SUCCESS;
+}
+
+void print_header_info() {
+    std::cout << "bvox header size: " << sizeof(BvoxHeader) << std::endl;
+    std::cout << "offset of bvox header version: " << offsetof(BvoxHeader, version) << std::endl;
+    std::cout << "offset of bvox header chunk_res: " << offsetof(BvoxHeader, chunk_res) << std::endl;
+    std::cout << "offset of bvox header chunk_size: " << offsetof(BvoxHeader, chunk_size) << std::endl;
+    std::cout << "offset of bvox header run_length_encoded: " << offsetof(BvoxHeader, run_length_encoded) << std::endl;
+    std::cout << "offset of bvox header morton_encoded: " << offsetof(BvoxHeader, morton_encoded) << std::endl;
+    std::cout << "offset of bvox header rle_format: " << offsetof(BvoxHeader, rle_format) << std::endl;
+    std::cout << "offset of bvox header bit_packed: " << offsetof(BvoxHeader, bit_packed) << std::endl;
+    std::cout << "offset of bvox header chunk_count: " << offsetof(BvoxHeader, chunk_count) << std::endl;
+    std::cout << "offset of bvox header index_offset: " << offsetof(BvoxHeader, index_offset) << std::endl;
+    std::cout << "offset of bvox header voxel_format: " << offsetof(BvoxHeader, voxel_format) << std::endl;
+    std::cout << "offset of bvox header palette_count: " << offsetof(BvoxHeader, palette_count) << std::endl;
+    std::cout << "offset of bvox header palette_offset: " << offsetof(BvoxHeader, palette_offset) << std::endl;
+
+    std::cout << "bsvo header size: " << sizeof(BsvoHeader) << std::endl;
+    std::cout << "offset of bsvo header version: " << offsetof(BsvoHeader, version) << std::endl;
+    std::cout << "offset of bsvo header max_depth: " << offsetof(BsvoHeader, max_depth) << std::endl;
+    std::cout << "offset of bsvo header root_res: " << offsetof(BsvoHeader, root_res) << std::endl;
+    std::cout << "offset of bsvo header run_length_encoded: " << offsetof(BsvoHeader, run_length_encoded) << std::endl;
+    std::cout << "offset of bsvo header node_format: " << offsetof(BsvoHeader, node_format) << std::endl;
+    std::cout << "offset of bsvo header lod: " << offsetof(BsvoHeader, lod) << std::endl;
+    std::cout << "offset of bsvo header voxel_format: " << offsetof(BsvoHeader, voxel_format) << std::endl;
+
+    std::cout << std::endl << std::endl;
+}
+
+int test_voxel_types() {
+    constexpr uint32_t res = 32;
+    constexpr size_t size = res * res * res;
+
+    std::mt19937 gen(23);
+    std::uniform_int_distribution<int> pick(0, 7);
+
+    // sparse materials with a few distinct normals
+    std::vector<std::vector<MatNormal>> chunks(3, std::vector<MatNormal>(size));
+    for (std::vector<MatNormal> &chunk: chunks) {
+        for (MatNormal &v: chunk) {
+            if (pick(gen) < 2)
+                v = MatNormal{static_cast<uint16_t>(1000 + pick(gen)), static_cast<uint8_t>(pick(gen) * 32), 128};
+        }
+    }
+
+    BvoxHeader header{};
+    header.chunk_res = res;
+    header.chunk_size = size;
+    header.run_length_encoded = true;
+    header.morton_encoded = true;
+    header.rle_format = RLE_FORMAT_VARINT;
+
+    write_bvox("voxel_types.bvox", chunks, header, 2);
+
+    std::vector<std::vector<MatNormal>> read_chunks;
+    BvoxHeader read_header{};
+    read_bvox("voxel_types.bvox", &read_chunks, &read_header);
+
+    std::vector<MatNormal> single;
+    read_bvox_chunk("voxel_types.bvox", 2, &single);
+
+    if (read_header.voxel_format != VOXEL_FORMAT_MAT_NORMAL || read_chunks != chunks || single != chunks[2]) {
+        std::cerr << "typed bvox chunks do not match." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // leaf data with a palette in the same order gives the same chunks, index and palette
+    std::vector<std::vector<uint32_t>> data(chunks.size(), std::vector<uint32_t>(size));
+    VoxelPalette palette;
+    for (size_t c = 0; c < chunks.size(); c++) {
+        for (size_t i = 0; i < size; i++)
+            palette.add(data[c][i] = VoxelTraits<MatNormal>::to_data(chunks[c][i]));
+    }
+
+    BvoxHeader data_header = header;
+    data_header.voxel_format = VOXEL_FORMAT_MAT_NORMAL;
+    write_bvox_data("voxel_types_data.bvox", data, data_header, palette, 2);
+    std::ifstream typed("voxel_types.bvox", std::ios::binary);
+    std::ifstream from_data("voxel_types_data.bvox", std::ios::binary);
+    const std::vector<char> typed_bytes((std::istreambuf_iterator<char>(typed)), std::istreambuf_iterator<char>());
+    const std::vector<char> data_bytes((std::istreambuf_iterator<char>(from_data)), std::istreambuf_iterator<char>());
+    std::vector<std::vector<MatNormal>> data_chunks;
+    read_bvox("voxel_types_data.bvox", &data_chunks, nullptr);
+    if (data_chunks != chunks || typed_bytes.size() != data_bytes.size() ||
+        !std::equal(typed_bytes.begin() + sizeof(BvoxHeader), typed_bytes.end(), data_bytes.begin() + sizeof(BvoxHeader))) {
+        std::cerr << "typed bvox from leaf data does not match." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // u8 readers refuse typed files
+    bool caught = false;
+    try {
+        std::vector<std::vector<uint8_t>> u8_chunks;
+        read_bvox("voxel_types.bvox", &u8_chunks, nullptr);
+    } catch (const std::runtime_error &) {
+        caught = true;
+    }
+
+    // appending would lose the palette, compact leaves have no room for 32 bit voxels
+    const auto error_message = [](const auto &fn) {
+        try {
+            fn();
+        } catch (const std::runtime_error &e) {
+            return std::string(e.what());
+        }
+        return std::string();
+    };
+
+    const std::string append_error = error_message([] {
+        append_to_bvox("voxel_types.bvox", std::vector<uint8_t>(size));
+    });
+    const std::string compact_error = error_message([] {
+        BsvoHeader bsvo_header{};
+        bsvo_header.voxel_format = VOXEL_FORMAT_RGBA8;
+        write_bsvo("voxel_types_compact.bsvo", SvoCompact{}, bsvo_header);
+    });
+
+    if (!caught || append_error != "append only supports u8 bvox files."
+        || compact_error != "compact nodes cannot hold rgba8 voxels.") {
+        std::cerr << "typed bvox format check does not match." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // crafted palette counts and chunk entries are refused before anything is allocated from them
+    const auto crafted_error = [&](const BvoxHeader &crafted_header, const BvoxChunkEntry &crafted_entry,
+                                   const bool single_chunk) {
+        std::filesystem::copy_file("voxel_types.bvox", "voxel_types_crafted.bvox",
+                                   std::filesystem::copy_options::overwrite_existing);
+        {
+            std::fstream fs("voxel_types_crafted.bvox", std::ios::binary | std::ios::in | std::ios::out);
+            fs.write(reinterpret_cast<const char *>(&crafted_header), sizeof(crafted_header));
+            fs.seekp(static_cast<std::streamoff>(read_header.index_offset + sizeof(BvoxChunkEntry) * 2));
+            fs.write(reinterpret_cast<const char *>(&crafted_entry), sizeof(crafted_entry));
+        }
+        return error_message([&] {
+            if (single_chunk)
+                read_bvox_chunk("voxel_types_crafted.bvox", 2, &single);
+            else
+                read_bvox("voxel_types_crafted.bvox", &read_chunks, nullptr);
+        });
+    };
+
+    BvoxChunkEntry entry{};
+    {
+        std::ifstream ifs("voxel_types.bvox", std::ios::binary);
+        entry = read_bvox_index_entry(ifs, read_header, 2);
+    }
+    BvoxHeader too_large = read_header;
+    too_large.palette_count = UINT32_MAX;
+    BvoxHeader past_end = read_header;
+    past_end.palette_count = VOXEL_PALETTE_MAX;
+    const BvoxChunkEntry huge_entry{entry.offset, 1ULL << 50};
+
+    for (const bool single_chunk: {false, true}) {
+        if (crafted_error(too_large, entry, single_chunk) != "palette is too large."
+            || crafted_error(past_end, entry, single_chunk) != "bvox palette exceeds file size."
+            || crafted_error(read_header, huge_entry, single_chunk) != "bvox chunk exceeds file size.") {
+            std::cerr << "typed bvox bounds check does not match." << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    // rgba chunks survive the planes of the rle codec and the svo
+    std::vector<Rgba8> colors(size);
+    for (size_t i = 0; i < size; i += 7)
+        colors[i] = Rgba8{static_cast<uint8_t>(i), static_cast<uint8_t>(i >> 8), 200, 255};
+
+    std::vector<Rgba8> decoded(size);
+    const std::vector<uint8_t> encoded = run_length_encode_values(colors, RLE_FORMAT_VARINT);
+    if (run_length_decode_values(encoded.data(), encoded.size(), decoded.data(), size, RLE_FORMAT_VARINT) != size
+        || decoded != colors) {
+        std::cerr << "typed rle does not match." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    Svo svo;
+    svo.root_res = res;
+    svo.max_depth = svo_res_depth(res);
+    svo.build(colors.data(), colors.size(), 2);
+
+    std::fill(decoded.begin(), decoded.end(), Rgba8{});
+    svo.decode_grid(decoded.data(), decoded.size());
+
+    uint32_t x, y, z;
+    morton_decode_3d_64(7 * 100, x, y, z);
+    if (decoded != colors || svo.get_voxel<Rgba8>(x, y, z) != colors[7 * 100]) {
+        std::cerr << "typed svo does not match." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << std::endl;
+
+    return EXIT_SUCCESS;
+}
+
+int test_voxelize() {
+    // cube from 2.5 to 9.5 as quads and a tilted triangle given with negative indices
+    {
+        std::ofstream obj("voxelize_test.obj");
+        obj << "# test mesh\n";
+        for (int i = 0; i < 8; i++)
+            obj << "v " << (i & 1 ? 9.5 : 2.5) << " " << (i & 2 ? 9.5 : 2.5) << " " << (i & 4 ? 9.5 : 2.5) << "\n";
+        obj << "f 1/1/1 3/1/1 4/1/1 2/1/1\nf 5 6 8 7\nf 1 2 6 5\nf 3 7 8 4\nf 1 5 7 3\nf 2 4 8 6\n";
+        obj << "v 20.3 1.1 3.7\nv 29.8 13.4 6.2\nv 22.6 9.9 14.9\nf -3 -2 -1\n";
+    }
+
+    Mesh mesh;
+    read_obj("voxelize_test.obj", &mesh);
+    if (mesh.vertices.size() != 11 || mesh.triangle_count() != 13) {
+        std::cerr << "obj mesh does not match." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    VoxelizeOptions options;
+    options.chunk_res = 8;
+    const std::vector<VoxelizedChunk> chunks = voxelize_mesh(mesh, options, 4);
+
+    auto filled = [&](const int32_t x, const int32_t y, const int32_t z) {
+        const int32_t res = static_cast<int32_t>(options.chunk_res);
+        const ChunkCoord coord{floor_div(x, res), floor_div(y, res), floor_div(z, res)};
+        for (const VoxelizedChunk &chunk: chunks) {
+            if (chunk.coord == coord)
+                return chunk.cells[morton_encode_3d_64(x - coord.x * res, y - coord.y * res, z - coord.z * res)] > 0;
+        }
+        return false;
+    };
+
+    // the cube shell is exactly the cells from 2 to 9 without the cells from 3 to 8
+    bool shell = true;
+    for (int32_t z = 0; z < 12; z++) {
+        for (int32_t y = 0; y < 12; y++) {
+            for (int32_t x = 0; x < 12; x++) {
+                const bool outer = x >= 2 && x <= 9 && y >= 2 && y <= 9 && z >= 2 && z <= 9;
+                const bool inner = x >= 3 && x <= 8 && y >= 3 && y <= 8 && z >= 3 && z <= 8;
+                shell = shell && filled(x, y, z) == (outer && !inner);
+            }
+        }
+    }
+
+    // every point of the tilted triangle lies in a filled cell
+    bool covered = true;
+    const glm::vec3 &a = mesh.vertices[8], &b = mesh.vertices[9], &c = mesh.vertices[10];
+    for (int i = 0; i <= 64; i++) {
+        for (int j = 0; i + j <= 64; j++) {
+            const glm::vec3 p = a + (b - a) * (i / 64.0f) + (c - a) * (j / 64.0f);
+            covered = covered && filled(static_cast<int32_t>(std::floor(p.x)), static_cast<int32_t>(std::floor(p.y)),
+                                        static_cast<int32_t>(std::floor(p.z)));
+        }
+    }
+
+    if (!shell || !covered) {
+        std::cerr << "voxelized mesh does not match." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // a unit cube scaled to exactly one chunk stays in that chunk, faces on the max side fill the last cells
+    Mesh unit;
+    for (int i = 0; i < 8; i++)
+        unit.vertices.emplace_back(i & 1 ? 1.0f : 0.0f, i & 2 ? 1.0f : 0.0f, i & 4 ? 1.0f : 0.0f);
+    unit.indices = {0, 2, 3, 0, 3, 1, 4, 5, 7, 4, 7, 6, 0, 1, 5, 0, 5, 4, 2, 6, 7, 2, 7, 3, 0, 4, 6, 0, 6, 2,
+                    1, 3, 7, 1, 7, 5};
+
+    VoxelizeOptions unit_options;
+    unit_options.chunk_res = 64;
+    unit_options.voxel_size = 1.0f / 64;
+    const std::vector<VoxelizedChunk> unit_chunks = voxelize_mesh(unit, unit_options, 4);
+
+    bool aligned = unit_chunks.size() == 1 && unit_chunks[0].coord == ChunkCoord{0, 0, 0};
+    for (uint32_t i = 0; aligned && i < 64 * 64 * 64; i++) {
+        uint32_t x, y, z;
+        morton_decode_3d_64(i, x, y, z);
+        const bool face = x == 0 || y == 0 || z == 0 || x == 63 || y == 63 || z == 63;
+        aligned = (unit_chunks[0].cells[i] > 0) == face;
+    }
+
+    if (!aligned) {
+        std::cerr << "integer aligned voxelized mesh does not match." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // the same chunks end up in a world with linear chunks, the world hands them out in morton order
+    std::filesystem::remove_all("voxelize_world");
+    BvoxHeader format{};
+    format.chunk_res = options.chunk_res;
+    format.chunk_size = options.chunk_res * options.chunk_res * options.chunk_res;
+    format.run_length_encoded = true;
+    World world("voxelize_world", format);
+    voxelize_mesh(world, mesh, options, 4);
+
+    bool stored = world.chunk_count() == chunks.size();
+    for (const VoxelizedChunk &chunk: chunks) {
+        const auto cells = world.chunk(chunk.coord);
+        stored = stored && cells && *cells == chunk.cells;
+    }
+
+    if (!stored) {
+        std::cerr << "voxelized world does not match." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << std::endl;
+
+    return EXIT_SUCCESS;
+}
+
+int test_greedy_mesh() {
+    constexpr uint32_t res = 32;
+    constexpr size_t size = res * res * res;
+
+    // a solid cube is six quads
+    const std::vector<uint8_t> solid(size, 3);
+    const std::vector<MeshQuad> solid_quads = greedy_mesh(solid, res);
+    bool whole = solid_quads.size() == FACE_COUNT;
+    for (const MeshQuad &quad: solid_quads)
+        whole = whole && quad.width == res && quad.height == res && quad.mat == 3;
+
+    glm::vec3 corners[4];
+    mesh_quad_corners(solid_quads[FACE_POS_Y], corners);
+    const glm::vec3 normal = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+    if (!whole || !(normal.y > 0 && normal.x == 0 && normal.z == 0)) {
+        std::cerr << "solid greedy mesh does not match." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // noisy boxes of three materials
+    std::mt19937 gen(41);
+    std::uniform_int_distribution<int> pick(0, 9);
+    std::vector<uint8_t> linear(size);
+    for (uint32_t z = 0; z < res; z++) {
+        for (uint32_t y = 0; y < res; y++) {
+            for (uint32_t x = 0; x < res; x++) {
+                const bool box = (x / 8 + y / 8 + z / 8) % 2 == 0;
+                linear[x + y * res + z * res * res] = box ? 1 + (x / 16) : (pick(gen) == 0 ? 3 : 0);
+            }
+        }
+    }
+
+    std::vector<uint8_t> chunk(size);
+    morton_encode_3d_grid(linear.data(), res, size, chunk.data());
+    const std::vector<MeshQuad> quads = greedy_mesh(chunk, res);
+
+    // every visible face is covered by exactly one quad of its material
+    auto cell = [&](const int64_t x, const int64_t y, const int64_t z) -> uint8_t {
+        if (x < 0 || y < 0 || z < 0 || x >= res || y >= res || z >= res)
+            return 0;
+        return linear[x + y * res + z * res * res];
+    };
+
+    std::vector<uint8_t> covered(size * FACE_COUNT, 0);
+    bool matching = true;
+    for (const MeshQuad &quad: quads) {
+        const int axis = quad.face / 2;
+        for (uint32_t j = 0; j < quad.height; j++) {
+            for (uint32_t i = 0; i < quad.width; i++) {
+                uint32_t p[3] = {quad.x, quad.y, quad.z};
+                p[axis == 0 ? 1 : 0] += i;
+                p[axis == 2 ? 1 : 2] += j;
+                const size_t index = p[0] + p[1] * res + p[2] * res * res;
+                covered[index * FACE_COUNT + quad.face]++;
+                matching = matching && linear[index] == quad.mat;
+            }
+        }
+    }
+
+    size_t face_count = 0;
+    for (uint32_t z = 0; z < res; z++) {
+        for (uint32_t y = 0; y < res; y++) {
+            for (uint32_t x = 0; x < res; x++) {
+                const size_t index = x + y * res + z * res * res;
+                for (uint8_t face = 0; face < FACE_COUNT; face++) {
+                    int64_t n[3] = {x, y, z};
+                    n[face / 2] += face % 2 == 1 ? 1 : -1;
+                    const bool visible = linear[index] > 0 && cell(n[0], n[1], n[2]) == 0;
+                    face_count += visible;
+                    matching = matching && covered[index * FACE_COUNT + face] == (visible ? 1 : 0);
+                }
+            }
+        }
+    }
+
+    if (!matching || quads.size() >= face_count) {
+        std::cerr << "greedy mesh does not match." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // svos and chunk batches give the same quads
+    Svo svo;
+    svo.root_res = res;
+    svo.max_depth = svo_res_depth(res);
+    svo.build(chunk.data(), chunk.size());
+
+    const std::vector<MeshQuad> svo_quads = greedy_mesh(svo);
+    const std::vector<std::vector<MeshQuad> > batch = greedy_mesh({chunk, solid}, res, 2);
+
+    auto same = [](const std::vector<MeshQuad> &a, const std::vector<MeshQuad> &b) {
+        if (a.size() != b.size())
+            return false;
+        for (size_t i = 0; i < a.size(); i++) {
+            if (a[i].x != b[i].x || a[i].y != b[i].y || a[i].z != b[i].z || a[i].width != b[i].width ||
+                a[i].height != b[i].height || a[i].mat != b[i].mat || a[i].face != b[i].face)
+                return false;
+        }
+        return true;
+    };
+
+    if (!same(svo_quads, quads) || batch.size() != 2 || !same(batch[0], quads) || !same(batch[1], solid_quads)) {
+        std::cerr << "greedy mesh sources do not match." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // u16 materials above 255 survive meshing a chunk and a tree
+    std::vector<uint16_t> wide(size);
+    for (size_t i = 0; i < size; i++)
+        wide[i] = static_cast<uint16_t>(chunk[i] * 1000);
+
+    Svo wide_svo;
+    wide_svo.root_res = res;
+    wide_svo.max_depth = svo_res_depth(res);
+    wide_svo.build(wide.data(), wide.size());
+
+    std::vector<MeshQuad> wide_expected = quads;
+    for (MeshQuad &quad: wide_expected)
+        quad.mat *= 1000;
+
+    if (!same(greedy_mesh(wide, res), wide_expected) || !same(greedy_mesh(wide_svo), wide_expected)) {
+        std::cerr << "typed greedy mesh does not match." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "greedy mesh: " << quads.size() << " quads for " << face_count << " faces" << std::endl;
+    std::cout << std::endl;
+
+    return EXIT_SUCCESS;
+}
+
+int test_svo_csg() {
+    constexpr uint32_t res = 32;
+    constexpr uint32_t b_res = 16;
+
+    // boxes of two materials in a, a ball in b
+    std::vector<uint8_t> a_linear(res * res * res);
+    for (uint32_t z = 0; z < res; z++) {
+        for (uint32_t y = 0; y < res; y++) {
+            for (uint32_t x = 0; x < res; x++)
+                a_linear[x + y * res + z * res * res] = y < 12 ? 1 : ((x / 4 + z / 4) % 3 == 0 ? 2 : 0);
+        }
+    }
+
+    std::vector<uint8_t> b_linear(b_res * b_res * b_res);
+    for (uint32_t z = 0; z < b_res; z++) {
+        for (uint32_t y = 0; y < b_res; y++) {
+            for (uint32_t x = 0; x < b_res; x++) {
+                const float dx = x - 7.5f, dy = y - 7.5f, dz = z - 7.5f;
+                b_linear[x + y * b_res + z * b_res * b_res] = dx * dx + dy * dy + dz * dz < 49.0f ? 3 : 0;
+            }
+        }
+    }
+
+    auto build = [](const std::vector<uint8_t> &linear, const uint32_t r) {
+        std::vector<uint8_t> morton(linear.size());
+        morton_encode_3d_grid(linear.data(), r, linear.size(), morton.data());
+        Svo svo;
+        svo.root_res = r;
+        svo.max_depth = svo_res_depth(r);
+        svo.build(morton.data(), morton.size());
+        return svo;
+    };
+
+    const Svo a = build(a_linear, res);
+    const Svo b = build(b_linear, b_res);
+    const glm::ivec3 offset(20, 4, -3);
+
+    bool matching = true;
+    for (uint8_t op = SVO_CSG_UNION; op <= SVO_CSG_INTERSECT; op++) {
+        const Svo result = svo_csg(a, b, op, offset);
+
+        std::vector<uint8_t> expected(a_linear.size());
+        for (uint32_t z = 0; z < res; z++) {
+            for (uint32_t y = 0; y < res; y++) {
+                for (uint32_t x = 0; x < res; x++) {
+                    const int64_t bx = x - offset.x, by = y - offset.y, bz = z - offset.z;
+                    const bool inside = bx >= 0 && by >= 0 && bz >= 0 && bx < b_res && by < b_res && bz < b_res;
+                    const uint8_t bv = inside ? b_linear[bx + by * b_res + bz * b_res * b_res] : 0;
+                    const uint8_t av = a_linear[x + y * res + z * res * res];
+
+                    uint8_t &v = expected[x + y * res + z * res * res];
+                    if (op == SVO_CSG_UNION)
+                        v = bv > 0 ? bv : av;
+                    else if (op == SVO_CSG_SUBTRACT)
+                        v = bv > 0 ? 0 : av;
+                    else
+                        v = bv > 0 ? av : 0;
+                }
+            }
+        }
+
+        std::vector<uint8_t> grid(expected.size()), linear(expected.size());
+        result.decode_grid(grid.data(), grid.size());
+        morton_decode_3d_grid(grid.data(), res, grid.size(), linear.data());
+
+        // uniform regions are collapsed, the result is never larger than a rebuilt tree
+        const Svo rebuilt = build(expected, res);
+        matching = matching && linear == expected && result.nodes.size() <= rebuilt.nodes.size();
+    }
+
+    if (!matching) {
+        std::cerr << "svo csg does not match." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // operands have to share their leaf size
+    Svo coarse = b;
+    coarse.max_depth = svo_res_depth(b_res) - 1;
+    bool caught = false;
+    try {
+        svo_union(a, coarse);
+    } catch (const std::runtime_error &) {
+        caught = true;
+    }
+
+    if (!caught) {
+        std::cerr << "svo csg leaf size check does not match." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << std::endl;
+
+    return EXIT_SUCCESS;
+}
+
+int test_svo_query() {
+    constexpr uint32_t res = 32;
+
+    // floor below y 8 and scattered pillars
+    std::vector<uint8_t> linear(res * res * res);
+    for (uint32_t z = 0; z < res; z++) {
+        for (uint32_t y = 0; y < res; y++) {
+            for (uint32_t x = 0; x < res; x++) {
+                const bool pillar = (x % 7 == 3 && z % 5 == 1) && y < 20;
+                linear[x + y * res + z * res * res] = y < 8 ? 1 : (pillar ? 2 : 0);
+            }
+        }
+    }
+
+    std::vector<uint8_t> morton(linear.size());
+    morton_encode_3d_grid(linear.data(), res, linear.size(), morton.data());
+    Svo svo;
+    svo.root_res = res;
+    svo.max_depth = svo_res_depth(res);
+    svo.build(morton.data(), morton.size());
+    const SvoDag dag(svo);
+
+    // cells overlapping a shape by brute force, leaves are single cells on a full depth tree
+    auto brute_force = [&](const auto &shape) {
+        std::vector<uint32_t> cells;
+        for (uint32_t z = 0; z < res; z++) {
+            for (uint32_t y = 0; y < res; y++) {
+                for (uint32_t x = 0; x < res; x++) {
+                    const glm::vec3 lo(x, y, z);
+                    if (linear[x + y * res + z * res * res] > 0 && shape_overlaps_box(shape, lo, lo + glm::vec3(1.0f)))
+                        cells.push_back(x + y * res + z * res * res);
+                }
+            }
+        }
+        return cells;
+    };
+
+    auto cell_indices = [&](const std::vector<SvoCell> &cells) {
+        std::vector<uint32_t> indices;
+        for (const SvoCell &cell: cells)
+            indices.push_back(cell.origin.x + cell.origin.y * res + cell.origin.z * res * res);
+        std::sort(indices.begin(), indices.end());
+        return indices;
+    };
+
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<float> pos(-4.0f, res + 4.0f);
+    std::uniform_real_distribution<float> extent(0.2f, 6.0f);
+
+    std::vector<SvoAabb> boxes;
+    std::vector<SvoSphere> spheres;
+    std::vector<SvoCapsule> capsules;
+    for (int i = 0; i < 200; i++) {
+        const glm::vec3 min(pos(gen), pos(gen), pos(gen));
+        boxes.push_back(SvoAabb{min, min + glm::vec3(extent(gen), extent(gen), extent(gen))});
+        spheres.push_back(SvoSphere{glm::vec3(pos(gen), pos(gen), pos(gen)), extent(gen)});
+        capsules.push_back(SvoCapsule{glm::vec3(pos(gen), pos(gen), pos(gen)), glm::vec3(pos(gen), pos(gen), pos(gen)),
+                                      extent(gen) * 0.5f});
+    }
+
+    bool matching = true;
+    auto check_shapes = [&](const auto &shapes) {
+        const std::vector<uint8_t> flags = svo_overlaps_many(svo, shapes, 4);
+        const std::vector<std::vector<SvoCell> > lists = svo_overlap_cells_many(svo, shapes, 4);
+
+        for (size_t i = 0; i < shapes.size(); i++) {
+            const std::vector<uint32_t> expected = brute_force(shapes[i]);
+            std::vector<SvoCell> cells, dag_cells;
+            svo_overlap_cells(svo, shapes[i], cells);
+            svo_overlap_cells(dag, shapes[i], dag_cells);
+
+            matching = matching && cell_indices(cells) == expected && cell_indices(dag_cells) == expected &&
+                       cell_indices(lists[i]) == expected;
+            matching = matching && svo_overlaps(svo, shapes[i]) == !expected.empty() &&
+                       svo_overlaps(dag, shapes[i]) == !expected.empty() && (flags[i] > 0) == !expected.empty();
+        }
+    };
+    check_shapes(boxes);
+    check_shapes(spheres);
+    check_shapes(capsules);
+
+    if (!matching) {
+        std::cerr << "svo overlap queries do not match." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // segment box distance against sampled points on the segment
+    for (const SvoCapsule &capsule: capsules) {
+        const glm::vec3 lo(10.0f, 4.0f, 12.0f), hi(14.0f, 9.0f, 13.0f);
+        float sampled = std::numeric_limits<float>::max();
+        for (int i = 0; i <= 1000; i++)
+            sampled = std::min(sampled, box_distance2(capsule.a + (capsule.b - capsule.a) * (i / 1000.0f), lo, hi));
+
+        const float exact = segment_box_distance2(capsule.a, capsule.b, lo, hi);
+        matching = matching && exact <= sampled + 1e-3f && exact >= sampled - 0.05f * (1.0f + sampled);
+    }
+
+    if (!matching) {
+        std::cerr << "segment box distance does not match." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // a box falling onto the floor, sliding along it and moving through a pillar
+    const SvoAabb player{glm::vec3(12.5f, 10.0f, 12.5f), glm::vec3(13.5f, 12.0f, 13.5f)};
+    const SvoSweepHit fall = svo_sweep(svo, player, glm::vec3(0.0f, -5.0f, 0.0f));
+    const SvoAabb standing{glm::vec3(12.5f, 8.0f, 12.5f), glm::vec3(13.5f, 10.0f, 13.5f)};
+    const SvoSweepHit slide = svo_sweep(svo, standing, glm::vec3(1.0f, 0.0f, 0.0f));
+    const SvoAabb walking{glm::vec3(14.5f, 10.0f, 11.2f), glm::vec3(15.5f, 12.0f, 11.8f)};
+    const SvoSweepHit blocked = svo_sweep(dag, walking, glm::vec3(4.0f, 0.0f, 0.0f));
+
+    const bool fall_matches = fall.hit && std::abs(fall.t - 0.4f) < 1e-5f && fall.normal == glm::ivec3(0, 1, 0) &&
+                              fall.cell.origin.y == 7;
+    const bool blocked_matches = blocked.hit && std::abs(blocked.t - 0.375f) < 1e-5f &&
+                                 blocked.normal == glm::ivec3(-1, 0, 0) && blocked.cell.origin.x == 17 &&
+                                 blocked.cell.mat == 2;
+
+    // batched sweeps against single ones
+    std::vector<SvoAabb> sweep_boxes;
+    std::vector<glm::vec3> deltas;
+    for (int i = 0; i < 200; i++) {
+        sweep_boxes.push_back(boxes[i]);
+        deltas.push_back(glm::vec3(pos(gen), pos(gen), pos(gen)) - boxes[i].min);
+    }
+
+    const std::vector<SvoSweepHit> hits = svo_sweep_many(svo, sweep_boxes, deltas, 4);
+    bool batch_matches = true;
+    for (size_t i = 0; i < hits.size(); i++) {
+        const SvoSweepHit single = svo_sweep(svo, sweep_boxes[i], deltas[i]);
+        batch_matches = batch_matches && hits[i].hit == single.hit && hits[i].t == single.t;
+
+        // the box touches the hit cell at t, and nothing before it
+        if (single.hit && single.t > 0.0f) {
+            const glm::vec3 move = deltas[i] * (single.t * 0.999f);
+            const SvoAabb before{sweep_boxes[i].min + move, sweep_boxes[i].max + move};
+            batch_matches = batch_matches && !svo_overlaps(svo, before);
+        }
+    }
+
+    if (!fall_matches || slide.hit || !blocked_matches || !batch_matches) {
+        std::cerr << "svo sweep does not match." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // trees deeper than the fixed traversal stack are refused up front
+    Svo deep;
+    deep.root_res = 1u << (MAX_LOOKUP_DEPTH + 1);
+    deep.max_depth = MAX_LOOKUP_DEPTH + 1;
+    deep.nodes = {SvoNode{0, 1}, SvoNode{1, 0}};
+    const SvoAabb everything{glm::vec3(0.0f), glm::vec3(static_cast<float>(deep.root_res))};
+    int refused = 0;
+    try {
+        svo_overlaps(deep, everything);
+    } catch (const std::runtime_error &) {
+        refused++;
+    }
+    try {
+        svo_sweep(deep, everything, glm::vec3(1.0f, 0.0f, 0.0f));
+    } catch (const std::runtime_error &) {
+        refused++;
+    }
+
+    if (refused != 2) {
+        std::cerr << "svo query depth check does not match." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << std::endl;
+
+    return EXIT_SUCCESS;
+}
+
+int test_distance_field() {
+    constexpr uint32_t res = 32;
+    constexpr size_t size = res * res * res;
+
+    // a ball, a thin wall and scattered cells
+    std::mt19937 gen(5);
+    std::uniform_int_distribution<int> pick(0, 999);
+
+    std::vector<uint8_t> linear(size);
+    for (uint32_t z = 0; z < res; z++) {
+        for (uint32_t y = 0; y < res; y++) {
+            for (uint32_t x = 0; x < res; x++) {
+                const float dx = x - 10.0f, dy = y - 12.0f, dz = z - 9.0f;
+                const bool ball = dx * dx + dy * dy + dz * dz < 36.0f;
+                linear[x + y * res + z * res * res] = ball ? 1 : (x == 24 && y < 20 ? 2 : (pick(gen) < 2 ? 3 : 0));
+            }
+        }
+    }
+
+    std::vector<uint8_t> chunk(size);
+    morton_encode_3d_grid(linear.data(), res, size, chunk.data());
+
+    // brute force distances between cell centers
+    std::vector<glm::ivec3> filled_cells, empty_cells;
+    for (uint32_t z = 0; z < res; z++) {
+        for (uint32_t y = 0; y < res; y++) {
+            for (uint32_t x = 0; x < res; x++)
+                (linear[x + y * res + z * res * res] > 0 ? filled_cells : empty_cells).push_back(glm::ivec3(x, y, z));
+        }
+    }
+
+    auto nearest = [](const std::vector<glm::ivec3> &cells, const glm::ivec3 &p) {
+        int best = std::numeric_limits<int>::max();
+        for (const glm::ivec3 &c: cells) {
+            const glm::ivec3 d = c - p;
+            best = std::min(best, d.x * d.x + d.y * d.y + d.z * d.z);
+        }
+        return std::sqrt(static_cast<float>(best));
+    };
+
+    const std::vector<float> unsigned_field = distance_field(chunk, res, DISTANCE_FIELD_UNSIGNED, 4);
+    const std::vector<float> signed_field = distance_field(chunk, res, DISTANCE_FIELD_SIGNED, 4);
+
+    const int level = simd_level();
+    simd_level() = SIMD_SCALAR;
+    const std::vector<float> scalar_field = distance_field(chunk, res, DISTANCE_FIELD_SIGNED, 4);
+    simd_level() = level;
+
+    bool matching = scalar_field == signed_field;
+    for (size_t i = 0; i < size && matching; i += 7) {
+        uint32_t x, y, z;
+        morton_decode_3d_64(i, x, y, z);
+        const glm::ivec3 p(x, y, z);
+        const bool filled = linear[x + y * res + z * res * res] > 0;
+
+        const float to_filled = filled ? 0.0f : nearest(filled_cells, p);
+        const float expected = filled ? -nearest(empty_cells, p) : to_filled;
+        matching = unsigned_field[i] == to_filled && signed_field[i] == expected;
+    }
+
+    if (!matching) {
+        std::cerr << "distance field does not match." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // quantized fields from the chunk and from the tree, on a grid of several blocks with empty space
+    constexpr uint32_t big_res = 64;
+    std::vector<uint8_t> big_linear(big_res * big_res * big_res);
+    for (uint32_t z = 0; z < res; z++) {
+        for (uint32_t y = 0; y < res; y++) {
+            for (uint32_t x = 0; x < res; x++)
+                big_linear[x + 20 + (y + 2) * big_res + (z + 8) * big_res * big_res] = linear[x + y * res + z * res * res];
+        }
+    }
+    for (uint32_t i = 0; i < big_res * big_res * 6; i++)
+        big_linear[i] = 4;
+
+    std::vector<uint8_t> big_chunk(big_linear.size());
+    morton_encode_3d_grid(big_linear.data(), big_res, big_linear.size(), big_chunk.data());
+
+    Svo svo;
+    svo.root_res = big_res;
+    svo.max_depth = svo_res_depth(big_res);
+    svo.build(big_chunk.data(), big_chunk.size());
+    svo.compact();
+
+    for (uint8_t type = DISTANCE_FIELD_UNSIGNED; type <= DISTANCE_FIELD_SIGNED; type++) {
+        const std::vector<uint16_t> full = quantized_distance_field<uint16_t>(big_chunk, big_res, 5.5f, type, 4);
+        const std::vector<uint16_t> tree = quantized_distance_field<uint16_t>(svo, 5.5f, type, 4);
+        const std::vector<uint8_t> full_u8 = quantized_distance_field<uint8_t>(big_chunk, big_res, 5.5f, type, 4);
+        const std::vector<uint8_t> tree_u8 = quantized_distance_field<uint8_t>(svo, 5.5f, type, 4);
+        matching = matching && full == tree && full_u8 == tree_u8;
+
+        const std::vector<float> exact = distance_field(big_chunk, big_res, type, 4);
+        for (size_t i = 0; i < exact.size() && matching; i += 13) {
+            const float value = dequantize_distance(full[i], 5.5f, type);
+            matching = std::abs(value - std::clamp(exact[i], -5.5f, 5.5f)) < 1e-3f;
+        }
+    }
+
+    if (!matching) {
+        std::cerr << "hierarchical distance field does not match." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // u16 fields are stored next to the chunks as a typed bvox
+    BvoxHeader header{};
+    header.chunk_res = big_res;
+    header.chunk_size = big_chunk.size();
+    header.run_length_encoded = true;
+    header.morton_encoded = true;
+    header.rle_format = RLE_FORMAT_VARINT;
+
+    const std::vector<std::vector<uint8_t> > chunks = {big_chunk};
+    write_bvox("distance.bvox", chunks, header);
+    write_bvox_distance_fields<uint16_t>("distance.bvox", chunks, header, 8.0f, DISTANCE_FIELD_SIGNED, 4);
+
+    std::vector<std::vector<uint16_t> > fields;
+    read_bvox(bvox_distance_field_filename("distance.bvox"), &fields, nullptr);
+    if (fields.size() != 1 || fields[0] != quantized_distance_field<uint16_t>(svo, 8.0f, DISTANCE_FIELD_SIGNED)) {
+        std::cerr << "distance field bvox does not match." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << std::endl;
+
+    return EXIT_SUCCESS;
 }
 
 int main() {
     print_header_info();
 
+    test_morton_64();
     test_bvox_read_write();
+    test_bvox_chunk_index();
+    benchmark_bvox_read();
+    test_rle_kernels();
     test_bsvo_read_write();
     sample_bvox_and_bsvo();
     simple_test_data();
+    benchmark_svo_build();
+    test_svo_parallel_build();
+    test_bsvo_view();
+    test_svo_compact();
+    test_svo_dag();
+    benchmark_ray_cast();
+    test_svo_lookup();
+    test_svo_edit();
+    test_svo_lod();
+    test_occupancy();
+    test_world();
+    test_world_loader();
+    test_parallel_convert();
+    test_metrics();
+    test_voxel_types();
+    test_voxelize();
+    test_greedy_mesh();
+    test_svo_csg();
+    test_svo_query();
+    test_distance_field();
 
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,98 @@
+//
+// Created by ludw on 9/13/24.
+//
+
+// voxelizes an obj mesh into the chunks of a world directory.
+//
+// the mesh is scaled to res voxels along its longest side unless a voxel size is given, chunks are voxelized
+// in parallel straight in morton order and appended to the region files of the world.
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "../include/vss.h"
+
+static void print_usage() {
+    std::cerr << "usage: vss_voxelize <mesh.obj> <world directory> [--res n] [--voxel-size f] [--chunk-res n] "
+                 "[--mat n] [--threads n]" << std::endl;
+}
+
+int main(const int argc, char **argv) {
+    if (argc < 3) {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    const std::string mesh_filename = argv[1];
+    const std::string world_directory = argv[2];
+    uint32_t res = 256;
+    float voxel_size = 0;
+    uint32_t thread_count = 0;
+    VoxelizeOptions options;
+
+    for (int a = 3; a < argc; a++) {
+        const std::string arg = argv[a];
+        if (arg == "--res" && a + 1 < argc) {
+            res = static_cast<uint32_t>(std::stoul(argv[++a]));
+        } else if (arg == "--voxel-size" && a + 1 < argc) {
+            voxel_size = std::stof(argv[++a]);
+        } else if (arg == "--chunk-res" && a + 1 < argc) {
+            options.chunk_res = static_cast<uint32_t>(std::stoul(argv[++a]));
+        } else if (arg == "--mat" && a + 1 < argc) {
+            options.mat = static_cast<uint8_t>(std::stoul(argv[++a]));
+        } else if (arg == "--threads" && a + 1 < argc) {
+            thread_count = static_cast<uint32_t>(std::stoul(argv[++a]));
+        } else {
+            print_usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    const auto start = std::chrono::high_resolution_clock::now();
+    size_t chunk_count;
+
+    try {
+        Mesh mesh;
+        read_obj(mesh_filename, &mesh);
+        if (mesh.vertices.empty())
+            throw std::runtime_error("mesh has no vertices.");
+
+        glm::vec3 min = mesh.vertices[0], max = mesh.vertices[0];
+        for (const glm::vec3 &v: mesh.vertices) {
+            min = glm::min(min, v);
+            max = glm::max(max, v);
+        }
+
+        const glm::vec3 extent = max - min;
+        const float longest = std::max(extent.x, std::max(extent.y, extent.z));
+        options.origin = min;
+        options.voxel_size = voxel_size > 0 ? voxel_size : (longest > 0 ? longest / static_cast<float>(res) : 1.0f);
+
+        BvoxHeader format{};
+        format.chunk_res = options.chunk_res;
+        format.chunk_size = options.chunk_res * options.chunk_res * options.chunk_res;
+        format.run_length_encoded = true;
+        format.morton_encoded = true;
+        format.rle_format = RLE_FORMAT_VARINT;
+
+        World world(world_directory, format);
+        voxelize_mesh(world, mesh, options, thread_count);
+        chunk_count = world.chunk_count();
+
+        std::cout << "voxelized " << mesh.triangle_count() << " triangles at voxel size " << options.voxel_size
+                  << std::endl;
+    } catch (const std::exception &e) {
+        std::cerr << "voxelization failed: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const auto end = std::chrono::high_resolution_clock::now();
+    const double seconds = std::chrono::duration<double>(end - start).count();
+
+    std::cout << "world holds " << chunk_count << " chunks | " << resolve_thread_count(thread_count) << " threads | "
+              << seconds << " s" << std::endl;
+
+    return EXIT_SUCCESS;
+}